@@ -1,138 +1,73 @@
 ﻿#include <iostream>
 #include <cstdlib>   // Для генерации случайных чисел
-#include <chrono>    // Для замера времени
+#include <ctime>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "AVL.h"
+#include "PersistentAVL.h"
+#include "../../Common/FrozenIndex.h"
 using namespace std;
-using namespace std::chrono;
-// Структура узла для AVL дерева
-struct Node {
-    int value;         // Значение, которое хранится в узле
-    Node* left;        // Указатель на левое поддерево
-    Node* right;       // Указатель на правое поддерево
-    int height;        // Высота узла в дереве
-
-    // Конструктор для создания узла
-    Node(int val) : value(val), left(nullptr), right(nullptr), height(1) {}
-};
-// Класс для AVL дерева
-class AVLTree {
-public:
-    // Вставка нового элемента в дерево
-    Node* insert(Node* root, int key) {
-        // 1. Стандартная вставка узла в дерево
-        if (root == nullptr)
-            return new Node(key);  // Если дерево пустое, создаем новый узел
-        if (key < root->value)
-            root->left = insert(root->left, key);  // Вставка в левое поддерево
-        else if (key > root->value)
-            root->right = insert(root->right, key);  // Вставка в правое поддерево
-        else
-            return root;  // Если ключ уже существует, не вставляем (уникальные ключи)
-        // 2. Обновляем высоту текущего узла
-        root->height = 1 + max(getHeight(root->left), getHeight(root->right));
-        // 3. Балансировка дерева
-        int balance = getBalance(root);  // Получаем баланс текущего узла
-        // Левый поворот
-        if (balance > 1 && key < root->left->value)
-            return rightRotate(root);
-        // Правый поворот
-        if (balance < -1 && key > root->right->value)
-            return leftRotate(root);
-        // Левый правый поворот
-        if (balance > 1 && key > root->left->value) {
-            root->left = leftRotate(root->left);
-            return rightRotate(root);
-        }
-        // Правый левый поворот
-        if (balance < -1 && key < root->right->value) {
-            root->right = rightRotate(root->right);
-            return leftRotate(root);
-        }
-        return root;  // Возвращаем корень дерева
-    }
-    // Поиск элемента в дереве
-    Node* search(Node* root, int key) {
-        if (root == nullptr || root->value == key)
-            return root;  // Если дерево пустое или нашли элемент
-        if (key < root->value)
-            return search(root->left, key);  // Ищем в левом поддереве
-        return search(root->right, key);  // Ищем в правом поддереве
-    }
-private:
-    // Функции для балансировки дерева
-    // Левый поворот
-    Node* leftRotate(Node* x) {
-        Node* y = x->right;  // Правая часть поворачивается влево
-        Node* T2 = y->left;  // Сохраняем левое поддерево правого узла
-        // Выполняем поворот
-        y->left = x;
-        x->right = T2;
-        // Обновляем высоты
-        x->height = 1 + max(getHeight(x->left), getHeight(x->right));
-        y->height = 1 + max(getHeight(y->left), getHeight(y->right));
-        return y;  // Новый корень
-    }
-    // Правый поворот
-    Node* rightRotate(Node* y) {
-        Node* x = y->left;  // Левое поддерево поворачивается вправо
-        Node* T2 = x->right;  // Сохраняем правое поддерево левого узла
-        // Выполняем поворот
-        x->right = y;
-        y->left = T2;
-        // Обновляем высоты
-        y->height = 1 + max(getHeight(y->left), getHeight(y->right));
-        x->height = 1 + max(getHeight(x->left), getHeight(x->right));
-        return x;  // Новый корень
-    }
-    // Функция для получения высоты узла
-    int getHeight(Node* root) {
-        if (root == nullptr)
-            return 0;  // Если узел пустой, высота равна 0
-        return root->height;
-    }
-    // Функция для вычисления баланса узла
-    int getBalance(Node* root) {
-        if (root == nullptr)
-            return 0;  // Если узел пустой, баланс равен 0
-        return getHeight(root->left) - getHeight(root->right);  // Баланс = высота левого поддерева - высота правого
-    }
-};
-// Функция для замера времени поиска
-double measureSearchTime(AVLTree& tree, Node* root, int key) {
-    auto start = high_resolution_clock::now();  // Время начала
-    tree.search(root, key);  // Поиск элемента
-    auto end = high_resolution_clock::now();  // Время окончания
-    auto duration = duration_cast<microseconds>(end - start);  // Разница во времени
-    return duration.count() / 1000000.0;  // Переводим в секунды
-}
+// Замеры времени вынесены в общий стенд Benchmark (см. Benchmark/Benchmark.sln)
 // Функция для вывода элементов дерева в порядке возрастания (in-order)
-void printInOrder(Node* root) {
-    if (root != nullptr) {
-        printInOrder(root->left);  // Сначала левое поддерево
-        cout << root->value << " ";  // Затем текущий узел
-        printInOrder(root->right);  // Затем правое поддерево
-    }
+void printInOrder(const AVLTree<>& tree) {
+    for (int value : tree)
+        cout << value << " ";
 }
 int main() {
     setlocale(LC_ALL, "Russian");
     srand(time(NULL));
-    AVLTree tree;
-    Node* root = nullptr;
+    AVLTree<> tree;
     int n = 1000;  // Количество случайных чисел
     // Заполнение дерева случайными числами
     for (int i = 0; i < n; ++i) {
         int num = rand() % 10000 + 1;  // Генерация случайного числа от 1 до 10000
-        root = tree.insert(root, num);  // Вставка числа в дерево
+        tree.insert(num);  // Вставка числа в дерево
     }
     // Выводим все элементы дерева
     cout << "Все числа, добавленные в дерево:" << endl;
-    printInOrder(root);
+    printInOrder(tree);
     cout << endl;
     // Выбираем случайное число для поиска
     int searchKey = rand() % 10000 + 1;
     cout << "Ищем число: " << searchKey << endl;
-    // Замер времени поиска
-    double avl_time = measureSearchTime(tree, root, searchKey);
-    // Выводим время поиска с точностью до миллионных долей секунды
-    cout.precision(6);
-    cout << "Время поиска в AVL дереве: " << fixed << avl_time << " секунд" << endl;
+    cout << (tree.search(searchKey) != nullptr ? "Число найдено" : "Число не найдено") << endl;
+    // Неизменяемая копия для индекса, который дальше только читают: ключи в одном массиве без указателей
+    FrozenIndex<int> frozen = freeze(tree);
+    cout << "В замороженной копии: " << (frozen.contains(searchKey) ? "число найдено" : "число не найдено")
+         << ", " << frozen.memoryBytes() << " байт на " << frozen.size() << " ключей" << endl;
+    // Словарь после перемещения, как std::map, пуст и принимает любые операции
+    AVLMap<int, string> names = { { 1, "x" } };
+    AVLMap<int, string> moved(std::move(names));
+    names[2].assign(1, 'y');
+    names.insert({ 3, "z" });
+    names.erase(3);
+    AVLMap<int, string> copy(names);
+    cout << "Словарь после перемещения:";
+    for (const auto& item : copy)
+        cout << " " << item.first << "=" << item.second;
+    cout << " (" << (names.count(2) == 1 && names.find(1) == names.end() && moved.size() == 1 ? "верно" : "ОШИБКА") << ")" << endl;
+    // Персистентное дерево: читатели без перерыва берут версии, писатель публикует новые.
+    // Замененные версии отпускаются по ходу дела, а не копятся до паузы в чтении
+    PersistentAVLTree<int> persistent;
+    atomic<bool> writing(true);
+    vector<thread> readers;
+    for (int r = 0; r < 3; ++r)
+        readers.emplace_back([&] {
+            while (writing.load())
+                persistent.version().contains(0);
+        });
+    size_t maxRetired = 0;
+    for (int i = 0; i < 20000; ++i) {
+        persistent.insert(i);
+        size_t retired = persistent.retiredCount();
+        maxRetired = retired > maxRetired ? retired : maxRetired;
+    }
+    writing.store(false);
+    for (thread& reader : readers)
+        reader.join();
+    cout << "Персистентное дерево: " << persistent.size() << " ключей, замененных версий в ожидании не больше "
+         << maxRetired << (maxRetired <= 3 ? " (верно)" : " (ОШИБКА)") << endl;
 }
\ No newline at end of file
@@ -0,0 +1,916 @@
+﻿#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "../../Common/BatchSearch.h"
+#include "../../Common/BulkBuild.h"
+#include "../../Common/NodeAllocator.h"
+#include "../../Common/OrderedContainers.h"
+#include "../../Common/RangeCursor.h"
+#include "../../Common/SetOperations.h"
+#include "../../Common/Snapshot.h"
+#include "../../Common/TreeStats.h"
+
+// Структура узла для AVL дерева
+template <typename T>
+struct AVLNode {
+    T value;           // Значение, которое хранится в узле
+    AVLNode* left;     // Указатель на левое поддерево
+    AVLNode* right;    // Указатель на правое поддерево
+    AVLNode* parent;   // Родитель: по нему ходят итераторы и балансировка на обратном пути
+    int height;        // Высота узла в дереве
+    size_t subtreeSize; // Число узлов в поддереве вместе с этим: для порядковых статистик
+
+    // Конструктор для создания узла: значение строится на месте из аргументов
+    template <typename... Args>
+    explicit AVLNode(Args&&... args)
+        : value(std::forward<Args>(args)...), left(nullptr), right(nullptr), parent(nullptr), height(1), subtreeSize(1) {}
+};
+// Класс для AVL дерева.
+// Дерево владеет своими узлами; память под них выделяет политика NodeAllocator (см. NodeAllocator.h).
+// Ключи уникальны и упорядочены компаратором Compare; Entry задает, что хранит узел: ключ (SetEntry),
+// пару ключ-значение (MapEntry), ключ со счетчиком (CountedEntry) или ключ со списком значений
+// (MultiMapEntry), и что делает вставка уже имеющегося ключа, см. OrderedContainers.h.
+// Поиск, вставка, удаление и обход итеративные; узлы не перемещаются, поэтому итераторы
+// остаются действительными, пока не удален их собственный элемент.
+// Узел хранит размер своего поддерева, поэтому ранг ключа, k-й элемент и число ключей
+// в отрезке находятся за один спуск, O(log n).
+// По высотам в узлах работают split и join, а на них — параллельные объединение,
+// пересечение и разность деревьев (SetOperations.h).
+template <typename Key = int, typename Compare = std::less<Key>, typename NodeAllocator = DefaultNodeAllocator,
+          typename Entry = SetEntry<Key>>
+class AVLTree {
+public:
+    using key_type = Key;
+    using key_compare = Compare;
+    using entry_type = Entry;
+    using value_type = typename Entry::value_type;
+    using Node = AVLNode<value_type>;
+
+    // Двунаправленный итератор симметричного обхода по ссылкам на родителя
+    class Iterator {
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = typename Entry::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = value_type*;
+        using reference = value_type&;
+
+        Iterator() : node(nullptr), tree(nullptr) {}
+
+        reference operator*() const { return node->value; }
+        pointer operator->() const { return &node->value; }
+        Iterator& operator++() {
+            if (node->right != nullptr) {
+                node = minimum(node->right);
+            }
+            else {
+                // Поднимаемся, пока приходим из правого поддерева; выше корня — конец
+                while (node->parent != nullptr && node == node->parent->right)
+                    node = node->parent;
+                node = node->parent;
+            }
+            return *this;
+        }
+        Iterator operator++(int) {
+            Iterator copy = *this;
+            ++*this;
+            return copy;
+        }
+        Iterator& operator--() {
+            if (node == nullptr) {
+                node = maximum(tree->root);  // Шаг назад от конца — наибольший элемент
+            }
+            else if (node->left != nullptr) {
+                node = maximum(node->left);
+            }
+            else {
+                while (node->parent != nullptr && node == node->parent->left)
+                    node = node->parent;
+                node = node->parent;
+            }
+            return *this;
+        }
+        Iterator operator--(int) {
+            Iterator copy = *this;
+            --*this;
+            return copy;
+        }
+        bool operator==(const Iterator& other) const { return node == other.node; }
+        bool operator!=(const Iterator& other) const { return node != other.node; }
+
+    private:
+        friend class AVLTree;
+        Iterator(Node* node, const AVLTree* tree) : node(node), tree(tree) {}
+
+        Node* node;            // nullptr — позиция за последним элементом
+        const AVLTree* tree;   // Нужен, чтобы шагнуть назад от конца
+    };
+
+    explicit AVLTree(const Compare& comp = Compare()) : root(nullptr), size_(0), comp(comp) {}
+    ~AVLTree() { clear(); }
+    AVLTree(const AVLTree&) = delete;
+    AVLTree& operator=(const AVLTree&) = delete;
+
+    Iterator begin() const { return Iterator(root != nullptr ? minimum(root) : nullptr, this); }
+    Iterator end() const { return Iterator(nullptr, this); }
+    size_t size() const { return size_; }
+    const Compare& keyComp() const { return comp; }
+    // Счетчики горячего пути (TreeStats.h); без TREE_STATS — нули
+    TreeStats stats() const { return counters.snapshot(getHeight(root)); }
+    void resetStats() { counters.reset(); }
+
+    // Вставка элемента в дерево; если ключ уже существует, элемент сливается с имеющимся
+    // (Entry::merge: множество и словарь не меняются, у мультимножества растет счетчик)
+    void insert(const value_type& value) {
+        Node* parent;
+        Node** link = findLink(Entry::key(value), parent);
+        if (*link != nullptr) {
+            Entry::merge((*link)->value, value);
+            return;
+        }
+        attach(allocator.template create<Node>(value), parent, link);
+    }
+    // Вставка значения, построенного из аргументов; при повторном ключе узел сразу освобождается
+    template <typename... Args>
+    std::pair<Iterator, bool> emplaceUnique(Args&&... args) {
+        Node* node = allocator.template create<Node>(std::forward<Args>(args)...);
+        Node* parent;
+        Node** link = findLink(Entry::key(node->value), parent);
+        if (*link != nullptr) {
+            allocator.destroy(node);
+            return { Iterator(*link, this), false };
+        }
+        attach(node, parent, link);
+        return { Iterator(node, this), true };
+    }
+    // Вставка по ключу: значение строится из аргументов, только если ключа еще нет
+    template <typename K, typename... Args>
+    std::pair<Iterator, bool> tryEmplace(const K& key, Args&&... args) {
+        Node* parent;
+        Node** link = findLink(key, parent);
+        if (*link != nullptr)
+            return { Iterator(*link, this), false };
+        Node* node = allocator.template create<Node>(std::forward<Args>(args)...);
+        attach(node, parent, link);
+        return { Iterator(node, this), true };
+    }
+    // Удаление элемента; возвращает false, если ключа нет
+    template <typename K>
+    bool erase(const K& key) {
+        Node* node = search(key);
+        if (node == nullptr)
+            return false;  // Ключ не найден
+        eraseNode(node);
+        return true;
+    }
+    // Удаление одного вхождения ключа (Entry::release): у мультимножества уменьшается счетчик,
+    // узел удаляется, когда вхождений не осталось. false, если ключа нет
+    template <typename K>
+    bool eraseOne(const K& key) {
+        Node* node = search(key);
+        if (node == nullptr)
+            return false;
+        if (Entry::release(node->value))
+            eraseNode(node);
+        return true;
+    }
+    // Удаление элемента по итератору; возвращает итератор на следующий элемент
+    Iterator erase(Iterator pos) {
+        Iterator next = pos;
+        ++next;
+        eraseNode(pos.node);
+        return next;
+    }
+    // Число вхождений ключа: 0 или 1, у мультимножества и мультисловаря — Entry::count элемента
+    template <typename K>
+    size_t count(const K& key) const {
+        Node* node = search(key);
+        return node != nullptr ? Entry::count(node->value) : 0;
+    }
+    // Поиск элемента в дереве
+    template <typename K>
+    Node* search(const K& key) const {
+        TreeDescent descent(counters);
+        Node* node = root;
+        while (node != nullptr) {
+            descent.visit();
+            if (descent.less(comp, key, Entry::key(node->value)))
+                node = node->left;  // Ищем в левом поддереве
+            else if (descent.less(comp, Entry::key(node->value), key))
+                node = node->right;  // Ищем в правом поддереве
+            else
+                return node;
+        }
+        return nullptr;
+    }
+    // Поиск сразу count ключей: results[i] = search(keys[i]). Спуски разных ключей чередуются
+    // с упреждающей загрузкой узлов (BatchSearch.h), и промахи кэша перекрываются
+    template <typename K>
+    void searchBatch(const K* keys, size_t count, Node** results) const {
+        struct State {
+            Node* node;
+            size_t index;
+        };
+        interleavedSearch<State>(count,
+            [&](State& state, size_t index) {
+                state.node = root;
+                state.index = index;
+                if (root != nullptr)
+                    return false;
+                results[index] = nullptr;
+                return true;
+            },
+            [&](State& state) {
+                Node* node = state.node;
+                const K& key = keys[state.index];
+                if (comp(key, Entry::key(node->value)))
+                    node = node->left;
+                else if (comp(Entry::key(node->value), key))
+                    node = node->right;
+                else {
+                    results[state.index] = node;
+                    return true;
+                }
+                if (node == nullptr) {
+                    results[state.index] = nullptr;
+                    return true;
+                }
+                prefetchLine(node);
+                state.node = node;
+                return false;
+            });
+    }
+    template <typename K>
+    Iterator find(const K& key) const {
+        return Iterator(search(key), this);
+    }
+    // Первый элемент, не меньший key
+    template <typename K>
+    Iterator lowerBound(const K& key) const {
+        Node* node = root;
+        Node* result = nullptr;
+        while (node != nullptr) {
+            if (comp(Entry::key(node->value), key)) {
+                node = node->right;
+            }
+            else {
+                result = node;
+                node = node->left;
+            }
+        }
+        return Iterator(result, this);
+    }
+    // Первый элемент, больший key
+    template <typename K>
+    Iterator upperBound(const K& key) const {
+        Node* node = root;
+        Node* result = nullptr;
+        while (node != nullptr) {
+            if (comp(key, Entry::key(node->value))) {
+                result = node;
+                node = node->left;
+            }
+            else {
+                node = node->right;
+            }
+        }
+        return Iterator(result, this);
+    }
+    // Элементы с ключом key, [first, last). Элемент на ключ один, поэтому хватает спуска lowerBound
+    template <typename K>
+    std::pair<Iterator, Iterator> equalRange(const K& key) const {
+        Iterator first = lowerBound(key);
+        Iterator last = first;
+        if (first != end() && !comp(key, Entry::key(*first)))
+            ++last;
+        return { first, last };
+    }
+    // Курсор по элементам с ключами из отрезка [lo, hi] (RangeCursor.h): начало ищется за O(log n),
+    // дальше элементы выдаются лениво, по одному или пачками
+    RangeCursor<AVLTree> range(const Key& lo, const Key& hi, ScanDirection direction = ScanDirection::Forward) const {
+        return RangeCursor<AVLTree>(*this, KeyRange<Key>::closed(lo, hi), direction);
+    }
+    // То же для любого диапазона: с открытыми границами, после ключа X и т. д.
+    RangeCursor<AVLTree> scan(const KeyRange<Key>& keys, ScanDirection direction = ScanDirection::Forward) const {
+        return RangeCursor<AVLTree>(*this, keys, direction);
+    }
+    // Удаление всех узлов
+    void clear() {
+        // Узлы без деструкторов можно не обходить: аллокатор отдает всю память разом
+        if (!NodeAllocator::kBulkRelease || !std::is_trivially_destructible<Node>::value)
+            destroy(root);
+        allocator.release();
+        root = nullptr;
+        size_ = 0;
+    }
+    // Замена содержимого элементами из [first, last), отсортированными по возрастанию без повторов.
+    // Дерево строится сразу идеально сбалансированным за O(n), без поворотов
+    template <typename ForwardIt>
+    void buildFromSorted(ForwardIt first, ForwardIt last) {
+        buildCounted(first, std::distance(first, last));
+    }
+    // То же в threads потоков: верхние уровни строит текущий поток, поддеревья под ними — рабочие
+    template <typename RandomIt>
+    void buildFromSortedParallel(RandomIt first, RandomIt last, unsigned threads = defaultBuildThreads()) {
+        size_t count = last - first;
+        int splitDepth = parallelSplitDepth(count, threads);
+        if (splitDepth == 0) {
+            buildFromSorted(first, last);
+            return;
+        }
+        clear();
+        std::vector<SubtreeTask<RandomIt, Node>> tasks;
+        std::vector<NodeAllocator> allocators(threads);
+        try {
+            buildTop(first, count, 0, splitDepth, &root, nullptr, tasks);
+            runParallel(tasks.size(), threads, [&](unsigned worker, size_t i) {
+                RandomIt it = tasks[i].first;
+                buildBalanced(it, tasks[i].count, tasks[i].link, tasks[i].parent, allocators[worker]);
+            });
+        }
+        catch (...) {
+            for (NodeAllocator& other : allocators)
+                allocator.adopt(other);
+            clear();
+            throw;
+        }
+        for (NodeAllocator& other : allocators)
+            allocator.adopt(other);
+        size_ = count;
+    }
+    // Снимок дерева в поток (формат — в Snapshot.h): элементы по порядку, блоками с контрольными суммами
+    void save(std::ostream& out, SnapshotEncoding encoding = SnapshotEncoding::Compact) const {
+        saveSnapshot<Entry>(out, begin(), end(), size_, encoding);
+    }
+    // Замена содержимого снимком из потока. Дерево сразу собирается сбалансированным, как в buildFromSorted;
+    // при ошибке (снимок поврежден или с другими типами элементов) исключение, дерево остается пустым
+    void load(std::istream& in) {
+        try {
+            SnapshotReader<Entry, Compare> reader(in, comp, true);
+            buildCounted(reader.begin(), reader.size());
+            reader.finish();
+        }
+        catch (...) {
+            clear();
+            throw;
+        }
+    }
+    // Сколько элементов меньше key
+    template <typename K>
+    size_t rank(const K& key) const {
+        size_t result = 0;
+        for (Node* node = root; node != nullptr;) {
+            if (comp(Entry::key(node->value), key)) {
+                result += getSize(node->left) + 1;  // Левое поддерево и сам узел меньше key
+                node = node->right;
+            }
+            else {
+                node = node->left;
+            }
+        }
+        return result;
+    }
+    // Сколько элементов с ключами в отрезке [lo, hi]
+    template <typename K>
+    size_t countRange(const K& lo, const K& hi) const {
+        if (comp(hi, lo))
+            return 0;
+        return countNotGreater(hi) - rank(lo);
+    }
+    // k-й по порядку элемент (с нуля); end(), если k >= size()
+    Iterator select(size_t k) const {
+        Node* node = root;
+        while (node != nullptr) {
+            size_t leftSize = getSize(node->left);
+            if (k < leftSize) {
+                node = node->left;
+            }
+            else if (k == leftSize) {
+                break;
+            }
+            else {
+                k -= leftSize + 1;
+                node = node->right;
+            }
+        }
+        return Iterator(node, this);
+    }
+    // Разрезание по ключу: элементы с ключами не меньше key переходят в right (его прежнее содержимое
+    // удаляется), здесь остаются меньшие. Сам разрез — O(log n). При политике с общей кучей (kSharedHeap)
+    // узлы правой части переходят к right как есть, иначе копируются в его память за O(размера части)
+    template <typename K>
+    void split(const K& key, AVLTree& right) {
+        if (&right == this)
+            return;
+        right.clear();
+        Node* less;
+        Node* equal;
+        Node* greater;
+        splitByKey(root, key, less, equal, greater);
+        if (equal != nullptr)
+            greater = joinNodes(nullptr, equal, greater);
+        assign(less);
+        if (greater == nullptr)
+            return;
+        if (NodeAllocator::kSharedHeap) {
+            right.assign(greater);
+            return;
+        }
+        try {
+            right.buildCounted(Iterator(minimum(greater), this), greater->subtreeSize);
+        }
+        catch (...) {
+            assign(concatNodes(root, greater));
+            throw;
+        }
+        destroy(greater);
+    }
+    // Склейка: элементы right, ключи которых больше всех здешних, дописываются справа за O(log n);
+    // right пустеет, его память переходит к этому дереву
+    void join(AVLTree& right) {
+        if (right.root == nullptr)
+            return;
+        if (root != nullptr && !comp(Entry::key(maximum(root)->value), Entry::key(minimum(right.root)->value)))
+            throw std::invalid_argument("AVLTree::join: ключи right должны быть больше ключей дерева");
+        allocator.adopt(right.allocator);
+        assign(concatNodes(root, right.take()));
+    }
+    // То же со средним элементом: middle встает между здешними ключами и ключами right
+    void join(const value_type& middle, AVLTree& right) {
+        const Key& key = Entry::key(middle);
+        if ((root != nullptr && !comp(Entry::key(maximum(root)->value), key)) ||
+            (right.root != nullptr && !comp(key, Entry::key(minimum(right.root)->value))))
+            throw std::invalid_argument("AVLTree::join: нужно ключи дерева < middle < ключи right");
+        Node* node = allocator.template create<Node>(middle);
+        if (&right != this)
+            allocator.adopt(right.allocator);
+        Node* left = take();
+        assign(joinNodes(left, node, right.take()));
+    }
+    // Объединение: добавляются элементы other с ключами, которых здесь нет. other пустеет,
+    // его память переходит к этому дереву. Работа O(m log(n/m + 1)) для размеров m <= n,
+    // независимые половины считаются в threads потоках (SetOperations.h)
+    void unionWith(AVLTree& other, unsigned threads = defaultBuildThreads()) {
+        if (&other != this)
+            combine(other, threads, &SetAlgebra<AVLTree>::unite);
+    }
+    // Пересечение: остаются элементы, ключи которых есть в other; other пустеет
+    void intersectWith(AVLTree& other, unsigned threads = defaultBuildThreads()) {
+        if (&other != this)
+            combine(other, threads, &SetAlgebra<AVLTree>::intersect);
+    }
+    // Разность: остаются элементы, ключей которых нет в other; other пустеет
+    void differenceWith(AVLTree& other, unsigned threads = defaultBuildThreads()) {
+        if (&other != this)
+            combine(other, threads, &SetAlgebra<AVLTree>::subtract);
+        else
+            clear();
+    }
+    // Публичный метод для получения корня дерева
+    Node* getRoot() {
+        return root;
+    }
+private:
+    Node* root;
+    size_t size_;
+    Compare comp;
+    NodeAllocator allocator;
+    mutable TreeCounters counters;
+
+    // Поддерево для split/join (SetOperations.h): высоты лежат в узлах, поэтому хватает корня.
+    // Ссылка корня поддерева на родителя может быть устаревшей: ее задает тот, кто его подвешивает
+    using Sub = Node*;
+    template <typename> friend class SetAlgebra;
+
+    // Содержимое дерева забирается целиком: узлы остаются, дерево пустеет
+    Node* take() {
+        Node* top = root;
+        root = nullptr;
+        size_ = 0;
+        return top;
+    }
+    // Дерево становится поддеревом top
+    void assign(Node* top) {
+        root = top;
+        if (top != nullptr)
+            top->parent = nullptr;
+        size_ = getSize(top);
+    }
+    // Общая часть объединения, пересечения и разности: узлы other переходят сюда, лишние разрушаются
+    // после слияния потоков
+    template <typename Operation>
+    void combine(AVLTree& other, unsigned threads, Operation operation) {
+        allocator.adopt(other.allocator);
+        SetAlgebra<AVLTree> algebra(*this, threads);
+        NodeGarbage<Node> garbage;
+        Node* top = take();
+        assign((algebra.*operation)(top, other.take(), garbage, 0));
+        while (garbage.head != nullptr) {
+            Node* next = garbage.head->parent;
+            destroy(garbage.head);
+            garbage.head = next;
+        }
+    }
+
+    static bool isEmpty(Node* t) { return t == nullptr; }
+    static size_t subtreeSize(Node* t) { return getSize(t); }
+    static void discard(Node* t, NodeGarbage<Node>& garbage) {
+        if (t != nullptr)
+            garbage.push(t);
+    }
+    static void absorb(Node* node, Node* equal) {
+        if (equal != nullptr)
+            Entry::merge(node->value, std::move(equal->value));
+    }
+    // Корень t отцепляется от своих поддеревьев
+    static void expose(Node* t, Node*& left, Node*& node, Node*& right) {
+        left = t->left;
+        right = t->right;
+        node = t;
+        t->left = t->right = nullptr;
+    }
+    // Узел node с поддеревьями left и right, высоты которых отличаются не больше чем на 1
+    static Node* link(Node* left, Node* node, Node* right) {
+        node->left = left;
+        node->right = right;
+        if (left != nullptr)
+            left->parent = node;
+        if (right != nullptr)
+            right->parent = node;
+        node->height = 1 + std::max(getHeight(left), getHeight(right));
+        updateSize(node);
+        return node;
+    }
+    // Склейка через узел: все ключи left меньше ключа node, а он меньше ключей right.
+    // Более низкое дерево подвешивается на краю более высокого на уровне своей высоты,
+    // повороты идут только по этому краю: O(|разность высот| + 1)
+    Node* joinNodes(Node* left, Node* node, Node* right) {
+        int leftHeight = getHeight(left);
+        int rightHeight = getHeight(right);
+        Node* top;
+        if (leftHeight > rightHeight + 1)
+            top = joinRight(left, node, right);
+        else if (rightHeight > leftHeight + 1)
+            top = joinLeft(left, node, right);
+        else
+            top = link(left, node, right);
+        top->parent = nullptr;
+        return top;
+    }
+    // left выше right больше чем на 1: спуск по правому краю left до поддерева высоты right
+    Node* joinRight(Node* left, Node* node, Node* right) {
+        Node* edge = left->right;
+        Node* sub = getHeight(edge) <= getHeight(right) + 1 ? link(edge, node, right) : joinRight(edge, node, right);
+        left->right = sub;
+        sub->parent = left;
+        left->height = 1 + std::max(getHeight(left->left), getHeight(sub));
+        updateSize(left);
+        return rebalance(left);
+    }
+    // right выше left больше чем на 1: спуск по левому краю right
+    Node* joinLeft(Node* left, Node* node, Node* right) {
+        Node* edge = right->left;
+        Node* sub = getHeight(edge) <= getHeight(left) + 1 ? link(left, node, edge) : joinLeft(left, node, edge);
+        right->left = sub;
+        sub->parent = right;
+        right->height = 1 + std::max(getHeight(sub), getHeight(right->right));
+        updateSize(right);
+        return rebalance(right);
+    }
+    // Склейка без среднего узла: им становится наибольший узел left
+    Node* concatNodes(Node* left, Node* right) {
+        if (left == nullptr)
+            return right;
+        if (right == nullptr)
+            return left;
+        Node* last;
+        Node* rest = splitLast(left, last);
+        return joinNodes(rest, last, right);
+    }
+    // Отцепление наибольшего узла t в last; возвращает остальное
+    Node* splitLast(Node* t, Node*& last) {
+        Node* left;
+        Node* node;
+        Node* right;
+        expose(t, left, node, right);
+        if (right == nullptr) {
+            last = node;
+            return left;
+        }
+        Node* rest = splitLast(right, last);
+        return joinNodes(left, node, rest);
+    }
+    // Разрезание t по ключу: less — меньшие ключи, greater — большие, equal — узел с этим ключом или nullptr.
+    // На каждом уровне отрезанная часть приклеивается join, в сумме O(log n)
+    template <typename K>
+    void splitByKey(Node* t, const K& key, Node*& less, Node*& equal, Node*& greater) {
+        if (t == nullptr) {
+            less = equal = greater = nullptr;
+            return;
+        }
+        Node* left;
+        Node* node;
+        Node* right;
+        expose(t, left, node, right);
+        if (comp(key, Entry::key(node->value))) {
+            splitByKey(left, key, less, equal, greater);
+            greater = joinNodes(greater, node, right);
+        }
+        else if (comp(Entry::key(node->value), key)) {
+            splitByKey(right, key, less, equal, greater);
+            less = joinNodes(left, node, less);
+        }
+        else {
+            less = left;
+            equal = link(nullptr, node, nullptr);
+            greater = right;
+        }
+    }
+    void splitNodes(Node* t, const Node* pivot, Node*& less, Node*& equal, Node*& greater) {
+        splitByKey(t, Entry::key(pivot->value), less, equal, greater);
+    }
+
+    // Поиск ссылки, на которой должен висеть ключ; parent — ее владелец (nullptr для корня).
+    // Если ключ уже есть, ссылка указывает на его узел
+    template <typename K>
+    Node** findLink(const K& key, Node*& parent) {
+        TreeDescent descent(counters);
+        parent = nullptr;
+        Node** link = &root;
+        while (*link != nullptr) {
+            Node* node = *link;
+            descent.visit();
+            if (descent.less(comp, key, Entry::key(node->value)))
+                link = &node->left;
+            else if (descent.less(comp, Entry::key(node->value), key))
+                link = &node->right;
+            else
+                break;
+            parent = node;
+        }
+        return link;
+    }
+    // Сколько элементов не больше key
+    template <typename K>
+    size_t countNotGreater(const K& key) const {
+        size_t result = 0;
+        for (Node* node = root; node != nullptr;) {
+            if (!comp(key, Entry::key(node->value))) {
+                result += getSize(node->left) + 1;
+                node = node->right;
+            }
+            else {
+                node = node->left;
+            }
+        }
+        return result;
+    }
+    // Подвешивание нового листа и балансировка на пути к корню
+    void attach(Node* node, Node* parent, Node** link) {
+        node->parent = parent;
+        *link = node;
+        ++size_;
+        for (Node* ancestor = parent; ancestor != nullptr; ancestor = ancestor->parent)
+            ++ancestor->subtreeSize;
+        retrace(parent);
+    }
+    // Стандартное удаление из дерева поиска: узел не копируется, а заменяется преемником,
+    // чтобы итераторы на остальные элементы оставались действительными
+    void eraseNode(Node* node) {
+        Node* from;  // Откуда начинать балансировку
+        if (node->left == nullptr || node->right == nullptr) {
+            // Не больше одного потомка: он занимает место удаляемого узла
+            Node* child = node->left != nullptr ? node->left : node->right;
+            if (child != nullptr)
+                child->parent = node->parent;
+            replaceChild(node->parent, node, child);
+            from = node->parent;
+        }
+        else {
+            // Два потомка: на место узла встает минимальный узел правого поддерева
+            Node* successor = minimum(node->right);
+            if (successor->parent == node) {
+                from = successor;
+            }
+            else {
+                from = successor->parent;
+                from->left = successor->right;
+                if (successor->right != nullptr)
+                    successor->right->parent = from;
+                successor->right = node->right;
+                successor->right->parent = successor;
+            }
+            successor->left = node->left;
+            successor->left->parent = successor;
+            successor->parent = node->parent;
+            successor->height = node->height;
+            replaceChild(node->parent, node, successor);
+        }
+        allocator.destroy(node);  // Узел возвращается аллокатору для повторного использования
+        --size_;
+        // Размеры пересчитываются до корня снизу вверх: потомки каждого узла на пути уже верны.
+        // Балансировка может остановиться раньше, поэтому размеры обновляются отдельным проходом
+        for (Node* ancestor = from; ancestor != nullptr; ancestor = ancestor->parent)
+            updateSize(ancestor);
+        retrace(from);
+    }
+    // Подъем от узла к корню: обновляем высоты и балансируем.
+    // Если узел не повернулся и его высота не изменилась, выше ничего не меняется
+    void retrace(Node* node) {
+        while (node != nullptr) {
+            Node* parent = node->parent;
+            int oldHeight = node->height;
+            node->height = 1 + std::max(getHeight(node->left), getHeight(node->right));
+            Node* subtree = rebalance(node);
+            if (subtree != node)
+                replaceChild(parent, node, subtree);
+            else if (node->height == oldHeight)
+                return;
+            node = parent;
+        }
+    }
+    // Замена потомка oldChild узла parent на newChild (parent == nullptr — корень)
+    void replaceChild(Node* parent, Node* oldChild, Node* newChild) {
+        if (parent == nullptr)
+            root = newChild;
+        else if (parent->left == oldChild)
+            parent->left = newChild;
+        else
+            parent->right = newChild;
+    }
+    // Балансировка узла по показателям баланса потомков
+    Node* rebalance(Node* root) {
+        int balance = getBalance(root);
+        if (balance > 1) {
+            if (getBalance(root->left) < 0) {
+                root->left = leftRotate(root->left);  // Левый правый случай
+                counters.rotation(RotationCase::LR);
+            }
+            else {
+                counters.rotation(RotationCase::LL);
+            }
+            return rightRotate(root);
+        }
+        if (balance < -1) {
+            if (getBalance(root->right) > 0) {
+                root->right = rightRotate(root->right);  // Правый левый случай
+                counters.rotation(RotationCase::RL);
+            }
+            else {
+                counters.rotation(RotationCase::RR);
+            }
+            return leftRotate(root);
+        }
+        return root;
+    }
+    static Node* minimum(Node* node) {
+        while (node->left != nullptr)
+            node = node->left;
+        return node;
+    }
+    static Node* maximum(Node* node) {
+        while (node->right != nullptr)
+            node = node->right;
+        return node;
+    }
+    // Замена содержимого count элементами, читаемыми по порядку с it: хватает однопроходного итератора
+    template <typename InputIt>
+    void buildCounted(InputIt it, size_t count) {
+        clear();
+        try {
+            buildBalanced(it, count, &root, nullptr, allocator);
+        }
+        catch (...) {
+            clear();  // Недостроенное дерево связно, его можно разобрать обычным способом
+            throw;
+        }
+        size_ = count;
+    }
+    // Сбалансированное поддерево из count элементов, читаемых по порядку начиная с it.
+    // Левое поддерево строится прямо в link и, пока нет его корня, висит там само,
+    // поэтому при исключении все созданные узлы достижимы от корня дерева.
+    // Глубина рекурсии — высота результата, то есть log2(count)
+    template <typename It>
+    void buildBalanced(It& it, size_t count, Node** link, Node* parent, NodeAllocator& alloc) {
+        if (count == 0)
+            return;
+        size_t leftCount = count / 2;
+        buildBalanced(it, leftCount, link, nullptr, alloc);
+        Node* node = alloc.template create<Node>(*it);
+        ++it;
+        if (leftCount != 0) {
+            node->left = *link;
+            node->left->parent = node;
+        }
+        node->parent = parent;
+        node->height = balancedHeight(count);
+        node->subtreeSize = count;
+        *link = node;
+        buildBalanced(it, count - leftCount - 1, &node->right, node, alloc);
+    }
+    // Верхние уровни для параллельного построения: деление то же, что в buildBalanced,
+    // а поддеревья на глубине splitDepth откладываются в tasks
+    template <typename RandomIt>
+    void buildTop(RandomIt first, size_t count, int depth, int splitDepth, Node** link, Node* parent,
+                  std::vector<SubtreeTask<RandomIt, Node>>& tasks) {
+        if (depth == splitDepth) {
+            tasks.push_back({ first, count, link, parent, depth });
+            return;
+        }
+        if (count == 0)
+            return;
+        size_t leftCount = count / 2;
+        Node* node = allocator.template create<Node>(first[leftCount]);
+        node->parent = parent;
+        node->height = balancedHeight(count);
+        node->subtreeSize = count;
+        *link = node;
+        buildTop(first, leftCount, depth + 1, splitDepth, &node->left, node, tasks);
+        buildTop(first + leftCount + 1, count - leftCount - 1, depth + 1, splitDepth, &node->right, node, tasks);
+    }
+    // Разбор без стека: правыми поворотами вытягиваем дерево в список по правым ссылкам
+    void destroy(Node* node) {
+        while (node != nullptr) {
+            if (node->left != nullptr) {
+                Node* left = node->left;
+                node->left = left->right;
+                left->right = node;
+                node = left;
+            }
+            else {
+                Node* next = node->right;
+                allocator.destroy(node);
+                node = next;
+            }
+        }
+    }
+    // Функции для балансировки дерева. Повороты обновляют ссылки на родителя;
+    // ссылку родителя на новый корень поддерева переставляет вызывающий
+    // Левый поворот
+    Node* leftRotate(Node* x) {
+        Node* y = x->right;  // Правая часть поворачивается влево
+        Node* T2 = y->left;  // Сохраняем левое поддерево правого узла
+        // Выполняем поворот
+        y->left = x;
+        x->right = T2;
+        if (T2 != nullptr)
+            T2->parent = x;
+        y->parent = x->parent;
+        x->parent = y;
+        // Обновляем высоты; поддерево y теперь то же, что было у x
+        x->height = 1 + std::max(getHeight(x->left), getHeight(x->right));
+        y->height = 1 + std::max(getHeight(y->left), getHeight(y->right));
+        y->subtreeSize = x->subtreeSize;
+        updateSize(x);
+        return y;  // Новый корень
+    }
+    // Правый поворот
+    Node* rightRotate(Node* y) {
+        Node* x = y->left;  // Левое поддерево поворачивается вправо
+        Node* T2 = x->right;  // Сохраняем правое поддерево левого узла
+        // Выполняем поворот
+        x->right = y;
+        y->left = T2;
+        if (T2 != nullptr)
+            T2->parent = y;
+        x->parent = y->parent;
+        y->parent = x;
+        // Обновляем высоты; поддерево x теперь то же, что было у y
+        y->height = 1 + std::max(getHeight(y->left), getHeight(y->right));
+        x->height = 1 + std::max(getHeight(x->left), getHeight(x->right));
+        x->subtreeSize = y->subtreeSize;
+        updateSize(y);
+        return x;  // Новый корень
+    }
+    // Функция для получения высоты узла
+    static int getHeight(Node* root) {
+        if (root == nullptr)
+            return 0;  // Если узел пустой, высота равна 0
+        return root->height;
+    }
+    // Размер поддерева (0 для пустого)
+    static size_t getSize(Node* root) {
+        return root != nullptr ? root->subtreeSize : 0;
+    }
+    static void updateSize(Node* node) {
+        node->subtreeSize = 1 + getSize(node->left) + getSize(node->right);
+    }
+    // Функция для вычисления баланса узла
+    static int getBalance(Node* root) {
+        if (root == nullptr)
+            return 0;  // Если узел пустой, баланс равен 0
+        return getHeight(root->left) - getHeight(root->right);  // Баланс = высота левого поддерева - высота правого
+    }
+};
+
+// Контейнеры с интерфейсом std::set и std::map на AVL дереве
+template <typename Key, typename Compare = std::less<Key>, typename NodeAllocator = DefaultNodeAllocator>
+using AVLSet = OrderedSet<AVLTree<Key, Compare, NodeAllocator>>;
+template <typename Key, typename T, typename Compare = std::less<Key>, typename NodeAllocator = DefaultNodeAllocator>
+using AVLMap = OrderedMap<AVLTree<Key, Compare, NodeAllocator, MapEntry<Key, T>>>;
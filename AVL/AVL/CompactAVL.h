@@ -0,0 +1,301 @@
+﻿#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include "../../Common/IndexPool.h"
+#include "../../Common/Snapshot.h"
+
+// Узел компактного AVL-дерева: ключ и две 32-битные ссылки. Показатель баланса (-1, 0, +1)
+// занимает 2 бита — признаки ссылок: у левой — выше левое поддерево, у правой — правое
+template <typename Key>
+struct CompactAVLNode {
+    Key key;
+    PackedLink child[2];  // Левый и правый потомки
+
+    CompactAVLNode() : key() {}
+    explicit CompactAVLNode(const Key& key) : key(key) {}
+    explicit CompactAVLNode(Key&& key) : key(std::move(key)) {}
+
+    int balance() const { return int(child[1].flag()) - int(child[0].flag()); }
+    void setBalance(int balance) {
+        child[0].setFlag(balance < 0);
+        child[1].setFlag(balance > 0);
+    }
+};
+
+// AVL-дерево (множество уникальных ключей) в компактном виде: узлы лежат в одном векторе
+// (IndexPool.h) и связаны 32-битными номерами, ссылок на родителя и высоты в узле нет.
+// Узел с ключом int занимает 12 байт против 48 у AVLTree, соседние по времени вставки узлы
+// лежат рядом, и на поиске больше узлов помещается в кэш. Цена — путь от корня при вставке
+// и удалении запоминается в стеке, итератор однонаправленный, порядковых статистик нет.
+// Не больше 2^31 - 1 элементов
+template <typename Key = int, typename Compare = std::less<Key>>
+class CompactAVLTree {
+public:
+    using key_type = Key;
+    using Node = CompactAVLNode<Key>;
+    using Index = typename IndexPool<Node>::Index;
+
+    // Высота AVL-дерева из n узлов меньше 1.45 * log2(n + 2): для 2^31 узлов это 46
+    static constexpr int kMaxHeight = 48;
+
+    using Iterator = IndexTreeIterator<Node, kMaxHeight>;
+
+    explicit CompactAVLTree(const Compare& comp = Compare()) : root(kNull), size_(0), comp(comp) {}
+    CompactAVLTree(const CompactAVLTree&) = delete;
+    CompactAVLTree& operator=(const CompactAVLTree&) = delete;
+
+    Iterator begin() const { return Iterator(&pool, root); }
+    Iterator end() const { return Iterator(); }
+    size_t size() const { return size_; }
+    const Compare& keyComp() const { return comp; }
+
+    // Память под count узлов заранее
+    void reserve(size_t count) { pool.reserve(count); }
+    // Байт, занятых узлами
+    size_t memoryUsage() const { return pool.memoryUsage(); }
+
+    // Поиск ключа
+    template <typename K>
+    bool contains(const K& key) const {
+        Index node = root;
+        while (node != kNull) {
+            const Node& current = pool[node];
+            if (comp(key, current.key))
+                node = current.child[0].index();
+            else if (comp(current.key, key))
+                node = current.child[1].index();
+            else
+                return true;
+        }
+        return false;
+    }
+
+    // Вставка ключа; возвращает false, если он уже есть
+    bool insert(const Key& key) {
+        Index path[kMaxHeight];
+        unsigned char dirs[kMaxHeight];  // Сторона, в которую шли из path[i]
+        int depth = 0;
+        for (Index node = root; node != kNull; ++depth) {
+            const Node& current = pool[node];
+            int dir;
+            if (comp(key, current.key))
+                dir = 0;
+            else if (comp(current.key, key))
+                dir = 1;
+            else
+                return false;
+            path[depth] = node;
+            dirs[depth] = static_cast<unsigned char>(dir);
+            node = current.child[dir].index();
+        }
+        Index fresh = pool.create(key);
+        ++size_;
+        relink(path, dirs, depth, fresh);
+
+        // Подъем к корню: поддерево на стороне dirs[i] стало выше на 1
+        for (int i = depth - 1; i >= 0; --i) {
+            Node& node = pool[path[i]];
+            int grown = dirs[i] == 0 ? -1 : 1;
+            int balance = node.balance();
+            if (balance == 0) {
+                node.setBalance(grown);  // Выросло и поддерево этого узла
+                continue;
+            }
+            if (balance != grown) {
+                node.setBalance(0);  // Выровнялось, выше рост не идет
+                break;
+            }
+            // Перевес 2: поворот возвращает поддереву высоту до вставки
+            bool shrunk;
+            relink(path, dirs, i, rebalance(path[i], dirs[i], shrunk));
+            break;
+        }
+        return true;
+    }
+
+    // Удаление ключа; возвращает false, если его нет
+    template <typename K>
+    bool erase(const K& key) {
+        Index path[kMaxHeight];
+        unsigned char dirs[kMaxHeight];
+        int depth = 0;
+        Index node = root;
+        while (node != kNull) {
+            const Node& current = pool[node];
+            int dir;
+            if (comp(key, current.key))
+                dir = 0;
+            else if (comp(current.key, key))
+                dir = 1;
+            else
+                break;
+            path[depth] = node;
+            dirs[depth++] = static_cast<unsigned char>(dir);
+            node = current.child[dir].index();
+        }
+        if (node == kNull)
+            return false;
+
+        if (pool[node].child[0].index() != kNull && pool[node].child[1].index() != kNull) {
+            // Два потомка: сюда переносится следующий по порядку ключ, удаляется его узел
+            Index target = node;
+            path[depth] = node;
+            dirs[depth++] = 1;
+            node = pool[node].child[1].index();
+            while (pool[node].child[0].index() != kNull) {
+                path[depth] = node;
+                dirs[depth++] = 0;
+                node = pool[node].child[0].index();
+            }
+            pool[target].key = std::move(pool[node].key);
+        }
+        // У удаляемого узла не больше одного потомка: он и занимает место узла
+        Index left = pool[node].child[0].index();
+        relink(path, dirs, depth, left != kNull ? left : pool[node].child[1].index());
+        pool.destroy(node);
+        --size_;
+
+        // Подъем к корню: поддерево на стороне dirs[i] стало ниже на 1
+        for (int i = depth - 1; i >= 0; --i) {
+            Node& current = pool[path[i]];
+            int lowered = dirs[i] == 0 ? -1 : 1;
+            int balance = current.balance();
+            if (balance == lowered) {
+                current.setBalance(0);  // Выровнялось, но и само стало ниже
+                continue;
+            }
+            if (balance == 0) {
+                current.setBalance(-lowered);  // Высота узла не изменилась
+                break;
+            }
+            bool shrunk;
+            relink(path, dirs, i, rebalance(path[i], 1 - dirs[i], shrunk));
+            if (!shrunk)
+                break;
+        }
+        return true;
+    }
+
+    // Удаление всех узлов: память пула отдается целиком, без обхода
+    void clear() {
+        pool.release();
+        root = kNull;
+        size_ = 0;
+    }
+
+    // Замена содержимого ключами из [first, last), отсортированными по возрастанию без повторов.
+    // Дерево строится идеально сбалансированным за O(n), узлы — в порядке ключей подряд в пуле
+    template <typename ForwardIt>
+    void buildFromSorted(ForwardIt first, ForwardIt last) {
+        buildCounted(first, std::distance(first, last));
+    }
+
+    // Снимок дерева в поток (формат — в Snapshot.h)
+    void save(std::ostream& out, SnapshotEncoding encoding = SnapshotEncoding::Compact) const {
+        saveSnapshot<SetEntry<Key>>(out, begin(), end(), size_, encoding);
+    }
+    // Замена содержимого снимком из потока; при ошибке исключение, дерево остается пустым
+    void load(std::istream& in) {
+        try {
+            SnapshotReader<SetEntry<Key>, Compare> reader(in, comp, true);
+            buildCounted(reader.begin(), reader.size());
+            reader.finish();
+        }
+        catch (...) {
+            clear();
+            throw;
+        }
+    }
+
+private:
+    static constexpr Index kNull = IndexPool<Node>::kNull;
+
+    IndexPool<Node> pool;
+    Index root;
+    size_t size_;
+    Compare comp;
+
+    // Поддерево, висевшее под path[level - 1] (или корень при level == 0), заменяется на node
+    void relink(const Index* path, const unsigned char* dirs, int level, Index node) {
+        if (level == 0)
+            root = node;
+        else
+            pool[path[level - 1]].child[dirs[level - 1]].setIndex(node);
+    }
+
+    // Поворот узла x, у которого поддерево на стороне side выше другого на 2.
+    // Возвращает новый корень поддерева; shrunk — стало ли поддерево ниже, чем было
+    // с перевесом (после вставки всегда да, после удаления — кроме случая брата без перевеса)
+    Index rebalance(Index x, int side, bool& shrunk) {
+        int heavy = side == 0 ? -1 : 1;
+        Index y = pool[x].child[side].index();
+        int yBalance = pool[y].balance();
+        if (yBalance == -heavy) {
+            // Внук z с внутренней стороны: большой поворот, z поднимается на место x
+            Index z = pool[y].child[1 - side].index();
+            int zBalance = pool[z].balance();
+            pool[y].child[1 - side].setIndex(pool[z].child[side].index());
+            pool[x].child[side].setIndex(pool[z].child[1 - side].index());
+            pool[z].child[side].setIndex(y);
+            pool[z].child[1 - side].setIndex(x);
+            pool[y].setBalance(zBalance == -heavy ? heavy : 0);
+            pool[x].setBalance(zBalance == heavy ? -heavy : 0);
+            pool[z].setBalance(0);
+            shrunk = true;
+            return z;
+        }
+        // Малый поворот: y поднимается на место x
+        rotateIndex(pool, x, 1 - side);
+        if (yBalance == 0) {
+            pool[x].setBalance(heavy);
+            pool[y].setBalance(-heavy);
+            shrunk = false;
+        }
+        else {
+            pool[x].setBalance(0);
+            pool[y].setBalance(0);
+            shrunk = true;
+        }
+        return y;
+    }
+
+    // Замена содержимого count ключами, читаемыми по порядку с it: хватает однопроходного итератора
+    template <typename InputIt>
+    void buildCounted(InputIt it, size_t count) {
+        clear();
+        try {
+            pool.reserve(count);
+            int height;
+            root = buildBalanced(it, count, height);
+        }
+        catch (...) {
+            clear();
+            throw;
+        }
+        size_ = count;
+    }
+    // Сбалансированное поддерево из count ключей; height — его высота (для показателей баланса)
+    template <typename It>
+    Index buildBalanced(It& it, size_t count, int& height) {
+        if (count == 0) {
+            height = 0;
+            return kNull;
+        }
+        size_t leftCount = count / 2;
+        int leftHeight, rightHeight;
+        Index left = buildBalanced(it, leftCount, leftHeight);
+        Index node = pool.create(*it);
+        ++it;
+        Index right = buildBalanced(it, count - leftCount - 1, rightHeight);
+        Node& current = pool[node];
+        current.child[0].setIndex(left);
+        current.child[1].setIndex(right);
+        current.setBalance(rightHeight - leftHeight);
+        height = std::max(leftHeight, rightHeight) + 1;
+        return node;
+    }
+};
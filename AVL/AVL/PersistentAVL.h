@@ -0,0 +1,110 @@
+﻿#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include "../../Common/PersistentTree.h"
+
+// Узел персистентного AVL-дерева: общая часть (PersistentTree.h) и высота поддерева
+template <typename Key>
+struct PersistentAVLNode : PersistentNodeBase<PersistentAVLNode<Key>, Key> {
+    using Base = PersistentNodeBase<PersistentAVLNode<Key>, Key>;
+
+    int height;
+
+    PersistentAVLNode(const Key& key, uint64_t stamp) : Base(key, stamp), height(1) {}
+    PersistentAVLNode(const PersistentAVLNode& other, uint64_t stamp) : Base(other, stamp), height(other.height) {}
+};
+
+// Балансировка AVL для PersistentTree. Вставка и удаление рекурсивны: на спуске узлы пути
+// копируются (PathCopier::own), на подъеме пересчитываются высоты и выполняются повороты.
+// После удаления повороты задевают узлы рядом с путем — они копируются внутри rotate
+template <typename Key, typename Compare>
+struct PersistentAVLBalance {
+    using Node = PersistentAVLNode<Key>;
+    using Copier = PathCopier<Node>;
+
+    // Вставка ключа, которого в поддереве slot нет
+    static void insert(Copier& copier, Node*& slot, const Key& key, const Compare& comp) {
+        if (slot == nullptr) {
+            slot = copier.create(key);
+            return;
+        }
+        Node* node = copier.own(slot);
+        insert(copier, node->child[comp(node->key, key) ? 1 : 0], key, comp);
+        rebalance(copier, slot);
+    }
+
+    // Удаление ключа, который в поддереве slot есть
+    template <typename K>
+    static void erase(Copier& copier, Node*& slot, const K& key, const Compare& comp) {
+        Node* node = copier.own(slot);
+        if (comp(key, node->key)) {
+            erase(copier, node->child[0], key, comp);
+        }
+        else if (comp(node->key, key)) {
+            erase(copier, node->child[1], key, comp);
+        }
+        else if (node->child[0] == nullptr || node->child[1] == nullptr) {
+            // Не больше одного потомка: он и занимает место узла
+            copier.unlink(slot, node->child[0] != nullptr ? 0 : 1);
+            return;
+        }
+        else {
+            // Два потомка: сюда переносится минимальный ключ правого поддерева
+            extractMin(copier, node->child[1], node->key);
+        }
+        rebalance(copier, slot);
+    }
+
+    // Разметка при сборке из отсортированного: высота известна сразу
+    struct BuildShape {
+        explicit BuildShape(size_t) {}
+        void operator()(Node* node, int height, int) const { node->height = height; }
+    };
+
+private:
+    static int height(const Node* node) { return node != nullptr ? node->height : 0; }
+    static void update(Node* node) { node->height = 1 + std::max(height(node->child[0]), height(node->child[1])); }
+
+    // Минимальный узел поддерева slot удаляется, его ключ переносится в key
+    static void extractMin(Copier& copier, Node*& slot, Key& key) {
+        Node* node = copier.own(slot);
+        if (node->child[0] == nullptr) {
+            key = std::move(node->key);  // Узел — копия этой транзакции, старые версии его не видят
+            copier.unlink(slot, 1);
+            return;
+        }
+        extractMin(copier, node->child[0], key);
+        rebalance(copier, slot);
+    }
+
+    // Восстановление баланса в узле slot (своей транзакции), поддеревья которого сбалансированы
+    static void rebalance(Copier& copier, Node*& slot) {
+        Node* node = slot;
+        int balance = height(node->child[1]) - height(node->child[0]);
+        if (balance >= -1 && balance <= 1) {
+            update(node);
+            return;
+        }
+        int heavy = balance > 0 ? 1 : 0;
+        Node* child = node->child[heavy];
+        // Внутренний внук выше внешнего: сначала он выводится наружу поворотом потомка
+        if (height(child->child[1 - heavy]) > height(child->child[heavy])) {
+            copier.own(node->child[heavy]);
+            Node* down = node->child[heavy];
+            Node* up = copier.rotate(node->child[heavy], heavy);
+            update(down);
+            update(up);
+        }
+        Node* up = copier.rotate(slot, 1 - heavy);
+        update(node);
+        update(up);
+    }
+};
+
+// Персистентное AVL-дерево (множество уникальных ключей): читатели берут неизменяемую версию
+// (version()) без блокировок, вставка и удаление копируют путь и публикуют новую версию.
+// Подробности — в PersistentTree.h
+template <typename Key = int, typename Compare = std::less<Key>>
+using PersistentAVLTree = PersistentTree<PersistentAVLBalance<Key, Compare>, Compare>;
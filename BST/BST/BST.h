@@ -0,0 +1,396 @@
+﻿#pragma once
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "../../Common/BulkBuild.h"
+#include "../../Common/NodeAllocator.h"
+#include "../../Common/OrderedContainers.h"
+#include "../../Common/RangeCursor.h"
+#include "../../Common/Snapshot.h"
+
+// Структура узла для бинарного дерева поиска (BST)
+template <typename T>
+struct BSTNode {
+    T value;
+    BSTNode* left;
+    BSTNode* right;
+
+    // Значение строится на месте из аргументов
+    template <typename... Args>
+    explicit BSTNode(Args&&... args) : value(std::forward<Args>(args)...), left(nullptr), right(nullptr) {}
+};
+// Класс для бинарного дерева поиска (BST).
+// Дерево владеет своими узлами; память под них выделяет политика NodeAllocator (см. NodeAllocator.h).
+// Ключи уникальны и упорядочены компаратором Compare; Entry задает, что хранит узел: ключ (SetEntry),
+// пару ключ-значение (MapEntry), ключ со счетчиком (CountedEntry) или ключ со списком значений
+// (MultiMapEntry), и что делает вставка уже имеющегося ключа, см. OrderedContainers.h.
+// Все операции итеративные: на отсортированном вводе дерево вырождается в список глубины n,
+// и рекурсия переполнила бы стек.
+template <typename Key = int, typename Compare = std::less<Key>, typename NodeAllocator = DefaultNodeAllocator,
+          typename Entry = SetEntry<Key>>
+class BST {
+public:
+    using key_type = Key;
+    using key_compare = Compare;
+    using entry_type = Entry;
+    using value_type = typename Entry::value_type;
+    using Node = BSTNode<value_type>;
+
+    // Двунаправленный итератор симметричного обхода. Ссылок на родителя в узлах нет, а высота BST
+    // не ограничена, поэтому путь от корня до текущего узла хранится в векторе
+    class Iterator {
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = typename Entry::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = value_type*;
+        using reference = value_type&;
+
+        Iterator() : root(nullptr) {}
+
+        reference operator*() const { return path.back()->value; }
+        pointer operator->() const { return &path.back()->value; }
+        Iterator& operator++() {
+            if (path.back()->right != nullptr) {
+                pushLeft(path.back()->right);  // Следующий — самый левый в правом поддереве
+                return *this;
+            }
+            // Поднимаемся, пока приходим из правого поддерева; выше корня — конец
+            Node* child;
+            do {
+                child = path.back();
+                path.pop_back();
+            } while (!path.empty() && path.back()->right == child);
+            return *this;
+        }
+        Iterator operator++(int) {
+            Iterator copy = *this;
+            ++*this;
+            return copy;
+        }
+        Iterator& operator--() {
+            if (path.empty()) {
+                pushRight(root);  // Шаг назад от конца — наибольший ключ
+                return *this;
+            }
+            if (path.back()->left != nullptr) {
+                pushRight(path.back()->left);
+                return *this;
+            }
+            Node* child;
+            do {
+                child = path.back();
+                path.pop_back();
+            } while (!path.empty() && path.back()->left == child);
+            return *this;
+        }
+        Iterator operator--(int) {
+            Iterator copy = *this;
+            --*this;
+            return copy;
+        }
+        bool operator==(const Iterator& other) const {
+            return path.empty() ? other.path.empty() : !other.path.empty() && path.back() == other.path.back();
+        }
+        bool operator!=(const Iterator& other) const { return !(*this == other); }
+
+    private:
+        friend class BST;
+        explicit Iterator(Node* root) : root(root) {}
+
+        Node* root;                // Нужен, чтобы шагнуть назад от конца
+        std::vector<Node*> path;   // От корня до текущего узла; пустой — позиция за последним ключом
+
+        void pushLeft(Node* node) {
+            for (; node != nullptr; node = node->left)
+                path.push_back(node);
+        }
+        void pushRight(Node* node) {
+            for (; node != nullptr; node = node->right)
+                path.push_back(node);
+        }
+    };
+
+    explicit BST(const Compare& comp = Compare()) : root(nullptr), comp(comp) {}
+    ~BST() { clear(); }
+    BST(const BST&) = delete;
+    BST& operator=(const BST&) = delete;
+
+    Iterator begin() const {
+        Iterator it(root);
+        it.pushLeft(root);
+        return it;
+    }
+    Iterator end() const { return Iterator(root); }
+    const Compare& keyComp() const { return comp; }
+
+    // Вставка элемента в дерево; если ключ уже существует, элемент сливается с имеющимся
+    // (Entry::merge: множество и словарь не меняются, у мультимножества растет счетчик)
+    void insert(const value_type& value) {
+        Node** link = findLink(Entry::key(value));
+        if (*link != nullptr)
+            Entry::merge((*link)->value, value);
+        else
+            *link = allocator.template create<Node>(value);
+    }
+    // Удаление элемента; возвращает false, если ключа нет
+    template <typename K>
+    bool erase(const K& key) {
+        Node** link = findLink(key);
+        if (*link == nullptr)
+            return false;  // ключ не найден
+
+        Node* node = *link;
+        if (node->left != nullptr && node->right != nullptr) {
+            // два потомка: переносим сюда минимальный ключ правого поддерева и удаляем его узел
+            Node** successorLink = &node->right;
+            while ((*successorLink)->left != nullptr)
+                successorLink = &(*successorLink)->left;
+            node->value = std::move((*successorLink)->value);
+            link = successorLink;
+            node = *successorLink;
+        }
+        *link = node->left != nullptr ? node->left : node->right;  // единственный потомок занимает место узла
+        allocator.destroy(node);
+        return true;
+    }
+    // Удаление одного вхождения ключа (Entry::release): у мультимножества уменьшается счетчик,
+    // узел удаляется, когда вхождений не осталось. false, если ключа нет
+    template <typename K>
+    bool eraseOne(const K& key) {
+        Node* node = search(key);
+        if (node == nullptr)
+            return false;
+        if (Entry::release(node->value))
+            erase(key);
+        return true;
+    }
+    // Число вхождений ключа: 0 или 1, у мультимножества и мультисловаря — Entry::count элемента
+    template <typename K>
+    size_t count(const K& key) const {
+        Node* node = search(key);
+        return node != nullptr ? Entry::count(node->value) : 0;
+    }
+    // Поиск элемента в дереве
+    template <typename K>
+    Node* search(const K& key) const {
+        Node* node = root;
+        while (node != nullptr) {
+            if (comp(key, Entry::key(node->value)))
+                node = node->left;
+            else if (comp(Entry::key(node->value), key))
+                node = node->right;
+            else
+                break;
+        }
+        return node;
+    }
+    // Первый ключ, не меньший key. Путь запоминается целиком и потом обрезается
+    // до последнего узла, от которого спуск ушел влево
+    template <typename K>
+    Iterator lowerBound(const K& key) const {
+        Iterator it(root);
+        size_t found = 0;
+        for (Node* node = root; node != nullptr;) {
+            it.path.push_back(node);
+            if (comp(Entry::key(node->value), key)) {
+                node = node->right;
+            }
+            else {
+                found = it.path.size();
+                node = node->left;
+            }
+        }
+        it.path.resize(found);
+        return it;
+    }
+    // Первый ключ, больший key
+    template <typename K>
+    Iterator upperBound(const K& key) const {
+        Iterator it(root);
+        size_t found = 0;
+        for (Node* node = root; node != nullptr;) {
+            it.path.push_back(node);
+            if (comp(key, Entry::key(node->value))) {
+                found = it.path.size();
+                node = node->left;
+            }
+            else {
+                node = node->right;
+            }
+        }
+        it.path.resize(found);
+        return it;
+    }
+    // Элементы с ключом key, [first, last). Элемент на ключ один, поэтому хватает спуска lowerBound
+    template <typename K>
+    std::pair<Iterator, Iterator> equalRange(const K& key) const {
+        Iterator first = lowerBound(key);
+        Iterator last = first;
+        if (first != end() && !comp(key, Entry::key(*first)))
+            ++last;
+        return { first, last };
+    }
+    // Курсор по ключам отрезка [lo, hi] (RangeCursor.h): начало ищется за один спуск,
+    // дальше ключи выдаются лениво, по одному или пачками
+    RangeCursor<BST> range(const Key& lo, const Key& hi, ScanDirection direction = ScanDirection::Forward) const {
+        return RangeCursor<BST>(*this, KeyRange<Key>::closed(lo, hi), direction);
+    }
+    // То же для любого диапазона: с открытыми границами, после ключа X и т. д.
+    RangeCursor<BST> scan(const KeyRange<Key>& keys, ScanDirection direction = ScanDirection::Forward) const {
+        return RangeCursor<BST>(*this, keys, direction);
+    }
+    // Функция для обхода дерева в порядке Inorder (симметричный обход)
+    void inorder() {
+        for (const value_type& value : *this)
+            std::cout << value << " ";
+    }
+    // Удаление всех узлов
+    void clear() {
+        // Узлы без деструкторов можно не обходить: аллокатор отдает всю память разом
+        if (!NodeAllocator::kBulkRelease || !std::is_trivially_destructible<Node>::value)
+            destroy(root);
+        allocator.release();
+        root = nullptr;
+    }
+    // Замена содержимого ключами из [first, last), отсортированными по возрастанию без повторов.
+    // Дерево строится идеально сбалансированным (высота log2(n) + 1) за O(n) — в отличие от вставок
+    // по одной, которые на отсортированном вводе дают список
+    template <typename ForwardIt>
+    void buildFromSorted(ForwardIt first, ForwardIt last) {
+        buildCounted(first, std::distance(first, last));
+    }
+    // То же в threads потоков: верхние уровни строит текущий поток, поддеревья под ними — рабочие
+    template <typename RandomIt>
+    void buildFromSortedParallel(RandomIt first, RandomIt last, unsigned threads = defaultBuildThreads()) {
+        size_t count = last - first;
+        int splitDepth = parallelSplitDepth(count, threads);
+        if (splitDepth == 0) {
+            buildFromSorted(first, last);
+            return;
+        }
+        clear();
+        std::vector<SubtreeTask<RandomIt, Node>> tasks;
+        std::vector<NodeAllocator> allocators(threads);
+        try {
+            buildTop(first, count, 0, splitDepth, &root, tasks);
+            runParallel(tasks.size(), threads, [&](unsigned worker, size_t i) {
+                RandomIt it = tasks[i].first;
+                buildBalanced(it, tasks[i].count, tasks[i].link, allocators[worker]);
+            });
+        }
+        catch (...) {
+            for (NodeAllocator& other : allocators)
+                allocator.adopt(other);
+            clear();
+            throw;
+        }
+        for (NodeAllocator& other : allocators)
+            allocator.adopt(other);
+    }
+    // Снимок дерева в поток (формат — в Snapshot.h). Размер в BST не хранится: его дает лишний проход по ключам
+    void save(std::ostream& out, SnapshotEncoding encoding = SnapshotEncoding::Compact) const {
+        saveSnapshot<Entry>(out, begin(), end(), std::distance(begin(), end()), encoding);
+    }
+    // Замена содержимого снимком из потока; дерево сразу строится сбалансированным, как в buildFromSorted.
+    // При ошибке (снимок поврежден или с другим типом ключей) исключение, дерево остается пустым
+    void load(std::istream& in) {
+        try {
+            SnapshotReader<Entry, Compare> reader(in, comp, true);
+            buildCounted(reader.begin(), reader.size());
+            reader.finish();
+        }
+        catch (...) {
+            clear();
+            throw;
+        }
+    }
+    // Публичный метод для получения корня дерева
+    Node* getRoot() {
+        return root;
+    }
+private:
+    Node* root;
+    Compare comp;
+    NodeAllocator allocator;
+
+    // Ссылка на узел с ключом или пустая ссылка, где он должен висеть
+    template <typename K>
+    Node** findLink(const K& key) {
+        Node** link = &root;
+        while (*link != nullptr) {
+            if (comp(key, Entry::key((*link)->value)))
+                link = &(*link)->left;
+            else if (comp(Entry::key((*link)->value), key))
+                link = &(*link)->right;
+            else
+                break;
+        }
+        return link;
+    }
+
+    // Замена содержимого count ключами, читаемыми по порядку с it: хватает однопроходного итератора
+    template <typename InputIt>
+    void buildCounted(InputIt it, size_t count) {
+        clear();
+        try {
+            buildBalanced(it, count, &root, allocator);
+        }
+        catch (...) {
+            clear();  // Недостроенное дерево связно, его можно разобрать обычным способом
+            throw;
+        }
+    }
+    // Сбалансированное поддерево из count ключей, читаемых по порядку начиная с it.
+    // Левое поддерево строится прямо в link и, пока нет его корня, висит там само,
+    // поэтому при исключении все созданные узлы достижимы от корня дерева
+    template <typename It>
+    void buildBalanced(It& it, size_t count, Node** link, NodeAllocator& alloc) {
+        if (count == 0)
+            return;
+        size_t leftCount = count / 2;
+        buildBalanced(it, leftCount, link, alloc);
+        Node* node = alloc.template create<Node>(*it);
+        ++it;
+        if (leftCount != 0)
+            node->left = *link;
+        *link = node;
+        buildBalanced(it, count - leftCount - 1, &node->right, alloc);
+    }
+    // Верхние уровни для параллельного построения: деление то же, что в buildBalanced,
+    // а поддеревья на глубине splitDepth откладываются в tasks
+    template <typename RandomIt>
+    void buildTop(RandomIt first, size_t count, int depth, int splitDepth, Node** link,
+                  std::vector<SubtreeTask<RandomIt, Node>>& tasks) {
+        if (depth == splitDepth) {
+            tasks.push_back({ first, count, link, nullptr, depth });
+            return;
+        }
+        if (count == 0)
+            return;
+        size_t leftCount = count / 2;
+        Node* node = allocator.template create<Node>(first[leftCount]);
+        *link = node;
+        buildTop(first, leftCount, depth + 1, splitDepth, &node->left, tasks);
+        buildTop(first + leftCount + 1, count - leftCount - 1, depth + 1, splitDepth, &node->right, tasks);
+    }
+    // Разбор без стека: правыми поворотами вытягиваем дерево в список по правым ссылкам
+    void destroy(Node* node) {
+        while (node != nullptr) {
+            if (node->left != nullptr) {
+                Node* left = node->left;
+                node->left = left->right;
+                left->right = node;
+                node = left;
+            }
+            else {
+                Node* next = node->right;
+                allocator.destroy(node);
+                node = next;
+            }
+        }
+    }
+};
@@ -0,0 +1,240 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include <vector>
+#include "../../Common/IndexPool.h"
+#include "../../Common/Snapshot.h"
+
+// Узел компактного BST: ключ и две 32-битные ссылки (признаки ссылок не используются)
+template <typename Key>
+struct CompactBSTNode {
+    Key key;
+    PackedLink child[2];  // Левый и правый потомки
+
+    CompactBSTNode() : key() {}
+    explicit CompactBSTNode(const Key& key) : key(key) {}
+    explicit CompactBSTNode(Key&& key) : key(std::move(key)) {}
+};
+
+// Бинарное дерево поиска (множество уникальных ключей) в компактном виде: узлы лежат в одном векторе
+// (IndexPool.h) и связаны 32-битными номерами. Узел с ключом int занимает 12 байт против 24 у BST.
+// Как и BST, дерево не балансируется; все операции итеративные. Не больше 2^31 - 1 элементов
+template <typename Key = int, typename Compare = std::less<Key>>
+class CompactBST {
+public:
+    using key_type = Key;
+    using Node = CompactBSTNode<Key>;
+    using Index = typename IndexPool<Node>::Index;
+
+    // Итератор симметричного обхода. Высота не ограничена, поэтому путь хранится в векторе
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Key;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Key*;
+        using reference = const Key&;
+
+        Iterator() : pool(nullptr) {}
+        Iterator(const IndexPool<Node>* pool, Index root) : pool(pool) { pushLeft(root); }
+
+        reference operator*() const { return (*pool)[path.back()].key; }
+        pointer operator->() const { return &(*pool)[path.back()].key; }
+        Iterator& operator++() {
+            Index node = path.back();
+            path.pop_back();
+            pushLeft((*pool)[node].child[1].index());
+            return *this;
+        }
+        Iterator operator++(int) {
+            Iterator copy = *this;
+            ++*this;
+            return copy;
+        }
+        bool operator==(const Iterator& other) const {
+            return path.empty() ? other.path.empty() : !other.path.empty() && path.back() == other.path.back();
+        }
+        bool operator!=(const Iterator& other) const { return !(*this == other); }
+
+    private:
+        const IndexPool<Node>* pool;
+        std::vector<Index> path;  // Узлы, ключи которых еще не выданы; текущий — последний
+
+        void pushLeft(Index node) {
+            for (; node != IndexPool<Node>::kNull; node = (*pool)[node].child[0].index())
+                path.push_back(node);
+        }
+    };
+
+    explicit CompactBST(const Compare& comp = Compare()) : root(kNull), size_(0), comp(comp) {}
+    CompactBST(const CompactBST&) = delete;
+    CompactBST& operator=(const CompactBST&) = delete;
+
+    Iterator begin() const { return Iterator(&pool, root); }
+    Iterator end() const { return Iterator(); }
+    size_t size() const { return size_; }
+    const Compare& keyComp() const { return comp; }
+
+    // Память под count узлов заранее
+    void reserve(size_t count) { pool.reserve(count); }
+    // Байт, занятых узлами
+    size_t memoryUsage() const { return pool.memoryUsage(); }
+
+    // Поиск ключа
+    template <typename K>
+    bool contains(const K& key) const {
+        Index node = root;
+        while (node != kNull) {
+            const Node& current = pool[node];
+            if (comp(key, current.key))
+                node = current.child[0].index();
+            else if (comp(current.key, key))
+                node = current.child[1].index();
+            else
+                return true;
+        }
+        return false;
+    }
+
+    // Вставка ключа; возвращает false, если он уже есть
+    bool insert(const Key& key) {
+        Index parent = kNull;
+        int dir = 0;
+        for (Index node = root; node != kNull;) {
+            const Node& current = pool[node];
+            if (comp(key, current.key))
+                dir = 0;
+            else if (comp(current.key, key))
+                dir = 1;
+            else
+                return false;
+            parent = node;
+            node = current.child[dir].index();
+        }
+        Index fresh = pool.create(key);  // Может перенести узлы: ссылки на них берутся заново
+        if (parent == kNull)
+            root = fresh;
+        else
+            pool[parent].child[dir].setIndex(fresh);
+        ++size_;
+        return true;
+    }
+
+    // Удаление ключа; возвращает false, если его нет
+    template <typename K>
+    bool erase(const K& key) {
+        Index parent = kNull;
+        int dir = 0;
+        Index node = root;
+        while (node != kNull) {
+            const Node& current = pool[node];
+            int next;
+            if (comp(key, current.key))
+                next = 0;
+            else if (comp(current.key, key))
+                next = 1;
+            else
+                break;
+            parent = node;
+            dir = next;
+            node = current.child[next].index();
+        }
+        if (node == kNull)
+            return false;
+
+        if (pool[node].child[0].index() != kNull && pool[node].child[1].index() != kNull) {
+            // Два потомка: сюда переносится минимальный ключ правого поддерева, удаляется его узел
+            Index target = node;
+            parent = node;
+            dir = 1;
+            node = pool[node].child[1].index();
+            while (pool[node].child[0].index() != kNull) {
+                parent = node;
+                dir = 0;
+                node = pool[node].child[0].index();
+            }
+            pool[target].key = std::move(pool[node].key);
+        }
+        // Единственный потомок занимает место узла
+        Index left = pool[node].child[0].index();
+        Index child = left != kNull ? left : pool[node].child[1].index();
+        if (parent == kNull)
+            root = child;
+        else
+            pool[parent].child[dir].setIndex(child);
+        pool.destroy(node);
+        --size_;
+        return true;
+    }
+
+    // Удаление всех узлов: память пула отдается целиком, без обхода
+    void clear() {
+        pool.release();
+        root = kNull;
+        size_ = 0;
+    }
+
+    // Замена содержимого ключами из [first, last), отсортированными по возрастанию без повторов.
+    // Дерево строится идеально сбалансированным за O(n)
+    template <typename ForwardIt>
+    void buildFromSorted(ForwardIt first, ForwardIt last) {
+        buildCounted(first, std::distance(first, last));
+    }
+
+    // Снимок дерева в поток (формат — в Snapshot.h)
+    void save(std::ostream& out, SnapshotEncoding encoding = SnapshotEncoding::Compact) const {
+        saveSnapshot<SetEntry<Key>>(out, begin(), end(), size_, encoding);
+    }
+    // Замена содержимого снимком из потока; при ошибке исключение, дерево остается пустым
+    void load(std::istream& in) {
+        try {
+            SnapshotReader<SetEntry<Key>, Compare> reader(in, comp, true);
+            buildCounted(reader.begin(), reader.size());
+            reader.finish();
+        }
+        catch (...) {
+            clear();
+            throw;
+        }
+    }
+
+private:
+    static constexpr Index kNull = IndexPool<Node>::kNull;
+
+    IndexPool<Node> pool;
+    Index root;
+    size_t size_;
+    Compare comp;
+
+    // Замена содержимого count ключами, читаемыми по порядку с it: хватает однопроходного итератора
+    template <typename InputIt>
+    void buildCounted(InputIt it, size_t count) {
+        clear();
+        try {
+            pool.reserve(count);
+            root = buildBalanced(it, count);
+        }
+        catch (...) {
+            clear();
+            throw;
+        }
+        size_ = count;
+    }
+    // Сбалансированное поддерево из count ключей; глубина рекурсии — log2(count)
+    template <typename It>
+    Index buildBalanced(It& it, size_t count) {
+        if (count == 0)
+            return kNull;
+        size_t leftCount = count / 2;
+        Index left = buildBalanced(it, leftCount);
+        Index node = pool.create(*it);
+        ++it;
+        Index right = buildBalanced(it, count - leftCount - 1);
+        pool[node].child[0].setIndex(left);
+        pool[node].child[1].setIndex(right);
+        return node;
+    }
+};
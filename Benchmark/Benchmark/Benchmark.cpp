@@ -0,0 +1,715 @@
+﻿#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Workload.h"
+#include "Stats.h"
+#include "TreeAdapters.h"
+#include "LoadGenerator.h"
+#include "../../Common/FrozenIndex.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// Общий стенд для всех деревьев: одинаковые нагрузки, задержка каждой операции
+// в наносекундах, перцентили, пропускная способность и пиковая память.
+//
+// Параметры запуска:
+//   --sizes 1000,10000,...  размеры дерева перед измерением (по умолчанию 1e3..1e8)
+//   --max-size N            отбросить размеры больше N (по умолчанию 1000000)
+//   --ops N                 число измеряемых операций на прогон (по умолчанию 200000)
+//   --trees bst,avl,rb,btree,bplus,splay
+//                           а также stdmap,avlmap,rbmap,btreemap — словари с интерфейсом std::map,
+//                           packed — B+дерево со сжатыми листьями и радиксным каталогом (PackedBPlusTree.h),
+//                           cbtree — параллельное B-дерево, lockedbtree — B-дерево под shared_mutex
+//                           (lockedbtree — только вместе с --threads), disk — B-дерево в файле (DiskBTree),
+//                           compactbst,compactavl,compactrb — деревья на 32-битных номерах узлов (IndexPool.h),
+//                           pavl,prb — персистентные деревья с копированием пути (PersistentTree.h)
+//   --threads 1,2,4,...     дополнительно прогнать cbtree, lockedbtree, pavl и prb в нескольких потоках:
+//                           операции нагрузки делятся между потоками поровну
+//   --alloc slab,arena,std  политики выделения узлов (по умолчанию slab)
+//   --btree-degree T        минимальная степень B-дерева: 2, 4, 8, 16 (по умолчанию), 32, 64 или 128
+//   --bst-seq-limit N       предел размера BST на последовательных ключах (по умолчанию 20000)
+//   --batch N               дополнительно сравнить на avl, rb и btree поиск пакетами по N ключей
+//                           (searchBatch) с поиском тех же ключей по одному: нагрузки batchN и lookup
+//   --frozen on             дополнительно сравнить на bst, avl, rb и btree поиск в дереве с поиском в его
+//                           неизменяемых копиях-массивах (FrozenIndex.h): нагрузки lookup, eytzinger и veb
+//   --load auto|R1,R2,...   открытый цикл вместо обычных прогонов (LoadGenerator.h): операции идут по расписанию
+//                           с заданной частотой (оп/с на все потоки), задержка — от запланированного начала.
+//                           auto — ступени от 10% до 125% пропускной способности, измеренной замкнутым циклом.
+//                           Ступени повторяются для каждого числа потоков из --threads (по умолчанию 1);
+//                           деревья без поддержки потоков работают под общим мьютексом. Для каждого дерева
+//                           печатается колено — наибольшая частота, которую оно держит без взлета p99
+//   --dists sequential,random,zipf   распределения ключей (по умолчанию все)
+//   --mixes read-heavy,mixed,write-heavy,churn   нагрузки (по умолчанию все)
+//   --build MODE            начальное заполнение: insert — вставками по одному (по умолчанию),
+//                           sorted — сортировка ключей и buildFromSorted, parallel — то же в несколько потоков
+//   --hw-counters on        аппаратные счетчики (промахи кэша, ошибки предсказания переходов) на однопоточных
+//                           прогонах; только Linux, perf_event_open. Счетчики самих деревьев (сравнения, повороты,
+//                           деления узлов) попадают в JSON, если стенд собран с TREE_STATS (TreeStats.h)
+//   --seed S
+//   --csv FILE, --json FILE файлы с результатами (benchmark_results.csv/.json)
+
+struct Config {
+    vector<size_t> sizes{ 1000, 10000, 100000, 1000000, 10000000, 100000000 };
+    size_t maxSize = 1000000;
+    size_t ops = 200000;
+    vector<string> trees{ "bst", "avl", "rb", "btree", "bplus", "splay" };
+    vector<string> allocators{ "slab" };
+    // BST без балансировки на возрастающих ключах вырождается в список:
+    // каждая операция стоит O(n), а рекурсия уходит на глубину n.
+    // Предел сравнивается с итоговым размером дерева (загрузка + вставки нагрузки)
+    size_t bstSequentialLimit = 20000;
+    int btreeDegree = kBTreeDefaultDegree;
+    vector<unsigned> threads;
+    string build = "insert";
+    size_t batch = 0;  // Размер пакета для сравнения пакетного поиска; 0 — не сравнивать
+    bool frozen = false;  // Сравнить поиск в дереве и в его замороженных копиях
+    bool hardwareCounters = false;
+    bool load = false;           // Открытый цикл (--load)
+    vector<double> loadRates;    // Частоты ступеней по возрастанию; пусто — от измеренной пропускной способности
+    vector<string> distributions;  // Пусто — все
+    vector<string> mixes;          // Пусто — все
+    uint64_t seed = 42;
+    string csvPath = "benchmark_results.csv";
+    string jsonPath = "benchmark_results.json";
+};
+
+static vector<string> splitList(const string& s) {
+    vector<string> items;
+    stringstream ss(s);
+    string item;
+    while (getline(ss, item, ','))
+        if (!item.empty())
+            items.push_back(item);
+    return items;
+}
+
+static Config parseArgs(int argc, char** argv) {
+    Config cfg;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (i + 1 >= argc) {
+            cerr << "Не задано значение параметра " << arg << endl;
+            exit(1);
+        }
+        string value = argv[++i];
+        if (arg == "--sizes") {
+            cfg.sizes.clear();
+            for (const string& s : splitList(value))
+                cfg.sizes.push_back(static_cast<size_t>(stod(s)));  // допускаем запись вида 1e6
+            cfg.maxSize = SIZE_MAX;
+        }
+        else if (arg == "--max-size")
+            cfg.maxSize = static_cast<size_t>(stod(value));
+        else if (arg == "--ops")
+            cfg.ops = static_cast<size_t>(stod(value));
+        else if (arg == "--trees")
+            cfg.trees = splitList(value);
+        else if (arg == "--alloc")
+            cfg.allocators = splitList(value);
+        else if (arg == "--btree-degree")
+            cfg.btreeDegree = stoi(value);
+        else if (arg == "--bst-seq-limit")
+            cfg.bstSequentialLimit = static_cast<size_t>(stod(value));
+        else if (arg == "--threads") {
+            cfg.threads.clear();
+            for (const string& s : splitList(value))
+                cfg.threads.push_back(static_cast<unsigned>(stoul(s)));
+        }
+        else if (arg == "--build")
+            cfg.build = value;
+        else if (arg == "--batch")
+            cfg.batch = static_cast<size_t>(stod(value));
+        else if (arg == "--frozen")
+            cfg.frozen = value == "on" || value == "1";
+        else if (arg == "--load") {
+            cfg.load = true;
+            cfg.loadRates.clear();
+            if (value != "auto")
+                for (const string& s : splitList(value))
+                    cfg.loadRates.push_back(stod(s));
+            sort(cfg.loadRates.begin(), cfg.loadRates.end());
+        }
+        else if (arg == "--dists")
+            cfg.distributions = splitList(value);
+        else if (arg == "--mixes")
+            cfg.mixes = splitList(value);
+        else if (arg == "--hw-counters")
+            cfg.hardwareCounters = value == "on" || value == "1";
+        else if (arg == "--seed")
+            cfg.seed = stoull(value);
+        else if (arg == "--csv")
+            cfg.csvPath = value;
+        else if (arg == "--json")
+            cfg.jsonPath = value;
+        else {
+            cerr << "Неизвестный параметр " << arg << endl;
+            exit(1);
+        }
+    }
+    return cfg;
+}
+
+// Не дает компилятору выбросить результаты поиска
+static volatile size_t sink;
+
+// Снимать ли аппаратные счетчики (--hw-counters)
+static bool measureHardware = false;
+
+// Счетчики дерева (TreeStats.h) есть не у всех адаптеров: выбор перегрузки по наличию tree.stats()
+template <typename Adapter>
+auto resetTreeStats(Adapter& adapter, int) -> decltype(adapter.tree.resetStats()) {
+    adapter.tree.resetStats();
+}
+template <typename Adapter>
+void resetTreeStats(Adapter&, long) {}
+
+template <typename Adapter>
+auto treeStatsJson(const Adapter& adapter, int) -> decltype(adapter.tree.stats(), string()) {
+    if (!TreeCounters::kEnabled)
+        return string();
+    ostringstream out;
+    writeJson(out, adapter.tree.stats());
+    return out.str();
+}
+template <typename Adapter>
+string treeStatsJson(const Adapter&, long) {
+    return string();
+}
+
+// Начальное заполнение дерева ключами нагрузки; возвращает затраченное время в мс
+template <typename Adapter>
+double fillTree(Adapter& tree, const Workload& w, const string& build) {
+    auto buildStart = steady_clock::now();
+    if (build == "insert") {
+        for (int key : w.preload)
+            tree.insert(key);
+    }
+    else {
+        // Сортировка входит в измеренное время: с нее начинается любая перестройка индекса
+        vector<int> keys(w.preload);
+        sort(keys.begin(), keys.end());
+        keys.erase(unique(keys.begin(), keys.end()), keys.end());
+        tree.build(keys.begin(), keys.end(), build == "parallel");
+    }
+    return duration<double, milli>(steady_clock::now() - buildStart).count();
+}
+
+// Один прогон: заполнение дерева и измерение каждой операции нагрузки.
+// При threads > 1 операции делятся между потоками на равные непрерывные части, потоки стартуют
+// одновременно, а пропускная способность считается по общему времени (дерево должно быть потокобезопасным)
+template <typename Adapter>
+BenchResult runOne(const Workload& w, KeyDistribution dist, const OperationMix& mix, const char* allocatorName,
+                   const string& build, unsigned threads = 1) {
+    BenchResult r;
+    r.tree = Adapter::name();
+    r.allocator = allocatorName;
+    r.distribution = distributionName(dist);
+    r.workload = mix.name;
+    r.size = w.preload.size();
+    r.ops = w.ops.size();
+    r.threads = threads;
+    r.readPercent = mix.readPercent;
+    r.build = build;
+
+    unique_ptr<Adapter> tree(new Adapter());
+    r.buildMs = fillTree(*tree, w, build);
+    resetTreeStats(*tree, 0);  // Считаются только измеряемые операции
+    // Счетчики процессора видят только свой поток, поэтому — только в однопоточном прогоне
+    unique_ptr<HardwareCounters> hardware(measureHardware && threads == 1 ? new HardwareCounters() : nullptr);
+
+    vector<uint64_t> samples(w.ops.size());
+    vector<size_t> found(threads);
+    atomic<bool> go(threads == 1);
+    auto worker = [&](unsigned id) {
+        while (!go.load(memory_order_acquire))
+            this_thread::yield();
+        size_t hits = 0;
+        size_t last = w.ops.size() * (id + 1) / threads;
+        for (size_t i = w.ops.size() * id / threads; i < last; ++i) {
+            const Operation& op = w.ops[i];
+            auto start = steady_clock::now();
+            if (op.type == OpType::Read)
+                hits += tree->contains(op.key);
+            else if (op.type == OpType::Insert)
+                tree->insert(op.key);
+            else
+                hits += tree->erase(op.key);
+            auto end = steady_clock::now();
+            samples[i] = static_cast<uint64_t>(duration_cast<nanoseconds>(end - start).count());
+        }
+        found[id] = hits;
+    };
+    vector<thread> pool;
+    for (unsigned id = 1; id < threads; ++id)
+        pool.emplace_back(worker, id);
+    auto runStart = steady_clock::now();
+    go.store(true, memory_order_release);
+    if (hardware)
+        hardware->start();
+    worker(0);
+    if (hardware)
+        r.hardware = hardware->stop();
+    for (thread& t : pool)
+        t.join();
+    double seconds = duration<double>(steady_clock::now() - runStart).count();
+    size_t hits = 0;
+    for (size_t f : found)
+        hits += f;
+    sink = hits;
+
+    r.treeStats = treeStatsJson(*tree, 0);
+
+    auto teardownStart = steady_clock::now();
+    tree.reset();
+    r.teardownMs = duration<double, milli>(steady_clock::now() - teardownStart).count();
+
+    r.latency = summarize(samples);
+    r.opsPerSec = seconds > 0 ? w.ops.size() / seconds : 0;
+    r.peakRssKb = peakRssKb();
+    return r;
+}
+
+// Поиск всех keys кусками по chunk штук: lookup(keys, count) возвращает число найденных.
+// Задержка ключа — время его куска, деленное на размер куска. r заполнен всем, кроме замеров
+template <typename Lookup>
+BenchResult measureLookups(BenchResult r, const vector<int>& keys, size_t chunk, Lookup lookup) {
+    r.ops = keys.size();
+    r.readPercent = 100;
+    vector<uint64_t> samples(keys.size());
+    size_t hits = 0;
+    auto runStart = steady_clock::now();
+    for (size_t first = 0; first < keys.size(); first += chunk) {
+        size_t count = min(chunk, keys.size() - first);
+        auto start = steady_clock::now();
+        hits += lookup(keys.data() + first, count);
+        auto end = steady_clock::now();
+        uint64_t perKey = static_cast<uint64_t>(duration_cast<nanoseconds>(end - start).count()) / count;
+        fill(samples.begin() + first, samples.begin() + first + count, perKey);
+    }
+    double seconds = duration<double>(steady_clock::now() - runStart).count();
+    sink = hits;
+
+    r.latency = summarize(samples);
+    r.opsPerSec = seconds > 0 ? keys.size() / seconds : 0;
+    r.peakRssKb = peakRssKb();
+    return r;
+}
+
+// Ключи всех операций нагрузки по порядку
+static vector<int> operationKeys(const Workload& w) {
+    vector<int> keys;
+    keys.reserve(w.ops.size());
+    for (const Operation& op : w.ops)
+        keys.push_back(op.key);
+    return keys;
+}
+
+// Строка результата поиска по дереву Adapter, без замеров
+template <typename Adapter>
+BenchResult lookupResult(const Config& cfg, const Workload& w, KeyDistribution dist, const char* allocatorName,
+                         const string& workload, double buildMs) {
+    BenchResult r;
+    r.tree = Adapter::name();
+    r.allocator = allocatorName;
+    r.distribution = distributionName(dist);
+    r.workload = workload;
+    r.size = w.preload.size();
+    r.build = cfg.build;
+    r.buildMs = buildMs;
+    return r;
+}
+
+// Пакетный поиск против поиска по одному на одном и том же дереве: ключи всех операций нагрузки
+// ищутся кусками по cfg.batch штук — циклом по contains (нагрузка lookup) и одним вызовом
+// containsBatch (нагрузка batchN)
+template <typename Adapter, typename Record>
+void runBatchLookups(const Config& cfg, const Workload& w, KeyDistribution dist, const char* allocatorName,
+                     Record record) {
+    unique_ptr<Adapter> tree(new Adapter());
+    double buildMs = fillTree(*tree, w, cfg.build);
+    vector<int> keys = operationKeys(w);
+
+    record(measureLookups(lookupResult<Adapter>(cfg, w, dist, allocatorName, "lookup", buildMs), keys, cfg.batch,
+                          [&](const int* batch, size_t count) {
+                              size_t hits = 0;
+                              for (size_t i = 0; i < count; ++i)
+                                  hits += tree->contains(batch[i]);
+                              return hits;
+                          }));
+    record(measureLookups(lookupResult<Adapter>(cfg, w, dist, allocatorName, "batch" + to_string(cfg.batch), buildMs),
+                          keys, cfg.batch, [&](const int* batch, size_t count) {
+                              return tree->containsBatch(batch, count);
+                          }));
+}
+
+// Поиск в дереве против поиска в его замороженных копиях (FrozenIndex.h): ключи всех операций нагрузки
+// ищутся в самом дереве (нагрузка lookup) и в копиях в раскладках Эйтцингера и ван Эмде Боаса
+// (нагрузки eytzinger и veb). У копий build_ms — время заморозки. Ключи ищутся кусками по cfg.batch
+// штук (без --batch — по 64), чтобы вызов часов не тонул во времени быстрого поиска
+template <typename Adapter, typename Record>
+void runFrozenLookups(const Config& cfg, const Workload& w, KeyDistribution dist, const char* allocatorName,
+                      Record record) {
+    unique_ptr<Adapter> tree(new Adapter());
+    double buildMs = fillTree(*tree, w, cfg.build);
+    vector<int> keys = operationKeys(w);
+    size_t chunk = cfg.batch != 0 ? cfg.batch : 64;
+
+    record(measureLookups(lookupResult<Adapter>(cfg, w, dist, allocatorName, "lookup", buildMs), keys, chunk,
+                          [&](const int* batch, size_t count) {
+                              size_t hits = 0;
+                              for (size_t i = 0; i < count; ++i)
+                                  hits += tree->contains(batch[i]);
+                              return hits;
+                          }));
+    const pair<FrozenLayout, const char*> layouts[] = { { FrozenLayout::Eytzinger, "eytzinger" },
+                                                        { FrozenLayout::VanEmdeBoas, "veb" } };
+    for (const auto& layout : layouts) {
+        auto freezeStart = steady_clock::now();
+        auto frozen = freeze(tree->tree, layout.first);
+        double freezeMs = duration<double, milli>(steady_clock::now() - freezeStart).count();
+        BenchResult r = measureLookups(lookupResult<Adapter>(cfg, w, dist, allocatorName, layout.second, freezeMs),
+                                       keys, chunk, [&](const int* batch, size_t count) {
+                                           size_t hits = 0;
+                                           for (size_t i = 0; i < count; ++i)
+                                               hits += frozen.contains(batch[i]);
+                                           return hits;
+                                       });
+        record(r);
+        cout << Adapter::name() << ": " << layout.second << " занимает " << fixed << setprecision(2)
+             << (frozen.size() != 0 ? static_cast<double>(frozen.memoryBytes()) / frozen.size() : 0.0)
+             << " байт на ключ" << endl;
+    }
+}
+
+// Степень B-дерева задана при компиляции, поэтому стенд собран для нескольких степеней,
+// а run получает выбранную как std::integral_constant. false — такой степени нет среди собранных
+template <typename Run>
+static bool withBTreeDegree(int degree, Run run) {
+    switch (degree) {
+    case 2: run(integral_constant<int, 2>()); return true;
+    case 4: run(integral_constant<int, 4>()); return true;
+    case 8: run(integral_constant<int, 8>()); return true;
+    case 16: run(integral_constant<int, 16>()); return true;
+    case 32: run(integral_constant<int, 32>()); return true;
+    case 64: run(integral_constant<int, 64>()); return true;
+    case 128: run(integral_constant<int, 128>()); return true;
+    default: return false;
+    }
+}
+
+static bool wanted(const Config& cfg, const string& tree) {
+    for (const string& t : cfg.trees)
+        if (t == tree)
+            return true;
+    return false;
+}
+
+// Есть ли name в списке-фильтре; пустой список пропускает все
+static bool selected(const vector<string>& filter, const string& name) {
+    return filter.empty() || find(filter.begin(), filter.end(), name) != filter.end();
+}
+
+static void printRow(const BenchResult& r) {
+    cout << left << setw(12) << r.tree << setw(7) << r.allocator << setw(12) << r.distribution << setw(12) << r.workload
+         << right << setw(11) << r.size << setw(5) << r.threads << fixed << setprecision(1)
+         << setw(11) << r.latency.meanNs << setw(9) << r.latency.p50Ns
+         << setw(9) << r.latency.p99Ns << setw(10) << r.latency.p999Ns
+         << setw(14) << setprecision(0) << r.opsPerSec << setw(12) << r.peakRssKb;
+    if (r.targetOpsPerSec > 0)
+        cout << "  цель " << r.targetOpsPerSec;
+    cout << endl;
+}
+
+// Доли пропускной способности замкнутого цикла для ступеней --load auto
+static const double kLoadFractions[] = { 0.1, 0.25, 0.5, 0.6, 0.7, 0.8, 0.9, 1.0, 1.1, 1.25 };
+
+// Открытый цикл на одном дереве: для каждого числа потоков — ступени частоты по возрастанию,
+// на каждой ступени дерево строится заново. concurrent — дерево потокобезопасно, иначе
+// при нескольких потоках операции идут под общим мьютексом
+template <typename Adapter, typename Record>
+void runLoadSweep(const Config& cfg, const Workload& w, KeyDistribution dist, const OperationMix& mix,
+                  const char* allocatorName, bool concurrent, Record record) {
+    vector<unsigned> threadCounts;
+    for (unsigned threads : cfg.threads)
+        if (threads != 0)
+            threadCounts.push_back(threads);
+    if (threadCounts.empty())
+        threadCounts.push_back(1);
+    for (unsigned threads : threadCounts) {
+        vector<double> rates = cfg.loadRates;
+        if (rates.empty()) {
+            // Под мьютексом потоки не добавляют пропускной способности: мерим в одном
+            double capacity = runOne<Adapter>(w, dist, mix, allocatorName, cfg.build, concurrent ? threads : 1).opsPerSec;
+            for (double fraction : kLoadFractions)
+                rates.push_back(capacity * fraction);
+        }
+        vector<LoadStep> steps;
+        for (double rate : rates) {
+            if (rate <= 0)
+                continue;
+            unique_ptr<Adapter> tree(new Adapter());
+            BenchResult r;
+            r.tree = Adapter::name();
+            r.allocator = allocatorName;
+            r.distribution = distributionName(dist);
+            r.workload = mix.name;
+            r.size = w.preload.size();
+            r.ops = w.ops.size();
+            r.threads = threads;
+            r.readPercent = mix.readPercent;
+            r.build = cfg.build;
+            r.buildMs = fillTree(*tree, w, cfg.build);
+
+            LoadStep step = runOpenLoop(*tree, w.ops, rate, threads, !concurrent);
+            sink = step.found;
+            r.targetOpsPerSec = rate;
+            r.opsPerSec = step.achievedOpsPerSec;
+            r.latency = step.latency.summary();
+            r.serviceP99Ns = step.service.percentile(0.99);
+            r.peakRssKb = peakRssKb();
+            record(r);
+            steps.push_back(move(step));
+        }
+        int knee = findKnee(steps);
+        cout << Adapter::name() << ", потоков " << threads << ": ";
+        if (knee < 0)
+            cout << "не держит и самой низкой частоты" << endl;
+        else
+            cout << "колено на " << fixed << setprecision(0) << steps[knee].targetOpsPerSec << " оп/с, p99 "
+                 << steps[knee].latency.percentile(0.99) << " нс" << endl;
+    }
+}
+
+// Открытый цикл на выбранных деревьях с политикой выделения NodeAllocator
+template <typename NodeAllocator, typename Record>
+void runLoadTrees(const Config& cfg, const Workload& w, KeyDistribution dist, const OperationMix& mix,
+                  const char* allocatorName, Record record) {
+    size_t finalSize = w.preload.size() + cfg.ops * (100 - mix.readPercent - mix.erasePercent) / 100;
+    if (wanted(cfg, "bst")) {
+        if (dist == KeyDistribution::Sequential && finalSize > cfg.bstSequentialLimit)
+            cout << "BST: пропуск sequential/" << mix.name << " при размере " << w.preload.size() << " (вырожденное дерево)" << endl;
+        else
+            runLoadSweep<BSTAdapter<NodeAllocator>>(cfg, w, dist, mix, allocatorName, false, record);
+    }
+    if (wanted(cfg, "avl"))
+        runLoadSweep<AVLAdapter<NodeAllocator>>(cfg, w, dist, mix, allocatorName, false, record);
+    if (wanted(cfg, "rb"))
+        runLoadSweep<RedBlackAdapter<NodeAllocator>>(cfg, w, dist, mix, allocatorName, false, record);
+    if (wanted(cfg, "btree")) {
+        withBTreeDegree(cfg.btreeDegree, [&](auto degree) {
+            runLoadSweep<BTreeAdapter<NodeAllocator, decltype(degree)::value>>(cfg, w, dist, mix, allocatorName, false, record);
+        });
+    }
+    if (wanted(cfg, "bplus"))
+        runLoadSweep<BPlusTreeAdapter<NodeAllocator>>(cfg, w, dist, mix, allocatorName, false, record);
+    if (wanted(cfg, "packed"))
+        runLoadSweep<PackedBPlusTreeAdapter<NodeAllocator>>(cfg, w, dist, mix, allocatorName, false, record);
+    if (wanted(cfg, "splay"))
+        runLoadSweep<SplayAdapter<NodeAllocator>>(cfg, w, dist, mix, allocatorName, false, record);
+    if (wanted(cfg, "cbtree"))
+        runLoadSweep<ConcurrentBTreeAdapter<NodeAllocator>>(cfg, w, dist, mix, allocatorName, true, record);
+    if (wanted(cfg, "lockedbtree"))
+        runLoadSweep<LockedBTreeAdapter<NodeAllocator>>(cfg, w, dist, mix, allocatorName, true, record);
+    // Эти деревья не зависят от политики выделения: прогоняются один раз, вместе с первой политикой
+    if (cfg.allocators.front() != allocatorName)
+        return;
+    if (wanted(cfg, "stdmap"))
+        runLoadSweep<StdMapAdapter>(cfg, w, dist, mix, "std", false, record);
+    if (wanted(cfg, "pavl"))
+        runLoadSweep<PersistentAVLAdapter>(cfg, w, dist, mix, "std", true, record);
+    if (wanted(cfg, "prb"))
+        runLoadSweep<PersistentRedBlackAdapter>(cfg, w, dist, mix, "std", true, record);
+}
+
+// Прогон одной нагрузки на всех выбранных деревьях с политикой выделения NodeAllocator
+template <typename NodeAllocator, typename Record>
+void runTrees(const Config& cfg, const Workload& w, KeyDistribution dist, const OperationMix& mix,
+              const char* allocatorName, Record record) {
+    if (cfg.load) {
+        runLoadTrees<NodeAllocator>(cfg, w, dist, mix, allocatorName, record);
+        return;
+    }
+    size_t finalSize = w.preload.size() + cfg.ops * (100 - mix.readPercent - mix.erasePercent) / 100;
+    bool bstDegenerate = dist == KeyDistribution::Sequential && finalSize > cfg.bstSequentialLimit;
+    if (wanted(cfg, "bst")) {
+        if (bstDegenerate)
+            cout << "BST: пропуск sequential/" << mix.name << " при размере " << w.preload.size() << " (вырожденное дерево)" << endl;
+        else
+            record(runOne<BSTAdapter<NodeAllocator>>(w, dist, mix, allocatorName, cfg.build));
+    }
+    if (wanted(cfg, "avl"))
+        record(runOne<AVLAdapter<NodeAllocator>>(w, dist, mix, allocatorName, cfg.build));
+    if (wanted(cfg, "rb"))
+        record(runOne<RedBlackAdapter<NodeAllocator>>(w, dist, mix, allocatorName, cfg.build));
+    if (wanted(cfg, "btree")) {
+        withBTreeDegree(cfg.btreeDegree, [&](auto degree) {
+            record(runOne<BTreeAdapter<NodeAllocator, decltype(degree)::value>>(w, dist, mix, allocatorName, cfg.build));
+        });
+    }
+    if (wanted(cfg, "bplus"))
+        record(runOne<BPlusTreeAdapter<NodeAllocator>>(w, dist, mix, allocatorName, cfg.build));
+    if (wanted(cfg, "packed"))
+        record(runOne<PackedBPlusTreeAdapter<NodeAllocator>>(w, dist, mix, allocatorName, cfg.build));
+    if (wanted(cfg, "splay"))
+        record(runOne<SplayAdapter<NodeAllocator>>(w, dist, mix, allocatorName, cfg.build));
+    // std::map не зависит от политики выделения: прогоняется один раз, вместе с первой политикой
+    if (wanted(cfg, "stdmap") && cfg.allocators.front() == allocatorName)
+        record(runOne<StdMapAdapter>(w, dist, mix, "std", cfg.build));
+    // Дисковое дерево держит узлы в кэше страниц, политика выделения к нему тоже не относится
+    if (wanted(cfg, "disk") && cfg.allocators.front() == allocatorName)
+        record(runOne<DiskBTreeAdapter>(w, dist, mix, "page", cfg.build));
+    // Компактные деревья держат узлы в своем пуле — тоже один прогон
+    if (cfg.allocators.front() == allocatorName) {
+        if (wanted(cfg, "compactbst") && !bstDegenerate)
+            record(runOne<CompactBSTAdapter>(w, dist, mix, "pool", cfg.build));
+        if (wanted(cfg, "compactavl"))
+            record(runOne<CompactAVLAdapter>(w, dist, mix, "pool", cfg.build));
+        if (wanted(cfg, "compactrb"))
+            record(runOne<CompactRedBlackAdapter>(w, dist, mix, "pool", cfg.build));
+    }
+    // Персистентные деревья выделяют узлы только через StdNodeAllocator — тоже один прогон
+    bool persistentRun = cfg.allocators.front() == allocatorName;
+    if (wanted(cfg, "pavl") && persistentRun && cfg.threads.empty())
+        record(runOne<PersistentAVLAdapter>(w, dist, mix, "std", cfg.build));
+    if (wanted(cfg, "prb") && persistentRun && cfg.threads.empty())
+        record(runOne<PersistentRedBlackAdapter>(w, dist, mix, "std", cfg.build));
+    if (wanted(cfg, "avlmap"))
+        record(runOne<AVLMapAdapter<NodeAllocator>>(w, dist, mix, allocatorName, cfg.build));
+    if (wanted(cfg, "rbmap"))
+        record(runOne<RedBlackMapAdapter<NodeAllocator>>(w, dist, mix, allocatorName, cfg.build));
+    if (wanted(cfg, "btreemap"))
+        record(runOne<BTreeMapAdapter<NodeAllocator>>(w, dist, mix, allocatorName, cfg.build));
+    // С --threads параллельные деревья прогоняются только в заданном числе потоков
+    if (wanted(cfg, "cbtree") && cfg.threads.empty())
+        record(runOne<ConcurrentBTreeAdapter<NodeAllocator>>(w, dist, mix, allocatorName, cfg.build));
+    for (unsigned threads : cfg.threads) {
+        if (threads == 0)
+            continue;
+        if (wanted(cfg, "cbtree"))
+            record(runOne<ConcurrentBTreeAdapter<NodeAllocator>>(w, dist, mix, allocatorName, cfg.build, threads));
+        if (wanted(cfg, "lockedbtree"))
+            record(runOne<LockedBTreeAdapter<NodeAllocator>>(w, dist, mix, allocatorName, cfg.build, threads));
+        if (wanted(cfg, "pavl") && persistentRun)
+            record(runOne<PersistentAVLAdapter>(w, dist, mix, "std", cfg.build, threads));
+        if (wanted(cfg, "prb") && persistentRun)
+            record(runOne<PersistentRedBlackAdapter>(w, dist, mix, "std", cfg.build, threads));
+    }
+}
+
+// Сравнения поиска: пакетного с поиском по одному (--batch) на деревьях, у которых он есть,
+// и поиска в дереве с поиском в его замороженных копиях (--frozen)
+template <typename NodeAllocator, typename Record>
+void runLookupTrees(const Config& cfg, const Workload& w, KeyDistribution dist, const char* allocatorName, Record record) {
+    if (cfg.batch != 0) {
+        if (wanted(cfg, "avl"))
+            runBatchLookups<AVLAdapter<NodeAllocator>>(cfg, w, dist, allocatorName, record);
+        if (wanted(cfg, "rb"))
+            runBatchLookups<RedBlackAdapter<NodeAllocator>>(cfg, w, dist, allocatorName, record);
+        if (wanted(cfg, "btree")) {
+            withBTreeDegree(cfg.btreeDegree, [&](auto degree) {
+                runBatchLookups<BTreeAdapter<NodeAllocator, decltype(degree)::value>>(cfg, w, dist, allocatorName, record);
+            });
+        }
+    }
+    if (cfg.frozen) {
+        if (wanted(cfg, "bst")) {
+            if (dist == KeyDistribution::Sequential && w.preload.size() > cfg.bstSequentialLimit)
+                cout << "BST: пропуск sequential/frozen при размере " << w.preload.size() << " (вырожденное дерево)" << endl;
+            else
+                runFrozenLookups<BSTAdapter<NodeAllocator>>(cfg, w, dist, allocatorName, record);
+        }
+        if (wanted(cfg, "avl"))
+            runFrozenLookups<AVLAdapter<NodeAllocator>>(cfg, w, dist, allocatorName, record);
+        if (wanted(cfg, "rb"))
+            runFrozenLookups<RedBlackAdapter<NodeAllocator>>(cfg, w, dist, allocatorName, record);
+        if (wanted(cfg, "btree")) {
+            withBTreeDegree(cfg.btreeDegree, [&](auto degree) {
+                runFrozenLookups<BTreeAdapter<NodeAllocator, decltype(degree)::value>>(cfg, w, dist, allocatorName, record);
+            });
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    setlocale(LC_ALL, "Russian");
+    Config cfg = parseArgs(argc, argv);
+    if (cfg.build != "insert" && cfg.build != "sorted" && cfg.build != "parallel") {
+        cerr << "Неизвестный способ заполнения " << cfg.build << endl;
+        return 1;
+    }
+    if (!withBTreeDegree(cfg.btreeDegree, [](auto) {})) {
+        cerr << "Стенд собран для степеней B-дерева 2, 4, 8, 16, 32, 64 и 128, а не " << cfg.btreeDegree << endl;
+        return 1;
+    }
+    measureHardware = cfg.hardwareCounters;
+    if (measureHardware && !HardwareCounters().available())
+        cerr << "Аппаратные счетчики недоступны (нужен Linux и разрешение perf_event_paranoid)" << endl;
+
+    const KeyDistribution distributions[] = { KeyDistribution::Sequential, KeyDistribution::Uniform, KeyDistribution::Zipf };
+    // churn: вставки и удаления поровну, размер дерева держится около исходного
+    const OperationMix mixes[] = { { "read-heavy", 95, 0 }, { "mixed", 50, 0 }, { "write-heavy", 5, 0 }, { "churn", 50, 25 } };
+
+    cout << left << setw(12) << "tree" << setw(7) << "alloc" << setw(12) << "keys" << setw(12) << "workload"
+         << right << setw(11) << "size" << setw(5) << "thr" << setw(11) << "ns/op" << setw(9) << "p50"
+         << setw(9) << "p99" << setw(10) << "p999" << setw(14) << "ops/sec" << setw(12) << "rss_kb" << endl;
+
+    vector<BenchResult> results;
+    auto record = [&](const BenchResult& r) {
+        results.push_back(r);
+        printRow(r);
+    };
+    for (size_t size : cfg.sizes) {
+        if (size == 0 || size > cfg.maxSize)
+            continue;
+        for (KeyDistribution dist : distributions) {
+            if (!selected(cfg.distributions, distributionName(dist)))
+                continue;
+            for (const OperationMix& mix : mixes) {
+                if (!selected(cfg.mixes, mix.name))
+                    continue;
+                // Одна и та же нагрузка прогоняется на всех деревьях
+                Workload w = makeWorkload(dist, mix, size, cfg.ops, cfg.seed);
+
+                for (const string& alloc : cfg.allocators) {
+                    if (alloc == "slab")
+                        runTrees<SlabNodeAllocator>(cfg, w, dist, mix, "slab", record);
+                    else if (alloc == "arena")
+                        runTrees<ArenaNodeAllocator>(cfg, w, dist, mix, "arena", record);
+                    else if (alloc == "std")
+                        runTrees<StdNodeAllocator>(cfg, w, dist, mix, "std", record);
+                    else
+                        cerr << "Неизвестная политика выделения " << alloc << endl;
+                }
+            }
+            if (cfg.batch == 0 && !cfg.frozen)
+                continue;
+            // Сравнения поиска идут по ключам нагрузки read-heavy: почти все они есть в дереве
+            Workload w = makeWorkload(dist, mixes[0], size, cfg.ops, cfg.seed);
+            for (const string& alloc : cfg.allocators) {
+                if (alloc == "slab")
+                    runLookupTrees<SlabNodeAllocator>(cfg, w, dist, "slab", record);
+                else if (alloc == "arena")
+                    runLookupTrees<ArenaNodeAllocator>(cfg, w, dist, "arena", record);
+                else if (alloc == "std")
+                    runLookupTrees<StdNodeAllocator>(cfg, w, dist, "std", record);
+            }
+        }
+    }
+
+    ofstream csv(cfg.csvPath);
+    writeCsv(csv, results);
+    ofstream json(cfg.jsonPath);
+    writeJson(json, results);
+    cout << "Результаты записаны в " << cfg.csvPath << " и " << cfg.jsonPath << endl;
+    return 0;
+}
@@ -0,0 +1,105 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Stats.h"
+
+#if !defined(__GNUC__) && !defined(__clang__) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Гистограмма задержек в духе HdrHistogram: постоянная память при любом числе замеров и
+// ограниченная относительная ошибка. Значения меньше 2^kSubBits хранятся точно, а каждый
+// следующий двоичный порядок [2^k, 2^(k+1)) делится на 2^(kSubBits-1) равных ячеек, так что
+// ячейка шире значения не больше чем на 1/128. Весь диапазон uint64_t (наносекунды —
+// до сотен лет) укладывается в несколько тысяч счетчиков. Гистограммы потоков складываются (add).
+// Перцентиль — верхняя граница ячейки, в которую он попал: оценка сверху
+class LatencyHistogram {
+public:
+    static constexpr int kSubBits = 8;
+
+    LatencyHistogram() : counts(bucketCount(), 0), total(0), sum(0), max_(0) {}
+
+    void record(uint64_t value) {
+        ++counts[bucketOf(value)];
+        ++total;
+        sum += value;
+        if (value > max_)
+            max_ = value;
+    }
+    void add(const LatencyHistogram& other) {
+        for (size_t i = 0; i < counts.size(); ++i)
+            counts[i] += other.counts[i];
+        total += other.total;
+        sum += other.sum;
+        if (other.max_ > max_)
+            max_ = other.max_;
+    }
+
+    uint64_t count() const { return total; }
+    uint64_t max() const { return max_; }
+    double mean() const { return total != 0 ? static_cast<double>(sum) / total : 0.0; }
+    // Значение, не больше которого доля q замеров (0 <= q <= 1)
+    uint64_t percentile(double q) const {
+        if (total == 0)
+            return 0;
+        uint64_t rank = static_cast<uint64_t>(q * (total - 1)) + 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); ++i) {
+            seen += counts[i];
+            if (seen >= rank)
+                return upperOf(i) < max_ ? upperOf(i) : max_;
+        }
+        return max_;
+    }
+    // Сводка в том же виде, что у summarize по полной выборке (Stats.h)
+    LatencySummary summary() const {
+        LatencySummary s;
+        s.meanNs = mean();
+        s.p50Ns = percentile(0.50);
+        s.p99Ns = percentile(0.99);
+        s.p999Ns = percentile(0.999);
+        s.maxNs = max_;
+        return s;
+    }
+
+private:
+    static constexpr uint64_t kHalf = uint64_t(1) << (kSubBits - 1);
+
+    std::vector<uint64_t> counts;
+    uint64_t total;
+    uint64_t sum;
+    uint64_t max_;
+
+    static size_t bucketCount() { return static_cast<size_t>((64 - kSubBits + 2) * kHalf); }
+    // Номер старшего единичного бита, value > 0
+    static int highestBit(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+        return 63 - __builtin_clzll(value);
+#elif defined(_MSC_VER) && defined(_M_X64)
+        unsigned long index;
+        _BitScanReverse64(&index, value);
+        return static_cast<int>(index);
+#else
+        int bit = 0;
+        while (value >>= 1)
+            ++bit;
+        return bit;
+#endif
+    }
+    // Порядок k делится на ячейки по 2^(k - kSubBits + 1): в номере ячейки — порядок и старшие kSubBits бит
+    static size_t bucketOf(uint64_t value) {
+        if (value < (uint64_t(1) << kSubBits))
+            return static_cast<size_t>(value);
+        int shift = highestBit(value) - kSubBits + 1;
+        return static_cast<size_t>(shift * kHalf + (value >> shift));
+    }
+    // Наибольшее значение, попадающее в ячейку index
+    static uint64_t upperOf(size_t index) {
+        if (index < (size_t(1) << kSubBits))
+            return index;
+        int shift = static_cast<int>(index / kHalf) - 1;
+        uint64_t sub = index % kHalf + kHalf;
+        return ((sub + 1) << shift) - 1;
+    }
+};
@@ -0,0 +1,130 @@
+﻿#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Histogram.h"
+#include "Workload.h"
+
+// Нагрузка с открытым циклом: операции приходят по расписанию с заданной частотой, успевает дерево
+// или нет, — как запросы от множества независимых клиентов.
+// Замкнутый цикл (runOne) начинает следующую операцию, только закончив предыдущую. Когда дерево
+// тормозит, генератор замедляется вместе с ним, и долгая пауза попадает в выборку одной операцией
+// вместо всех, что должны были прийти за это время (coordinated omission): хвост задержек выглядит
+// лучше, чем его увидят клиенты. Здесь операция i запланирована на start + i / rate, и задержка
+// считается от запланированного начала: ожидание за отставшими операциями входит в нее.
+// Операции делятся между потоками по кругу (поток t берет t, t + T, ...), каждый поток ждет
+// своего времени активно, уступая процессор (yield): сон не дает микросекундной точности, а без
+// уступки ждущие потоки отнимают ядро у работающих, если ядер меньше, чем потоков; опоздавшая
+// операция начинается сразу. Задержки копятся в гистограммах (Histogram.h) каждого потока и затем складываются
+
+// Одна ступень: заданная частота и что из нее вышло
+struct LoadStep {
+    double targetOpsPerSec = 0;
+    double achievedOpsPerSec = 0;  // Операций за время от начала расписания до конца последней
+    unsigned threads = 1;
+    size_t found = 0;              // Найдено и удалено ключей: результат, который нельзя выбросить
+    LatencyHistogram latency;      // От запланированного начала до конца операции
+    LatencyHistogram service;      // От фактического начала до конца — то, что видит замкнутый цикл
+};
+
+// Прогон операций ops на дереве с общей частотой rate в threads потоках.
+// serialize — дерево не потокобезопасно: при нескольких потоках операции идут под общим мьютексом,
+// и очередь к нему видна в задержке
+template <typename Adapter>
+LoadStep runOpenLoop(Adapter& tree, const std::vector<Operation>& ops, double rate, unsigned threads, bool serialize) {
+    using Clock = std::chrono::steady_clock;
+    using std::chrono::nanoseconds;
+
+    LoadStep step;
+    step.targetOpsPerSec = rate;
+    step.threads = threads;
+    std::vector<LatencyHistogram> latency(threads);
+    std::vector<LatencyHistogram> service(threads);
+    std::vector<size_t> found(threads);
+    std::mutex mutex;
+    bool lock = serialize && threads > 1;
+    double intervalNs = 1e9 / rate;
+    std::atomic<bool> go(false);
+    Clock::time_point start;
+
+    auto run = [&](const Operation& op) -> size_t {
+        if (op.type == OpType::Read)
+            return tree.contains(op.key);
+        if (op.type == OpType::Insert) {
+            tree.insert(op.key);
+            return 0;
+        }
+        return tree.erase(op.key);
+    };
+    auto worker = [&](unsigned id) {
+        while (!go.load(std::memory_order_acquire))
+            std::this_thread::yield();
+        size_t hits = 0;
+        for (size_t i = id; i < ops.size(); i += threads) {
+            Clock::time_point planned = start + nanoseconds(static_cast<int64_t>(i * intervalNs));
+            Clock::time_point begin = Clock::now();
+            while (begin < planned) {
+                std::this_thread::yield();
+                begin = Clock::now();
+            }
+            if (lock) {
+                std::lock_guard<std::mutex> guard(mutex);
+                hits += run(ops[i]);
+            }
+            else {
+                hits += run(ops[i]);
+            }
+            Clock::time_point end = Clock::now();
+            latency[id].record(static_cast<uint64_t>(std::chrono::duration_cast<nanoseconds>(end - planned).count()));
+            service[id].record(static_cast<uint64_t>(std::chrono::duration_cast<nanoseconds>(end - begin).count()));
+        }
+        found[id] = hits;
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned id = 1; id < threads; ++id)
+        pool.emplace_back(worker, id);
+    // Расписание начинается чуть позже, чтобы все потоки успели дойти до ожидания
+    start = Clock::now() + std::chrono::milliseconds(1);
+    go.store(true, std::memory_order_release);
+    worker(0);
+    for (std::thread& t : pool)
+        t.join();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    for (unsigned id = 0; id < threads; ++id) {
+        step.latency.add(latency[id]);
+        step.service.add(service[id]);
+        step.found += found[id];
+    }
+    step.achievedOpsPerSec = seconds > 0 ? ops.size() / seconds : 0;
+    return step;
+}
+
+// Колено кривой «пропускная способность — задержка»: дерево еще держит заданную частоту
+// (выдает не меньше kKneeThroughput от нее), а p99 выросла не больше чем в kKneeLatencyFactor раз
+// против лучшей из предыдущих ступеней. Лучшая, а не самая легкая: одна пауза планировщика
+// на легкой ступени не должна сдвигать порог
+constexpr double kKneeThroughput = 0.95;
+constexpr double kKneeLatencyFactor = 10;
+
+// Последняя ступень до колена; ступени — по возрастанию частоты. -1 — дерево не держит и самую легкую
+inline int findKnee(const std::vector<LoadStep>& steps) {
+    if (steps.empty())
+        return -1;
+    int knee = -1;
+    double best = 0;
+    for (size_t i = 0; i < steps.size(); ++i) {
+        const LoadStep& step = steps[i];
+        double p99 = static_cast<double>(step.latency.percentile(0.99));
+        if (step.achievedOpsPerSec < kKneeThroughput * step.targetOpsPerSec || (i > 0 && p99 > kKneeLatencyFactor * best))
+            break;
+        best = i == 0 || p99 < best ? p99 : best;
+        knee = static_cast<int>(i);
+    }
+    return knee;
+}
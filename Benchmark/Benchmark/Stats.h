@@ -0,0 +1,136 @@
+﻿#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "../../Common/HardwareCounters.h"
+#include "../../Common/TreeStats.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+// Пиковый размер резидентной памяти процесса в килобайтах
+inline uint64_t peakRssKb() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+        return pmc.PeakWorkingSetSize / 1024;
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;  // На macOS значение в байтах
+#else
+    return usage.ru_maxrss;         // На Linux значение уже в килобайтах
+#endif
+#endif
+}
+
+// Сводка по задержкам одной серии операций
+struct LatencySummary {
+    double meanNs = 0;
+    uint64_t p50Ns = 0;
+    uint64_t p99Ns = 0;
+    uint64_t p999Ns = 0;
+    uint64_t maxNs = 0;
+};
+
+// Перцентили считаются по полной выборке; вектор переупорядочивается
+inline LatencySummary summarize(std::vector<uint64_t>& samples) {
+    LatencySummary s;
+    if (samples.empty())
+        return s;
+    auto at = [&](double q) {
+        size_t idx = static_cast<size_t>(q * (samples.size() - 1));
+        std::nth_element(samples.begin(), samples.begin() + idx, samples.end());
+        return samples[idx];
+    };
+    double total = 0;
+    for (uint64_t v : samples)
+        total += static_cast<double>(v);
+    s.meanNs = total / samples.size();
+    s.p50Ns = at(0.50);
+    s.p99Ns = at(0.99);
+    s.p999Ns = at(0.999);
+    s.maxNs = *std::max_element(samples.begin(), samples.end());
+    return s;
+}
+
+// Результат одного прогона (дерево x распределение x нагрузка x размер)
+struct BenchResult {
+    std::string tree;
+    std::string allocator;  // Политика выделения узлов
+    std::string distribution;
+    std::string workload;
+    size_t size = 0;        // Число ключей, загруженных до начала измерений
+    size_t ops = 0;         // Число измеренных операций
+    unsigned threads = 1;   // Сколько потоков выполняли операции
+    int readPercent = 0;
+    std::string build;      // Способ начального заполнения: insert, sorted или parallel
+    double buildMs = 0;     // Время начального заполнения
+    double teardownMs = 0;  // Время разрушения дерева
+    LatencySummary latency;
+    double opsPerSec = 0;
+    uint64_t peakRssKb = 0;
+    HardwareSample hardware;  // Счетчики процессора за измеряемые операции (--hw-counters)
+    std::string treeStats;    // Счетчики дерева в JSON (TreeStats.h); пусто, если не собирались
+    double targetOpsPerSec = 0;  // Заданная частота открытого цикла (--load); 0 — замкнутый цикл
+    uint64_t serviceP99Ns = 0;   // Открытый цикл: p99 без ожидания в очереди, как ее видит замкнутый цикл
+};
+
+// Среднее на операцию для столбца CSV; пусто, если счетчики не снимались
+inline std::string perOp(const HardwareSample& sample, uint64_t value, size_t ops) {
+    if (!sample.valid || ops == 0)
+        return std::string();
+    return std::to_string(static_cast<double>(value) / ops);
+}
+
+inline void writeCsv(std::ostream& out, const std::vector<BenchResult>& results) {
+    out << "tree,allocator,distribution,workload,size,ops,threads,read_percent,build,build_ms,teardown_ms,"
+           "ns_per_op,p50_ns,p99_ns,p999_ns,max_ns,ops_per_sec,peak_rss_kb,"
+           "cycles_per_op,instructions_per_op,cache_misses_per_op,branch_misses_per_op,target_ops_per_sec,service_p99_ns\n";
+    for (const BenchResult& r : results) {
+        out << r.tree << ',' << r.allocator << ',' << r.distribution << ',' << r.workload << ','
+            << r.size << ',' << r.ops << ',' << r.threads << ',' << r.readPercent << ',' << r.build << ',' << r.buildMs << ',' << r.teardownMs << ','
+            << r.latency.meanNs << ',' << r.latency.p50Ns << ',' << r.latency.p99Ns << ','
+            << r.latency.p999Ns << ',' << r.latency.maxNs << ',' << r.opsPerSec << ','
+            << r.peakRssKb << ',' << perOp(r.hardware, r.hardware.cycles, r.ops) << ','
+            << perOp(r.hardware, r.hardware.instructions, r.ops) << ',' << perOp(r.hardware, r.hardware.cacheMisses, r.ops) << ','
+            << perOp(r.hardware, r.hardware.branchMisses, r.ops) << ',' << r.targetOpsPerSec << ','
+            << r.serviceP99Ns << '\n';
+    }
+}
+
+inline void writeJson(std::ostream& out, const std::vector<BenchResult>& results) {
+    out << "[\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        out << "  {\"tree\": \"" << r.tree << "\", \"allocator\": \"" << r.allocator
+            << "\", \"distribution\": \"" << r.distribution
+            << "\", \"workload\": \"" << r.workload << "\", \"size\": " << r.size
+            << ", \"ops\": " << r.ops << ", \"threads\": " << r.threads << ", \"read_percent\": " << r.readPercent
+            << ", \"build\": \"" << r.build << "\", \"build_ms\": " << r.buildMs << ", \"teardown_ms\": " << r.teardownMs << ", \"ns_per_op\": " << r.latency.meanNs
+            << ", \"p50_ns\": " << r.latency.p50Ns << ", \"p99_ns\": " << r.latency.p99Ns
+            << ", \"p999_ns\": " << r.latency.p999Ns << ", \"max_ns\": " << r.latency.maxNs
+            << ", \"ops_per_sec\": " << r.opsPerSec << ", \"peak_rss_kb\": " << r.peakRssKb;
+        if (r.hardware.valid) {
+            out << ", \"hardware\": ";
+            writeJson(out, r.hardware);
+        }
+        if (!r.treeStats.empty())
+            out << ", \"tree_stats\": " << r.treeStats;
+        if (r.targetOpsPerSec > 0)
+            out << ", \"target_ops_per_sec\": " << r.targetOpsPerSec << ", \"service_p99_ns\": " << r.serviceP99Ns;
+        out << "}" << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "]\n";
+}
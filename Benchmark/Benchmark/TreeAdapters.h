@@ -0,0 +1,347 @@
+﻿#pragma once
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+#include "../../BST/BST/BST.h"
+#include "../../BST/BST/CompactBST.h"
+#include "../../AVL/AVL/AVL.h"
+#include "../../AVL/AVL/CompactAVL.h"
+#include "../../AVL/AVL/PersistentAVL.h"
+#include "../../Red-Black/Red-Black/Red-Black.h"
+#include "../../Red-Black/Red-Black/CompactRedBlack.h"
+#include "../../Red-Black/Red-Black/PersistentRedBlack.h"
+#include "../../Btree/Btree/Btree.h"
+#include "../../Btree/Btree/BPlusTree.h"
+#include "../../Btree/Btree/PackedBPlusTree.h"
+#include "../../Btree/Btree/ConcurrentBTree.h"
+#include "../../Btree/Btree/DiskBTree.h"
+#include "../../Splay/Splay/Splay.h"
+
+// Адаптеры приводят деревья к общему интерфейсу стенда:
+//   insert(key)   — вставка ключа; все деревья хранят ключи без повторов, повторная вставка не создает узла
+//   contains(key) — поиск ключа
+//   erase(key)    — удаление ключа
+//   build(first, last, parallel) — построение из отсортированных ключей без повторов
+//   containsBatch(keys, count) — число найденных среди count ключей, пакетный поиск
+//                  (searchBatch, BatchSearch.h); есть только у деревьев, которые его умеют
+// Политика выделения узлов (NodeAllocator.h) передается деревьям как есть;
+// узлы освобождаются деструкторами деревьев.
+
+// Пакетный поиск через searchBatch; found — буфер под результаты, чтобы не выделять его на каждый пакет
+template <typename Tree>
+size_t countBatchHits(const Tree& tree, const int* keys, size_t count, std::vector<typename Tree::Node*>& found) {
+    found.resize(count);
+    tree.searchBatch(keys, count, found.data());
+    size_t hits = 0;
+    for (typename Tree::Node* node : found)
+        hits += node != nullptr;
+    return hits;
+}
+
+template <typename NodeAllocator>
+struct BSTAdapter {
+    static const char* name() { return "BST"; }
+
+    BST<int, std::less<int>, NodeAllocator> tree;
+
+    void insert(int key) { tree.insert(key); }
+    bool contains(int key) { return tree.search(key) != nullptr; }
+    bool erase(int key) { return tree.erase(key); }
+    template <typename It>
+    void build(It first, It last, bool parallel) {
+        if (parallel)
+            tree.buildFromSortedParallel(first, last);
+        else
+            tree.buildFromSorted(first, last);
+    }
+};
+
+template <typename NodeAllocator>
+struct AVLAdapter {
+    static const char* name() { return "AVL"; }
+
+    AVLTree<int, std::less<int>, NodeAllocator> tree;
+    std::vector<typename AVLTree<int, std::less<int>, NodeAllocator>::Node*> found;
+
+    void insert(int key) { tree.insert(key); }
+    bool contains(int key) { return tree.search(key) != nullptr; }
+    size_t containsBatch(const int* keys, size_t count) { return countBatchHits(tree, keys, count, found); }
+    bool erase(int key) { return tree.erase(key); }
+    template <typename It>
+    void build(It first, It last, bool parallel) {
+        if (parallel)
+            tree.buildFromSortedParallel(first, last);
+        else
+            tree.buildFromSorted(first, last);
+    }
+};
+
+template <typename NodeAllocator>
+struct RedBlackAdapter {
+    static const char* name() { return "RedBlack"; }
+
+    RedBlackTree<int, std::less<int>, NodeAllocator> tree;
+    std::vector<typename RedBlackTree<int, std::less<int>, NodeAllocator>::Node*> found;
+
+    void insert(int key) { tree.insert(key); }
+    bool contains(int key) { return tree.search(key) != nullptr; }
+    size_t containsBatch(const int* keys, size_t count) { return countBatchHits(tree, keys, count, found); }
+    bool erase(int key) { return tree.erase(key); }
+    template <typename It>
+    void build(It first, It last, bool parallel) {
+        if (parallel)
+            tree.buildFromSortedParallel(first, last);
+        else
+            tree.buildFromSorted(first, last);
+    }
+};
+
+// Косое дерево перестраивается на каждом поиске: contains меняет его форму,
+// поэтому на перекошенных нагрузках горячие ключи оказываются у корня
+template <typename NodeAllocator>
+struct SplayAdapter {
+    static const char* name() { return "Splay"; }
+
+    SplayTree<int, std::less<int>, NodeAllocator> tree;
+
+    void insert(int key) { tree.insert(key); }
+    bool contains(int key) { return tree.search(key) != nullptr; }
+    bool erase(int key) { return tree.erase(key); }
+    // Параллельной сборки нет: дерево строится сбалансированным за O(n), дальше форму задают обращения
+    template <typename It>
+    void build(It first, It last, bool) { tree.buildFromSorted(first, last); }
+};
+
+// Компактные деревья держат узлы в собственном пуле (IndexPool.h): политика выделения к ним
+// не относится, параллельной сборки у них нет
+template <typename Tree>
+struct CompactAdapter {
+    Tree tree;
+
+    void insert(int key) { tree.insert(key); }
+    bool contains(int key) { return tree.contains(key); }
+    bool erase(int key) { return tree.erase(key); }
+    template <typename It>
+    void build(It first, It last, bool) { tree.buildFromSorted(first, last); }
+};
+
+struct CompactBSTAdapter : CompactAdapter<CompactBST<int>> {
+    static const char* name() { return "CompactBST"; }
+};
+
+struct CompactAVLAdapter : CompactAdapter<CompactAVLTree<int>> {
+    static const char* name() { return "CompactAVL"; }
+};
+
+struct CompactRedBlackAdapter : CompactAdapter<CompactRedBlackTree<int>> {
+    static const char* name() { return "CompactRB"; }
+};
+
+// Персистентные деревья потокобезопасны: поиск берет текущую версию без блокировок,
+// вставка и удаление публикуют новую версию под мьютексом писателей. Узлы — StdNodeAllocator
+template <typename Tree>
+struct PersistentAdapter {
+    Tree tree;
+
+    void insert(int key) { tree.insert(key); }
+    bool contains(int key) { return tree.contains(key); }
+    bool erase(int key) { return tree.erase(key); }
+    template <typename It>
+    void build(It first, It last, bool) { tree.buildFromSorted(first, last); }
+};
+
+struct PersistentAVLAdapter : PersistentAdapter<PersistentAVLTree<int>> {
+    static const char* name() { return "PersistAVL"; }
+};
+
+struct PersistentRedBlackAdapter : PersistentAdapter<PersistentRedBlackTree<int>> {
+    static const char* name() { return "PersistRB"; }
+};
+
+// Степень B-дерева — параметр шаблона; при запуске стенда ее выбирают из собранных (--btree-degree)
+template <typename NodeAllocator, int Degree = kBTreeDefaultDegree>
+struct BTreeAdapter {
+    static const char* name() { return "BTree"; }
+
+    BTree<int, std::less<int>, NodeAllocator, SetEntry<int>, Degree> tree;
+    std::vector<typename BTree<int, std::less<int>, NodeAllocator, SetEntry<int>, Degree>::Node*> found;
+
+    void insert(int key) { tree.insert(key); }
+    bool contains(int key) { return tree.search(key) != nullptr; }
+    size_t containsBatch(const int* keys, size_t count) { return countBatchHits(tree, keys, count, found); }
+    bool erase(int key) { return tree.erase(key); }
+    template <typename It>
+    void build(It first, It last, bool parallel) {
+        if (parallel)
+            tree.buildFromSortedParallel(first, last);
+        else
+            tree.buildFromSorted(first, last);
+    }
+};
+
+template <typename NodeAllocator>
+struct BPlusTreeAdapter {
+    static const char* name() { return "BPlusTree"; }
+
+    BPlusTree<int, 4 * kCacheLine / sizeof(int), NodeAllocator> tree;
+
+    void insert(int key) { tree.insert(key); }
+    bool contains(int key) { return tree.contains(key); }
+    bool erase(int key) { return tree.erase(key); }
+    template <typename It>
+    void build(It first, It last, bool parallel) {
+        if (parallel)
+            tree.buildFromSortedParallel(first, last);
+        else
+            tree.buildFromSorted(first, last);
+    }
+};
+
+// B+дерево со сжатыми листьями (разности с наименьшим ключом листа) и радиксным каталогом над ними.
+// Параллельной сборки нет: листья укладываются подряд одним проходом
+template <typename NodeAllocator>
+struct PackedBPlusTreeAdapter {
+    static const char* name() { return "PackedBPlus"; }
+
+    PackedBPlusTree<int, 4 * kCacheLine, NodeAllocator> tree;
+
+    void insert(int key) { tree.insert(key); }
+    bool contains(int key) { return tree.contains(key); }
+    bool erase(int key) { return tree.erase(key); }
+    template <typename It>
+    void build(It first, It last, bool) { tree.buildFromSorted(first, last); }
+};
+
+// Параллельное B-дерево; степень задана при компиляции (16), --btree-degree на него не влияет.
+// Построения из отсортированного у него нет: ключи вставляются по порядку
+template <typename NodeAllocator>
+struct ConcurrentBTreeAdapter {
+    static const char* name() { return "CBTree"; }
+
+    ConcurrentBTree<int, int, std::less<int>, 16, NodeAllocator> tree;
+
+    void insert(int key) { tree.insert(key, key); }
+    bool contains(int key) { return tree.contains(key); }
+    bool erase(int key) { return tree.erase(key); }
+    template <typename It>
+    void build(It first, It last, bool) {
+        for (; first != last; ++first)
+            tree.insert(*first, *first);
+    }
+};
+
+// Точка отсчета для параллельного B-дерева: обычное B-дерево под одной блокировкой
+// читателей-писателей
+template <typename NodeAllocator>
+struct LockedBTreeAdapter {
+    static const char* name() { return "LockedBTree"; }
+
+    BTree<int, std::less<int>, NodeAllocator> tree;
+    std::shared_mutex mutex;
+
+    void insert(int key) {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        tree.insert(key);
+    }
+    bool contains(int key) {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return tree.search(key) != nullptr;
+    }
+    bool erase(int key) {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        return tree.erase(key);
+    }
+    template <typename It>
+    void build(It first, It last, bool parallel) {
+        if (parallel)
+            tree.buildFromSortedParallel(first, last);
+        else
+            tree.buildFromSorted(first, last);
+    }
+};
+
+// B-дерево в файле со страницами по 4 КиБ и кэшем страниц по умолчанию; файл создается
+// во временном каталоге и удаляется после прогона. Начальное заполнение фиксируется,
+// измеряемые операции идут одной незафиксированной транзакцией, которую деструктор дерева отбрасывает
+struct DiskBTreeAdapter {
+    static const char* name() { return "DiskBTree"; }
+
+    std::filesystem::path path;
+    std::unique_ptr<DiskBTree<int, int>> tree;
+
+    DiskBTreeAdapter() : path(tempIndexPath()), tree(new DiskBTree<int, int>(path.string())) {}
+    ~DiskBTreeAdapter() {
+        tree.reset();
+        std::error_code ignored;
+        std::filesystem::remove(path, ignored);
+    }
+
+    void insert(int key) { tree->insert(key, key); }
+    bool contains(int key) { return tree->contains(key); }
+    bool erase(int key) { return tree->erase(key); }
+    template <typename It>
+    void build(It first, It last, bool) {
+        std::vector<std::pair<int, int>> items;
+        items.reserve(last - first);
+        for (; first != last; ++first)
+            items.emplace_back(*first, *first);
+        tree->buildFromSorted(items.begin(), items.end());
+        tree->commit();
+    }
+
+    static std::filesystem::path tempIndexPath() {
+        static std::atomic<unsigned> counter(0);
+        return std::filesystem::temp_directory_path() / ("benchmark_disk_" + std::to_string(counter++) + ".db");
+    }
+};
+
+// Словари с интерфейсом std::map: те же вызовы идут и в сам std::map, что дает прямое A/B сравнение.
+// Значение равно ключу; B-дерево в BTreeMap имеет степень kBTreeDefaultDegree
+template <typename Map>
+struct MapAdapter {
+    Map map;
+
+    void insert(int key) { map.try_emplace(key, key); }
+    bool contains(int key) { return map.find(key) != map.end(); }
+    bool erase(int key) { return map.erase(key) != 0; }
+    // Параллельного построения у словарей нет. У std::map ближайший аналог —
+    // вставка диапазона: отсортированные элементы встают в конец за O(1)
+    template <typename It>
+    void build(It first, It last, bool) {
+        std::vector<std::pair<int, int>> items;
+        items.reserve(last - first);
+        for (; first != last; ++first)
+            items.emplace_back(*first, *first);
+        if constexpr (std::is_same<Map, std::map<int, int>>::value)
+            map.insert(items.begin(), items.end());
+        else
+            map.build_from_sorted(items.begin(), items.end());
+    }
+};
+
+struct StdMapAdapter : MapAdapter<std::map<int, int>> {
+    static const char* name() { return "std::map"; }
+};
+
+template <typename NodeAllocator>
+struct AVLMapAdapter : MapAdapter<AVLMap<int, int, std::less<int>, NodeAllocator>> {
+    static const char* name() { return "AVLMap"; }
+};
+
+template <typename NodeAllocator>
+struct RedBlackMapAdapter : MapAdapter<RedBlackMap<int, int, std::less<int>, NodeAllocator>> {
+    static const char* name() { return "RBMap"; }
+};
+
+template <typename NodeAllocator>
+struct BTreeMapAdapter : MapAdapter<BTreeMap<int, int, std::less<int>, NodeAllocator>> {
+    static const char* name() { return "BTreeMap"; }
+};
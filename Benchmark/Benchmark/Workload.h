@@ -0,0 +1,127 @@
+﻿#pragma once
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+// Распределение ключей в нагрузке
+enum class KeyDistribution { Sequential, Uniform, Zipf };
+
+inline const char* distributionName(KeyDistribution d) {
+    switch (d) {
+    case KeyDistribution::Sequential: return "sequential";
+    case KeyDistribution::Uniform:    return "random";
+    default:                          return "zipf";
+    }
+}
+
+// Соотношение чтений и записей
+struct OperationMix {
+    const char* name;   // Название нагрузки для отчета
+    int readPercent;    // Доля операций поиска в процентах
+    int erasePercent;   // Доля удалений в процентах; остальное — вставки
+};
+
+// Генератор Zipf-распределения на [0, n) (метод Грея и др., как в YCSB).
+// Ранг 0 — самый «горячий» элемент.
+class ZipfGenerator {
+public:
+    ZipfGenerator(uint64_t n, double theta = 0.99) : n(n), theta(theta) {
+        zetan = zeta(n, theta);
+        double zeta2 = zeta(2, theta);
+        alpha = 1.0 / (1.0 - theta);
+        eta = (1.0 - std::pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zetan);
+    }
+
+    template <typename Rng>
+    uint64_t operator()(Rng& rng) {
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+        double uz = u * zetan;
+        if (uz < 1.0)
+            return 0;
+        if (uz < 1.0 + std::pow(0.5, theta))
+            return 1;
+        uint64_t rank = static_cast<uint64_t>(n * std::pow(eta * u - eta + 1.0, alpha));
+        return rank < n ? rank : n - 1;
+    }
+
+private:
+    uint64_t n;
+    double theta;
+    double zetan;
+    double alpha;
+    double eta;
+
+    static double zeta(uint64_t n, double theta) {
+        double sum = 0.0;
+        for (uint64_t i = 1; i <= n; ++i)
+            sum += 1.0 / std::pow(static_cast<double>(i), theta);
+        return sum;
+    }
+};
+
+enum class OpType : uint8_t { Read, Insert, Erase };
+
+// Одна операция нагрузки: поиск, вставка или удаление ключа
+struct Operation {
+    int key;
+    OpType type;
+};
+
+// Заранее сгенерированная нагрузка, чтобы генератор случайных чисел
+// не попадал в измеряемый интервал
+struct Workload {
+    std::vector<int> preload;      // Ключи для начального заполнения дерева (в порядке вставки)
+    std::vector<Operation> ops;    // Измеряемые операции
+};
+
+// Построение нагрузки.
+// sequential: дерево заполняется ключами 0..n-1 по возрастанию, поиски идут по кругу,
+//             вставки дописывают ключи n, n+1, ...
+// random:     случайные ключи, поиски попадают в существующие ключи равномерно,
+//             вставки — новые случайные ключи
+// zipf:       как random, но поиски выбирают существующие ключи по Zipf (горячие ключи
+//             разбросаны по дереву), вставки — новые случайные ключи
+// Удаления (нагрузка churn) берут загруженные ключи: на sequential — по порядку с начала,
+// на остальных — равномерно, так что размер дерева остается примерно постоянным.
+inline Workload makeWorkload(KeyDistribution dist, const OperationMix& mix, size_t size, size_t opCount, uint64_t seed) {
+    Workload w;
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<int> anyKey(0, INT32_MAX - 1);
+    std::uniform_int_distribution<int> percent(0, 99);
+
+    w.preload.resize(size);
+    for (size_t i = 0; i < size; ++i)
+        w.preload[i] = dist == KeyDistribution::Sequential ? static_cast<int>(i) : anyKey(rng);
+
+    std::uniform_int_distribution<size_t> anyIndex(0, size - 1);
+    // Для остальных распределений генератор не используется, поэтому строим его на одном элементе
+    ZipfGenerator zipf(dist == KeyDistribution::Zipf ? size : 1);
+    int nextSequential = static_cast<int>(size);
+    int nextSequentialErase = 0;
+
+    w.ops.resize(opCount);
+    for (size_t i = 0; i < opCount; ++i) {
+        Operation& op = w.ops[i];
+        int p = percent(rng);
+        op.type = p < mix.readPercent ? OpType::Read
+                : p < mix.readPercent + mix.erasePercent ? OpType::Erase
+                : OpType::Insert;
+        if (op.type == OpType::Read) {
+            if (dist == KeyDistribution::Sequential)
+                op.key = static_cast<int>(i % size);
+            else if (dist == KeyDistribution::Zipf)
+                op.key = w.preload[zipf(rng)];
+            else
+                op.key = w.preload[anyIndex(rng)];
+        }
+        else if (op.type == OpType::Erase) {
+            op.key = dist == KeyDistribution::Sequential ? nextSequentialErase++ : w.preload[anyIndex(rng)];
+        }
+        else {
+            op.key = dist == KeyDistribution::Sequential ? nextSequential++ : anyKey(rng);
+        }
+    }
+    return w;
+}
@@ -0,0 +1,714 @@
+﻿#pragma once
+#include <iostream>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <utility>
+#include <type_traits>
+#include <vector>
+#include "../../Common/BatchSearch.h"
+#include "../../Common/BulkBuild.h"
+#include "../../Common/NodeAllocator.h"
+#include "../../Common/Snapshot.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BPLUS_SSE2 1
+#endif
+
+// Поиск внутри узла без ветвлений: узел всегда просматривается целиком.
+// Свободные ячейки заполнены максимальным значением T, поэтому в countLess они не попадают,
+// а в countLessEqual отсекаются по числу занятых ключей.
+// Только целые ключи: у чисел с плавающей точкой +inf не меньше заполнителя, а NaN не сравним ни с чем,
+// и countLess досчитал бы до Capacity на неполном узле — вставка сдвинула бы ключи за его границу
+template <typename T, int Capacity>
+struct NodeSearch {
+    static_assert(std::is_integral<T>::value, "NodeSearch: свободные ячейки отсекаются по максимуму T, ключи — целые");
+
+    // Число ключей, меньших key (позиция lower_bound)
+    static int countLess(const T* keys, T key) {
+        if constexpr (std::is_same<T, int32_t>::value && Capacity % 8 == 0)
+            return simdCount(keys, key, false);
+        int count = 0;
+        for (int i = 0; i < Capacity; ++i)
+            count += keys[i] < key;
+        return count;
+    }
+
+    // Число ключей, не больших key (позиция upper_bound), среди первых used
+    static int countLessEqual(const T* keys, int used, T key) {
+        int count;
+        if constexpr (std::is_same<T, int32_t>::value && Capacity % 8 == 0) {
+            count = simdCount(keys, key, true);
+        }
+        else {
+            count = 0;
+            for (int i = 0; i < Capacity; ++i)
+                count += !(key < keys[i]);
+        }
+        return count < used ? count : used;
+    }
+
+private:
+    // Сравнение по 8 (AVX2) или 4 (SSE2) ключей за инструкцию.
+    // Результаты сравнения (-1 или 0) накапливаются вычитанием, без movemask/popcnt.
+    static int simdCount(const T* keys, T key, bool orEqual) {
+#if defined(__AVX2__)
+        __m256i needle = _mm256_set1_epi32(key);
+        __m256i acc = _mm256_setzero_si256();
+        for (int i = 0; i < Capacity; i += 8) {
+            __m256i k = _mm256_load_si256(reinterpret_cast<const __m256i*>(keys + i));
+            // orEqual: k <= key  <=>  !(k > key); иначе k < key  <=>  key > k
+            __m256i cmp = orEqual ? _mm256_xor_si256(_mm256_cmpgt_epi32(k, needle), _mm256_set1_epi32(-1))
+                                  : _mm256_cmpgt_epi32(needle, k);
+            acc = _mm256_sub_epi32(acc, cmp);
+        }
+        __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtsi128_si32(sum);
+#elif defined(BPLUS_SSE2)
+        __m128i needle = _mm_set1_epi32(key);
+        __m128i acc = _mm_setzero_si128();
+        for (int i = 0; i < Capacity; i += 4) {
+            __m128i k = _mm_load_si128(reinterpret_cast<const __m128i*>(keys + i));
+            __m128i cmp = orEqual ? _mm_xor_si128(_mm_cmpgt_epi32(k, needle), _mm_set1_epi32(-1))
+                                  : _mm_cmplt_epi32(k, needle);
+            acc = _mm_sub_epi32(acc, cmp);
+        }
+        acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+        acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtsi128_si32(acc);
+#else
+        int count = 0;
+        for (int i = 0; i < Capacity; ++i)
+            count += orEqual ? !(key < keys[i]) : keys[i] < key;
+        return count;
+#endif
+    }
+};
+
+// Внутренний узел B+дерева: ключи лежат в самом узле подряд, начиная с границы строки кэша,
+// поэтому поиск по узлу читает только строки с ключами и одну строку с нужным указателем
+template <typename T, int Capacity>
+struct alignas(kCacheLine) BPlusInner {
+    T keys[Capacity];               // Разделители; свободные ячейки заполнены максимумом T
+    int count;                      // Число занятых ключей (потомков на один больше)
+    void* children[Capacity + 1];   // Потомки: внутренние узлы или листья (по высоте дерева)
+
+    BPlusInner() : count(0) {
+        std::fill(keys, keys + Capacity, std::numeric_limits<T>::max());
+    }
+};
+
+// Лист B+дерева: хранит сами ключи и связан с соседями для обхода диапазонов
+template <typename T, int Capacity>
+struct alignas(kCacheLine) BPlusLeaf {
+    T keys[Capacity];
+    int count;
+    BPlusLeaf* next;   // Следующий лист (ключи больше)
+    BPlusLeaf* prev;   // Предыдущий лист (ключи меньше)
+
+    BPlusLeaf() : count(0), next(nullptr), prev(nullptr) {
+        std::fill(keys, keys + Capacity, std::numeric_limits<T>::max());
+    }
+};
+
+// Кэш-ориентированный вариант B-дерева (B+дерево).
+// Все ключи хранятся в листах, внутренние узлы содержат только разделители.
+// Узлы фиксированного размера, ключи занимают Capacity * sizeof(T) байт
+// (по умолчанию 4 строки кэша), поиск внутри узла — векторное сравнение без ветвлений.
+// Ключи целые и уникальны: повторная вставка ключа ничего не меняет.
+// Компаратора и значений нет намеренно: узел сравнивается векторно по сырым ключам в естественном
+// порядке. Ключи с компаратором, словари, строки и UUID — в BTree (BTreeNodeSearch).
+// Память под узлы выделяет политика NodeAllocator (см. NodeAllocator.h).
+template <typename T, int Capacity = 4 * kCacheLine / sizeof(T), typename NodeAllocator = DefaultNodeAllocator>
+class BPlusTree {
+    static_assert(std::is_integral<T>::value, "BPlusTree хранит целые ключи (см. NodeSearch)");
+    static_assert(Capacity >= 4, "Слишком маленький узел");
+
+    using Inner = BPlusInner<T, Capacity>;
+    using Leaf = BPlusLeaf<T, Capacity>;
+    using Search = NodeSearch<T, Capacity>;
+
+    // Предел высоты: при заполнении узлов хотя бы наполовину этого хватает с запасом
+    static constexpr int kMaxHeight = 32;
+    // Минимальное заполнение любого узла, кроме корня
+    static constexpr int kMinKeys = Capacity / 2;
+
+public:
+    // Итератор по ключам в порядке возрастания: идет по цепочке листов, стек не нужен
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const T*;
+        using reference = const T&;
+
+        Iterator() : leaf(nullptr), index(0) {}
+        Iterator(const Leaf* leaf, int index) : leaf(leaf), index(index) {}
+
+        reference operator*() const { return leaf->keys[index]; }
+        pointer operator->() const { return &leaf->keys[index]; }
+        Iterator& operator++() {
+            if (++index == leaf->count) {
+                leaf = leaf->next;
+                index = 0;
+            }
+            return *this;
+        }
+        Iterator operator++(int) {
+            Iterator copy = *this;
+            ++*this;
+            return copy;
+        }
+        bool operator==(const Iterator& other) const { return leaf == other.leaf && index == other.index; }
+        bool operator!=(const Iterator& other) const { return !(*this == other); }
+
+    private:
+        const Leaf* leaf;  // nullptr — позиция за последним ключом
+        int index;
+    };
+
+    BPlusTree() : root(nullptr), height(0), first(nullptr), size_(0) {}
+    ~BPlusTree() { clear(); }
+    BPlusTree(const BPlusTree&) = delete;
+    BPlusTree& operator=(const BPlusTree&) = delete;
+
+    size_t size() const { return size_; }
+
+    Iterator begin() const { return Iterator(first, 0); }
+    Iterator end() const { return Iterator(); }
+
+    // Удаление всех узлов
+    void clear() {
+        // Узлы тривиально разрушаемы, поэтому со слабом или ареной обход не нужен
+        if (!NodeAllocator::kBulkRelease && root != nullptr)
+            destroy(root, height);
+        allocator.release();
+        root = first = nullptr;
+        height = 0;
+        size_ = 0;
+    }
+
+    // Поиск ключа
+    bool contains(T key) const {
+        if (root == nullptr)
+            return false;
+        const Leaf* leaf = findLeaf(key);
+        int i = Search::countLess(leaf->keys, key);
+        return i < leaf->count && leaf->keys[i] == key;
+    }
+
+    // Вставка ключа; возвращает false, если ключ уже есть
+    bool insert(T key) {
+        if (root == nullptr) {
+            Leaf* leaf = allocator.template create<Leaf>();
+            leaf->keys[0] = key;
+            leaf->count = 1;
+            root = first = leaf;
+            height = 1;
+            size_ = 1;
+            return true;
+        }
+
+        // Спуск с запоминанием пути: узел и номер потомка на каждом уровне
+        Inner* path[kMaxHeight];
+        int slot[kMaxHeight];
+        void* node = root;
+        for (int level = 0; level < height - 1; ++level) {
+            Inner* inner = static_cast<Inner*>(node);
+            int i = Search::countLessEqual(inner->keys, inner->count, key);
+            path[level] = inner;
+            slot[level] = i;
+            node = inner->children[i];
+        }
+
+        Leaf* leaf = static_cast<Leaf*>(node);
+        int pos = Search::countLess(leaf->keys, key);
+        if (pos < leaf->count && leaf->keys[pos] == key)
+            return false;
+        ++size_;
+
+        if (leaf->count < Capacity) {
+            insertAt(leaf->keys, leaf->count, pos, key);
+            ++leaf->count;
+            return true;
+        }
+
+        // Лист заполнен: делим пополам и поднимаем первый ключ правой половины
+        Leaf* right = splitLeaf(leaf, pos, key);
+        T separator = right->keys[0];
+        void* newChild = right;
+
+        for (int level = height - 2; level >= 0; --level) {
+            Inner* parent = path[level];
+            int at = slot[level];
+            if (parent->count < Capacity) {
+                insertAt(parent->keys, parent->count, at, separator);
+                insertAt(parent->children, parent->count + 1, at + 1, newChild);
+                ++parent->count;
+                return true;
+            }
+            newChild = splitInner(parent, at, separator, newChild, separator);
+        }
+
+        // Разделился корень: дерево растет вверх
+        Inner* newRoot = allocator.template create<Inner>();
+        newRoot->keys[0] = separator;
+        newRoot->count = 1;
+        newRoot->children[0] = root;
+        newRoot->children[1] = newChild;
+        root = newRoot;
+        ++height;
+        return true;
+    }
+
+    // Удаление ключа; возвращает false, если ключа нет.
+    // Недозаполненный узел (меньше половины емкости) занимает ключ у соседа или сливается с ним.
+    bool erase(T key) {
+        if (root == nullptr)
+            return false;
+
+        Inner* path[kMaxHeight];
+        int slot[kMaxHeight];
+        void* node = root;
+        for (int level = 0; level < height - 1; ++level) {
+            Inner* inner = static_cast<Inner*>(node);
+            int i = Search::countLessEqual(inner->keys, inner->count, key);
+            path[level] = inner;
+            slot[level] = i;
+            node = inner->children[i];
+        }
+
+        Leaf* leaf = static_cast<Leaf*>(node);
+        int pos = Search::countLess(leaf->keys, key);
+        if (pos >= leaf->count || leaf->keys[pos] != key)
+            return false;
+        removeKeyAt(leaf->keys, leaf->count, pos);
+        --leaf->count;
+        --size_;
+
+        if (height == 1) {
+            if (leaf->count == 0) {
+                allocator.destroy(leaf);
+                root = first = nullptr;
+                height = 0;
+            }
+            return true;
+        }
+        if (leaf->count >= kMinKeys)
+            return true;
+
+        // Разделители родителей могут остаться равными удаленному ключу: как границы они по-прежнему верны
+        bool merged = fixLeaf(path[height - 2], slot[height - 2], leaf);
+        for (int level = height - 2; merged && level > 0; --level) {
+            Inner* inner = path[level];
+            if (inner->count >= kMinKeys)
+                return true;
+            merged = fixInner(path[level - 1], slot[level - 1], inner);
+        }
+
+        // Корень остался без ключей: дерево становится ниже на уровень
+        Inner* top = static_cast<Inner*>(root);
+        if (height > 1 && top->count == 0) {
+            root = top->children[0];
+            allocator.destroy(top);
+            --height;
+        }
+        return true;
+    }
+
+    // Замена содержимого ключами из [from, to), отсортированными строго по возрастанию.
+    // Листья заполняются подряд на долю fill от емкости (не меньше половины) и связываются в цепочку,
+    // затем над ними за O(n) собираются внутренние уровни; разделитель — наименьший ключ правого поддерева
+    template <typename ForwardIt>
+    void buildFromSorted(ForwardIt from, ForwardIt to, double fill = 1.0) {
+        buildCounted(from, std::distance(from, to), fill);
+    }
+
+    // То же в threads потоков: листья заполняют рабочие потоки кусками,
+    // цепочку листьев и внутренние уровни достраивает текущий поток
+    template <typename RandomIt>
+    void buildFromSortedParallel(RandomIt from, RandomIt to, double fill = 1.0,
+                                 unsigned threads = defaultBuildThreads()) {
+        size_t count = to - from;
+        if (threads <= 1 || count < 2 * kParallelBuildMin) {
+            buildFromSorted(from, to, fill);
+            return;
+        }
+        clear();
+        EvenSplit split = leafSplit(count, fill);
+        EvenSplit chunks(split.parts, std::min<size_t>(split.parts, threads * 4));
+        std::vector<void*> nodes(split.parts, nullptr);
+        std::vector<T> lows(split.parts);
+        std::vector<NodeAllocator> allocators(threads);
+        try {
+            runParallel(chunks.parts, threads, [&](unsigned worker, size_t chunk) {
+                size_t end = chunks.offset(chunk) + chunks.size(chunk);
+                for (size_t j = chunks.offset(chunk); j < end; ++j) {
+                    Leaf* leaf = allocators[worker].template create<Leaf>();
+                    nodes[j] = leaf;
+                    RandomIt it = from + split.offset(j);
+                    fillLeaf(leaf, it, split.size(j));
+                    lows[j] = leaf->keys[0];
+                }
+            });
+        }
+        catch (...) {
+            for (NodeAllocator& other : allocators)
+                allocator.adopt(other);
+            destroyLeaves(nodes);
+            throw;
+        }
+        for (NodeAllocator& other : allocators)
+            allocator.adopt(other);
+        linkLeaves(nodes);
+        buildInner(nodes, lows, fill);
+        size_ = count;
+    }
+
+    // Обход ключей из [lo, hi] по связанным листам
+    template <typename Visitor>
+    void forEachInRange(T lo, T hi, Visitor visit) const {
+        if (root == nullptr || hi < lo)
+            return;
+        const Leaf* leaf = findLeaf(lo);
+        int i = Search::countLess(leaf->keys, lo);
+        for (; leaf != nullptr; leaf = leaf->next, i = 0) {
+            for (; i < leaf->count; ++i) {
+                if (hi < leaf->keys[i])
+                    return;
+                visit(leaf->keys[i]);
+            }
+        }
+    }
+
+    // Снимок дерева в поток (формат — в Snapshot.h): ключи по порядку, блоками с контрольными суммами
+    void save(std::ostream& out, SnapshotEncoding encoding = SnapshotEncoding::Compact) const {
+        saveSnapshot<SetEntry<T>>(out, begin(), end(), size_, encoding);
+    }
+
+    // Замена содержимого снимком из потока; листья заполняются подряд на долю fill, как в buildFromSorted.
+    // При ошибке (снимок поврежден или с другим типом ключей) исключение, дерево остается пустым
+    void load(std::istream& in, double fill = 1.0) {
+        try {
+            SnapshotReader<SetEntry<T>, std::less<T>> reader(in, std::less<T>(), true);
+            buildCounted(reader.begin(), reader.size(), fill);
+            reader.finish();
+        }
+        catch (...) {
+            clear();
+            throw;
+        }
+    }
+
+    // Вывод всех ключей по возрастанию
+    void traverse() const {
+        for (const T& key : *this)
+            std::cout << key << " ";
+        std::cout << std::endl;
+    }
+
+private:
+    void* root;
+    int height;      // Число уровней; 1 — корень является листом
+    Leaf* first;     // Самый левый лист
+    size_t size_;
+    NodeAllocator allocator;
+
+    // Спуск до листа. Перед просмотром узла запрашиваются сразу все его строки с ключами,
+    // чтобы промахи кэша внутри одного узла обрабатывались параллельно
+    const Leaf* findLeaf(T key) const {
+        const void* node = root;
+        for (int level = 0; level < height - 1; ++level) {
+            const Inner* inner = static_cast<const Inner*>(node);
+            node = inner->children[Search::countLessEqual(inner->keys, inner->count, key)];
+            prefetchKeys(node);
+        }
+        return static_cast<const Leaf*>(node);
+    }
+
+    static void prefetchKeys(const void* node) {
+        const char* p = static_cast<const char*>(node);
+        for (size_t offset = 0; offset < Capacity * sizeof(T); offset += kCacheLine)
+            prefetchLine(p + offset);
+    }
+
+    // Замена содержимого count ключами, читаемыми по порядку с from (см. buildFromSorted):
+    // хватает однопроходного итератора
+    template <typename InputIt>
+    void buildCounted(InputIt from, size_t count, double fill) {
+        clear();
+        if (count == 0)
+            return;
+        EvenSplit split = leafSplit(count, fill);
+        std::vector<void*> nodes(split.parts);
+        std::vector<T> lows(split.parts);
+        try {
+            for (size_t j = 0; j < split.parts; ++j) {
+                Leaf* leaf = allocator.template create<Leaf>();
+                nodes[j] = leaf;
+                fillLeaf(leaf, from, split.size(j));
+                lows[j] = leaf->keys[0];
+            }
+        }
+        catch (...) {
+            destroyLeaves(nodes);
+            throw;
+        }
+        linkLeaves(nodes);
+        buildInner(nodes, lows, fill);
+        size_ = count;
+    }
+
+    // Разбиение count ключей по листам с заполнением fill
+    static EvenSplit leafSplit(size_t count, double fill) {
+        size_t target = fillTarget(fill, kMinKeys, Capacity);
+        return EvenSplit(count, packedNodeCount(count, kMinKeys, Capacity, target));
+    }
+
+    template <typename It>
+    static void fillLeaf(Leaf* leaf, It& it, size_t count) {
+        for (size_t i = 0; i < count; ++i, ++it)
+            leaf->keys[i] = *it;
+        leaf->count = static_cast<int>(count);
+    }
+
+    // Связывание листьев в цепочку; первый становится началом обхода
+    void linkLeaves(const std::vector<void*>& leaves) {
+        Leaf* prev = nullptr;
+        for (void* node : leaves) {
+            Leaf* leaf = static_cast<Leaf*>(node);
+            leaf->prev = prev;
+            if (prev != nullptr)
+                prev->next = leaf;
+            prev = leaf;
+        }
+        first = static_cast<Leaf*>(leaves.front());
+    }
+
+    // Разбор листьев недостроенного дерева (пустые ячейки — еще не созданные листья)
+    void destroyLeaves(const std::vector<void*>& leaves) {
+        for (void* leaf : leaves)
+            if (leaf != nullptr)
+                allocator.destroy(static_cast<Leaf*>(leaf));
+    }
+
+    // Внутренние уровни над связанными листьями nodes с наименьшими ключами lows.
+    // Потомков у узла от kMinKeys + 1 до Capacity + 1, разделитель перед потомком — его наименьший ключ.
+    // При исключении разбирает все узлы, дерево остается пустым
+    void buildInner(std::vector<void*>& nodes, std::vector<T>& lows, double fill) {
+        size_t target = fillTarget(fill, kMinKeys, Capacity) + 1;
+        std::vector<Inner*> created;  // Каждый внутренний узел имеет хотя бы двух потомков
+        int levels = 1;
+        try {
+            created.reserve(nodes.size());
+            while (nodes.size() > 1) {
+                size_t children = nodes.size();
+                EvenSplit split(children, packedNodeCount(children, kMinKeys + 1, Capacity + 1, target));
+                for (size_t j = 0; j < split.parts; ++j) {
+                    Inner* inner = allocator.template create<Inner>();
+                    created.push_back(inner);
+                    size_t begin = split.offset(j);
+                    size_t size = split.size(j);
+                    for (size_t i = 0; i < size; ++i) {
+                        inner->children[i] = nodes[begin + i];
+                        if (i > 0)
+                            inner->keys[i - 1] = lows[begin + i];
+                    }
+                    inner->count = static_cast<int>(size - 1);
+                    nodes[j] = inner;
+                    lows[j] = lows[begin];
+                }
+                nodes.resize(split.parts);
+                lows.resize(split.parts);
+                ++levels;
+            }
+        }
+        catch (...) {
+            for (Inner* inner : created)
+                allocator.destroy(inner);
+            destroy(nullptr, 1);  // Только цепочка листьев
+            first = nullptr;
+            throw;
+        }
+        root = nodes[0];
+        height = levels;
+    }
+
+    // Вставка value в позицию pos массива из used элементов
+    template <typename U>
+    static void insertAt(U* items, int used, int pos, U value) {
+        std::memmove(items + pos + 1, items + pos, (used - pos) * sizeof(U));
+        items[pos] = value;
+    }
+
+    // Удаление ключа из позиции pos массива из used ключей; освободившаяся ячейка снова заполняется максимумом
+    static void removeKeyAt(T* keys, int used, int pos) {
+        std::memmove(keys + pos, keys + pos + 1, (used - pos - 1) * sizeof(T));
+        keys[used - 1] = std::numeric_limits<T>::max();
+    }
+
+    template <typename U>
+    static void removeAt(U* items, int used, int pos) {
+        std::memmove(items + pos, items + pos + 1, (used - pos - 1) * sizeof(U));
+    }
+
+    // Удаление из родителя разделителя keyPos и потомка childPos
+    static void removeFromParent(Inner* parent, int keyPos, int childPos) {
+        removeKeyAt(parent->keys, parent->count, keyPos);
+        removeAt(parent->children, parent->count + 1, childPos);
+        --parent->count;
+    }
+
+    // Исправление недозаполненного листа leaf (потомок at узла parent).
+    // Возвращает true, если листы слились и в parent стало на ключ меньше
+    bool fixLeaf(Inner* parent, int at, Leaf* leaf) {
+        Leaf* left = at > 0 ? static_cast<Leaf*>(parent->children[at - 1]) : nullptr;
+        Leaf* right = at < parent->count ? static_cast<Leaf*>(parent->children[at + 1]) : nullptr;
+
+        if (left != nullptr && left->count > kMinKeys) {
+            insertAt(leaf->keys, leaf->count, 0, left->keys[left->count - 1]);
+            ++leaf->count;
+            removeKeyAt(left->keys, left->count, left->count - 1);
+            --left->count;
+            parent->keys[at - 1] = leaf->keys[0];
+            return false;
+        }
+        if (right != nullptr && right->count > kMinKeys) {
+            leaf->keys[leaf->count++] = right->keys[0];
+            removeKeyAt(right->keys, right->count, 0);
+            --right->count;
+            parent->keys[at] = right->keys[0];
+            return false;
+        }
+
+        // Сливаем правый лист пары в левый
+        Leaf* target = left != nullptr ? left : leaf;
+        Leaf* source = left != nullptr ? leaf : right;
+        std::memcpy(target->keys + target->count, source->keys, source->count * sizeof(T));
+        target->count += source->count;
+        target->next = source->next;
+        if (source->next != nullptr)
+            source->next->prev = target;
+        int sourceAt = left != nullptr ? at : at + 1;
+        removeFromParent(parent, sourceAt - 1, sourceAt);
+        allocator.destroy(source);
+        return true;
+    }
+
+    // То же для внутреннего узла: заем идет через разделитель родителя
+    bool fixInner(Inner* parent, int at, Inner* node) {
+        Inner* left = at > 0 ? static_cast<Inner*>(parent->children[at - 1]) : nullptr;
+        Inner* right = at < parent->count ? static_cast<Inner*>(parent->children[at + 1]) : nullptr;
+
+        if (left != nullptr && left->count > kMinKeys) {
+            insertAt(node->keys, node->count, 0, parent->keys[at - 1]);
+            insertAt(node->children, node->count + 1, 0, left->children[left->count]);
+            ++node->count;
+            parent->keys[at - 1] = left->keys[left->count - 1];
+            removeKeyAt(left->keys, left->count, left->count - 1);
+            --left->count;
+            return false;
+        }
+        if (right != nullptr && right->count > kMinKeys) {
+            node->keys[node->count] = parent->keys[at];
+            node->children[node->count + 1] = right->children[0];
+            ++node->count;
+            parent->keys[at] = right->keys[0];
+            removeKeyAt(right->keys, right->count, 0);
+            removeAt(right->children, right->count + 1, 0);
+            --right->count;
+            return false;
+        }
+
+        // Слияние: левый узел пары получает разделитель родителя и все содержимое правого
+        Inner* target = left != nullptr ? left : node;
+        Inner* source = left != nullptr ? node : right;
+        int sourceAt = left != nullptr ? at : at + 1;
+        target->keys[target->count] = parent->keys[sourceAt - 1];
+        std::memcpy(target->keys + target->count + 1, source->keys, source->count * sizeof(T));
+        std::memcpy(target->children + target->count + 1, source->children, (source->count + 1) * sizeof(void*));
+        target->count += source->count + 1;
+        removeFromParent(parent, sourceAt - 1, sourceAt);
+        allocator.destroy(source);
+        return true;
+    }
+
+    // Деление заполненного листа со вставкой key в позицию pos; возвращает новый правый лист
+    Leaf* splitLeaf(Leaf* leaf, int pos, T key) {
+        T merged[Capacity + 1];
+        std::memcpy(merged, leaf->keys, pos * sizeof(T));
+        merged[pos] = key;
+        std::memcpy(merged + pos + 1, leaf->keys + pos, (Capacity - pos) * sizeof(T));
+
+        int leftCount = (Capacity + 1) / 2;
+        int rightCount = Capacity + 1 - leftCount;
+        Leaf* right = allocator.template create<Leaf>();
+        std::fill(leaf->keys, leaf->keys + Capacity, std::numeric_limits<T>::max());
+        std::memcpy(leaf->keys, merged, leftCount * sizeof(T));
+        std::memcpy(right->keys, merged + leftCount, rightCount * sizeof(T));
+        leaf->count = leftCount;
+        right->count = rightCount;
+
+        right->next = leaf->next;
+        right->prev = leaf;
+        if (leaf->next != nullptr)
+            leaf->next->prev = right;
+        leaf->next = right;
+        return right;
+    }
+
+    // Деление заполненного внутреннего узла со вставкой пары (key, child) в позицию at.
+    // Средний ключ уходит к родителю через up; возвращает новый правый узел
+    Inner* splitInner(Inner* node, int at, T key, void* child, T& up) {
+        T keys[Capacity + 1];
+        void* children[Capacity + 2];
+        std::memcpy(keys, node->keys, Capacity * sizeof(T));
+        std::memcpy(children, node->children, (Capacity + 1) * sizeof(void*));
+        insertAt(keys, Capacity, at, key);
+        insertAt(children, Capacity + 1, at + 1, child);
+
+        int leftCount = Capacity / 2;
+        int rightCount = Capacity - leftCount;  // Один ключ из Capacity + 1 поднимается наверх
+        Inner* right = allocator.template create<Inner>();
+        std::fill(node->keys, node->keys + Capacity, std::numeric_limits<T>::max());
+        std::memcpy(node->keys, keys, leftCount * sizeof(T));
+        std::memcpy(node->children, children, (leftCount + 1) * sizeof(void*));
+        std::memcpy(right->keys, keys + leftCount + 1, rightCount * sizeof(T));
+        std::memcpy(right->children, children + leftCount + 1, (rightCount + 1) * sizeof(void*));
+        node->count = leftCount;
+        right->count = rightCount;
+        up = keys[leftCount];
+        return right;
+    }
+
+    // Разбор без рекурсии: листья освобождаются по цепочке, внутренние узлы — через явный стек
+    void destroy(void* node, int levels) {
+        std::vector<std::pair<Inner*, int>> pending;
+        if (levels > 1)
+            pending.emplace_back(static_cast<Inner*>(node), levels);
+        while (!pending.empty()) {
+            Inner* inner = pending.back().first;
+            int level = pending.back().second;
+            pending.pop_back();
+            if (level > 2)
+                for (int i = 0; i <= inner->count; ++i)
+                    pending.emplace_back(static_cast<Inner*>(inner->children[i]), level - 1);
+            allocator.destroy(inner);
+        }
+        for (Leaf* leaf = first; leaf != nullptr;) {
+            Leaf* next = leaf->next;
+            allocator.destroy(leaf);
+            leaf = next;
+        }
+    }
+};
@@ -1,146 +1,125 @@
 ﻿#include <iostream>
-#include <vector>
-#include <algorithm>
 #include <ctime>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include "Btree.h"
+#include "BPlusTree.h"
+#include "PackedBPlusTree.h"
 
 using namespace std;
 
-// Структура узла B-дерева
-template <typename T>
-struct BTreeNode {
-    vector<T> keys;         // Вектор ключей
-    vector<BTreeNode*> children; // Вектор дочерних узлов
-    bool isLeaf;           // Флаг, указывающий, является ли узел листом
-    int minDegree;         // Минимальная степень (минимальное количество ключей)
-
-    // Конструктор узла
-    BTreeNode(int t, bool leaf) : minDegree(t), isLeaf(leaf) {}
-};
-
-// Класс B-дерева
-template <typename T>
-class BTree {
-private:
-    BTreeNode<T>* root;   // Корень дерева
-public:
-    BTree(int t) : root(nullptr), minDegree(t) {}
-
-    void traverse() {
-        if (root != nullptr)
-            traverse(root);
-        cout << endl;
-    }
-
-    void insert(T key) {
-        if (root == nullptr) {  // Если дерево пустое, создаем корень
-            root = new BTreeNode<T>(minDegree, true);
-            root->keys.push_back(key); // Добавляем ключ в корень
-        }
-        else {  // Если дерево не пустое, вставляем ключ в подходящее место
-            if (root->keys.size() == 2 * minDegree - 1) { // Если корень заполнен
-                auto newRoot = new BTreeNode<T>(minDegree, false);
-                newRoot->children.push_back(root);
-                splitChild(newRoot, 0);
-                int i = 0;
-                if (newRoot->keys[0] < key)
-                    i++;
-                insertNonFull(newRoot->children[i], key);
-                root = newRoot;
-            }
-            else {
-                insertNonFull(root, key);
-            }
-        }
-    }
-
-private:
-    int minDegree;
-    void splitChild(BTreeNode<T>* parent, int index) {
-        auto child = parent->children[index];
-
-        // Проверяем, достаточно ли ключей у дочернего узла для разделения
-        if (child->keys.size() < minDegree) {
-            throw std::runtime_error("Недостаточно ключей для разделения узла.");
-        }
-
-        auto newChild = new BTreeNode<T>(child->minDegree, child->isLeaf);
-
-        // Переносим ключи из старого узла в новый
-        for (int j = 0; j < minDegree - 1; j++) {
-            newChild->keys.push_back(child->keys[j + minDegree]);
-        }
-
-        // Если узел не является листом, переносим дочерние узлы
-        if (!child->isLeaf) {
-            for (int j = 0; j < minDegree; j++) {
-                newChild->children.push_back(child->children[j + minDegree]);
-            }
-        }
-
-        // Обрезаем старый узел
-        child->keys.resize(minDegree - 1);
-
-        // Вставляем новый дочерний узел в родительский
-        parent->children.insert(parent->children.begin() + index + 1, newChild);
-
-        // Вставляем "подъем" ключа в родительский узел
-        parent->keys.insert(parent->keys.begin() + index, child->keys[minDegree - 1]);
-    }
-    void insertNonFull(BTreeNode<T>* node, T key) {
-        int i = node->keys.size() - 1;
-
-        if (node->isLeaf) {
-            node->keys.push_back(0);
-            while (i >= 0 && node->keys[i] > key) {
-                node->keys[i + 1] = node->keys[i];
-                i--;
-            }
-            node->keys[i + 1] = key;
-        }
-        else {
-            while (i >= 0 && node->keys[i] > key)
-                i--;
-
-            if (node->children[i + 1]->keys.size() == 2 * minDegree - 1) {
-                splitChild(node, i + 1);
-
-                if (node->keys[i + 1] < key)
-                    i++;
-            }
-
-            insertNonFull(node->children[i + 1], key);
-        }
-    }
-
-    void traverse(BTreeNode<T>* node) {
-        for (size_t i = 0; i < node->keys.size(); ++i) {
-            if (!node->isLeaf)
-                traverse(node->children[i]);
-
-            cout << node->keys[i] << " ";
-        }
-
-        if (!node->isLeaf)
-            traverse(node->children[node->keys.size()]);
-    }
-};
-
 int main() {
     const int numElements = 1000;
 
     // Инициализируем генератор случайных чисел.
     srand(static_cast<unsigned>(time(0)));
 
-    BTree<int> btree(3);
+    BTree<int, std::less<int>, DefaultNodeAllocator, SetEntry<int>, 3> btree;  // Степень 3: в узле от 2 до 5 ключей
+    BPlusTree<int> bplus;  // Кэш-ориентированный вариант с теми же ключами
 
     // Генерация и вставка случайных элементов в B-дерево.
     for (int i = 0; i < numElements; ++i) {
         int randomValue = rand() % numElements;
         btree.insert(randomValue);
+        bplus.insert(randomValue);
     }
 
     cout << "Элементы в B-дереве: ";
     btree.traverse();
 
+    // Поиск случайного элемента
+    int searchKey = rand() % numElements;
+    cout << "Ищем число: " << searchKey << endl;
+    cout << (btree.search(searchKey) != nullptr ? "Число найдено" : "Число не найдено") << endl;
+
+    // Страница: следующие 10 ключей после искомого, без обхода всего дерева
+    int page[10];
+    size_t pageSize = btree.scan(KeyRange<int>::greaterThan(searchKey)).fetch(page, 10);
+    cout << "10 ключей после " << searchKey << ": ";
+    for (size_t i = 0; i < pageSize; ++i)
+        cout << page[i] << " ";
+    cout << endl;
+
+    // Строки и UUID ищутся в узле своими быстрыми путями (префикс строки числом, UUID без ветвлений)
+    BTree<std::string> words;
+    for (const char* word : { "омега", "альфа", "бета", "user:000002", "user:000001" })
+        words.insert(word);
+    cout << "Строки в B-дереве: ";
+    words.traverse();
+    BTree<Uuid> ids;
+    ids.insert(Uuid(0x123e4567e89b12d3, 0xa456426614174000));
+    ids.insert(Uuid(0x00112233445566, 0x778899aabbccddee));
+    cout << "UUID в B-дереве: ";
+    ids.traverse();
+
+
+    cout << "Уникальные элементы в B+дереве: ";
+    bplus.traverse();
+
+    // Обход диапазона по связанным листам B+дерева
+    cout << "Элементы B+дерева в диапазоне [100, 200]: ";
+    bplus.forEachInRange(100, 200, [](int key) { cout << key << " "; });
+    cout << endl;
+
+    // Снимок с поддельным числом элементов в заголовке (и пересчитанной суммой заголовка)
+    // отвергается до сборки: элементов не может быть больше, чем байт до конца снимка
+    ostringstream saved;
+    bplus.save(saved);
+    for (uint64_t forged : { ~uint64_t(0), uint64_t(1) << 40 }) {
+        string bytes = saved.str();
+        for (int i = 0; i < 8; ++i)
+            bytes[16 + i] = static_cast<char>(forged >> (8 * i));
+        uint32_t crc = snapshotCrc(reinterpret_cast<const unsigned char*>(bytes.data()), kSnapshotHeaderSize - 4);
+        for (int i = 0; i < 4; ++i)
+            bytes[kSnapshotHeaderSize - 4 + i] = static_cast<char>(crc >> (8 * i));
+        istringstream forgedBPlus(bytes), forgedBTree(bytes);
+        BPlusTree<int> loadedBPlus;
+        BTree<int> loadedBTree;
+        try {
+            loadedBPlus.load(forgedBPlus);
+            cout << "Ошибка: B+дерево загрузило снимок с count = " << forged << endl;
+        }
+        catch (const runtime_error& e) {
+            cout << "B+дерево, count = " << forged << ": " << e.what() << endl;
+        }
+        try {
+            loadedBTree.load(forgedBTree);
+            cout << "Ошибка: B-дерево загрузило снимок с count = " << forged << endl;
+        }
+        catch (const runtime_error& e) {
+            cout << "B-дерево, count = " << forged << ": " << e.what() << endl;
+        }
+    }
+
+    // Десятый байт varint несет только старший бит числа: 0x01 — это 2^64 - 1,
+    // 0x02 раньше молча терялся; сейчас он и продолжение после десятого байта — повреждение
+    const unsigned char varints[3][11] = {
+        { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x01 },
+        { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x02 },
+        { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x00 },
+    };
+    for (const unsigned char (&varint)[11] : varints) {
+        SnapshotCursor cursor(varint, sizeof(varint));
+        try {
+            uint64_t value = cursor.getVarint();
+            cout << "Varint из 10 байт: " << value << endl;
+        }
+        catch (const runtime_error& e) {
+            cout << "Varint из 10 байт: " << e.what() << endl;
+        }
+    }
+
+    // Плотные 64-битные идентификаторы: лист хранит разности с наименьшим ключом по байту,
+    // и ключей в нем в несколько раз больше, чем в несжатом листе того же размера
+    PackedBPlusTree<int64_t> packed;
+    const int64_t firstId = int64_t(1) << 40;
+    for (int64_t id = firstId; id < firstId + 100000; ++id)
+        packed.insert(id);
+    cout << "Упакованное B+дерево: " << packed.size() << " идентификаторов в " << packed.leaves() << " листах, "
+         << (packed.hasDirectory() ? "поиск через радиксный каталог" : "поиск спуском") << endl;
+    cout << "Идентификатор " << firstId + 4242 << (packed.contains(firstId + 4242) ? " найден" : " не найден") << endl;
+
     return 0;
 }
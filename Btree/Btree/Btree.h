@@ -0,0 +1,1250 @@
+﻿#pragma once
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <vector>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include "../../Common/BatchSearch.h"
+#include "../../Common/BulkBuild.h"
+#include "../../Common/NodeAllocator.h"
+#include "../../Common/OrderedContainers.h"
+#include "../../Common/RangeCursor.h"
+#include "../../Common/Snapshot.h"
+#include "../../Common/TreeStats.h"
+#include "../../Common/Uuid.h"
+
+// Массив фиксированной емкости внутри узла B-дерева: элементы лежат прямо в узле, а не в отдельном
+// блоке, как у std::vector, поэтому узел — одно выделение памяти постоянного размера.
+// Интерфейс — та часть std::vector, которой пользуется BTree. Свободные ячейки хранят
+// сконструированные по умолчанию элементы: удаленный элемент заменяется T(), и строки
+// или другие владеющие памятью значения отдают ее сразу
+template <typename T, size_t Capacity>
+class NodeArray {
+public:
+    NodeArray() : count(0), items() {}
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T* data() { return items.data(); }
+    const T* data() const { return items.data(); }
+    T* begin() { return items.data(); }
+    const T* begin() const { return items.data(); }
+    T* end() { return items.data() + count; }
+    const T* end() const { return items.data() + count; }
+    T& operator[](size_t i) { return items[i]; }
+    const T& operator[](size_t i) const { return items[i]; }
+    T& front() { return items[0]; }
+    const T& front() const { return items[0]; }
+    T& back() { return items[count - 1]; }
+    const T& back() const { return items[count - 1]; }
+
+    void push_back(T value) { items[count++] = std::move(value); }
+    template <typename... Args>
+    void emplace_back(Args&&... args) { items[count++] = T(std::forward<Args>(args)...); }
+    void pop_back() { reset(begin() + --count); }
+    template <typename... Args>
+    T* emplace(T* pos, Args&&... args) {
+        T value(std::forward<Args>(args)...);  // Аргументы могут ссылаться на сдвигаемые элементы
+        std::move_backward(pos, end(), end() + 1);
+        ++count;
+        *pos = std::move(value);
+        return pos;
+    }
+    T* insert(T* pos, T value) { return emplace(pos, std::move(value)); }
+    template <typename It>
+    void insert(T* pos, It first, It last) {
+        size_t n = std::distance(first, last);
+        std::move_backward(pos, end(), end() + n);
+        std::copy(first, last, pos);
+        count += static_cast<uint32_t>(n);
+    }
+    template <typename It>
+    void assign(It first, It last) {
+        clear();
+        insert(begin(), first, last);
+    }
+    void erase(T* pos) { erase(pos, pos + 1); }
+    void erase(T* first, T* last) {
+        T* tail = std::move(last, end(), first);
+        for (T* p = tail; p != end(); ++p)
+            reset(p);
+        count = static_cast<uint32_t>(tail - begin());
+    }
+    // Только уменьшение
+    void resize(size_t n) { erase(begin() + n, end()); }
+    void clear() { erase(begin(), end()); }
+
+private:
+    uint32_t count;
+    std::array<T, Capacity> items;
+
+    static void reset(T* p) {
+        if constexpr (!std::is_trivially_destructible<T>::value)
+            *p = T();
+    }
+};
+
+// Узел B-дерева минимальной степени Degree: от Degree - 1 до 2 * Degree - 1 ключей (корень — от одного).
+// Ключи лежат в самом узле. Потомки есть только у внутренних узлов (BTreeInnerNode),
+// лист их не хранит и занимает меньше памяти
+template <typename T, int Degree>
+struct BTreeNode {
+    static constexpr size_t kMaxKeys = 2 * Degree - 1;
+    using Children = NodeArray<BTreeNode*, kMaxKeys + 1>;
+
+    bool isLeaf;                   // Флаг, указывающий, является ли узел листом
+    size_t subtreeSize;            // Число элементов в поддереве: ключи узла и всех его потомков
+    NodeArray<T, kMaxKeys> keys;   // Ключи по возрастанию
+
+    explicit BTreeNode(bool leaf) : isLeaf(leaf), subtreeSize(0) {}
+
+    // Потомки внутреннего узла
+    Children& children();
+    const Children& children() const;
+};
+
+template <typename T, int Degree>
+struct BTreeInnerNode : BTreeNode<T, Degree> {
+    typename BTreeNode<T, Degree>::Children childNodes;  // На одного больше, чем ключей
+
+    BTreeInnerNode() : BTreeNode<T, Degree>(false) {}
+};
+
+template <typename T, int Degree>
+typename BTreeNode<T, Degree>::Children& BTreeNode<T, Degree>::children() {
+    return static_cast<BTreeInnerNode<T, Degree>*>(this)->childNodes;
+}
+
+template <typename T, int Degree>
+const typename BTreeNode<T, Degree>::Children& BTreeNode<T, Degree>::children() const {
+    return static_cast<const BTreeInnerNode<T, Degree>*>(this)->childNodes;
+}
+
+// Поиск позиции ключа среди count отсортированных элементов узла; compared — счетчик сравнений
+// для TreeStats. Общий случай — двоичный поиск компаратором. Быстрые пути — специализации ниже
+// с теми же функциями: числовые ключи, строки (std::string, std::string_view) и UUID (Uuid.h)
+template <typename Entry, typename Compare, size_t Capacity, typename = void>
+struct BTreeNodeSearch {
+    using value_type = typename Entry::value_type;
+
+    // Первый элемент, не меньший key
+    template <typename K>
+    static size_t lower(const value_type* items, size_t count, const K& key, const Compare& comp, uint64_t& compared) {
+        return std::lower_bound(items, items + count, key,
+            [&](const value_type& value, const K& k) { ++compared; return comp(Entry::key(value), k); }) - items;
+    }
+    // Первый элемент, больший key
+    template <typename K>
+    static size_t upper(const value_type* items, size_t count, const K& key, const Compare& comp, uint64_t& compared) {
+        return std::upper_bound(items, items + count, key,
+            [&](const K& k, const value_type& value) { ++compared; return comp(k, Entry::key(value)); }) - items;
+    }
+};
+
+// Числовые ключи множества в естественном порядке: позиция — число меньших ключей, подсчитанное
+// без ветвлений. Цикл идет по всем ячейкам узла, граница — константа, и компилятор разворачивает
+// и векторизует его; ячейки за последним ключом отсекает маска. Для крупных узлов (больше 64 ячеек)
+// полный просмотр дороже двоичного поиска, там остается общий путь
+template <typename Key, size_t Capacity>
+struct BTreeNodeSearch<SetEntry<Key>, std::less<Key>, Capacity, std::enable_if_t<std::is_arithmetic<Key>::value>> {
+    using General = BTreeNodeSearch<SetEntry<Key>, std::less<Key>, Capacity, int>;  // Основной шаблон
+
+    template <typename K>
+    static size_t lower(const Key* items, size_t count, const K& key, const std::less<Key>& comp, uint64_t& compared) {
+        if constexpr (std::is_same<K, Key>::value && Capacity <= 64) {
+            size_t result = 0;
+            for (size_t i = 0; i < Capacity; ++i)
+                result += (i < count) & (items[i] < key);
+            compared += count;
+            return result;
+        }
+        else {
+            return General::lower(items, count, key, comp, compared);
+        }
+    }
+    template <typename K>
+    static size_t upper(const Key* items, size_t count, const K& key, const std::less<Key>& comp, uint64_t& compared) {
+        if constexpr (std::is_same<K, Key>::value && Capacity <= 64) {
+            size_t result = 0;
+            for (size_t i = 0; i < Capacity; ++i)
+                result += (i < count) & !(key < items[i]);
+            compared += count;
+            return result;
+        }
+        else {
+            return General::upper(items, count, key, comp, compared);
+        }
+    }
+};
+
+// Тип ключа элемента Entry
+template <typename Entry>
+using EntryKeyType = std::decay_t<decltype(Entry::key(std::declval<const typename Entry::value_type&>()))>;
+
+// Компаратор задает естественный порядок Key: std::less<Key> или прозрачный std::less<>
+template <typename Compare, typename Key>
+constexpr bool kNaturalOrder = std::is_same<Compare, std::less<Key>>::value || std::is_same<Compare, std::less<>>::value;
+
+template <typename Key>
+constexpr bool kStringKey = std::is_same<Key, std::string>::value || std::is_same<Key, std::string_view>::value;
+
+// Первые 8 байт строки числом big-endian, недостающие байты — нули. Строки сравниваются побайтно
+// как unsigned char (char_traits<char>), поэтому разные префиксы упорядочены так же, как строки;
+// при равных префиксах (и у строк, отличающихся только дальше восьмого байта) решает полное сравнение
+inline uint64_t stringPrefix(std::string_view s) {
+    unsigned char bytes[8] = {};
+    std::memcpy(bytes, s.data(), s.size() < 8 ? s.size() : 8);
+    uint64_t prefix = 0;
+    for (unsigned char b : bytes)
+        prefix = prefix << 8 | b;
+    return prefix;
+}
+
+// Строковые ключи в естественном порядке: двоичный поиск, но на каждом шаге сначала сравниваются
+// 8-байтные префиксы как числа — префикс искомого ключа считается один раз, а memcmp с разбором
+// длин нужен только при совпадении префиксов. Ключи вида "user:000123" различаются дальше
+// восьмого байта и идут полным сравнением — выигрыш там, где различаются первые байты
+template <typename Entry, typename Compare, size_t Capacity>
+struct BTreeNodeSearch<Entry, Compare, Capacity,
+                       std::enable_if_t<kStringKey<EntryKeyType<Entry>> && kNaturalOrder<Compare, EntryKeyType<Entry>>>> {
+    using value_type = typename Entry::value_type;
+    using General = BTreeNodeSearch<Entry, Compare, Capacity, int>;  // Основной шаблон
+
+    template <typename K>
+    static size_t lower(const value_type* items, size_t count, const K& key, const Compare& comp, uint64_t& compared) {
+        if constexpr (std::is_convertible<const K&, std::string_view>::value) {
+            std::string_view needle(key);
+            uint64_t prefix = stringPrefix(needle);
+            return std::lower_bound(items, items + count, needle, [&](const value_type& value, std::string_view k) {
+                ++compared;
+                std::string_view item(Entry::key(value));
+                uint64_t p = stringPrefix(item);
+                return p != prefix ? p < prefix : item < k;
+            }) - items;
+        }
+        else {
+            return General::lower(items, count, key, comp, compared);
+        }
+    }
+    template <typename K>
+    static size_t upper(const value_type* items, size_t count, const K& key, const Compare& comp, uint64_t& compared) {
+        if constexpr (std::is_convertible<const K&, std::string_view>::value) {
+            std::string_view needle(key);
+            uint64_t prefix = stringPrefix(needle);
+            return std::upper_bound(items, items + count, needle, [&](std::string_view k, const value_type& value) {
+                ++compared;
+                std::string_view item(Entry::key(value));
+                uint64_t p = stringPrefix(item);
+                return p != prefix ? prefix < p : k < item;
+            }) - items;
+        }
+        else {
+            return General::upper(items, count, key, comp, compared);
+        }
+    }
+};
+
+// UUID в естественном порядке: как у числовых ключей, подсчет меньших без ветвлений по всем ячейкам
+// узла (до 64), каждое сравнение — две пары 64-битных половин вместо memcmp по 16 байтам
+template <typename Entry, typename Compare, size_t Capacity>
+struct BTreeNodeSearch<Entry, Compare, Capacity,
+                       std::enable_if_t<std::is_same<EntryKeyType<Entry>, Uuid>::value && kNaturalOrder<Compare, Uuid>>> {
+    using value_type = typename Entry::value_type;
+    using General = BTreeNodeSearch<Entry, Compare, Capacity, int>;  // Основной шаблон
+
+    template <typename K>
+    static size_t lower(const value_type* items, size_t count, const K& key, const Compare& comp, uint64_t& compared) {
+        if constexpr (std::is_same<K, Uuid>::value && Capacity <= 64) {
+            size_t result = 0;
+            for (size_t i = 0; i < Capacity; ++i) {
+                const Uuid& item = Entry::key(items[i]);
+                bool less = (item.high < key.high) | ((item.high == key.high) & (item.low < key.low));
+                result += (i < count) & less;
+            }
+            compared += count;
+            return result;
+        }
+        else {
+            return General::lower(items, count, key, comp, compared);
+        }
+    }
+    template <typename K>
+    static size_t upper(const value_type* items, size_t count, const K& key, const Compare& comp, uint64_t& compared) {
+        if constexpr (std::is_same<K, Uuid>::value && Capacity <= 64) {
+            size_t result = 0;
+            for (size_t i = 0; i < Capacity; ++i) {
+                const Uuid& item = Entry::key(items[i]);
+                bool notGreater = (item.high < key.high) | ((item.high == key.high) & (item.low <= key.low));
+                result += (i < count) & notGreater;
+            }
+            compared += count;
+            return result;
+        }
+        else {
+            return General::upper(items, count, key, comp, compared);
+        }
+    }
+};
+
+// Степень B-дерева по умолчанию (и для контейнеров BTreeSet / BTreeMap)
+constexpr int kBTreeDefaultDegree = 16;
+
+// Класс B-дерева.
+// Дерево владеет своими узлами; память под них выделяет политика NodeAllocator (см. NodeAllocator.h).
+// Ключи уникальны и упорядочены компаратором Compare; Entry задает, что хранит дерево: ключи (SetEntry),
+// пары ключ-значение (MapEntry), ключи со счетчиками (CountedEntry) или ключи со списками значений
+// (MultiMapEntry), и что делает вставка уже имеющегося ключа, см. OrderedContainers.h.
+// Минимальная степень Degree — параметр шаблона: узлы фиксированного размера, циклы по ключам
+// ограничены константами, а элементы должны конструироваться по умолчанию (ими заполнены свободные ячейки).
+// Поиск, вставка, удаление и обход выполняются циклами за один спуск, без рекурсии.
+// Узел хранит число элементов своего поддерева, поэтому ранг ключа, k-й элемент и число
+// ключей в отрезке находятся за один спуск: O(t log_t n), по t потомков на уровень.
+// Элементы переезжают между узлами при делении и слиянии, поэтому любая вставка
+// или удаление делает итераторы недействительными.
+template <typename Key = int, typename Compare = std::less<Key>, typename NodeAllocator = DefaultNodeAllocator,
+          typename Entry = SetEntry<Key>, int Degree = kBTreeDefaultDegree>
+class BTree {
+    static_assert(Degree >= 2, "Минимальная степень B-дерева не меньше 2");
+
+public:
+    using key_type = Key;
+    using key_compare = Compare;
+    using entry_type = Entry;
+    using value_type = typename Entry::value_type;
+    using Node = BTreeNode<value_type, Degree>;
+
+private:
+    Node* root;   // Корень дерева
+public:
+    static constexpr int kMaxHeight = 64;  // При степени от 2 высота не больше log2(n) + 1
+    static constexpr size_t kDegree = Degree;
+    static constexpr size_t kMaxKeys = Node::kMaxKeys;
+
+    // Двунаправленный итератор: стек пар (узел, позиция) от корня до текущего узла.
+    // В текущем (верхнем) узле позиция — номер ключа, в предках — номер потомка, в котором идет обход
+    class Iterator {
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = typename Entry::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = value_type*;
+        using reference = value_type&;
+
+        Iterator() : tree(nullptr), depth(0) {}
+        // Копируется только занятая часть стека
+        Iterator(const Iterator& other) : tree(other.tree), depth(other.depth) {
+            std::copy(other.path, other.path + other.depth, path);
+        }
+        Iterator& operator=(const Iterator& other) {
+            tree = other.tree;
+            depth = other.depth;
+            std::copy(other.path, other.path + other.depth, path);
+            return *this;
+        }
+
+        reference operator*() const { return top().node->keys[top().index]; }
+        pointer operator->() const { return &top().node->keys[top().index]; }
+        Iterator& operator++() {
+            Frame& frame = top();
+            ++frame.index;
+            if (!frame.node->isLeaf) {
+                pushLeft(frame.node->children()[frame.index]);  // Следующий ключ — самый левый в правом поддереве
+                return *this;
+            }
+            // Лист пройден: поднимаемся до первого узла, у которого остались ключи
+            settle();
+            return *this;
+        }
+        Iterator operator++(int) {
+            Iterator copy = *this;
+            ++*this;
+            return copy;
+        }
+        Iterator& operator--() {
+            if (depth == 0) {
+                pushRight(tree->root);  // Шаг назад от конца — наибольший ключ
+                return *this;
+            }
+            Frame& frame = top();
+            if (!frame.node->isLeaf) {
+                pushRight(frame.node->children()[frame.index]);  // Предыдущий ключ — самый правый в левом поддереве
+                return *this;
+            }
+            if (frame.index > 0) {
+                --frame.index;
+                return *this;
+            }
+            // Первый ключ листа: поднимаемся, пока пришли из самого левого потомка
+            --depth;
+            while (depth > 0 && top().index == 0)
+                --depth;
+            --top().index;
+            return *this;
+        }
+        Iterator operator--(int) {
+            Iterator copy = *this;
+            --*this;
+            return copy;
+        }
+        bool operator==(const Iterator& other) const {
+            if (depth == 0 || other.depth == 0)
+                return depth == other.depth;
+            return top().node == other.top().node && top().index == other.top().index;
+        }
+        bool operator!=(const Iterator& other) const { return !(*this == other); }
+
+    private:
+        friend class BTree;
+
+        struct Frame {
+            Node* node;
+            size_t index;
+        };
+        const BTree* tree;   // Нужен, чтобы шагнуть назад от конца
+        Frame path[kMaxHeight];
+        int depth;
+
+        explicit Iterator(const BTree* tree) : tree(tree), depth(0) {}
+
+        Frame& top() { return path[depth - 1]; }
+        const Frame& top() const { return path[depth - 1]; }
+        void push(Node* node, size_t index) { path[depth++] = Frame{ node, index }; }
+        void pushLeft(Node* node) {
+            for (; node != nullptr; node = node->isLeaf ? nullptr : node->children()[0])
+                push(node, 0);
+        }
+        void pushRight(Node* node) {
+            for (; node != nullptr && !node->isLeaf; node = node->children()[node->keys.size()])
+                push(node, node->keys.size());
+            if (node != nullptr)
+                push(node, node->keys.size() - 1);
+        }
+        // Снимаем узлы, в которых ключи справа от позиции закончились
+        void settle() {
+            while (depth > 0 && top().index == top().node->keys.size())
+                --depth;
+        }
+    };
+
+    explicit BTree(const Compare& comp = Compare()) : root(nullptr), size_(0), comp(comp) {}
+    ~BTree() { clear(); }
+    BTree(const BTree&) = delete;
+    BTree& operator=(const BTree&) = delete;
+
+    Iterator begin() const {
+        Iterator it(this);
+        it.pushLeft(root);
+        return it;
+    }
+    Iterator end() const { return Iterator(this); }
+    size_t size() const { return size_; }
+    const Compare& keyComp() const { return comp; }
+    // Счетчики горячего пути (TreeStats.h); без TREE_STATS — нули.
+    // Сравнения считаются в поиске внутри узлов (BTreeNodeSearch)
+    TreeStats stats() const { return counters.snapshot(height()); }
+    void resetStats() { counters.reset(); }
+
+    // Удаление всех узлов
+    void clear() {
+        // Узлы с нетривиальными элементами приходится разрушать по одному; память аллокатора уходит разом
+        if (!NodeAllocator::kBulkRelease || !std::is_trivially_destructible<Node>::value)
+            destroy(root);
+        allocator.release();
+        root = nullptr;
+        size_ = 0;
+    }
+
+    // Замена содержимого элементами из [first, last), отсортированными по возрастанию без повторов.
+    // Узлы собираются снизу вверх за O(n): элементы раскладываются по листьям поровну,
+    // по одному элементу между соседними листьями уходит разделителем на уровень выше, и так до корня.
+    // Узлы заполняются на долю fill от емкости 2t - 1, но не меньше t - 1 ключей.
+    // Плотная упаковка (fill = 1) дает самое низкое дерево для чтения; под вставки лучше оставить запас
+    template <typename ForwardIt>
+    void buildFromSorted(ForwardIt first, ForwardIt last, double fill = 1.0) {
+        buildCounted(first, std::distance(first, last), fill);
+    }
+
+    // То же в threads потоков: листья (почти все элементы) заполняют рабочие потоки кусками,
+    // верхние уровни достраивает текущий поток
+    template <typename RandomIt>
+    void buildFromSortedParallel(RandomIt first, RandomIt last, double fill = 1.0,
+                                 unsigned threads = defaultBuildThreads()) {
+        size_t count = last - first;
+        if (threads <= 1 || count < 2 * kParallelBuildMin) {
+            buildFromSorted(first, last, fill);
+            return;
+        }
+        clear();
+        size_t target = slotTarget(fill);
+        EvenSplit split = levelSplit(count, target);
+        EvenSplit chunks(split.parts, std::min<size_t>(split.parts, threads * 4));
+        std::vector<Node*> nodes(split.parts, nullptr);
+        std::vector<value_type> separators;
+        std::vector<NodeAllocator> allocators(threads);
+        try {
+            runParallel(chunks.parts, threads, [&](unsigned worker, size_t chunk) {
+                size_t end = chunks.offset(chunk) + chunks.size(chunk);
+                for (size_t j = chunks.offset(chunk); j < end; ++j) {
+                    nodes[j] = allocators[worker].template create<Node>(true);
+                    RandomIt it = first + split.offset(j);
+                    fillLeaf(nodes[j], it, split.size(j) - 1);
+                }
+            });
+            // Разделитель — последняя ячейка группы каждого листа, кроме последнего
+            separators.reserve(split.parts - 1);
+            for (size_t j = 1; j < split.parts; ++j)
+                separators.push_back(first[split.offset(j) - 1]);
+        }
+        catch (...) {
+            for (NodeAllocator& other : allocators)
+                allocator.adopt(other);
+            for (Node* leaf : nodes)
+                destroy(leaf);
+            throw;
+        }
+        for (NodeAllocator& other : allocators)
+            allocator.adopt(other);
+        root = buildUpper(nodes, separators, target);
+        size_ = count;
+    }
+
+    void traverse() {
+        for (const value_type& key : *this)
+            std::cout << key << " ";
+        std::cout << std::endl;
+    }
+
+    // Поиск ключа: возвращает узел, содержащий ключ, или nullptr
+    template <typename K>
+    Node* search(const K& key) const {
+        TreeDescent descent(counters);
+        Node* node = root;
+        while (node != nullptr) {
+            descent.visit();
+            // Первый ключ, не меньший искомого
+            size_t i = lowerIndex(node, key);
+            if (i < node->keys.size() && !comp(key, Entry::key(node->keys[i])))
+                return node;
+            node = node->isLeaf ? nullptr : node->children()[i];
+        }
+        return nullptr;
+    }
+
+    // Поиск сразу count ключей: results[i] = search(keys[i]). Спуски разных ключей чередуются
+    // с упреждающей загрузкой (BatchSearch.h). Ключи лежат в самом узле, поэтому уровень проходится
+    // за два шага: поиск в узле с запросом указателя на нужного потомка, затем запрос самого потомка
+    template <typename K>
+    void searchBatch(const K* keys, size_t count, Node** results) const {
+        struct State {
+            const Node* node;
+            size_t index;
+            size_t child;  // Номер потомка, в который идет спуск (на втором шаге)
+            int phase;     // 0 — загружен узел, 1 — указатель на потомка
+        };
+        interleavedSearch<State>(count,
+            [&](State& state, size_t index) {
+                state.node = root;
+                state.index = index;
+                state.phase = 0;
+                if (root != nullptr)
+                    return false;
+                results[index] = nullptr;
+                return true;
+            },
+            [&](State& state) {
+                const Node* node = state.node;
+                if (state.phase == 0) {
+                    const K& key = keys[state.index];
+                    size_t i = lowerIndex(node, key);
+                    if (i < node->keys.size() && !comp(key, Entry::key(node->keys[i]))) {
+                        results[state.index] = const_cast<Node*>(node);
+                        return true;
+                    }
+                    if (node->isLeaf) {
+                        results[state.index] = nullptr;
+                        return true;
+                    }
+                    prefetchLine(&node->children()[i]);
+                    state.child = i;
+                    state.phase = 1;
+                    return false;
+                }
+                // Заголовок узла и его ключи; потомки внутреннего узла идут после них и не нужны
+                state.node = node->children()[state.child];
+                prefetchRange(state.node, sizeof(Node));
+                state.phase = 0;
+                return false;
+            });
+    }
+
+    template <typename K>
+    Iterator find(const K& key) const {
+        Iterator it(this);
+        Node* node = root;
+        while (node != nullptr) {
+            size_t i = lowerIndex(node, key);
+            it.push(node, i);
+            if (i < node->keys.size() && !comp(key, Entry::key(node->keys[i])))
+                return it;
+            node = node->isLeaf ? nullptr : node->children()[i];
+        }
+        return end();
+    }
+
+    // Число вхождений ключа: 0 или 1, у мультимножества и мультисловаря — Entry::count элемента
+    template <typename K>
+    size_t count(const K& key) const {
+        Iterator it = find(key);
+        return it != end() ? Entry::count(*it) : 0;
+    }
+
+    // Первый элемент, не меньший key
+    template <typename K>
+    Iterator lowerBound(const K& key) const {
+        Iterator it(this);
+        for (Node* node = root; node != nullptr;) {
+            size_t i = lowerIndex(node, key);
+            it.push(node, i);
+            node = node->isLeaf ? nullptr : node->children()[i];
+        }
+        it.settle();  // Если в листе подходящих нет, ответ — разделитель в ближайшем предке
+        return it;
+    }
+
+    // Первый элемент, больший key
+    template <typename K>
+    Iterator upperBound(const K& key) const {
+        Iterator it(this);
+        for (Node* node = root; node != nullptr;) {
+            size_t i = upperIndex(node, key);
+            it.push(node, i);
+            node = node->isLeaf ? nullptr : node->children()[i];
+        }
+        it.settle();
+        return it;
+    }
+
+    // Элементы с ключом key, [first, last). Элемент на ключ один, поэтому хватает спуска lowerBound
+    template <typename K>
+    std::pair<Iterator, Iterator> equalRange(const K& key) const {
+        Iterator first = lowerBound(key);
+        Iterator last = first;
+        if (first != end() && !comp(key, Entry::key(*first)))
+            ++last;
+        return { first, last };
+    }
+
+    // Курсор по элементам с ключами из отрезка [lo, hi] (RangeCursor.h): начало ищется за O(log n),
+    // дальше элементы выдаются лениво, по одному или пачками
+    RangeCursor<BTree> range(const Key& lo, const Key& hi, ScanDirection direction = ScanDirection::Forward) const {
+        return RangeCursor<BTree>(*this, KeyRange<Key>::closed(lo, hi), direction);
+    }
+    // То же для любого диапазона: с открытыми границами, после ключа X и т. д.
+    RangeCursor<BTree> scan(const KeyRange<Key>& keys, ScanDirection direction = ScanDirection::Forward) const {
+        return RangeCursor<BTree>(*this, keys, direction);
+    }
+    // Пакетное чтение для RangeCursor: ключи листа, в котором стоит it, копируются в out одним куском —
+    // в направлении обхода до края листа или до last включительно, но не больше capacity.
+    // it остается на последнем скопированном элементе. Во внутреннем узле ключи чередуются
+    // с поддеревьями, там копируется один элемент
+    static size_t copyRun(Iterator& it, const Iterator& last, bool forward, value_type* out, size_t capacity) {
+        typename Iterator::Frame& frame = it.top();
+        const Node* node = frame.node;
+        if (!node->isLeaf) {
+            *out = node->keys[frame.index];
+            return 1;
+        }
+        bool lastHere = last.top().node == node;
+        size_t count;
+        if (forward) {
+            size_t end = lastHere ? last.top().index + 1 : node->keys.size();
+            count = std::min(capacity, end - frame.index);
+            std::copy(node->keys.begin() + frame.index, node->keys.begin() + frame.index + count, out);
+            frame.index += count - 1;
+        }
+        else {
+            size_t begin = lastHere ? last.top().index : 0;
+            count = std::min(capacity, frame.index + 1 - begin);
+            std::reverse_copy(node->keys.begin() + (frame.index + 1 - count), node->keys.begin() + frame.index + 1, out);
+            frame.index -= count - 1;
+        }
+        return count;
+    }
+
+    // Вставка элемента за один спуск; если ключ уже существует, элемент сливается с имеющимся
+    // (Entry::merge: множество и словарь не меняются, у мультимножества растет счетчик)
+    void insert(const value_type& value) {
+        std::pair<Iterator, bool> result = tryEmplace(Entry::key(value), value);
+        if (!result.second)
+            Entry::merge(*result.first, value);
+    }
+
+    // Вставка значения, построенного из аргументов, если такого ключа еще нет
+    template <typename... Args>
+    std::pair<Iterator, bool> emplaceUnique(Args&&... args) {
+        value_type value(std::forward<Args>(args)...);
+        return tryEmplace(Entry::key(value), std::move(value));
+    }
+
+    // Вставка по ключу за один спуск: значение строится из аргументов, только если ключа еще нет
+    template <typename K, typename... Args>
+    std::pair<Iterator, bool> tryEmplace(const K& key, Args&&... args) {
+        Iterator it(this);
+        if (root == nullptr) {
+            root = allocator.template create<Node>(true);
+            root->keys.emplace_back(std::forward<Args>(args)...);
+            root->subtreeSize = 1;
+            ++size_;
+            it.push(root, 0);
+            return { it, true };
+        }
+        growRoot();
+        TreeDescent descent(counters);
+        Node* node = root;
+        while (true) {
+            descent.visit();
+            size_t i = lowerIndex(node, key);
+            if (i < node->keys.size() && !comp(key, Entry::key(node->keys[i]))) {
+                it.push(node, i);
+                return { it, false };
+            }
+            if (node->isLeaf) {
+                node->keys.emplace(node->keys.begin() + i, std::forward<Args>(args)...);
+                ++size_;
+                it.push(node, i);
+                for (int level = 0; level < it.depth; ++level)
+                    ++it.path[level].node->subtreeSize;  // Элемент добавился в каждое поддерево на пути
+                return { it, true };
+            }
+            // Заполненный потомок делится до перехода в него; поднявшийся ключ сравниваем заново
+            if (node->children()[i]->keys.size() == kMaxKeys) {
+                splitChild(node, i);
+                if (!comp(key, Entry::key(node->keys[i]))) {
+                    if (!comp(Entry::key(node->keys[i]), key)) {
+                        it.push(node, i);
+                        return { it, false };
+                    }
+                    ++i;
+                }
+            }
+            it.push(node, i);
+            node = node->children()[i];
+        }
+    }
+
+    // Удаление ключа; возвращает false, если ключа нет
+    template <typename K>
+    bool erase(const K& key) {
+        if (root == nullptr)
+            return false;
+
+        bool erased = remove(root, key);
+        if (erased)
+            --size_;
+
+        // Корень опустел: дерево становится ниже на уровень
+        if (root->keys.empty()) {
+            Node* oldRoot = root;
+            root = root->isLeaf ? nullptr : root->children()[0];
+            destroyNode(oldRoot);
+        }
+        return erased;
+    }
+
+    // Удаление одного вхождения ключа (Entry::release): у мультимножества уменьшается счетчик,
+    // элемент удаляется, когда вхождений не осталось. false, если ключа нет
+    template <typename K>
+    bool eraseOne(const K& key) {
+        Iterator it = find(key);
+        if (it == end())
+            return false;
+        if (Entry::release(*it))
+            erase(key);
+        return true;
+    }
+
+    // Удаление по итератору; возвращает итератор на следующий элемент.
+    // Узлы перестраиваются, поэтому следующий элемент находится заново по копии его ключа
+    Iterator erase(Iterator pos) {
+        Iterator next = pos;
+        ++next;
+        Key erasedKey = Entry::key(*pos);  // Копия: сам элемент может переехать во время удаления
+        if (next == end()) {
+            erase(erasedKey);
+            return end();
+        }
+        Key nextKey = Entry::key(*next);
+        erase(erasedKey);
+        return lowerBound(nextKey);
+    }
+
+    // Снимок дерева в поток (формат — в Snapshot.h): элементы по порядку, блоками с контрольными суммами
+    void save(std::ostream& out, SnapshotEncoding encoding = SnapshotEncoding::Compact) const {
+        saveSnapshot<Entry>(out, begin(), end(), size_, encoding);
+    }
+
+    // Замена содержимого снимком из потока; узлы собираются снизу вверх, как в buildFromSorted,
+    // с заполнением fill. При ошибке (снимок поврежден или с другими типами элементов) исключение,
+    // дерево остается пустым
+    void load(std::istream& in, double fill = 1.0) {
+        try {
+            SnapshotReader<Entry, Compare> reader(in, comp, true);
+            buildCounted(reader.begin(), reader.size(), fill);
+            reader.finish();
+        }
+        catch (...) {
+            clear();
+            throw;
+        }
+    }
+
+    // Сколько элементов меньше key
+    template <typename K>
+    size_t rank(const K& key) const {
+        size_t result = 0;
+        for (Node* node = root; node != nullptr;) {
+            size_t i = lowerIndex(node, key);
+            result += countBefore(node, i);
+            node = node->isLeaf ? nullptr : node->children()[i];
+        }
+        return result;
+    }
+
+    // Сколько элементов с ключами в отрезке [lo, hi]
+    template <typename K>
+    size_t countRange(const K& lo, const K& hi) const {
+        if (comp(hi, lo))
+            return 0;
+        size_t notGreater = 0;
+        for (Node* node = root; node != nullptr;) {
+            size_t i = upperIndex(node, hi);
+            notGreater += countBefore(node, i);
+            node = node->isLeaf ? nullptr : node->children()[i];
+        }
+        return notGreater - rank(lo);
+    }
+
+    // k-й по порядку элемент (с нуля); end(), если k >= size()
+    Iterator select(size_t k) const {
+        Iterator it(this);
+        if (k >= size_)
+            return it;
+        Node* node = root;
+        while (!node->isLeaf) {
+            // Пропускаем потомков целиком, пока k не попадет в потомка i или в ключ i
+            size_t i = 0;
+            while (k >= node->children()[i]->subtreeSize) {
+                k -= node->children()[i]->subtreeSize;
+                if (k == 0) {
+                    it.push(node, i);
+                    return it;
+                }
+                --k;
+                ++i;
+            }
+            it.push(node, i);
+            node = node->children()[i];
+        }
+        it.push(node, k);
+        return it;
+    }
+
+private:
+    using Inner = BTreeInnerNode<value_type, Degree>;
+
+    size_t size_;
+    Compare comp;
+    NodeAllocator allocator;
+    mutable TreeCounters counters;
+
+    using Search = BTreeNodeSearch<Entry, Compare, kMaxKeys>;
+
+    // Позиция первого ключа, не меньшего key
+    template <typename K>
+    size_t lowerIndex(const Node* node, const K& key) const {
+        uint64_t compared = 0;
+        size_t i = Search::lower(node->keys.data(), node->keys.size(), key, comp, compared);
+        counters.compare(compared);
+        return i;
+    }
+
+    // Позиция первого ключа, большего key
+    template <typename K>
+    size_t upperIndex(const Node* node, const K& key) const {
+        uint64_t compared = 0;
+        size_t i = Search::upper(node->keys.data(), node->keys.size(), key, comp, compared);
+        counters.compare(compared);
+        return i;
+    }
+    // Число уровней: все листья на одной глубине
+    int height() const {
+        int levels = 0;
+        for (Node* node = root; node != nullptr; node = node->isLeaf ? nullptr : node->children()[0])
+            ++levels;
+        return levels;
+    }
+
+    // Замена содержимого count элементами, читаемыми по порядку с first (см. buildFromSorted):
+    // хватает однопроходного итератора
+    template <typename InputIt>
+    void buildCounted(InputIt first, size_t count, double fill = 1.0) {
+        clear();
+        if (count == 0)
+            return;
+        size_t target = slotTarget(fill);
+        EvenSplit split = levelSplit(count, target);
+        std::vector<Node*> nodes;
+        std::vector<value_type> separators;
+        try {
+            nodes.reserve(split.parts);
+            separators.reserve(split.parts - 1);
+            for (size_t j = 0; j < split.parts; ++j) {
+                nodes.push_back(allocator.template create<Node>(true));
+                fillLeaf(nodes.back(), first, split.size(j) - 1);
+                if (j + 1 < split.parts) {
+                    separators.push_back(*first);
+                    ++first;
+                }
+            }
+        }
+        catch (...) {
+            for (Node* leaf : nodes)
+                destroy(leaf);
+            throw;
+        }
+        root = buildUpper(nodes, separators, target);
+        size_ = count;
+    }
+
+    // Ячеек на узел при построении из отсортированного: узел с k ключами занимает k + 1 ячейку
+    // (ключи и разделитель после него, или ключи и потомки)
+    size_t slotTarget(double fill) const {
+        return fillTarget(fill, kDegree - 1, kMaxKeys) + 1;
+    }
+
+    // Разбиение уровня из items элементов на узлы: ячеек на одну больше, чем элементов
+    EvenSplit levelSplit(size_t items, size_t target) const {
+        size_t slots = items + 1;
+        return EvenSplit(slots, packedNodeCount(slots, kDegree, 2 * kDegree, target));
+    }
+
+    // Сколько элементов поддерева node лежит левее позиции i: i ключей и потомки до i-го
+    static size_t countBefore(const Node* node, size_t i) {
+        size_t result = i;
+        if (!node->isLeaf) {
+            for (size_t j = 0; j < i; ++j)
+                result += node->children()[j]->subtreeSize;
+        }
+        return result;
+    }
+
+    // Размер поддерева по ключам узла и размерам потомков
+    static void updateSize(Node* node) {
+        node->subtreeSize = countBefore(node, node->keys.size()) +
+            (node->isLeaf ? 0 : node->children().back()->subtreeSize);
+    }
+
+    template <typename It>
+    static void fillLeaf(Node* leaf, It& it, size_t count) {
+        leaf->subtreeSize = count;
+        for (size_t i = 0; i < count; ++i, ++it)
+            leaf->keys.push_back(*it);
+    }
+
+    // Уровни над построенными узлами nodes; между соседними узлами лежит по разделителю из items.
+    // Возвращает корень. При исключении разбирает все узлы, в том числе nodes
+    Node* buildUpper(std::vector<Node*>& nodes, std::vector<value_type>& items, size_t target) {
+        std::vector<Node*> upper;
+        std::vector<value_type> upperItems;
+        size_t used = 0;  // Сколько узлов nodes уже стали потомками узлов upper
+        try {
+            while (nodes.size() > 1) {
+                upper.clear();
+                upperItems.clear();
+                used = 0;
+                EvenSplit split = levelSplit(items.size(), target);
+                upper.reserve(split.parts);
+                upperItems.reserve(split.parts - 1);
+                size_t item = 0;
+                for (size_t j = 0; j < split.parts; ++j) {
+                    Node* node = allocator.template create<Inner>();
+                    upper.push_back(node);
+                    size_t keys = split.size(j) - 1;
+                    node->children().assign(nodes.begin() + used, nodes.begin() + used + keys + 1);
+                    used += keys + 1;
+                    node->keys.assign(std::make_move_iterator(items.begin() + item),
+                                      std::make_move_iterator(items.begin() + item + keys));
+                    item += keys;
+                    updateSize(node);
+                    if (j + 1 < split.parts)
+                        upperItems.push_back(std::move(items[item++]));
+                }
+                nodes.swap(upper);
+                items.swap(upperItems);
+            }
+        }
+        catch (...) {
+            for (Node* node : upper)
+                destroy(node);
+            for (size_t i = used; i < nodes.size(); ++i)
+                destroy(nodes[i]);
+            throw;
+        }
+        return nodes[0];
+    }
+
+    // Заполненный корень делится заранее: дерево растет вверх, а спуск идет по незаполненным узлам
+    void growRoot() {
+        if (root->keys.size() == kMaxKeys) {
+            Node* newRoot = allocator.template create<Inner>();
+            newRoot->children().push_back(root);
+            newRoot->subtreeSize = root->subtreeSize;
+            root = newRoot;
+            splitChild(newRoot, 0);
+        }
+    }
+
+    // Удаление за один спуск: перед переходом в потомка у него должно быть не меньше Degree ключей,
+    // тогда удаление из него не оставит узел недозаполненным.
+    // Размеры поддеревьев на пути уменьшаются заранее; если ключа не оказалось, они возвращаются
+    template <typename K>
+    bool remove(Node* node, const K& key) {
+        TreeDescent descent(counters);
+        Node* path[kMaxHeight];
+        int depth = 0;
+        while (true) {
+            descent.visit();
+            --node->subtreeSize;
+            path[depth++] = node;
+            int idx = lowerIndex(node, key);
+            int n = node->keys.size();
+
+            if (idx < n && !comp(key, Entry::key(node->keys[idx]))) {
+                if (node->isLeaf) {
+                    node->keys.erase(node->keys.begin() + idx);
+                    return true;
+                }
+                node = removeFromInternal(node, idx);
+                if (node == nullptr)
+                    return true;
+                continue;
+            }
+
+            if (node->isLeaf) {
+                // Ключа в дереве нет
+                for (int level = 0; level < depth; ++level)
+                    ++path[level]->subtreeSize;
+                return false;
+            }
+
+            // Пополняем потомка, в который спускаемся; после слияния с левым соседом ключ уходит в него
+            bool lastChild = idx == n;
+            if (node->children()[idx]->keys.size() < kDegree)
+                fill(node, idx);
+            if (lastChild && idx > (int)node->keys.size())
+                node = node->children()[idx - 1];
+            else
+                node = node->children()[idx];
+        }
+    }
+
+    // Ключ найден во внутреннем узле на позиции idx. Возвращает узел, в котором удаление
+    // продолжается, или nullptr, если ключ уже заменен соседним элементом
+    Node* removeFromInternal(Node* node, int idx) {
+        Node* left = node->children()[idx];
+        Node* right = node->children()[idx + 1];
+
+        if (left->keys.size() >= kDegree) {
+            // Заменяем ключ предшественником, вынутым из левого поддерева
+            node->keys[idx] = takeMax(left);
+            return nullptr;
+        }
+        if (right->keys.size() >= kDegree) {
+            // Заменяем ключ последователем, вынутым из правого поддерева
+            node->keys[idx] = takeMin(right);
+            return nullptr;
+        }
+        // У обоих соседей минимум ключей: сливаем их вместе с ключом и удаляем из результата
+        merge(node, idx);
+        return left;
+    }
+
+    // Извлечение наибольшего элемента поддерева (в корне поддерева не меньше Degree ключей);
+    // потомки пополняются по пути так же, как при удалении
+    value_type takeMax(Node* node) {
+        while (!node->isLeaf) {
+            --node->subtreeSize;
+            if (node->children()[node->keys.size()]->keys.size() < kDegree)
+                fill(node, node->keys.size());
+            node = node->children()[node->keys.size()];
+        }
+        --node->subtreeSize;
+        value_type result = std::move(node->keys.back());
+        node->keys.pop_back();
+        return result;
+    }
+
+    // Извлечение наименьшего элемента поддерева
+    value_type takeMin(Node* node) {
+        while (!node->isLeaf) {
+            --node->subtreeSize;
+            if (node->children()[0]->keys.size() < kDegree)
+                fill(node, 0);
+            node = node->children()[0];
+        }
+        --node->subtreeSize;
+        value_type result = std::move(node->keys.front());
+        node->keys.erase(node->keys.begin());
+        return result;
+    }
+
+    // Пополнение потомка idx до Degree ключей: заем у соседа или слияние
+    void fill(Node* node, int idx) {
+        if (idx > 0 && node->children()[idx - 1]->keys.size() >= kDegree)
+            borrowFromPrev(node, idx);
+        else if (idx < (int)node->keys.size() && node->children()[idx + 1]->keys.size() >= kDegree)
+            borrowFromNext(node, idx);
+        else if (idx < (int)node->keys.size())
+            merge(node, idx);
+        else
+            merge(node, idx - 1);
+    }
+
+    // Ключ родителя опускается в потомка, последний ключ левого соседа поднимается в родителя
+    void borrowFromPrev(Node* node, int idx) {
+        counters.borrow();
+        Node* child = node->children()[idx];
+        Node* sibling = node->children()[idx - 1];
+
+        size_t moved = 1;  // Сколько элементов переходит от соседа к потомку
+        child->keys.insert(child->keys.begin(), std::move(node->keys[idx - 1]));
+        if (!child->isLeaf) {
+            moved += sibling->children().back()->subtreeSize;
+            child->children().insert(child->children().begin(), sibling->children().back());
+            sibling->children().pop_back();
+        }
+        child->subtreeSize += moved;
+        sibling->subtreeSize -= moved;
+        node->keys[idx - 1] = std::move(sibling->keys.back());
+        sibling->keys.pop_back();
+    }
+
+    // Ключ родителя опускается в потомка, первый ключ правого соседа поднимается в родителя
+    void borrowFromNext(Node* node, int idx) {
+        counters.borrow();
+        Node* child = node->children()[idx];
+        Node* sibling = node->children()[idx + 1];
+
+        size_t moved = 1;
+        child->keys.push_back(std::move(node->keys[idx]));
+        if (!child->isLeaf) {
+            moved += sibling->children().front()->subtreeSize;
+            child->children().push_back(sibling->children().front());
+            sibling->children().erase(sibling->children().begin());
+        }
+        child->subtreeSize += moved;
+        sibling->subtreeSize -= moved;
+        node->keys[idx] = std::move(sibling->keys.front());
+        sibling->keys.erase(sibling->keys.begin());
+    }
+
+    // Слияние потомков idx и idx + 1 через разделяющий ключ родителя; правый узел освобождается
+    void merge(Node* node, int idx) {
+        counters.merge();
+        Node* child = node->children()[idx];
+        Node* sibling = node->children()[idx + 1];
+
+        child->keys.push_back(std::move(node->keys[idx]));
+        child->keys.insert(child->keys.end(), std::make_move_iterator(sibling->keys.begin()),
+            std::make_move_iterator(sibling->keys.end()));
+        if (!child->isLeaf)
+            child->children().insert(child->children().end(), sibling->children().begin(), sibling->children().end());
+        child->subtreeSize += 1 + sibling->subtreeSize;
+
+        node->keys.erase(node->keys.begin() + idx);
+        node->children().erase(node->children().begin() + idx + 1);
+        destroyNode(sibling);  // Узел возвращается аллокатору для повторного использования
+    }
+
+    // Узел разрушается под своим настоящим типом: размеры листа и внутреннего узла разные
+    void destroyNode(Node* node) {
+        if (node->isLeaf)
+            allocator.destroy(node);
+        else
+            allocator.destroy(static_cast<Inner*>(node));
+    }
+
+    // Разбор с явным стеком узлов вместо рекурсии
+    void destroy(Node* node) {
+        if (node == nullptr)
+            return;
+        std::vector<Node*> pending{ node };
+        while (!pending.empty()) {
+            node = pending.back();
+            pending.pop_back();
+            if (!node->isLeaf)
+                pending.insert(pending.end(), node->children().begin(), node->children().end());
+            destroyNode(node);
+        }
+    }
+
+    void splitChild(Node* parent, int index) {
+        auto child = parent->children()[index];
+
+        // Проверяем, достаточно ли ключей у дочернего узла для разделения
+        if (child->keys.size() < kDegree) {
+            throw std::runtime_error("Недостаточно ключей для разделения узла.");
+        }
+
+        Node* newChild = child->isLeaf ? allocator.template create<Node>(true) : allocator.template create<Inner>();
+        counters.split();
+
+        // Переносим ключи из старого узла в новый
+        for (size_t j = 0; j < kDegree - 1; j++) {
+            newChild->keys.push_back(std::move(child->keys[j + kDegree]));
+        }
+
+        // Если узел не является листом, переносим дочерние узлы
+        if (!child->isLeaf) {
+            for (size_t j = 0; j < kDegree; j++) {
+                newChild->children().push_back(child->children()[j + kDegree]);
+            }
+        }
+
+        // Средний ключ поднимается в родителя; запоминаем его до обрезки
+        value_type middle = std::move(child->keys[kDegree - 1]);
+
+        // Обрезаем старый узел (перенесенные дочерние узлы тоже убираем, иначе
+        // они останутся в двух узлах сразу и будут освобождены дважды)
+        child->keys.erase(child->keys.begin() + (kDegree - 1), child->keys.end());
+        if (!child->isLeaf)
+            child->children().resize(kDegree);
+
+        // Вставляем новый дочерний узел в родительский
+        parent->children().insert(parent->children().begin() + index + 1, newChild);
+
+        // Вставляем "подъем" ключа в родительский узел
+        parent->keys.insert(parent->keys.begin() + index, std::move(middle));
+
+        // Поддерево родителя не изменилось; средний ключ и правая половина ушли из child
+        updateSize(newChild);
+        child->subtreeSize -= newChild->subtreeSize + 1;
+    }
+};
+
+// Контейнеры с интерфейсом std::set и std::map на B-дереве
+template <typename Key, typename Compare = std::less<Key>, typename NodeAllocator = DefaultNodeAllocator,
+          int Degree = kBTreeDefaultDegree>
+using BTreeSet = OrderedSet<BTree<Key, Compare, NodeAllocator, SetEntry<Key>, Degree>>;
+template <typename Key, typename T, typename Compare = std::less<Key>, typename NodeAllocator = DefaultNodeAllocator,
+          int Degree = kBTreeDefaultDegree>
+using BTreeMap = OrderedMap<BTree<Key, Compare, NodeAllocator, MapEntry<Key, T>, Degree>>;
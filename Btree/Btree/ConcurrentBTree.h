@@ -0,0 +1,417 @@
+﻿#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "../../Common/NodeAllocator.h"
+
+// Версионная блокировка узла для оптимистичного сцепления блокировок (optimistic lock coupling).
+// Младший бит — узел захвачен писателем, остальные биты — счетчик изменений.
+// Читатель запоминает версию, читает узел без блокировки и затем проверяет, что версия не изменилась;
+// писатель захватывает узел, только если его версия все еще та, которую он видел при чтении
+class OptimisticLock {
+public:
+    // Версия для чтения; пока узел захвачен, ждем
+    uint64_t readLock() const {
+        uint64_t version = word.load(std::memory_order_acquire);
+        for (int spins = 0; (version & kLocked) != 0; ++spins) {
+            if (spins >= kSpinsBeforeYield)
+                std::this_thread::yield();
+            version = word.load(std::memory_order_acquire);
+        }
+        return version;
+    }
+    // Узел не менялся с того момента, как была получена version
+    bool validate(uint64_t version) const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return word.load(std::memory_order_relaxed) == version;
+    }
+    // Захват для записи, если узел не менялся
+    bool tryUpgrade(uint64_t version) {
+        if (!word.compare_exchange_strong(version, version + kLocked, std::memory_order_acquire))
+            return false;
+        std::atomic_thread_fence(std::memory_order_release);  // Запись в узел не видна раньше захвата
+        return true;
+    }
+    // Снятие захвата; версия увеличивается, и все, кто читал узел до этого, начнут заново
+    void unlock() {
+        word.fetch_add(kLocked, std::memory_order_release);
+    }
+
+private:
+    static constexpr uint64_t kLocked = 1;
+    static constexpr int kSpinsBeforeYield = 64;
+
+    std::atomic<uint64_t> word{ 0 };
+};
+
+// Узел параллельного B-дерева: массивы фиксированного размера вместо векторов,
+// чтобы читатель без блокировки никогда не попал в освобожденную память.
+// live[i] == false — элемент удален (надгробие), но ключ остается на месте как разделитель
+template <typename Key, typename T, int Degree>
+struct alignas(ChunkList::kAlignment) ConcurrentBTreeNode {
+    static constexpr int kMaxKeys = 2 * Degree - 1;
+
+    OptimisticLock lock;
+    int count;          // Число занятых ключей
+    const bool isLeaf;  // Не меняется после создания, поэтому читается без проверки версии
+    bool live[kMaxKeys];
+    Key keys[kMaxKeys];
+    T values[kMaxKeys];
+    ConcurrentBTreeNode* children[kMaxKeys + 1];
+
+    explicit ConcurrentBTreeNode(bool leaf) : count(0), isLeaf(leaf), live(), keys(), values(), children() {}
+};
+
+// Потокобезопасное B-дерево (словарь ключ-значение) для многих читателей и писателей.
+// Вставка устроена так же, как в BTree::insert: заполненный узел делится заранее, на спуске,
+// поэтому писатель захватывает только лист, в который вставляет, а при делении — делимый узел
+// и его родителя. Читатели не берут блокировок: они проверяют версии узлов и при изменении
+// начинают спуск заново. Удаление помечает элемент надгробием и ничего не перестраивает,
+// поэтому узлы не освобождаются, пока дерево живо, и читатель не может встретить удаленный узел;
+// повторная вставка ключа оживляет его на том же месте. Память надгробий возвращается в clear().
+// Ключи и значения должны копироваться побайтно: читатель может увидеть их наполовину записанными,
+// но такое чтение всегда отбрасывается проверкой версии.
+// Узлы выделяет политика NodeAllocator (см. NodeAllocator.h); она не потокобезопасна,
+// поэтому создание узлов (одно-два на деление) идет под мьютексом.
+template <typename Key, typename T, typename Compare = std::less<Key>, int Degree = 16,
+          typename NodeAllocator = DefaultNodeAllocator>
+class ConcurrentBTree {
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<T>::value,
+                  "Оптимистичное чтение требует побайтно копируемых ключей и значений");
+    static_assert(Degree >= 2, "Минимальная степень B-дерева не меньше 2");
+
+public:
+    using key_type = Key;
+    using mapped_type = T;
+    using key_compare = Compare;
+    using Node = ConcurrentBTreeNode<Key, T, Degree>;
+
+    static constexpr int kMaxKeys = Node::kMaxKeys;
+
+    explicit ConcurrentBTree(const Compare& comp = Compare()) : comp(comp) {
+        root.store(allocator.template create<Node>(true), std::memory_order_relaxed);
+    }
+    ~ConcurrentBTree() { destroy(root.load(std::memory_order_relaxed)); }
+    ConcurrentBTree(const ConcurrentBTree&) = delete;
+    ConcurrentBTree& operator=(const ConcurrentBTree&) = delete;
+
+    // Число живых элементов; при параллельных изменениях — приблизительное
+    size_t size() const {
+        ptrdiff_t total = 0;
+        for (const Counter& counter : counters)
+            total += counter.value.load(std::memory_order_relaxed);
+        return static_cast<size_t>(total);
+    }
+
+    // Поиск без блокировок: при успехе значение копируется в value
+    bool find(const Key& key, T& value) const {
+        while (true) {  // Каждый проход — спуск от корня; повторяется, если узел изменился во время чтения
+            Node* node;
+            uint64_t version;
+            if (!readRoot(node, version))
+                continue;
+            while (true) {
+                int count = loadCount(node);
+                int i = lowerIndex(node, count, key);
+                if (i < count && !comp(key, node->keys[i])) {
+                    bool live = node->live[i];
+                    T found = node->values[i];
+                    if (!node->lock.validate(version))
+                        break;
+                    if (live)
+                        value = found;
+                    return live;
+                }
+                if (node->isLeaf) {
+                    if (!node->lock.validate(version))
+                        break;
+                    return false;
+                }
+                if (!descend(node, version, i))
+                    break;
+            }
+        }
+    }
+    bool contains(const Key& key) const {
+        T value;
+        return find(key, value);
+    }
+
+    // Вставка, если ключа еще нет (удаленный ключ оживает с новым значением)
+    bool insert(const Key& key, const T& value) {
+        while (true) {
+            Node* node;
+            uint64_t version;
+            if (!readRoot(node, version))
+                continue;
+            Node* parent = nullptr;
+            uint64_t parentVersion = 0;
+            int parentIndex = 0;
+            while (true) {
+                int count = loadCount(node);
+                if (count == kMaxKeys) {
+                    // Заполненный узел делится до спуска в него; после деления — новый спуск от корня
+                    splitFull(parent, parentVersion, parentIndex, node, version);
+                    break;
+                }
+                int i = lowerIndex(node, count, key);
+                if (i < count && !comp(key, node->keys[i])) {
+                    if (node->live[i]) {
+                        if (!node->lock.validate(version))
+                            break;
+                        return false;
+                    }
+                    if (!node->lock.tryUpgrade(version))
+                        break;
+                    node->values[i] = value;
+                    node->live[i] = true;
+                    node->lock.unlock();
+                    addToSize(1);
+                    return true;
+                }
+                if (node->isLeaf) {
+                    // Лист не менялся с момента чтения, значит, он по-прежнему не заполнен
+                    if (!node->lock.tryUpgrade(version))
+                        break;
+                    insertNonFull(node, i, key, value);
+                    node->lock.unlock();
+                    addToSize(1);
+                    return true;
+                }
+                Node* child = node->children[i];
+                uint64_t childVersion;
+                if (!coupleChild(node, version, child, childVersion))
+                    break;
+                parent = node;
+                parentVersion = version;
+                parentIndex = i;
+                node = child;
+                version = childVersion;
+            }
+        }
+    }
+
+    // Удаление: элемент помечается надгробием; возвращает false, если живого ключа нет
+    bool erase(const Key& key) {
+        while (true) {
+            Node* node;
+            uint64_t version;
+            if (!readRoot(node, version))
+                continue;
+            while (true) {
+                int count = loadCount(node);
+                int i = lowerIndex(node, count, key);
+                if (i < count && !comp(key, node->keys[i])) {
+                    if (!node->live[i]) {
+                        if (!node->lock.validate(version))
+                            break;
+                        return false;
+                    }
+                    if (!node->lock.tryUpgrade(version))
+                        break;
+                    node->live[i] = false;
+                    node->lock.unlock();
+                    addToSize(-1);
+                    return true;
+                }
+                if (node->isLeaf) {
+                    if (!node->lock.validate(version))
+                        break;
+                    return false;
+                }
+                if (!descend(node, version, i))
+                    break;
+            }
+        }
+    }
+
+    // Обход живых элементов по возрастанию ключей: visit(key, value).
+    // Только когда дерево никто не меняет
+    template <typename Visitor>
+    void forEach(Visitor visit) const {
+        // Шаг step узла: четный — спуск в потомка step / 2, нечетный — ключ step / 2
+        std::vector<std::pair<const Node*, int>> path{ { root.load(std::memory_order_acquire), 0 } };
+        while (!path.empty()) {
+            const Node* node = path.back().first;
+            if (node->isLeaf) {
+                for (int i = 0; i < node->count; ++i)
+                    if (node->live[i])
+                        visit(node->keys[i], node->values[i]);
+                path.pop_back();
+                continue;
+            }
+            int step = path.back().second++;
+            if (step > 2 * node->count)
+                path.pop_back();
+            else if (step % 2 == 0)
+                path.push_back({ node->children[step / 2], 0 });
+            else if (node->live[step / 2])
+                visit(node->keys[step / 2], node->values[step / 2]);
+        }
+    }
+
+    // Удаление всех элементов и надгробий. Только когда дерево никто не использует
+    void clear() {
+        destroy(root.load(std::memory_order_relaxed));
+        allocator.release();
+        root.store(allocator.template create<Node>(true), std::memory_order_relaxed);
+        for (Counter& counter : counters)
+            counter.value.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    // Размер считается по полосам, чтобы писатели из разных потоков не делили одну строку кэша
+    static constexpr size_t kCounterStripes = 64;
+    struct alignas(ChunkList::kAlignment) Counter {
+        std::atomic<ptrdiff_t> value{ 0 };
+    };
+
+    std::atomic<Node*> root;
+    Compare comp;
+    NodeAllocator allocator;
+    std::mutex allocatorMutex;
+    Counter counters[kCounterStripes];
+
+    void addToSize(ptrdiff_t delta) {
+        static thread_local const size_t stripe = std::hash<std::thread::id>()(std::this_thread::get_id()) % kCounterStripes;
+        counters[stripe].value.fetch_add(delta, std::memory_order_relaxed);
+    }
+
+    // Число ключей узла, прочитанное без блокировки: в пределах массива, даже если чтение устарело
+    static int loadCount(const Node* node) {
+        int count = node->count;
+        return count < 0 ? 0 : (count > kMaxKeys ? kMaxKeys : count);
+    }
+
+    // Позиция первого ключа, не меньшего key
+    int lowerIndex(const Node* node, int count, const Key& key) const {
+        return static_cast<int>(std::lower_bound(node->keys, node->keys + count, key, comp) - node->keys);
+    }
+
+    // Корень и его версия; false — корень сменился, пока его читали
+    bool readRoot(Node*& node, uint64_t& version) const {
+        node = root.load(std::memory_order_acquire);
+        version = node->lock.readLock();
+        return node == root.load(std::memory_order_acquire);
+    }
+
+    // Переход к потомку со сцеплением: указатель на потомка берется из проверенной версии узла,
+    // а версия потомка получена, пока узел еще не менялся. Иначе деление могло бы
+    // перенести искомый ключ в соседа между чтением указателя и чтением потомка
+    bool coupleChild(const Node* node, uint64_t version, Node* child, uint64_t& childVersion) const {
+        if (!node->lock.validate(version))
+            return false;
+        childVersion = child->lock.readLock();
+        return node->lock.validate(version);
+    }
+
+    bool descend(Node*& node, uint64_t& version, int index) const {
+        Node* child = node->children[index];
+        uint64_t childVersion;
+        if (!coupleChild(node, version, child, childVersion))
+            return false;
+        node = child;
+        version = childVersion;
+        return true;
+    }
+
+    // Деление заполненного узла node — потомка parentIndex узла parent (nullptr — node корень).
+    // Захватываются только эти два узла; если кто-то изменил их раньше, деление не выполняется —
+    // вызывающий все равно начинает спуск заново
+    void splitFull(Node* parent, uint64_t parentVersion, int parentIndex, Node* node, uint64_t version) {
+        if (parent != nullptr && !parent->lock.tryUpgrade(parentVersion))
+            return;
+        if (!node->lock.tryUpgrade(version)) {
+            if (parent != nullptr)
+                parent->lock.unlock();
+            return;
+        }
+        // Корень мог смениться, пока его делил другой писатель
+        if (parent != nullptr || node == root.load(std::memory_order_relaxed)) {
+            Node* sibling = nullptr;
+            Node* newRoot = nullptr;
+            try {
+                std::lock_guard<std::mutex> guard(allocatorMutex);
+                sibling = allocator.template create<Node>(node->isLeaf);
+                if (parent == nullptr)
+                    newRoot = allocator.template create<Node>(false);
+            }
+            catch (...) {
+                if (sibling != nullptr) {
+                    std::lock_guard<std::mutex> guard(allocatorMutex);
+                    allocator.destroy(sibling);
+                }
+                node->lock.unlock();
+                if (parent != nullptr)
+                    parent->lock.unlock();
+                throw;
+            }
+            if (parent == nullptr) {
+                // Корень делится: дерево растет вверх, новый корень публикуется уже заполненным
+                newRoot->children[0] = node;
+                splitChild(newRoot, 0, node, sibling);
+                root.store(newRoot, std::memory_order_release);
+            }
+            else {
+                splitChild(parent, parentIndex, node, sibling);
+            }
+        }
+        node->lock.unlock();
+        if (parent != nullptr)
+            parent->lock.unlock();
+    }
+
+    // Деление заполненного потомка child узла parent (оба захвачены): верхняя половина
+    // уходит в sibling, средний элемент — в parent на позицию index
+    static void splitChild(Node* parent, int index, Node* child, Node* sibling) {
+        sibling->count = Degree - 1;
+        std::copy(child->keys + Degree, child->keys + kMaxKeys, sibling->keys);
+        std::copy(child->values + Degree, child->values + kMaxKeys, sibling->values);
+        std::copy(child->live + Degree, child->live + kMaxKeys, sibling->live);
+        if (!child->isLeaf)
+            std::copy(child->children + Degree, child->children + kMaxKeys + 1, sibling->children);
+
+        int count = parent->count;
+        std::copy_backward(parent->keys + index, parent->keys + count, parent->keys + count + 1);
+        std::copy_backward(parent->values + index, parent->values + count, parent->values + count + 1);
+        std::copy_backward(parent->live + index, parent->live + count, parent->live + count + 1);
+        std::copy_backward(parent->children + index + 1, parent->children + count + 1, parent->children + count + 2);
+        parent->keys[index] = child->keys[Degree - 1];
+        parent->values[index] = child->values[Degree - 1];
+        parent->live[index] = child->live[Degree - 1];
+        parent->children[index + 1] = sibling;
+        parent->count = count + 1;
+        child->count = Degree - 1;
+    }
+
+    // Вставка в незаполненный захваченный лист на позицию i
+    static void insertNonFull(Node* leaf, int i, const Key& key, const T& value) {
+        int count = leaf->count;
+        std::copy_backward(leaf->keys + i, leaf->keys + count, leaf->keys + count + 1);
+        std::copy_backward(leaf->values + i, leaf->values + count, leaf->values + count + 1);
+        std::copy_backward(leaf->live + i, leaf->live + count, leaf->live + count + 1);
+        leaf->keys[i] = key;
+        leaf->values[i] = value;
+        leaf->live[i] = true;
+        leaf->count = count + 1;
+    }
+
+    // Разбор с явным стеком узлов вместо рекурсии
+    void destroy(Node* node) {
+        std::vector<Node*> pending{ node };
+        while (!pending.empty()) {
+            node = pending.back();
+            pending.pop_back();
+            if (!node->isLeaf)
+                pending.insert(pending.end(), node->children, node->children + node->count + 1);
+            allocator.destroy(node);
+        }
+    }
+};
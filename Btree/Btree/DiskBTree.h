@@ -0,0 +1,695 @@
+﻿#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "../../Common/BulkBuild.h"
+#include "PageCache.h"
+#include "PageFile.h"
+
+// Заголовок файла дискового B-дерева. Страницы 0 и 1 — две его копии: фиксация с номером txn
+// пишет заголовок в страницу txn % 2, поэтому недописанный при сбое заголовок не портит предыдущий
+struct DiskTreeMeta {
+    uint64_t magic;
+    uint32_t formatVersion;
+    uint32_t pageSize;
+    uint32_t keySize;
+    uint32_t valueSize;
+    uint64_t txn;        // Номер фиксации: действует целый заголовок с наибольшим номером
+    uint64_t root;       // Страница корня; 0 — дерево пустое
+    uint64_t height;
+    uint64_t count;
+    uint64_t pageCount;  // Страниц в файле (занятых и свободных)
+    uint64_t freeList;   // Первая страница списка свободных; 0 — список пуст
+    uint64_t checksum;   // FNV-1a всех полей выше
+
+    static constexpr uint64_t kMagic = 0x3145455254445342ull;  // "BSDTREE1"
+    static constexpr uint32_t kFormatVersion = 1;
+
+    uint64_t computeChecksum() const {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(this);
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (size_t i = 0; i < offsetof(DiskTreeMeta, checksum); ++i)
+            hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+        return hash;
+    }
+};
+
+// Начало каждой страницы узла
+struct DiskNodeHeader {
+    uint32_t count;   // Число ключей
+    uint32_t isLeaf;
+};
+
+// Лист: ключи и значения. Емкость — сколько пар помещается в страницу
+template <typename Key, typename T, size_t PageSize>
+struct DiskLeaf {
+    static constexpr size_t kCapacity =
+        (PageSize - sizeof(DiskNodeHeader) - alignof(Key) - alignof(T)) / (sizeof(Key) + sizeof(T));
+
+    DiskNodeHeader header;
+    Key keys[kCapacity];
+    T values[kCapacity];
+};
+
+// Внутренний узел: в потомке i ключи меньше keys[i], в потомке i + 1 — не меньше
+template <typename Key, size_t PageSize>
+struct DiskInner {
+    static constexpr size_t kCapacity =
+        (PageSize - sizeof(DiskNodeHeader) - sizeof(uint64_t) - alignof(Key) - alignof(uint64_t)) /
+        (sizeof(Key) + sizeof(uint64_t));
+
+    DiskNodeHeader header;
+    Key keys[kCapacity];
+    uint64_t children[kCapacity + 1];
+};
+
+// Страница списка свободных страниц
+template <size_t PageSize>
+struct DiskFreePage {
+    static constexpr size_t kCapacity = (PageSize - 2 * sizeof(uint64_t)) / sizeof(uint64_t);
+
+    uint64_t next;   // Следующая страница списка; 0 — последняя
+    uint64_t count;
+    uint64_t ids[kCapacity];
+};
+
+// B-дерево (словарь ключ-значение) в файле: каждый узел — страница PageSize байт
+// (4 КиБ по умолчанию, 16 КиБ — DiskBTree<Key, T, Compare, 16384>). Устроено как B+ дерево:
+// значения лежат в листьях, во внутренних узлах — разделители и номера страниц потомков,
+// поэтому степень определяется размером страницы, а не задается вручную.
+// Страницы читаются через кэш PageCache ограниченного размера, так что индекс может быть больше памяти.
+//
+// Надежность — копирование при записи (shadow paging): страница зафиксированной версии никогда
+// не переписывается. Изменяемый узел и весь путь к нему от корня копируются в новые страницы
+// (один раз за фиксацию: новые страницы дальше меняются на месте), старые освобождаются,
+// но переиспользуются только после следующей фиксации. commit() записывает новые страницы,
+// сбрасывает их на диск и только потом пишет заголовок с новым корнем. При сбое до записи
+// заголовка файл открывается в состоянии предыдущей фиксации; недописанный заголовок
+// отбрасывается по контрольной сумме. Открытие существующего индекса читает заголовок
+// и список свободных страниц — ключи не перечитываются и не вставляются заново.
+//
+// Удаление не сливает узлы (как и многие дисковые индексы): опустевший узел освобождается,
+// неполные узлы заполняются последующими вставками.
+// Ключи и значения копируются побайтно (trivially copyable) и должны иметь одинаковое
+// представление у всех программ, открывающих файл. Дерево не потокобезопасно.
+// После исключения ввода-вывода посреди изменения состояние в памяти нужно вернуть rollback().
+// Фиксация только явная: при разрушении дерева незафиксированные изменения отбрасываются
+template <typename Key, typename T, typename Compare = std::less<Key>, size_t PageSize = 4096>
+class DiskBTree {
+public:
+    using key_type = Key;
+    using mapped_type = T;
+    using key_compare = Compare;
+    using Leaf = DiskLeaf<Key, T, PageSize>;
+    using Inner = DiskInner<Key, PageSize>;
+    using FreePage = DiskFreePage<PageSize>;
+    using Cache = PageCache<PageSize>;
+    using PageRef = typename Cache::PageRef;
+
+    static constexpr size_t kDefaultCachePages = 4096;  // 16 МиБ при страницах по 4 КиБ
+    static constexpr size_t kMinCachePages = 64;        // Путь от корня и узлы при делении всегда помещаются
+
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<T>::value,
+                  "DiskBTree хранит ключи и значения побайтно");
+    static_assert((PageSize & (PageSize - 1)) == 0 && PageSize >= sizeof(DiskTreeMeta),
+                  "Размер страницы — степень двойки");
+    static_assert(Leaf::kCapacity >= 2 && Inner::kCapacity >= 2, "В страницу должны помещаться хотя бы два элемента");
+    static_assert(sizeof(Leaf) <= PageSize && sizeof(Inner) <= PageSize && sizeof(FreePage) <= PageSize,
+                  "Узел не помещается в страницу");
+
+    // Открытие индекса path или создание пустого, если файла нет. cachePages — размер кэша в страницах
+    explicit DiskBTree(const std::string& path, size_t cachePages = kDefaultCachePages,
+                       const Compare& comp = Compare())
+        : file(path), cache(file, std::max(cachePages, kMinCachePages)), comp(comp) {
+        if (file.size() == 0)
+            create();
+        else
+            open();
+    }
+    // Незафиксированные изменения отбрасываются, в файле остается последняя фиксация: деструктор
+    // может сработать при раскрутке стека после исключения посреди insert или erase, и наполовину
+    // примененное изменение не должно стать новой версией. Сохранять изменения — только через commit()
+    ~DiskBTree() { cache.reset(); }
+    DiskBTree(const DiskBTree&) = delete;
+    DiskBTree& operator=(const DiskBTree&) = delete;
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    int height() const { return static_cast<int>(levels); }
+    // Номер последней фиксации
+    uint64_t version() const { return durable.txn; }
+
+    // Поиск: при успехе значение копируется в value
+    bool find(const Key& key, T& value) const {
+        PageRef page = leafFor(key);
+        if (!page)
+            return false;
+        const Leaf* leaf = page.template as<Leaf>();
+        uint32_t i = lowerIndex(leaf, key);
+        if (i == leaf->header.count || comp(key, leaf->keys[i]))
+            return false;
+        value = leaf->values[i];
+        return true;
+    }
+    bool contains(const Key& key) const {
+        T value;
+        return find(key, value);
+    }
+
+    // Вставка, если ключа еще нет. Переполненный лист делится пополам, разделитель уходит
+    // в родителя; переполненные предки делятся так же, вплоть до нового корня
+    bool insert(const Key& key, const T& value) {
+        if (contains(key))
+            return false;  // Проверка до копирования пути: повтор ключа ничего не меняет в файле
+        if (root == 0) {
+            root = newNode(true).id();
+            levels = 1;
+        }
+        std::vector<PageRef> path;
+        std::vector<uint32_t> indices;
+        descendForWrite(key, path, indices);
+
+        Leaf* leaf = path.back().template as<Leaf>();
+        uint32_t i = lowerIndex(leaf, key);
+        if (leaf->header.count < Leaf::kCapacity) {
+            insertAt(leaf, i, key, value);
+        }
+        else {
+            PageRef right = newNode(true);
+            Leaf* sibling = right.template as<Leaf>();
+            uint32_t leftCount = (Leaf::kCapacity + 1) / 2;  // Размер левой половины после вставки
+            if (i < leftCount) {
+                moveTail(leaf, leftCount - 1, sibling);
+                insertAt(leaf, i, key, value);
+            }
+            else {
+                moveTail(leaf, leftCount, sibling);
+                insertAt(sibling, i - leftCount, key, value);
+            }
+            insertSeparator(path, indices, sibling->keys[0], right.id());
+        }
+        ++size_;
+        return true;
+    }
+
+    // Удаление; возвращает false, если ключа нет
+    bool erase(const Key& key) {
+        if (!contains(key))
+            return false;
+        std::vector<PageRef> path;
+        std::vector<uint32_t> indices;
+        descendForWrite(key, path, indices);
+
+        Leaf* leaf = path.back().template as<Leaf>();
+        uint32_t i = lowerIndex(leaf, key);
+        std::copy(leaf->keys + i + 1, leaf->keys + leaf->header.count, leaf->keys + i);
+        std::copy(leaf->values + i + 1, leaf->values + leaf->header.count, leaf->values + i);
+        --leaf->header.count;
+        --size_;
+
+        // Опустевший узел уходит из родителя; родитель, у которого это был единственный потомок, — тоже
+        bool emptied = leaf->header.count == 0;
+        for (size_t level = path.size() - 1; emptied; --level) {
+            uint64_t page = path[level].id();
+            path[level] = PageRef();
+            release(page);
+            if (level == 0) {
+                root = 0;
+                levels = 0;
+                break;
+            }
+            Inner* parent = path[level - 1].template as<Inner>();
+            emptied = parent->header.count == 0;
+            if (!emptied)
+                removeChild(parent, indices[level - 1]);
+        }
+        path.clear();
+        shrinkRoot();
+        return true;
+    }
+
+    // Обход по возрастанию ключей: visit(key, value). Менять дерево во время обхода нельзя
+    template <typename Visitor>
+    void forEach(Visitor visit) const {
+        scan(nullptr, nullptr, visit);
+    }
+    // Обход элементов с ключами в отрезке [lo, hi]
+    template <typename Visitor>
+    void forEachInRange(const Key& lo, const Key& hi, Visitor visit) const {
+        if (!comp(hi, lo))
+            scan(&lo, &hi, visit);
+    }
+
+    // Замена содержимого парами (ключ, значение) из [first, last), отсортированными по ключу без повторов.
+    // Листья заполняются подряд на долю fill от емкости страницы, затем над ними строятся
+    // внутренние уровни — за один проход, без вставок по одному. Подходит для первичной загрузки
+    // индекса: дальше файл открывается без перестроения
+    template <typename ForwardIt>
+    void buildFromSorted(ForwardIt first, ForwardIt last, double fill = 1.0) {
+        clear();
+        size_t count = std::distance(first, last);
+        if (count == 0)
+            return;
+        const size_t minLeaf = (Leaf::kCapacity + 1) / 2;
+        EvenSplit leaves(count, packedNodeCount(count, minLeaf, Leaf::kCapacity,
+                                                fillTarget(fill, minLeaf, Leaf::kCapacity)));
+        std::vector<uint64_t> level;  // Страницы текущего уровня
+        std::vector<Key> lows;        // Наименьшие ключи их поддеревьев — разделители для уровня выше
+        level.reserve(leaves.parts);
+        lows.reserve(leaves.parts);
+        for (size_t j = 0; j < leaves.parts; ++j) {
+            PageRef page = newNode(true);
+            Leaf* leaf = page.template as<Leaf>();
+            leaf->header.count = static_cast<uint32_t>(leaves.size(j));
+            for (uint32_t i = 0; i < leaf->header.count; ++i, ++first) {
+                leaf->keys[i] = first->first;
+                leaf->values[i] = first->second;
+            }
+            level.push_back(page.id());
+            lows.push_back(leaf->keys[0]);
+        }
+        levels = 1;
+
+        const size_t minChildren = (Inner::kCapacity + 2) / 2;
+        const size_t maxChildren = Inner::kCapacity + 1;
+        size_t target = fillTarget(fill, minChildren, maxChildren);
+        while (level.size() > 1) {
+            EvenSplit parents(level.size(), packedNodeCount(level.size(), minChildren, maxChildren, target));
+            std::vector<uint64_t> upper;
+            std::vector<Key> upperLows;
+            upper.reserve(parents.parts);
+            upperLows.reserve(parents.parts);
+            size_t next = 0;
+            for (size_t j = 0; j < parents.parts; ++j) {
+                PageRef page = newNode(false);
+                Inner* inner = page.template as<Inner>();
+                size_t children = parents.size(j);
+                inner->header.count = static_cast<uint32_t>(children - 1);
+                for (size_t c = 0; c < children; ++c) {
+                    inner->children[c] = level[next + c];
+                    if (c > 0)
+                        inner->keys[c - 1] = lows[next + c];
+                }
+                upper.push_back(page.id());
+                upperLows.push_back(lows[next]);
+                next += children;
+            }
+            level.swap(upper);
+            lows.swap(upperLows);
+            ++levels;
+        }
+        root = level[0];
+        size_ = count;
+    }
+
+    // Удаление всех элементов. Страницы не читаются: свободным становится все, кроме заголовков
+    void clear() {
+        std::vector<bool> isFree(pageCount, false);
+        isFree[0] = isFree[1] = true;
+        for (const std::vector<uint64_t>* pages : { &reusable, &freed, &freeListPages }) {
+            for (uint64_t page : *pages)
+                isFree[page] = true;
+        }
+        for (uint64_t page = 2; page < pageCount; ++page) {
+            if (!isFree[page])
+                (fresh.count(page) != 0 ? reusable : freed).push_back(page);
+        }
+        fresh.clear();
+        cache.reset();
+        root = 0;
+        levels = 0;
+        size_ = 0;
+        changed = true;
+    }
+
+    // Фиксация: после возврата изменения переживут сбой. Порядок записи: новые страницы и список
+    // свободных, сброс на диск, затем заголовок в другую копию и еще один сброс
+    void commit() {
+        if (!changed)
+            return;
+        // После фиксации свободны: свободные до нее, освобожденные в ней и страницы прежнего списка.
+        // Под новый список берутся только страницы, свободные и в зафиксированной версии:
+        // их можно переписать уже сейчас
+        std::vector<uint64_t> available = reusable;
+        std::vector<uint64_t> listPages;
+        uint64_t pages = pageCount;
+        size_t entries = available.size() + freed.size() + freeListPages.size();
+        while (listPages.size() * FreePage::kCapacity < entries) {
+            if (!available.empty()) {
+                listPages.push_back(available.back());
+                available.pop_back();
+                --entries;
+            }
+            else {
+                listPages.push_back(pages++);
+            }
+        }
+        std::vector<uint64_t> free = available;
+        free.insert(free.end(), freed.begin(), freed.end());
+        free.insert(free.end(), freeListPages.begin(), freeListPages.end());
+        for (size_t j = 0; j < listPages.size(); ++j) {
+            PageRef page = cache.create(listPages[j]);
+            FreePage* list = page.template as<FreePage>();
+            size_t from = j * FreePage::kCapacity;
+            list->next = j + 1 < listPages.size() ? listPages[j + 1] : 0;
+            list->count = std::min(FreePage::kCapacity, free.size() - from);
+            std::copy(free.begin() + from, free.begin() + from + list->count, list->ids);
+        }
+        cache.flush();
+        file.sync();
+
+        DiskTreeMeta next = durable;
+        ++next.txn;
+        next.root = root;
+        next.height = levels;
+        next.count = size_;
+        next.pageCount = pages;
+        next.freeList = listPages.empty() ? 0 : listPages[0];
+        writeMeta(next);
+        file.sync();
+
+        durable = next;
+        pageCount = pages;
+        reusable.swap(free);
+        freeListPages.swap(listPages);
+        freed.clear();
+        fresh.clear();
+        changed = false;
+    }
+
+    // Отказ от незафиксированных изменений: дерево возвращается к последней фиксации
+    void rollback() {
+        cache.reset();
+        restore(durable);
+    }
+
+private:
+    PageFile file;
+    mutable Cache cache;  // Чтение тоже меняет кэш
+    Compare comp;
+    DiskTreeMeta durable;  // Заголовок последней фиксации
+
+    // Текущее (возможно, незафиксированное) состояние
+    uint64_t root;
+    uint64_t levels;
+    size_t size_;
+    uint64_t pageCount;
+    std::vector<uint64_t> reusable;       // Свободны и в зафиксированной версии: можно занимать сразу
+    std::vector<uint64_t> freed;          // Освобождены после фиксации: заняты до следующей
+    std::vector<uint64_t> freeListPages;  // Хранят зафиксированный список свободных
+    std::unordered_set<uint64_t> fresh;   // Заняты после фиксации: меняются на месте
+    bool changed;
+
+    // Новый файл: заголовок пустого дерева и пустая вторая копия
+    void create() {
+        DiskTreeMeta meta = {};
+        meta.magic = DiskTreeMeta::kMagic;
+        meta.formatVersion = DiskTreeMeta::kFormatVersion;
+        meta.pageSize = static_cast<uint32_t>(PageSize);
+        meta.keySize = static_cast<uint32_t>(sizeof(Key));
+        meta.valueSize = static_cast<uint32_t>(sizeof(T));
+        meta.pageCount = 2;
+        writeMeta(meta);
+        std::vector<unsigned char> blank(PageSize, 0);
+        file.write(PageSize, blank.data(), PageSize);
+        file.sync();
+        restore(meta);
+    }
+
+    // Существующий файл: действует целый заголовок с большим номером фиксации
+    void open() {
+        if (file.size() < 2 * PageSize)
+            throw std::runtime_error("DiskBTree: файл слишком мал для индекса");
+        DiskTreeMeta copies[2];
+        bool valid[2];
+        for (int slot = 0; slot < 2; ++slot) {
+            file.read(slot * PageSize, &copies[slot], sizeof(DiskTreeMeta));
+            valid[slot] = copies[slot].magic == DiskTreeMeta::kMagic &&
+                          copies[slot].checksum == copies[slot].computeChecksum();
+        }
+        if (!valid[0] && !valid[1])
+            throw std::runtime_error("DiskBTree: в файле нет целого заголовка (не индекс или поврежден)");
+        const DiskTreeMeta& meta = !valid[1] || (valid[0] && copies[0].txn > copies[1].txn) ? copies[0] : copies[1];
+        if (meta.formatVersion != DiskTreeMeta::kFormatVersion || meta.pageSize != PageSize ||
+            meta.keySize != sizeof(Key) || meta.valueSize != sizeof(T))
+            throw std::runtime_error("DiskBTree: индекс создан с другим форматом, размером страницы, ключа или значения");
+        restore(meta);
+    }
+
+    // Состояние по заголовку; список свободных читается с диска
+    void restore(const DiskTreeMeta& meta) {
+        durable = meta;
+        root = meta.root;
+        levels = meta.height;
+        size_ = meta.count;
+        pageCount = meta.pageCount;
+        reusable.clear();
+        freed.clear();
+        freeListPages.clear();
+        fresh.clear();
+        changed = false;
+        for (uint64_t page = meta.freeList; page != 0;) {
+            PageRef list = cache.fetch(page);
+            const FreePage* entries = list.template as<FreePage>();
+            freeListPages.push_back(page);
+            reusable.insert(reusable.end(), entries->ids, entries->ids + entries->count);
+            page = entries->next;
+        }
+    }
+
+    void writeMeta(DiskTreeMeta& meta) {
+        meta.checksum = meta.computeChecksum();
+        std::vector<unsigned char> page(PageSize, 0);
+        std::memcpy(page.data(), &meta, sizeof(DiskTreeMeta));
+        file.write((meta.txn % 2) * PageSize, page.data(), PageSize);
+    }
+
+    // Номер страницы под новый узел: сначала свободные, затем конец файла
+    uint64_t allocate() {
+        uint64_t page;
+        if (!reusable.empty()) {
+            page = reusable.back();
+            reusable.pop_back();
+        }
+        else {
+            page = pageCount++;
+        }
+        fresh.insert(page);
+        changed = true;
+        return page;
+    }
+
+    // Освобождение страницы, на которую больше никто не ссылается (и которая не закреплена)
+    void release(uint64_t page) {
+        cache.discard(page);
+        if (fresh.erase(page) != 0)
+            reusable.push_back(page);  // Зафиксированная версия ее не видит
+        else
+            freed.push_back(page);
+        changed = true;
+    }
+
+    PageRef newNode(bool leaf) {
+        PageRef page = cache.create(allocate());
+        page.template as<DiskNodeHeader>()->isLeaf = leaf ? 1 : 0;
+        return page;
+    }
+
+    // Страница, которую можно менять: страница зафиксированной версии заменяется копией
+    PageRef writable(PageRef page) {
+        if (fresh.count(page.id()) != 0) {
+            page.markDirty();
+            return page;
+        }
+        PageRef copy = cache.create(allocate());
+        std::memcpy(copy.data(), page.data(), PageSize);
+        uint64_t old = page.id();
+        page = PageRef();
+        release(old);
+        return copy;
+    }
+
+    static bool isLeaf(const PageRef& page) { return page.template as<DiskNodeHeader>()->isLeaf != 0; }
+
+    // Спуск к листу для key с копированием пути: в path — закрепленные изменяемые узлы от корня,
+    // в indices — номер потомка, по которому шли из каждого внутреннего узла
+    void descendForWrite(const Key& key, std::vector<PageRef>& path, std::vector<uint32_t>& indices) {
+        path.push_back(writable(cache.fetch(root)));
+        root = path.back().id();
+        while (!isLeaf(path.back())) {
+            Inner* inner = path.back().template as<Inner>();
+            uint32_t i = upperIndex(inner, key);
+            PageRef child = writable(cache.fetch(inner->children[i]));
+            inner->children[i] = child.id();
+            indices.push_back(i);
+            path.push_back(std::move(child));
+        }
+    }
+
+    // Лист, в котором должен быть key (пустая ссылка у пустого дерева)
+    PageRef leafFor(const Key& key) const {
+        if (root == 0)
+            return PageRef();
+        PageRef page = cache.fetch(root);
+        while (!isLeaf(page)) {
+            const Inner* inner = page.template as<Inner>();
+            page = cache.fetch(inner->children[upperIndex(inner, key)]);
+        }
+        return page;
+    }
+
+    template <typename Node>
+    uint32_t lowerIndex(const Node* node, const Key& key) const {
+        return static_cast<uint32_t>(std::lower_bound(node->keys, node->keys + node->header.count, key, comp) - node->keys);
+    }
+    template <typename Node>
+    uint32_t upperIndex(const Node* node, const Key& key) const {
+        return static_cast<uint32_t>(std::upper_bound(node->keys, node->keys + node->header.count, key, comp) - node->keys);
+    }
+
+    static void insertAt(Leaf* leaf, uint32_t i, const Key& key, const T& value) {
+        uint32_t count = leaf->header.count;
+        std::copy_backward(leaf->keys + i, leaf->keys + count, leaf->keys + count + 1);
+        std::copy_backward(leaf->values + i, leaf->values + count, leaf->values + count + 1);
+        leaf->keys[i] = key;
+        leaf->values[i] = value;
+        ++leaf->header.count;
+    }
+
+    // Перенос элементов листа начиная с from в пустой лист sibling
+    static void moveTail(Leaf* leaf, uint32_t from, Leaf* sibling) {
+        uint32_t count = leaf->header.count;
+        std::copy(leaf->keys + from, leaf->keys + count, sibling->keys);
+        std::copy(leaf->values + from, leaf->values + count, sibling->values);
+        sibling->header.count = count - from;
+        leaf->header.count = from;
+    }
+
+    // Узел path.back() разделился: separator и правая половина right вставляются в родителя.
+    // Заполненный родитель делится сам: средний ключ поднимается дальше
+    void insertSeparator(std::vector<PageRef>& path, const std::vector<uint32_t>& indices, Key separator, uint64_t right) {
+        for (size_t level = path.size() - 1;; --level) {
+            if (level == 0) {
+                // Разделился корень: дерево растет вверх
+                PageRef page = newNode(false);
+                Inner* inner = page.template as<Inner>();
+                inner->header.count = 1;
+                inner->keys[0] = separator;
+                inner->children[0] = root;
+                inner->children[1] = right;
+                root = page.id();
+                ++levels;
+                return;
+            }
+            Inner* parent = path[level - 1].template as<Inner>();
+            uint32_t pos = indices[level - 1];  // Левая половина — потомок pos
+            uint32_t count = parent->header.count;
+            if (count < Inner::kCapacity) {
+                std::copy_backward(parent->keys + pos, parent->keys + count, parent->keys + count + 1);
+                std::copy_backward(parent->children + pos + 1, parent->children + count + 1, parent->children + count + 2);
+                parent->keys[pos] = separator;
+                parent->children[pos + 1] = right;
+                ++parent->header.count;
+                return;
+            }
+            // Ключи и потомки вместе с новыми не помещаются: собираем их подряд и делим пополам
+            std::vector<Key> keys(parent->keys, parent->keys + count);
+            std::vector<uint64_t> children(parent->children, parent->children + count + 1);
+            keys.insert(keys.begin() + pos, separator);
+            children.insert(children.begin() + pos + 1, right);
+            uint32_t leftCount = static_cast<uint32_t>(keys.size() / 2);
+            PageRef page = newNode(false);
+            Inner* sibling = page.template as<Inner>();
+            parent->header.count = leftCount;
+            std::copy(keys.begin(), keys.begin() + leftCount, parent->keys);
+            std::copy(children.begin(), children.begin() + leftCount + 1, parent->children);
+            sibling->header.count = static_cast<uint32_t>(keys.size()) - leftCount - 1;
+            std::copy(keys.begin() + leftCount + 1, keys.end(), sibling->keys);
+            std::copy(children.begin() + leftCount + 1, children.end(), sibling->children);
+            separator = keys[leftCount];
+            right = page.id();
+        }
+    }
+
+    // Удаление потомка pos вместе с разделителем между ним и соседом
+    static void removeChild(Inner* node, uint32_t pos) {
+        uint32_t count = node->header.count;
+        uint32_t key = pos == 0 ? 0 : pos - 1;
+        std::copy(node->keys + key + 1, node->keys + count, node->keys + key);
+        std::copy(node->children + pos + 1, node->children + count + 1, node->children + pos);
+        --node->header.count;
+    }
+
+    // Корень без разделителей (с одним потомком) не нужен: дерево становится ниже
+    void shrinkRoot() {
+        while (levels > 1) {
+            uint64_t child;
+            {
+                PageRef page = cache.fetch(root);
+                const Inner* inner = page.template as<Inner>();
+                if (inner->header.count != 0)
+                    return;
+                child = inner->children[0];
+            }
+            release(root);
+            root = child;
+            --levels;
+        }
+    }
+
+    // Обход листов по порядку от первого ключа, не меньшего *lo, до ключа больше *hi
+    // (nullptr — без границы). Стек хранит внутренние узлы пути и номер следующего потомка
+    template <typename Visitor>
+    void scan(const Key* lo, const Key* hi, Visitor& visit) const {
+        if (root == 0)
+            return;
+        std::vector<std::pair<uint64_t, uint32_t>> stack;
+        uint64_t page = root;
+        for (uint64_t level = 1; level < levels; ++level) {
+            PageRef node = cache.fetch(page);
+            const Inner* inner = node.template as<Inner>();
+            uint32_t i = lo != nullptr ? upperIndex(inner, *lo) : 0;
+            stack.push_back({ page, i + 1 });
+            page = inner->children[i];
+        }
+        for (bool first = true;; first = false) {
+            {
+                PageRef node = cache.fetch(page);
+                const Leaf* leaf = node.template as<Leaf>();
+                uint32_t i = first && lo != nullptr ? lowerIndex(leaf, *lo) : 0;
+                for (; i < leaf->header.count; ++i) {
+                    if (hi != nullptr && comp(*hi, leaf->keys[i]))
+                        return;
+                    visit(leaf->keys[i], leaf->values[i]);
+                }
+            }
+            // Подъем до узла, у которого остались потомки, и спуск к самому левому листу под следующим
+            while (true) {
+                if (stack.empty())
+                    return;
+                PageRef node = cache.fetch(stack.back().first);
+                const Inner* inner = node.template as<Inner>();
+                if (stack.back().second > inner->header.count) {
+                    stack.pop_back();
+                    continue;
+                }
+                page = inner->children[stack.back().second++];
+                break;
+            }
+            while (stack.size() + 1 < levels) {
+                PageRef node = cache.fetch(page);
+                stack.push_back({ page, 1 });
+                page = node.template as<Inner>()->children[0];
+            }
+        }
+    }
+};
@@ -0,0 +1,901 @@
+﻿#pragma once
+#include <iostream>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <initializer_list>
+#include <iterator>
+#include <limits>
+#include <utility>
+#include <type_traits>
+#include <vector>
+#include "BPlusTree.h"
+
+#if defined(__AVX2__) || defined(BPLUS_SSE2)
+#define PACKED_SSE2 1
+#endif
+
+// Поиск в упакованном листе: число разностей, меньших delta, среди всех Bytes байт листа без ветвлений.
+// Свободные ячейки заполнены единицами — наибольшей разностью любой ширины — и в счет не попадают.
+// SSE2 сравнивает только числа со знаком, поэтому у обеих сторон переворачивается старший бит:
+// за инструкцию сравниваются 16 разностей в байт, 8 в два байта или 4 в четыре.
+// Для 8-байтных разностей сравнения в SSE2 нет — простой цикл
+template <int Bytes>
+struct PackedSearch {
+    static_assert(Bytes % 16 == 0 && Bytes / 16 <= 127, "Счетчики байтовых сравнений не должны переполняться");
+
+    static int countLess(const unsigned char* cells, int width, uint64_t delta) {
+        switch (width) {
+        case 1:
+            return count8(cells, static_cast<uint8_t>(delta));
+        case 2:
+            return count16(cells, static_cast<uint16_t>(delta));
+        case 4:
+            return count32(cells, static_cast<uint32_t>(delta));
+        default:
+            return scalarCount<uint64_t>(cells, delta);
+        }
+    }
+
+private:
+    template <typename U>
+    static int scalarCount(const unsigned char* cells, U delta) {
+        int count = 0;
+        for (int i = 0; i < Bytes; i += static_cast<int>(sizeof(U))) {
+            U cell;
+            std::memcpy(&cell, cells + i, sizeof(U));
+            count += cell < delta;
+        }
+        return count;
+    }
+
+    // Результаты сравнения (-1 или 0) накапливаются вычитанием, как в NodeSearch
+    static int count8(const unsigned char* cells, uint8_t delta) {
+#if defined(PACKED_SSE2)
+        const __m128i bias = _mm_set1_epi8(static_cast<char>(0x80));
+        __m128i needle = _mm_xor_si128(_mm_set1_epi8(static_cast<char>(delta)), bias);
+        __m128i acc = _mm_setzero_si128();
+        for (int i = 0; i < Bytes; i += 16) {
+            __m128i cell = _mm_xor_si128(_mm_load_si128(reinterpret_cast<const __m128i*>(cells + i)), bias);
+            acc = _mm_sub_epi8(acc, _mm_cmplt_epi8(cell, needle));
+        }
+        // Суммы байтов каждой половины регистра
+        __m128i sum = _mm_sad_epu8(acc, _mm_setzero_si128());
+        return _mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+#else
+        return scalarCount<uint8_t>(cells, delta);
+#endif
+    }
+
+    static int count16(const unsigned char* cells, uint16_t delta) {
+#if defined(PACKED_SSE2)
+        const __m128i bias = _mm_set1_epi16(static_cast<short>(0x8000));
+        __m128i needle = _mm_xor_si128(_mm_set1_epi16(static_cast<short>(delta)), bias);
+        __m128i acc = _mm_setzero_si128();
+        for (int i = 0; i < Bytes; i += 16) {
+            __m128i cell = _mm_xor_si128(_mm_load_si128(reinterpret_cast<const __m128i*>(cells + i)), bias);
+            acc = _mm_sub_epi16(acc, _mm_cmplt_epi16(cell, needle));
+        }
+        return sum32(_mm_madd_epi16(acc, _mm_set1_epi16(1)));
+#else
+        return scalarCount<uint16_t>(cells, delta);
+#endif
+    }
+
+    static int count32(const unsigned char* cells, uint32_t delta) {
+#if defined(PACKED_SSE2)
+        const __m128i bias = _mm_set1_epi32(static_cast<int>(0x80000000u));
+        __m128i needle = _mm_xor_si128(_mm_set1_epi32(static_cast<int>(delta)), bias);
+        __m128i acc = _mm_setzero_si128();
+        for (int i = 0; i < Bytes; i += 16) {
+            __m128i cell = _mm_xor_si128(_mm_load_si128(reinterpret_cast<const __m128i*>(cells + i)), bias);
+            acc = _mm_sub_epi32(acc, _mm_cmplt_epi32(cell, needle));
+        }
+        return sum32(acc);
+#else
+        return scalarCount<uint32_t>(cells, delta);
+#endif
+    }
+
+#if defined(PACKED_SSE2)
+    static int sum32(__m128i acc) {
+        acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+        acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtsi128_si32(acc);
+    }
+#endif
+};
+
+// Упакованный лист: наименьший ключ base и разности остальных с ним, все одной ширины.
+// Разности лежат с начала узла, с границы строки кэша; поля после них читаются одной строкой
+template <typename T, int Bytes>
+struct alignas(kCacheLine) PackedLeaf {
+    unsigned char cells[Bytes];  // Разности по width байт; свободные ячейки — все единицы
+    T base;                      // Наименьший ключ листа
+    int count;
+    int width;                   // Ширина разности: 1, 2, 4 или 8 байт
+    PackedLeaf* next;            // Следующий лист (ключи больше)
+    PackedLeaf* prev;            // Предыдущий лист (ключи меньше)
+
+    PackedLeaf() : base(), count(0), width(1), next(nullptr), prev(nullptr) {
+        std::memset(cells, 0xFF, Bytes);
+    }
+};
+
+// B+дерево для целых ключей со сжатыми листьями — например, для плотных 64-битных идентификаторов.
+// Ключи одного листа отличаются в младших байтах, поэтому лист хранит наименьший ключ и разности
+// с ним шириной 1, 2, 4 или 8 байт — самой узкой, в которую укладывается разброс ключей этого листа.
+// Лист занимает LeafBytes байт (по умолчанию 4 строки кэша) и вмещает LeafBytes / width ключей:
+// на плотных ключах в 2–8 раз больше, чем несжатый лист BPlusTree, поэтому листьев меньше и дерево ниже.
+// Поиск в листе сравнивает сами разности, не раскодируя ключи (PackedSearch).
+// Ключ, который не укладывается в ширину листа, расширяет ее; когда места не хватает, лист делится,
+// и каждая половина выбирает ширину заново. Внутренние узлы — как в BPlusTree (BPlusInner, NodeSearch).
+//
+// Радиксный каталог над листьями: диапазон ключей режется на ячейки по 2^shift значений (около двух
+// на лист), ячейка хранит лист, с которого начинается ее диапазон. Поиск берет лист из каталога по
+// старшим битам разности с наименьшим ключом и проходит по цепочке вперед, пока следующий лист
+// начинается не дальше ключа, — внутренние уровни пропускаются. Ячейка, которую задевают больше
+// kMaxSlotLeaves листьев (ключи там лежат кучно), пуста, и поиск по ней спускается от корня;
+// если пусты больше половины ячеек, каталог не строится вовсе.
+// Деление листа каталог не портит: новый лист находится шагом по цепочке. Каталог перестраивается
+// за O(листьев), когда изменений листьев с прошлой постройки больше четверти их числа; слияние или
+// перераспределение листьев при удалении выключает его до этой перестройки. Константные методы
+// каталог только читают.
+// Ключи уникальны: повторная вставка ключа ничего не меняет.
+// Память под узлы выделяет политика NodeAllocator (см. NodeAllocator.h).
+template <typename T, int LeafBytes = 4 * kCacheLine, typename NodeAllocator = DefaultNodeAllocator>
+class PackedBPlusTree {
+    static_assert(std::is_integral<T>::value && !std::is_same<T, bool>::value, "PackedBPlusTree хранит целые ключи");
+    static_assert(LeafBytes % kCacheLine == 0 && LeafBytes >= kCacheLine && LeafBytes <= 16 * kCacheLine,
+                  "Лист занимает от 1 до 16 строк кэша");
+
+    using U = std::make_unsigned_t<T>;
+    static constexpr int kInnerCapacity = static_cast<int>(4 * kCacheLine / sizeof(T));
+    using Inner = BPlusInner<T, kInnerCapacity>;
+    using Leaf = PackedLeaf<T, LeafBytes>;
+    using Search = NodeSearch<T, kInnerCapacity>;
+    using Cells = PackedSearch<LeafBytes>;
+
+    // Предел высоты: при заполнении узлов хотя бы наполовину этого хватает с запасом
+    static constexpr int kMaxHeight = 32;
+    // Минимальное заполнение внутреннего узла, кроме корня
+    static constexpr int kMinKeys = kInnerCapacity / 2;
+    // Больше всего ключей в листе — при разностях в байт
+    static constexpr int kMaxLeafKeys = LeafBytes;
+    // Лист недозаполнен, если в нем меньше ключей, чем в половине несжатого листа того же размера
+    static constexpr int kMinLeafKeys = static_cast<int>(LeafBytes / sizeof(T) / 2);
+    // Сколько листов может задеть ячейка каталога, чтобы поиск через нее был дешевле спуска
+    static constexpr size_t kMaxSlotLeaves = 2;
+
+public:
+    // Итератор по ключам в порядке возрастания по цепочке листов.
+    // Ключ раскодируется на лету, поэтому разыменование возвращает копию
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = T;
+
+        Iterator() : leaf(nullptr), index(0) {}
+        Iterator(const Leaf* leaf, int index) : leaf(leaf), index(index) {}
+
+        reference operator*() const { return keyAt(leaf, index); }
+        Iterator& operator++() {
+            if (++index == leaf->count) {
+                leaf = leaf->next;
+                index = 0;
+            }
+            return *this;
+        }
+        Iterator operator++(int) {
+            Iterator copy = *this;
+            ++*this;
+            return copy;
+        }
+        bool operator==(const Iterator& other) const { return leaf == other.leaf && index == other.index; }
+        bool operator!=(const Iterator& other) const { return !(*this == other); }
+
+    private:
+        const Leaf* leaf;  // nullptr — позиция за последним ключом
+        int index;
+    };
+
+    PackedBPlusTree()
+        : root(nullptr), height(0), first(nullptr), size_(0), leafCount(0),
+          directoryLow(), directoryShift(0), changes(0) {}
+    ~PackedBPlusTree() { clear(); }
+    PackedBPlusTree(const PackedBPlusTree&) = delete;
+    PackedBPlusTree& operator=(const PackedBPlusTree&) = delete;
+
+    size_t size() const { return size_; }
+    // Число листьев: при том же числе ключей чем плотнее ключи, тем их меньше
+    size_t leaves() const { return leafCount; }
+    // Идет ли сейчас поиск через радиксный каталог
+    bool hasDirectory() const { return !directory.empty(); }
+
+    Iterator begin() const { return Iterator(first, 0); }
+    Iterator end() const { return Iterator(); }
+
+    // Удаление всех узлов
+    void clear() {
+        // Узлы тривиально разрушаемы, поэтому со слабом или ареной обход не нужен
+        if (!NodeAllocator::kBulkRelease && root != nullptr)
+            destroy(root, height);
+        allocator.release();
+        root = first = nullptr;
+        height = 0;
+        size_ = 0;
+        leafCount = 0;
+        directory.clear();
+        changes = 0;
+    }
+
+    // Поиск ключа
+    bool contains(T key) const {
+        if (root == nullptr)
+            return false;
+        const Leaf* leaf = findLeaf(key);
+        int i = lowerIndex(leaf, key);
+        return i < leaf->count && keyAt(leaf, i) == key;
+    }
+
+    // Вставка ключа; возвращает false, если ключ уже есть
+    bool insert(T key) {
+        if (root == nullptr) {
+            Leaf* leaf = allocator.template create<Leaf>();
+            encode(leaf, &key, 1);
+            root = first = leaf;
+            height = 1;
+            size_ = 1;
+            leafCount = 1;
+            return true;
+        }
+
+        Inner* path[kMaxHeight];
+        int slot[kMaxHeight];
+        Leaf* leaf = descend(key, path, slot);
+        int pos = lowerIndex(leaf, key);
+        if (pos < leaf->count && keyAt(leaf, pos) == key)
+            return false;
+        ++size_;
+
+        // Ключ больше наименьшего, разность укладывается в ширину листа и место есть: сдвиг хвоста разностей
+        uint64_t d = delta(key, leaf->base);
+        int width = leaf->width;
+        if (pos > 0 && d <= maxDelta(width) && (leaf->count + 1) * width <= LeafBytes) {
+            unsigned char* at = leaf->cells + pos * width;
+            std::memmove(at + width, at, (leaf->count - pos) * width);
+            setCell(leaf, pos, d);
+            ++leaf->count;
+            return true;
+        }
+
+        // Иначе лист раскодируется и укладывается заново: с новым наименьшим ключом, шире или вдвое
+        T keys[kMaxLeafKeys + 1];
+        int n = decode(leaf, keys);
+        insertAt(keys, n, pos, key);
+        ++n;
+        if (fits(keys, n)) {
+            encode(leaf, keys, n);
+            return true;
+        }
+
+        // Места не хватает: делим поближе к середине так, чтобы обе половины уложились
+        Leaf* right = allocator.template create<Leaf>();
+        int at = splitNear(keys, n);
+        encode(leaf, keys, at);
+        encode(right, keys + at, n - at);
+        right->next = leaf->next;
+        right->prev = leaf;
+        if (leaf->next != nullptr)
+            leaf->next->prev = right;
+        leaf->next = right;
+        ++leafCount;
+        insertSeparator(path, slot, keys[at], right);
+        noteLeafChange();
+        return true;
+    }
+
+    // Удаление ключа; возвращает false, если ключа нет.
+    // Недозаполненный лист сливается с соседом, если их ключи укладываются в один лист, иначе
+    // ключи пары делятся заново; внутренние узлы исправляются как в BPlusTree
+    bool erase(T key) {
+        if (root == nullptr)
+            return false;
+
+        Inner* path[kMaxHeight];
+        int slot[kMaxHeight];
+        Leaf* leaf = descend(key, path, slot);
+        int pos = lowerIndex(leaf, key);
+        if (pos >= leaf->count || keyAt(leaf, pos) != key)
+            return false;
+        --size_;
+
+        if (pos == 0 && leaf->count > 1) {
+            // Ушел наименьший ключ: лист укладывается от следующего, разности могут стать уже
+            T keys[kMaxLeafKeys];
+            int n = decode(leaf, keys);
+            encode(leaf, keys + 1, n - 1);
+        }
+        else {
+            int width = leaf->width;
+            unsigned char* at = leaf->cells + pos * width;
+            std::memmove(at, at + width, (leaf->count - pos - 1) * width);
+            std::memset(leaf->cells + (leaf->count - 1) * width, 0xFF, width);
+            --leaf->count;
+        }
+
+        if (height == 1) {
+            if (leaf->count == 0) {
+                allocator.destroy(leaf);
+                root = first = nullptr;
+                height = 0;
+                leafCount = 0;
+            }
+            return true;
+        }
+        if (leaf->count >= kMinLeafKeys)
+            return true;
+
+        bool merged = fixLeaf(path[height - 2], slot[height - 2], leaf);
+        for (int level = height - 2; merged && level > 0; --level) {
+            Inner* inner = path[level];
+            if (inner->count >= kMinKeys)
+                break;
+            merged = fixInner(path[level - 1], slot[level - 1], inner);
+        }
+
+        // Корень остался без ключей: дерево становится ниже на уровень
+        Inner* top = static_cast<Inner*>(root);
+        if (height > 1 && top->count == 0) {
+            root = top->children[0];
+            allocator.destroy(top);
+            --height;
+        }
+        noteLeafChange();
+        return true;
+    }
+
+    // Замена содержимого ключами из [from, to), отсортированными строго по возрастанию.
+    // Листья заполняются подряд, пока разности занимают не больше доли fill от LeafBytes (не меньше половины);
+    // внутренние уровни и каталог строятся за O(n)
+    template <typename ForwardIt>
+    void buildFromSorted(ForwardIt from, ForwardIt to, double fill = 1.0) {
+        buildCounted(from, static_cast<size_t>(std::distance(from, to)), fill);
+    }
+
+    // Обход ключей из [lo, hi] по связанным листам
+    template <typename Visitor>
+    void forEachInRange(T lo, T hi, Visitor visit) const {
+        if (root == nullptr || hi < lo)
+            return;
+        const Leaf* leaf = findLeaf(lo);
+        int i = lowerIndex(leaf, lo);
+        for (; leaf != nullptr; leaf = leaf->next, i = 0) {
+            for (; i < leaf->count; ++i) {
+                T key = keyAt(leaf, i);
+                if (hi < key)
+                    return;
+                visit(key);
+            }
+        }
+    }
+
+    // Снимок дерева в поток (формат — в Snapshot.h), совместимый со снимками BPlusTree с тем же типом ключей
+    void save(std::ostream& out, SnapshotEncoding encoding = SnapshotEncoding::Compact) const {
+        saveSnapshot<SetEntry<T>>(out, begin(), end(), size_, encoding);
+    }
+
+    // Замена содержимого снимком из потока; листья заполняются как в buildFromSorted.
+    // При ошибке (снимок поврежден или с другим типом ключей) исключение, дерево остается пустым
+    void load(std::istream& in, double fill = 1.0) {
+        try {
+            SnapshotReader<SetEntry<T>, std::less<T>> reader(in, std::less<T>(), true);
+            buildCounted(reader.begin(), reader.size(), fill);
+            reader.finish();
+        }
+        catch (...) {
+            clear();
+            throw;
+        }
+    }
+
+    // Вывод всех ключей по возрастанию
+    void traverse() const {
+        for (T key : *this)
+            std::cout << key << " ";
+        std::cout << std::endl;
+    }
+
+private:
+    void* root;
+    int height;        // Число уровней; 1 — корень является листом
+    Leaf* first;       // Самый левый лист
+    size_t size_;
+    size_t leafCount;
+    NodeAllocator allocator;
+    // Радиксный каталог: ячейка s — лист, с которого начинаются ключи directoryLow + (s << directoryShift);
+    // nullptr — искать спуском. Пусто — каталог выключен
+    std::vector<const Leaf*> directory;
+    T directoryLow;
+    int directoryShift;
+    size_t changes;    // Делений, слияний и перераспределений листьев с последней постройки каталога
+
+    // Разность ключа с base (key >= base) в беззнаковой арифметике: верна и для ключей со знаком
+    static uint64_t delta(T key, T base) {
+        return static_cast<uint64_t>(static_cast<U>(static_cast<U>(key) - static_cast<U>(base)));
+    }
+    static T keyOf(T base, uint64_t d) {
+        return static_cast<T>(static_cast<U>(static_cast<U>(base) + static_cast<U>(d)));
+    }
+    static uint64_t maxDelta(int width) {
+        return width >= 8 ? ~uint64_t(0) : (uint64_t(1) << (8 * width)) - 1;
+    }
+    // Самая узкая ширина, в которую укладывается разность span
+    static int widthFor(uint64_t span) {
+        return span <= 0xFF ? 1 : span <= 0xFFFF ? 2 : span <= 0xFFFFFFFFu ? 4 : 8;
+    }
+
+    static uint64_t cell(const Leaf* leaf, int i) {
+        const unsigned char* p = leaf->cells + i * leaf->width;
+        switch (leaf->width) {
+        case 1:
+            return *p;
+        case 2: {
+            uint16_t v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+        case 4: {
+            uint32_t v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+        default: {
+            uint64_t v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+        }
+    }
+    static void setCell(Leaf* leaf, int i, uint64_t d) {
+        unsigned char* p = leaf->cells + i * leaf->width;
+        switch (leaf->width) {
+        case 1:
+            *p = static_cast<uint8_t>(d);
+            break;
+        case 2: {
+            uint16_t v = static_cast<uint16_t>(d);
+            std::memcpy(p, &v, sizeof(v));
+            break;
+        }
+        case 4: {
+            uint32_t v = static_cast<uint32_t>(d);
+            std::memcpy(p, &v, sizeof(v));
+            break;
+        }
+        default:
+            std::memcpy(p, &d, sizeof(d));
+        }
+    }
+    static T keyAt(const Leaf* leaf, int i) { return keyOf(leaf->base, cell(leaf, i)); }
+
+    // Число ключей листа, меньших key (позиция lower_bound)
+    static int lowerIndex(const Leaf* leaf, T key) {
+        if (leaf->count == 0 || !(leaf->base < key))
+            return 0;
+        uint64_t d = delta(key, leaf->base);
+        if (d > maxDelta(leaf->width))
+            return leaf->count;
+        return Cells::countLess(leaf->cells, leaf->width, d);
+    }
+
+    // Укладываются ли n ключей по возрастанию в один лист
+    static bool fits(const T* keys, int n) {
+        return n <= 1 || n * widthFor(delta(keys[n - 1], keys[0])) <= LeafBytes;
+    }
+    // Запись n ключей по возрастанию в лист: base — наименьший, ширина — по разбросу
+    static void encode(Leaf* leaf, const T* keys, int n) {
+        std::memset(leaf->cells, 0xFF, LeafBytes);
+        leaf->count = n;
+        if (n == 0)
+            return;
+        leaf->base = keys[0];
+        leaf->width = widthFor(delta(keys[n - 1], keys[0]));
+        for (int i = 0; i < n; ++i)
+            setCell(leaf, i, delta(keys[i], keys[0]));
+    }
+    static int decode(const Leaf* leaf, T* out) {
+        for (int i = 0; i < leaf->count; ++i)
+            out[i] = keyAt(leaf, i);
+        return leaf->count;
+    }
+    // Место деления n ключей на два листа, ближайшее к середине. Оно всегда есть: ключи пары
+    // уже лежали в двух листах, а лишний ключ вставки расширяет разброс, только встав с краю
+    static int splitNear(const T* keys, int n) {
+        int mid = n / 2;
+        for (int step = 0; step <= mid; ++step) {
+            for (int at : { mid - step, mid + step })
+                if (at >= 1 && at < n && fits(keys, at) && fits(keys + at, n - at))
+                    return at;
+        }
+        return mid;
+    }
+
+    // Спуск до листа с запоминанием пути: узел и номер потомка на каждом уровне
+    Leaf* descend(T key, Inner** path, int* slot) {
+        void* node = root;
+        for (int level = 0; level < height - 1; ++level) {
+            Inner* inner = static_cast<Inner*>(node);
+            int i = Search::countLessEqual(inner->keys, inner->count, key);
+            path[level] = inner;
+            slot[level] = i;
+            node = inner->children[i];
+        }
+        return static_cast<Leaf*>(node);
+    }
+
+    // Лист, в котором должен лежать key: через каталог, если ячейка ключа заполнена, иначе спуском.
+    // Перед просмотром узла запрашиваются сразу все его строки с ключами
+    const Leaf* findLeaf(T key) const {
+        if (!directory.empty() && !(key < directoryLow)) {
+            uint64_t s = delta(key, directoryLow) >> directoryShift;
+            if (s < directory.size() && directory[s] != nullptr) {
+                const Leaf* leaf = directory[s];
+                while (leaf->next != nullptr && !(key < leaf->next->base))
+                    leaf = leaf->next;
+                return leaf;
+            }
+        }
+        const void* node = root;
+        for (int level = 0; level < height - 1; ++level) {
+            const Inner* inner = static_cast<const Inner*>(node);
+            node = inner->children[Search::countLessEqual(inner->keys, inner->count, key)];
+            prefetchRange(node, level + 2 < height ? kInnerCapacity * sizeof(T) : LeafBytes);
+        }
+        return static_cast<const Leaf*>(node);
+    }
+
+    const Leaf* lastLeaf() const {
+        const void* node = root;
+        for (int level = 0; level < height - 1; ++level) {
+            const Inner* inner = static_cast<const Inner*>(node);
+            node = inner->children[inner->count];
+        }
+        return static_cast<const Leaf*>(node);
+    }
+
+    // Изменение цепочки листьев: каталог перестраивается, когда их накопилось больше четверти числа листьев
+    void noteLeafChange() {
+        if (++changes > leafCount / 4)
+            buildDirectory();
+    }
+
+    // Постройка каталога по цепочке листьев за O(листьев + ячеек). В дереве из одного листа он не нужен
+    void buildDirectory() {
+        directory.clear();
+        changes = 0;
+        if (height < 2)
+            return;
+        const Leaf* last = lastLeaf();
+        T low = first->base;
+        uint64_t span = delta(keyAt(last, last->count - 1), low);
+        uint64_t target = 2 * static_cast<uint64_t>(leafCount);
+        int shift = 0;
+        while ((span >> shift) >= target)
+            ++shift;
+        size_t slots = static_cast<size_t>(span >> shift) + 1;
+        uint64_t slotSpan = (uint64_t(1) << shift) - 1;
+        directory.resize(slots, nullptr);
+
+        size_t useful = 0;
+        const Leaf* leaf = first;
+        for (size_t s = 0; s < slots; ++s) {
+            uint64_t offset = static_cast<uint64_t>(s) << shift;
+            T start = keyOf(low, offset);
+            T end = keyOf(low, offset + std::min(slotSpan, span - offset));
+            while (leaf->next != nullptr && !(start < leaf->next->base))
+                leaf = leaf->next;
+            // Сколько листов задевает ячейка [start, end]
+            const Leaf* probe = leaf;
+            size_t touched = 1;
+            while (touched <= kMaxSlotLeaves && probe->next != nullptr && !(end < probe->next->base)) {
+                probe = probe->next;
+                ++touched;
+            }
+            if (touched <= kMaxSlotLeaves) {
+                directory[s] = leaf;
+                ++useful;
+            }
+        }
+        if (useful * 2 < slots) {
+            directory.clear();
+            directory.shrink_to_fit();
+            return;
+        }
+        directoryLow = low;
+        directoryShift = shift;
+    }
+
+    // Замена содержимого count ключами, читаемыми по порядку с from (см. buildFromSorted):
+    // хватает однопроходного итератора
+    template <typename InputIt>
+    void buildCounted(InputIt from, size_t count, double fill) {
+        clear();
+        if (count == 0)
+            return;
+        size_t budget = fillTarget(fill, LeafBytes / 2, LeafBytes);  // Байт разностей на лист
+        std::vector<void*> nodes;
+        std::vector<T> lows;
+        T keys[kMaxLeafKeys];
+        int n = 0;
+        try {
+            for (size_t i = 0; i < count; ++i, ++from) {
+                T key = *from;
+                if (n > 0 && static_cast<size_t>(n + 1) * widthFor(delta(key, keys[0])) > budget) {
+                    appendLeaf(nodes, lows, keys, n);
+                    n = 0;
+                }
+                keys[n++] = key;
+            }
+            appendLeaf(nodes, lows, keys, n);
+        }
+        catch (...) {
+            destroyLeaves(nodes);
+            throw;
+        }
+        // Последний лист мог остаться почти пустым: ключи двух последних делятся заново
+        size_t leaves = nodes.size();
+        if (leaves > 1 && static_cast<Leaf*>(nodes[leaves - 1])->count < kMinLeafKeys)
+            lows[leaves - 1] = rebalance(static_cast<Leaf*>(nodes[leaves - 2]), static_cast<Leaf*>(nodes[leaves - 1]));
+        linkLeaves(nodes);
+        leafCount = leaves;
+        buildInner(nodes, lows, fill);
+        size_ = count;
+        buildDirectory();
+    }
+
+    void appendLeaf(std::vector<void*>& nodes, std::vector<T>& lows, const T* keys, int n) {
+        nodes.push_back(nullptr);
+        lows.push_back(keys[0]);
+        Leaf* leaf = allocator.template create<Leaf>();
+        nodes.back() = leaf;
+        encode(leaf, keys, n);
+    }
+
+    // Связывание листьев в цепочку; первый становится началом обхода
+    void linkLeaves(const std::vector<void*>& leaves) {
+        Leaf* prev = nullptr;
+        for (void* node : leaves) {
+            Leaf* leaf = static_cast<Leaf*>(node);
+            leaf->prev = prev;
+            if (prev != nullptr)
+                prev->next = leaf;
+            prev = leaf;
+        }
+        first = static_cast<Leaf*>(leaves.front());
+    }
+
+    // Разбор листьев недостроенного дерева (пустые ячейки — еще не созданные листья)
+    void destroyLeaves(const std::vector<void*>& leaves) {
+        for (void* leaf : leaves)
+            if (leaf != nullptr)
+                allocator.destroy(static_cast<Leaf*>(leaf));
+    }
+
+    // Внутренние уровни над связанными листьями nodes с наименьшими ключами lows (как в BPlusTree).
+    // При исключении разбирает все узлы, дерево остается пустым
+    void buildInner(std::vector<void*>& nodes, std::vector<T>& lows, double fill) {
+        size_t target = fillTarget(fill, kMinKeys, kInnerCapacity) + 1;
+        std::vector<Inner*> created;  // Каждый внутренний узел имеет хотя бы двух потомков
+        int levels = 1;
+        try {
+            created.reserve(nodes.size());
+            while (nodes.size() > 1) {
+                size_t children = nodes.size();
+                EvenSplit split(children, packedNodeCount(children, kMinKeys + 1, kInnerCapacity + 1, target));
+                for (size_t j = 0; j < split.parts; ++j) {
+                    Inner* inner = allocator.template create<Inner>();
+                    created.push_back(inner);
+                    size_t begin = split.offset(j);
+                    size_t size = split.size(j);
+                    for (size_t i = 0; i < size; ++i) {
+                        inner->children[i] = nodes[begin + i];
+                        if (i > 0)
+                            inner->keys[i - 1] = lows[begin + i];
+                    }
+                    inner->count = static_cast<int>(size - 1);
+                    nodes[j] = inner;
+                    lows[j] = lows[begin];
+                }
+                nodes.resize(split.parts);
+                lows.resize(split.parts);
+                ++levels;
+            }
+        }
+        catch (...) {
+            for (Inner* inner : created)
+                allocator.destroy(inner);
+            destroy(nullptr, 1);  // Только цепочка листьев
+            first = nullptr;
+            leafCount = 0;
+            throw;
+        }
+        root = nodes[0];
+        height = levels;
+    }
+
+    // Вставка value в позицию pos массива из used элементов
+    template <typename V>
+    static void insertAt(V* items, int used, int pos, V value) {
+        std::memmove(items + pos + 1, items + pos, (used - pos) * sizeof(V));
+        items[pos] = value;
+    }
+
+    // Удаление ключа из позиции pos массива из used ключей; освободившаяся ячейка снова заполняется максимумом
+    static void removeKeyAt(T* keys, int used, int pos) {
+        std::memmove(keys + pos, keys + pos + 1, (used - pos - 1) * sizeof(T));
+        keys[used - 1] = std::numeric_limits<T>::max();
+    }
+
+    template <typename V>
+    static void removeAt(V* items, int used, int pos) {
+        std::memmove(items + pos, items + pos + 1, (used - pos - 1) * sizeof(V));
+    }
+
+    // Удаление из родителя разделителя keyPos и потомка childPos
+    static void removeFromParent(Inner* parent, int keyPos, int childPos) {
+        removeKeyAt(parent->keys, parent->count, keyPos);
+        removeAt(parent->children, parent->count + 1, childPos);
+        --parent->count;
+    }
+
+    // Подъем разделителя separator и нового правого потомка child по пути вставки
+    void insertSeparator(Inner** path, const int* slot, T separator, void* child) {
+        for (int level = height - 2; level >= 0; --level) {
+            Inner* parent = path[level];
+            int at = slot[level];
+            if (parent->count < kInnerCapacity) {
+                insertAt(parent->keys, parent->count, at, separator);
+                insertAt(parent->children, parent->count + 1, at + 1, child);
+                ++parent->count;
+                return;
+            }
+            child = splitInner(parent, at, separator, child, separator);
+        }
+
+        // Разделился корень: дерево растет вверх
+        Inner* newRoot = allocator.template create<Inner>();
+        newRoot->keys[0] = separator;
+        newRoot->count = 1;
+        newRoot->children[0] = root;
+        newRoot->children[1] = child;
+        root = newRoot;
+        ++height;
+    }
+
+    // Новое деление ключей соседних листьев lo и hi поближе к середине; возвращает наименьший ключ hi
+    static T rebalance(Leaf* lo, Leaf* hi) {
+        T keys[2 * kMaxLeafKeys];
+        int n = decode(lo, keys);
+        n += decode(hi, keys + n);
+        int at = splitNear(keys, n);
+        encode(lo, keys, at);
+        encode(hi, keys + at, n - at);
+        return keys[at];
+    }
+
+    // Исправление недозаполненного листа leaf (потомок at узла parent) вместе с соседом — левым, если он есть.
+    // Ключи перемещаются между листьями, поэтому каталог выключается до перестройки.
+    // Возвращает true, если листы слились и в parent стало на ключ меньше
+    bool fixLeaf(Inner* parent, int at, Leaf* leaf) {
+        directory.clear();
+        Leaf* lo = at > 0 ? static_cast<Leaf*>(parent->children[at - 1]) : leaf;
+        Leaf* hi = at > 0 ? leaf : static_cast<Leaf*>(parent->children[at + 1]);
+        int hiAt = at > 0 ? at : at + 1;
+
+        T keys[2 * kMaxLeafKeys];
+        int n = decode(lo, keys);
+        n += decode(hi, keys + n);
+        if (!fits(keys, n)) {
+            parent->keys[hiAt - 1] = rebalance(lo, hi);
+            return false;
+        }
+
+        // Сливаем правый лист пары в левый
+        encode(lo, keys, n);
+        lo->next = hi->next;
+        if (hi->next != nullptr)
+            hi->next->prev = lo;
+        removeFromParent(parent, hiAt - 1, hiAt);
+        allocator.destroy(hi);
+        --leafCount;
+        return true;
+    }
+
+    // То же для внутреннего узла: заем идет через разделитель родителя
+    bool fixInner(Inner* parent, int at, Inner* node) {
+        Inner* left = at > 0 ? static_cast<Inner*>(parent->children[at - 1]) : nullptr;
+        Inner* right = at < parent->count ? static_cast<Inner*>(parent->children[at + 1]) : nullptr;
+
+        if (left != nullptr && left->count > kMinKeys) {
+            insertAt(node->keys, node->count, 0, parent->keys[at - 1]);
+            insertAt(node->children, node->count + 1, 0, left->children[left->count]);
+            ++node->count;
+            parent->keys[at - 1] = left->keys[left->count - 1];
+            removeKeyAt(left->keys, left->count, left->count - 1);
+            --left->count;
+            return false;
+        }
+        if (right != nullptr && right->count > kMinKeys) {
+            node->keys[node->count] = parent->keys[at];
+            node->children[node->count + 1] = right->children[0];
+            ++node->count;
+            parent->keys[at] = right->keys[0];
+            removeKeyAt(right->keys, right->count, 0);
+            removeAt(right->children, right->count + 1, 0);
+            --right->count;
+            return false;
+        }
+
+        // Слияние: левый узел пары получает разделитель родителя и все содержимое правого
+        Inner* target = left != nullptr ? left : node;
+        Inner* source = left != nullptr ? node : right;
+        int sourceAt = left != nullptr ? at : at + 1;
+        target->keys[target->count] = parent->keys[sourceAt - 1];
+        std::memcpy(target->keys + target->count + 1, source->keys, source->count * sizeof(T));
+        std::memcpy(target->children + target->count + 1, source->children, (source->count + 1) * sizeof(void*));
+        target->count += source->count + 1;
+        removeFromParent(parent, sourceAt - 1, sourceAt);
+        allocator.destroy(source);
+        return true;
+    }
+
+    // Деление заполненного внутреннего узла со вставкой пары (key, child) в позицию at.
+    // Средний ключ уходит к родителю через up; возвращает новый правый узел
+    Inner* splitInner(Inner* node, int at, T key, void* child, T& up) {
+        T keys[kInnerCapacity + 1];
+        void* children[kInnerCapacity + 2];
+        std::memcpy(keys, node->keys, kInnerCapacity * sizeof(T));
+        std::memcpy(children, node->children, (kInnerCapacity + 1) * sizeof(void*));
+        insertAt(keys, kInnerCapacity, at, key);
+        insertAt(children, kInnerCapacity + 1, at + 1, child);
+
+        int leftCount = kInnerCapacity / 2;
+        int rightCount = kInnerCapacity - leftCount;  // Один ключ из kInnerCapacity + 1 поднимается наверх
+        Inner* right = allocator.template create<Inner>();
+        std::fill(node->keys, node->keys + kInnerCapacity, std::numeric_limits<T>::max());
+        std::memcpy(node->keys, keys, leftCount * sizeof(T));
+        std::memcpy(node->children, children, (leftCount + 1) * sizeof(void*));
+        std::memcpy(right->keys, keys + leftCount + 1, rightCount * sizeof(T));
+        std::memcpy(right->children, children + leftCount + 1, (rightCount + 1) * sizeof(void*));
+        node->count = leftCount;
+        right->count = rightCount;
+        up = keys[leftCount];
+        return right;
+    }
+
+    // Разбор без рекурсии: листья освобождаются по цепочке, внутренние узлы — через явный стек
+    void destroy(void* node, int levels) {
+        std::vector<std::pair<Inner*, int>> pending;
+        if (levels > 1)
+            pending.emplace_back(static_cast<Inner*>(node), levels);
+        while (!pending.empty()) {
+            Inner* inner = pending.back().first;
+            int level = pending.back().second;
+            pending.pop_back();
+            if (level > 2)
+                for (int i = 0; i <= inner->count; ++i)
+                    pending.emplace_back(static_cast<Inner*>(inner->children[i]), level - 1);
+            allocator.destroy(inner);
+        }
+        for (Leaf* leaf = first; leaf != nullptr;) {
+            Leaf* next = leaf->next;
+            allocator.destroy(leaf);
+            leaf = next;
+        }
+    }
+};
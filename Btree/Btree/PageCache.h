@@ -0,0 +1,181 @@
+﻿#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "PageFile.h"
+
+// Кэш страниц файла (буферный пул): capacity кадров по PageSize байт, вытеснение по часовой
+// стрелке (clock) — приближение LRU, которому не нужен список при каждом обращении.
+// Страница, на которую есть ссылка PageRef, закреплена и не вытесняется. Измененная (грязная)
+// страница записывается в файл при вытеснении или при flush(); сброс на носитель — забота владельца
+template <size_t PageSize>
+class PageCache {
+public:
+    using PageId = uint64_t;
+
+    // Ссылка на закрепленную страницу кэша; только перемещается
+    class PageRef {
+    public:
+        PageRef() : cache(nullptr), frame(0) {}
+        PageRef(PageRef&& other) noexcept : cache(other.cache), frame(other.frame) { other.cache = nullptr; }
+        PageRef& operator=(PageRef&& other) noexcept {
+            if (this != &other) {
+                release();
+                cache = other.cache;
+                frame = other.frame;
+                other.cache = nullptr;
+            }
+            return *this;
+        }
+        ~PageRef() { release(); }
+
+        // Ссылка на страницу, а не пустая
+        explicit operator bool() const { return cache != nullptr; }
+        PageId id() const { return cache->frames[frame].id; }
+        unsigned char* data() const { return cache->pages[frame].bytes; }
+        template <typename Layout>
+        Layout* as() const { return reinterpret_cast<Layout*>(data()); }
+        // Страница будет изменена: при вытеснении ее нужно записать
+        void markDirty() const { cache->frames[frame].dirty = true; }
+
+    private:
+        friend class PageCache;
+        PageRef(PageCache* cache, size_t frame) : cache(cache), frame(frame) { ++cache->frames[frame].pins; }
+
+        void release() {
+            if (cache != nullptr)
+                --cache->frames[frame].pins;
+            cache = nullptr;
+        }
+
+        PageCache* cache;
+        size_t frame;
+    };
+
+    PageCache(PageFile& file, size_t capacity)
+        : file(file), pages(capacity), frames(capacity), hand(0), used(0) {
+        if (capacity == 0)
+            throw std::invalid_argument("PageCache: нужен хотя бы один кадр");
+        index.reserve(capacity);
+    }
+    PageCache(const PageCache&) = delete;
+    PageCache& operator=(const PageCache&) = delete;
+
+    size_t capacity() const { return frames.size(); }
+
+    // Страница id; если ее нет в кэше, она читается из файла
+    PageRef fetch(PageId id) {
+        auto found = index.find(id);
+        if (found != index.end()) {
+            frames[found->second].referenced = true;
+            return PageRef(this, found->second);
+        }
+        size_t frame = freeFrame();
+        file.read(id * PageSize, pages[frame].bytes, PageSize);
+        occupy(frame, id, false);
+        return PageRef(this, frame);
+    }
+
+    // Новая страница id, заполненная нулями, без чтения из файла; сразу грязная
+    PageRef create(PageId id) {
+        auto found = index.find(id);
+        size_t frame = found != index.end() ? found->second : freeFrame();
+        std::memset(pages[frame].bytes, 0, PageSize);
+        if (found == index.end())
+            occupy(frame, id, true);
+        frames[frame].dirty = true;
+        frames[frame].referenced = true;
+        return PageRef(this, frame);
+    }
+
+    // Страница больше не нужна: кадр освобождается без записи. Страница не должна быть закреплена
+    void discard(PageId id) {
+        auto found = index.find(id);
+        if (found == index.end())
+            return;
+        frames[found->second] = Frame();
+        index.erase(found);
+    }
+
+    // Запись всех грязных страниц в файл, по возрастанию номеров: запись идет почти подряд
+    void flush() {
+        std::vector<size_t> dirty;
+        for (size_t frame = 0; frame < frames.size(); ++frame) {
+            if (frames[frame].occupied && frames[frame].dirty)
+                dirty.push_back(frame);
+        }
+        std::sort(dirty.begin(), dirty.end(), [this](size_t a, size_t b) { return frames[a].id < frames[b].id; });
+        for (size_t frame : dirty) {
+            file.write(frames[frame].id * PageSize, pages[frame].bytes, PageSize);
+            frames[frame].dirty = false;
+        }
+    }
+
+    // Сброс всего кэша без записи (откат незафиксированных изменений). Закрепленных страниц быть не должно
+    void reset() {
+        std::fill(frames.begin(), frames.end(), Frame());
+        index.clear();
+        hand = 0;
+        used = 0;
+    }
+
+private:
+    struct alignas(64) Page {
+        unsigned char bytes[PageSize];
+    };
+    struct Frame {
+        PageId id = 0;
+        unsigned pins = 0;
+        bool occupied = false;
+        bool dirty = false;
+        bool referenced = false;  // Бит обращения для часовой стрелки
+    };
+
+    PageFile& file;
+    std::vector<Page> pages;
+    std::vector<Frame> frames;
+    std::unordered_map<PageId, size_t> index;  // Номер страницы -> кадр
+    size_t hand;  // Стрелка: следующий кандидат на вытеснение
+    size_t used;  // Кадры, которые еще ни разу не занимались, идут первыми
+
+    void occupy(size_t frame, PageId id, bool dirty) {
+        Frame& f = frames[frame];
+        f.id = id;
+        f.occupied = true;
+        f.dirty = dirty;
+        f.referenced = true;
+        index.emplace(id, frame);
+    }
+
+    // Кадр под новую страницу: незанятый или вытесненный. Стрелка снимает бит обращения
+    // и выбирает первый незакрепленный кадр без него; за два оборота такой найдется,
+    // если закреплены не все кадры
+    size_t freeFrame() {
+        if (used < frames.size() && !frames[used].occupied)
+            return used++;
+        for (size_t step = 0; step < 2 * frames.size(); ++step) {
+            size_t frame = hand;
+            hand = (hand + 1) % frames.size();
+            Frame& f = frames[frame];
+            if (!f.occupied)
+                return frame;
+            if (f.pins != 0)
+                continue;
+            if (f.referenced) {
+                f.referenced = false;
+                continue;
+            }
+            if (f.dirty)
+                file.write(f.id * PageSize, pages[frame].bytes, PageSize);
+            index.erase(f.id);
+            f = Frame();
+            return frame;
+        }
+        throw std::runtime_error("PageCache: все страницы кэша закреплены, кэш слишком мал");
+    }
+};
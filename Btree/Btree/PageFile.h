@@ -0,0 +1,157 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Файл с данными дискового индекса: чтение и запись по смещению (без общей позиции в файле)
+// и сброс на носитель. Файл открывается монопольно: второй процесс с тем же индексом
+// получит ошибку, а не испортит данные. Ошибки ввода-вывода — исключения std::system_error
+class PageFile {
+public:
+    // Открытие существующего файла или создание пустого
+    explicit PageFile(const std::string& path) {
+#ifdef _WIN32
+        handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_ALWAYS,
+                             FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (handle == INVALID_HANDLE_VALUE)
+            throwLastError("PageFile: не удалось открыть " + path);
+#else
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0)
+            throwLastError("PageFile: не удалось открыть " + path);
+        if (::flock(fd, LOCK_EX | LOCK_NB) != 0) {
+            int error = errno;
+            ::close(fd);
+            throw std::system_error(error, std::generic_category(), "PageFile: файл уже открыт другим процессом " + path);
+        }
+#endif
+    }
+    ~PageFile() {
+#ifdef _WIN32
+        CloseHandle(handle);
+#else
+        ::close(fd);  // Закрытие снимает и блокировку
+#endif
+    }
+    PageFile(const PageFile&) = delete;
+    PageFile& operator=(const PageFile&) = delete;
+
+    uint64_t size() const {
+#ifdef _WIN32
+        LARGE_INTEGER result;
+        if (!GetFileSizeEx(handle, &result))
+            throwLastError("PageFile: не удалось узнать размер файла");
+        return static_cast<uint64_t>(result.QuadPart);
+#else
+        struct stat info;
+        if (::fstat(fd, &info) != 0)
+            throwLastError("PageFile: не удалось узнать размер файла");
+        return static_cast<uint64_t>(info.st_size);
+#endif
+    }
+
+    // Чтение length байт со смещения offset; чтение за концом файла — ошибка
+    void read(uint64_t offset, void* data, size_t length) const {
+        char* out = static_cast<char*>(data);
+        while (length > 0) {
+            size_t done = readSome(offset, out, length);
+            if (done == 0)
+                throw std::runtime_error("PageFile: неожиданный конец файла");
+            offset += done;
+            out += done;
+            length -= done;
+        }
+    }
+
+    // Запись со смещения offset; запись за концом файла его удлиняет
+    void write(uint64_t offset, const void* data, size_t length) {
+        const char* in = static_cast<const char*>(data);
+        while (length > 0) {
+            size_t done = writeSome(offset, in, length);
+            offset += done;
+            in += done;
+            length -= done;
+        }
+    }
+
+    // Все записанное до вызова (и новый размер файла) дошло до носителя
+    void sync() {
+#ifdef _WIN32
+        if (!FlushFileBuffers(handle))
+            throwLastError("PageFile: не удалось сбросить файл на диск");
+#else
+        if (::fsync(fd) != 0)
+            throwLastError("PageFile: не удалось сбросить файл на диск");
+#endif
+    }
+
+private:
+#ifdef _WIN32
+    HANDLE handle;
+
+    static OVERLAPPED at(uint64_t offset) {
+        OVERLAPPED position = {};
+        position.Offset = static_cast<DWORD>(offset);
+        position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        return position;
+    }
+    static DWORD chunk(size_t length) {
+        return static_cast<DWORD>(length < (1u << 30) ? length : (1u << 30));
+    }
+    size_t readSome(uint64_t offset, char* data, size_t length) const {
+        OVERLAPPED position = at(offset);
+        DWORD done = 0;
+        if (!ReadFile(handle, data, chunk(length), &done, &position) && GetLastError() != ERROR_HANDLE_EOF)
+            throwLastError("PageFile: ошибка чтения");
+        return done;
+    }
+    size_t writeSome(uint64_t offset, const char* data, size_t length) {
+        OVERLAPPED position = at(offset);
+        DWORD done = 0;
+        if (!WriteFile(handle, data, chunk(length), &done, &position))
+            throwLastError("PageFile: ошибка записи");
+        return done;
+    }
+    [[noreturn]] static void throwLastError(const std::string& what) {
+        throw std::system_error(static_cast<int>(GetLastError()), std::system_category(), what);
+    }
+#else
+    int fd;
+
+    size_t readSome(uint64_t offset, char* data, size_t length) const {
+        while (true) {
+            ssize_t done = ::pread(fd, data, length, static_cast<off_t>(offset));
+            if (done >= 0)
+                return static_cast<size_t>(done);
+            if (errno != EINTR)
+                throwLastError("PageFile: ошибка чтения");
+        }
+    }
+    size_t writeSome(uint64_t offset, const char* data, size_t length) {
+        while (true) {
+            ssize_t done = ::pwrite(fd, data, length, static_cast<off_t>(offset));
+            if (done >= 0)
+                return static_cast<size_t>(done);
+            if (errno != EINTR)
+                throwLastError("PageFile: ошибка записи");
+        }
+    }
+    [[noreturn]] static void throwLastError(const std::string& what) {
+        throw std::system_error(errno, std::generic_category(), what);
+    }
+#endif
+};
@@ -0,0 +1,68 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#if !defined(__GNUC__) && !defined(__clang__) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#endif
+
+// Пакетный поиск с перекрытием промахов кэша.
+// Одиночный спуск по большому дереву почти все время ждет память: адрес следующего узла
+// известен только после загрузки текущего, и промахи идут строго друг за другом.
+// Когда ключей много, их спуски независимы, и ожидание можно перекрыть: ведется окно
+// из kBatchWindow спусков, каждый за шаг проходит один уровень и запрашивает заранее
+// (prefetch) строку, которая понадобится ему на следующем шаге; пока она едет из памяти,
+// шагают остальные спуски окна. Закончивший спуск сразу уступает место следующему ключу
+// (AMAC — asynchronous memory access chaining), поэтому окно не простаивает из-за разной глубины.
+
+// Размер строки кэша (под него же выравниваются узлы B+дерева)
+constexpr size_t kCacheLine = 64;
+
+// Подсказка процессору заранее подтянуть строку кэша
+inline void prefetchLine(const void* p) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(p);
+#elif defined(_M_X64) || defined(_M_IX86)
+    _mm_prefetch(static_cast<const char*>(p), _MM_HINT_T0);
+#endif
+}
+
+// То же для всех строк отрезка [p, p + bytes)
+inline void prefetchRange(const void* p, size_t bytes) {
+    uintptr_t first = reinterpret_cast<uintptr_t>(p);
+    for (uintptr_t line = first & ~uintptr_t(kCacheLine - 1); line < first + bytes; line += kCacheLine)
+        prefetchLine(reinterpret_cast<const void*>(line));
+}
+
+// Число спусков в полете. Процессор держит около 10–20 промахов L1 одновременно,
+// больше запросов только вытесняет из кэша еще не использованные строки
+constexpr size_t kBatchWindow = 16;
+
+// Чередование спусков для count ключей.
+// start(state, i) начинает спуск для ключа i: заполняет state и запрашивает первую строку;
+// возвращает true, если ответ известен сразу (пустое дерево).
+// step(state) проходит один шаг — читает запрошенное, запрашивает следующее;
+// возвращает true, когда спуск закончен и результат записан
+template <typename State, typename Start, typename Step>
+void interleavedSearch(size_t count, Start start, Step step) {
+    State states[kBatchWindow];
+    size_t next = 0;
+    // Следующий ключ, которому нужен спуск; false — ключи кончились
+    auto refill = [&](State& state) {
+        while (next < count)
+            if (!start(state, next++))
+                return true;
+        return false;
+    };
+    size_t active = 0;
+    while (active < kBatchWindow && refill(states[active]))
+        ++active;
+    while (active > 0) {
+        for (size_t slot = 0; slot < active;) {
+            if (!step(states[slot]) || refill(states[slot]))
+                ++slot;
+            else
+                states[slot] = states[--active];  // Ключи кончились: окно сжимается
+        }
+    }
+}
@@ -0,0 +1,123 @@
+﻿#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <vector>
+
+// Общие расчеты для построения деревьев из отсортированной последовательности (buildFromSorted).
+// Двоичные деревья строятся идеально сбалансированными: корень поддерева — средний элемент,
+// размеры левой и правой частей отличаются не больше чем на единицу.
+// B-деревья собираются снизу вверх: элементы раскладываются по узлам уровня поровну,
+// между соседними узлами один элемент уходит разделителем на уровень выше.
+// Параллельный вариант строит независимые поддеревья (или куски уровня листьев) в разных потоках,
+// у каждого потока своя политика памяти; после построения дерево забирает их память через adopt().
+
+// Поддеревья меньше этого строятся в одном потоке: запуск потоков дороже самого построения
+constexpr size_t kParallelBuildMin = 1 << 15;
+
+// Высота поддерева из count элементов при делении пополам (0 для пустого)
+inline int balancedHeight(size_t count) {
+    int height = 0;
+    for (; count != 0; count >>= 1)
+        ++height;
+    return height;
+}
+
+// Равномерное разбиение count элементов на parts групп: первые extra групп на один элемент больше
+struct EvenSplit {
+    size_t parts;
+    size_t base;
+    size_t extra;
+
+    EvenSplit(size_t count, size_t parts) : parts(parts), base(count / parts), extra(count % parts) {}
+
+    size_t size(size_t i) const { return base + (i < extra ? 1 : 0); }
+    // Сколько элементов приходится на группы до i-й
+    size_t offset(size_t i) const { return i * base + std::min(i, extra); }
+};
+
+// Число узлов уровня, по которым раскладываются count ячеек: в каждом узле от minPerNode
+// до maxPerNode ячеек и как можно ближе к target. Если все помещается в один узел, это корень,
+// и нижняя граница для него не действует. Округления считаются через остаток, без count + ...,
+// чтобы не переполниться при count, близком к SIZE_MAX
+inline size_t packedNodeCount(size_t count, size_t minPerNode, size_t maxPerNode, size_t target) {
+    if (count <= maxPerNode)
+        return 1;
+    size_t fewest = count / maxPerNode + (count % maxPerNode != 0 ? 1 : 0);
+    size_t most = std::max(fewest, count / minPerNode);
+    size_t nearest = count / target + (count % target >= target - target / 2 ? 1 : 0);
+    return std::clamp(nearest, fewest, most);
+}
+
+// Целевое заполнение узла по доле fill от емкости, в допустимых пределах
+inline size_t fillTarget(double fill, size_t minPerNode, size_t maxPerNode) {
+    double wanted = fill * static_cast<double>(maxPerNode) + 0.5;
+    if (!(wanted > static_cast<double>(minPerNode)))  // Заодно отсекает NaN
+        return minPerNode;
+    return std::min(static_cast<size_t>(wanted), maxPerNode);
+}
+
+// Число потоков по умолчанию
+inline unsigned defaultBuildThreads() {
+    unsigned threads = std::thread::hardware_concurrency();
+    return threads != 0 ? threads : 1;
+}
+
+// Глубина, на которой двоичное дерево из count элементов режется на поддеревья для потоков.
+// Поддеревьев берется в несколько раз больше потоков, чтобы те, кто закончил раньше, взяли еще.
+// 0 — строить в одном потоке
+inline int parallelSplitDepth(size_t count, unsigned threads) {
+    if (threads <= 1 || count < 2 * kParallelBuildMin)
+        return 0;
+    int depth = 2;
+    while ((size_t(1) << depth) < threads * 4u && (count >> (depth + 1)) >= kParallelBuildMin)
+        ++depth;
+    return depth;
+}
+
+// Поддерево, которое достраивает один поток: count элементов начиная с first
+// вешаются на ссылку link узла parent, корень поддерева лежит на глубине depth
+template <typename It, typename Node>
+struct SubtreeTask {
+    It first;
+    size_t count;
+    Node** link;
+    Node* parent;
+    int depth;
+};
+
+// Выполнение task(worker, i) для всех i из [0, count) на workers потоках; задачи разбираются
+// по общему счетчику. Первое исключение из задач пробрасывается после завершения всех потоков
+template <typename Task>
+void runParallel(size_t count, unsigned workers, Task task) {
+    std::atomic<size_t> nextTask(0);
+    std::atomic<bool> failed(false);
+    std::exception_ptr error;
+    auto work = [&](unsigned worker) {
+        try {
+            for (size_t i = nextTask++; i < count && !failed; i = nextTask++)
+                task(worker, i);
+        }
+        catch (...) {
+            if (!failed.exchange(true))
+                error = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(workers);
+    try {
+        for (unsigned worker = 1; worker < workers; ++worker)
+            threads.emplace_back(work, worker);
+    }
+    catch (...) {
+        // Не удалось запустить поток: оставшуюся работу сделают уже запущенные и текущий
+    }
+    work(0);
+    for (std::thread& thread : threads)
+        thread.join();
+    if (error)
+        std::rethrow_exception(error);
+}
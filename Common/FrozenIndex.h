@@ -0,0 +1,250 @@
+﻿#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "BatchSearch.h"
+
+#if !defined(__GNUC__) && !defined(__clang__) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Замороженный индекс: неизменяемая копия ключей дерева в одном массиве без указателей.
+// Индексы, которые после построения часами только читаются, не нуждаются в узлах: спуск по
+// AVL или красно-черному дереву — промах кэша на каждом уровне, потому что узлы разбросаны
+// по куче. Здесь ключи лежат подряд в порядке, удобном для спуска, и на ключ уходит sizeof(Key).
+// freeze(tree, layout) строит индекс из любого дерева (BST, AVLTree, RedBlackTree, BTree, SplayTree);
+// дерево после этого можно менять или удалять, индекс от него не зависит.
+//
+// Раскладки:
+//   Eytzinger   — дерево поиска в порядке обхода в ширину (как двоичная куча): потомки узла k —
+//                 2k и 2k + 1. Массив из n + 1 ключей. Спуск без ветвлений: номер следующего узла
+//                 вычисляется из результата сравнения, а потомки на kPrefetchLevels уровней ниже
+//                 лежат в одной строке кэша и запрашиваются заранее
+//   VanEmdeBoas — раскладка ван Эмде Боаса (кэш-независимая): дерево высоты h режется пополам
+//                 по высоте, верхнее поддерево и затем все нижние по порядку раскладываются так же.
+//                 Любое поддерево высоты 2^i занимает непрерывный кусок, и спуск читает O(log_B n)
+//                 блоков при любом размере блока B — строки кэша, страницы, TLB. Место узла на пути
+//                 считается по таблицам глубин (Brodal, Fagerberg, Jacob). Дерево дополняется до
+//                 полного копиями наибольшего ключа, поэтому массив — от n до 2n ключей
+// Eytzinger обычно быстрее, пока индекс помещается в память без подкачки, и занимает ровно n + 1 ключ;
+// VanEmdeBoas не зависит от размеров кэшей и страниц.
+// Ключ копируется побайтно (trivially copyable): иначе массив снова держал бы указатели
+
+enum class FrozenLayout { Eytzinger, VanEmdeBoas };
+
+// Число младших единичных битов x
+inline int trailingOnes(uint64_t x) {
+    x = ~x;
+#if defined(__GNUC__) || defined(__clang__)
+    return x != 0 ? __builtin_ctzll(x) : 64;
+#elif defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    return _BitScanForward64(&index, x) ? static_cast<int>(index) : 64;
+#else
+    int count = 0;
+    for (; count < 64 && (x & 1) == 0; x >>= 1)
+        ++count;
+    return count;
+#endif
+}
+
+template <typename Key, typename Compare = std::less<Key>>
+class FrozenIndex {
+    static_assert(std::is_trivially_copyable<Key>::value,
+                  "Замороженный индекс хранит ключи плоским массивом: ключ должен копироваться побайтно");
+
+public:
+    using key_type = Key;
+    using key_compare = Compare;
+
+    explicit FrozenIndex(FrozenLayout layout = FrozenLayout::Eytzinger, const Compare& comp = Compare())
+        : data(nullptr), count(0), slots(0), height(0), layout_(layout), comp(comp) {}
+    // Индекс из ключей [first, last), отсортированных по возрастанию без повторов
+    template <typename RandomIt>
+    FrozenIndex(RandomIt first, RandomIt last, FrozenLayout layout, const Compare& comp = Compare())
+        : FrozenIndex(layout, comp) {
+        count = static_cast<size_t>(std::distance(first, last));
+        if (count == 0)
+            return;
+        while (height < kMaxHeight && (size_t(1) << height) - 1 < count)
+            ++height;
+        slots = layout == FrozenLayout::Eytzinger ? count + 1 : (size_t(1) << height) - 1;
+        data.reset(static_cast<Key*>(::operator new(slots * sizeof(Key), std::align_val_t(kCacheLine))));
+        if (layout == FrozenLayout::Eytzinger) {
+            new (data.get()) Key(first[0]);  // Ячейка 0 не используется: корень — 1
+            RandomIt next = first;
+            fillEytzinger(1, next);
+        }
+        else {
+            size_t slot = 0;
+            fillVanEmdeBoas(1, height, slot, first);
+            splitLevels(1, height);
+        }
+    }
+    FrozenIndex(FrozenIndex&& other) noexcept : FrozenIndex(other.layout_, other.comp) { *this = std::move(other); }
+    // Перенесенный индекс остается пустым
+    FrozenIndex& operator=(FrozenIndex&& other) noexcept {
+        data = std::move(other.data);
+        count = std::exchange(other.count, 0);
+        slots = std::exchange(other.slots, 0);
+        height = std::exchange(other.height, 0);
+        layout_ = other.layout_;
+        comp = other.comp;
+        levels = other.levels;
+        return *this;
+    }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    FrozenLayout layout() const { return layout_; }
+    // Байт под ключи, вместе с неиспользуемой ячейкой Eytzinger и дополнением VanEmdeBoas
+    size_t memoryBytes() const { return slots * sizeof(Key); }
+
+    // Наименьший ключ, не меньший key, или nullptr
+    template <typename K>
+    const Key* lowerBound(const K& key) const {
+        if (count == 0)
+            return nullptr;
+        return layout_ == FrozenLayout::Eytzinger ? lowerBoundEytzinger(key) : lowerBoundVanEmdeBoas(key);
+    }
+    // Ключ, равный key, или nullptr
+    template <typename K>
+    const Key* search(const K& key) const {
+        const Key* found = lowerBound(key);
+        return found != nullptr && !comp(key, *found) ? found : nullptr;
+    }
+    template <typename K>
+    bool contains(const K& key) const {
+        return search(key) != nullptr;
+    }
+
+private:
+    // Высоты больше не бывает: 2^63 ключей не поместится в память
+    static constexpr int kMaxHeight = 63;
+
+    // Сколько уровней вперед запрашивать: потомки узла k через L уровней — 2^L ключей подряд с номера k·2^L,
+    // и при выровненном массиве они занимают одну строку кэша
+    static constexpr int prefetchLevels() {
+        int levels = 0;
+        while (levels < 8 && (sizeof(Key) << (levels + 1)) <= kCacheLine)
+            ++levels;
+        return levels;
+    }
+    static constexpr int kPrefetchLevels = prefetchLevels();
+
+    struct Release {
+        void operator()(Key* p) const { ::operator delete(p, std::align_val_t(kCacheLine)); }
+    };
+    using Storage = std::unique_ptr<Key, Release>;
+    // Строка таблицы VanEmdeBoas для глубины d (корень — 1): узел этой глубины — корень нижнего
+    // поддерева при одном из разрезов. anchor — глубина корня верхнего поддерева, над которым он висит,
+    // top — размер этого верхнего поддерева, bottom — размер нижнего
+    struct Level {
+        int anchor = 0;
+        size_t top = 0;
+        size_t bottom = 0;
+    };
+
+    Storage data;    // Ключи в выбранной раскладке, массив выровнен по строке кэша
+    size_t count;    // Число ключей
+    size_t slots;    // Число ячеек массива
+    int height;      // Высота полного дерева, в которое укладываются ключи
+    FrozenLayout layout_;
+    Compare comp;
+    std::array<Level, kMaxHeight + 1> levels;
+
+    // Симметричный обход дерева Eytzinger, ключи берутся по порядку
+    template <typename RandomIt>
+    void fillEytzinger(size_t k, RandomIt& next) {
+        if (k > count)
+            return;
+        fillEytzinger(2 * k, next);
+        new (data.get() + k) Key(*next);
+        ++next;
+        fillEytzinger(2 * k + 1, next);
+    }
+    // Укладка полного поддерева высоты h с корнем номер node (нумерация обхода в ширину, корень — 1).
+    // Ключ узла — по его месту в симметричном порядке; места за последним ключом получают наибольший ключ
+    template <typename RandomIt>
+    void fillVanEmdeBoas(size_t node, int h, size_t& slot, RandomIt first) {
+        if (h == 1) {
+            int depth = 0;
+            while ((node >> depth) > 1)
+                ++depth;
+            size_t rank = ((2 * (node - (size_t(1) << depth)) + 1) << (height - depth - 1)) - 1;
+            new (data.get() + slot++) Key(first[rank < count ? rank : count - 1]);
+            return;
+        }
+        int upper = h / 2;
+        fillVanEmdeBoas(node, upper, slot, first);
+        for (size_t j = 0; j < (size_t(1) << upper); ++j)
+            fillVanEmdeBoas((node << upper) + j, h - upper, slot, first);
+    }
+    // Те же разрезы, что в fillVanEmdeBoas, для поддерева высоты h с корнем на глубине depth
+    void splitLevels(int depth, int h) {
+        if (h == 1)
+            return;
+        int upper = h / 2;
+        int lower = depth + upper;
+        levels[lower].anchor = depth;
+        levels[lower].top = (size_t(1) << upper) - 1;
+        levels[lower].bottom = (size_t(1) << (h - upper)) - 1;
+        splitLevels(depth, upper);
+        splitLevels(lower, h - upper);
+    }
+
+    // Спуск без ветвлений по результату сравнения. После выхода за лист номер k хранит путь: единицы —
+    // повороты направо; сняв их хвост и еще один бит, получаем последний узел, где шли налево, — ответ
+    template <typename K>
+    const Key* lowerBoundEytzinger(const K& key) const {
+        const Key* keys = data.get();
+        size_t k = 1;
+        while (k <= count) {
+            // Адрес может оказаться за концом массива: подсказка по нему ничего не загружает
+            prefetchLine(reinterpret_cast<const void*>(reinterpret_cast<uintptr_t>(keys) +
+                                                       (k << kPrefetchLevels) * sizeof(Key)));
+            k = 2 * k + static_cast<size_t>(comp(keys[k], key));
+        }
+        k >>= trailingOnes(k) + 1;
+        return k != 0 ? keys + k : nullptr;
+    }
+    // Спуск по полному дереву: ровно height шагов, место узла на глубине d считается от места
+    // корня его верхнего поддерева — pos[anchor] + top + (номер нижнего поддерева) * bottom
+    template <typename K>
+    const Key* lowerBoundVanEmdeBoas(const K& key) const {
+        const Key* keys = data.get();
+        size_t pos[kMaxHeight + 1];
+        pos[1] = 0;
+        size_t node = 1;
+        const Key* result = nullptr;
+        for (int depth = 1;; ) {
+            const Key* current = keys + pos[depth];
+            bool less = comp(*current, key);
+            result = less ? result : current;
+            node = 2 * node + static_cast<size_t>(less);
+            if (++depth > height)
+                break;
+            const Level& level = levels[depth];
+            pos[depth] = pos[level.anchor] + level.top + (node & level.top) * level.bottom;
+        }
+        return result;
+    }
+};
+
+// Замороженная копия дерева в раскладке layout
+template <typename Tree>
+auto freeze(const Tree& tree, FrozenLayout layout = FrozenLayout::Eytzinger)
+    -> FrozenIndex<typename Tree::key_type, std::decay_t<decltype(tree.keyComp())>> {
+    std::vector<typename Tree::key_type> keys;
+    for (const auto& value : tree)
+        keys.push_back(Tree::entry_type::key(value));
+    return FrozenIndex<typename Tree::key_type, std::decay_t<decltype(tree.keyComp())>>(
+        keys.begin(), keys.end(), layout, tree.keyComp());
+}
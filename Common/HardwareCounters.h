@@ -0,0 +1,113 @@
+﻿#pragma once
+#include <cstdint>
+#include <ostream>
+
+#if defined(__linux__)
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Аппаратные счетчики процессора для отрезка кода: такты, инструкции, промахи кэша
+// последнего уровня и ошибки предсказания переходов. Нужны, чтобы понять, откуда хвост
+// задержек: из памяти (промахи) или из ветвлений (ошибки предсказания).
+// Есть только в Linux (perf_event_open); считается поток, создавший HardwareCounters.
+// Ядро может запретить счетчики (kernel.perf_event_paranoid, контейнеры, виртуальные машины) —
+// тогда available() == false, а замеры возвращают valid == false
+
+// Показания за один замер
+struct HardwareSample {
+    bool valid = false;
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint64_t cacheMisses = 0;
+    uint64_t branchMisses = 0;
+};
+
+inline void writeJson(std::ostream& out, const HardwareSample& sample) {
+    out << "{\"valid\": " << (sample.valid ? "true" : "false") << ", \"cycles\": " << sample.cycles
+        << ", \"instructions\": " << sample.instructions << ", \"cache_misses\": " << sample.cacheMisses
+        << ", \"branch_misses\": " << sample.branchMisses << "}";
+}
+
+#if defined(__linux__)
+
+class HardwareCounters {
+public:
+    // Счетчики открываются одной группой: ядро включает и выключает их одновременно
+    HardwareCounters() {
+        static const uint64_t kEvents[kCount] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                  PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+        for (int i = 0; i < kCount; ++i) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = kEvents[i];
+            attr.disabled = i == 0 ? 1 : 0;  // Группа стоит, пока ее не включат
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP;
+            fds[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fds[0], 0));
+            if (fds[i] < 0) {
+                close();
+                return;
+            }
+        }
+    }
+    ~HardwareCounters() { close(); }
+    HardwareCounters(const HardwareCounters&) = delete;
+    HardwareCounters& operator=(const HardwareCounters&) = delete;
+
+    bool available() const { return fds[0] >= 0; }
+
+    // Обнуление и запуск
+    void start() {
+        if (!available())
+            return;
+        ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+    // Остановка и показания с момента start()
+    HardwareSample stop() {
+        HardwareSample sample;
+        if (!available())
+            return sample;
+        ioctl(fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        uint64_t values[1 + kCount];  // Число счетчиков, затем значения в порядке открытия
+        if (read(fds[0], values, sizeof(values)) != static_cast<ssize_t>(sizeof(values)) || values[0] != kCount)
+            return sample;
+        sample.valid = true;
+        sample.cycles = values[1];
+        sample.instructions = values[2];
+        sample.cacheMisses = values[3];
+        sample.branchMisses = values[4];
+        return sample;
+    }
+
+private:
+    static constexpr int kCount = 4;
+
+    int fds[kCount] = { -1, -1, -1, -1 };
+
+    void close() {
+        for (int& fd : fds) {
+            if (fd >= 0)
+                ::close(fd);
+            fd = -1;
+        }
+    }
+};
+
+#else
+
+class HardwareCounters {
+public:
+    bool available() const { return false; }
+    void start() {}
+    HardwareSample stop() { return HardwareSample(); }
+};
+
+#endif
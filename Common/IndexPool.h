@@ -0,0 +1,132 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Компактное хранение узлов двоичных деревьев: узлы лежат подряд в одном векторе
+// и ссылаются друг на друга 32-битными номерами вместо 8-байтовых указателей.
+// Старший бит ссылки свободен под однобитный признак узла (цвет, перевес), так что
+// узел с ключом int и двумя ссылками занимает 12 байт.
+
+// Ссылка на узел пула: 31 бит номера и бит признака
+class PackedLink {
+public:
+    static constexpr uint32_t kFlag = 0x80000000u;
+    static constexpr uint32_t kMaxIndex = kFlag - 1;
+
+    PackedLink() : word(0) {}
+
+    uint32_t index() const { return word & kMaxIndex; }
+    bool flag() const { return (word & kFlag) != 0; }
+    // Номер меняется, признак остается
+    void setIndex(uint32_t index) { word = (word & kFlag) | index; }
+    void setFlag(bool flag) { word = flag ? word | kFlag : word & kMaxIndex; }
+
+private:
+    uint32_t word;
+};
+
+// Пул узлов в одном непрерывном векторе. Номер 0 — пустая ссылка: под ним лежит узел-заглушка,
+// который никогда не меняется (поэтому, например, «цвет» пустого потомка читается без проверок).
+// Номера удаленных узлов переиспользуются. При росте вектор переносит узлы: ссылки Node&
+// живут только до следующего create, номера верны всегда. Узлу нужен конструктор по умолчанию
+template <typename Node>
+class IndexPool {
+public:
+    using Index = uint32_t;
+    static constexpr Index kNull = 0;
+
+    IndexPool() : nodes(1) {}
+
+    Node& operator[](Index index) { return nodes[index]; }
+    const Node& operator[](Index index) const { return nodes[index]; }
+
+    // Память под count узлов сразу: при построении из отсортированного вектор не растет удвоениями
+    void reserve(size_t count) { nodes.reserve(count + 1); }
+    // Байт, занятых пулом (включая запас вектора)
+    size_t memoryUsage() const { return nodes.capacity() * sizeof(Node) + freed.capacity() * sizeof(Index); }
+
+    template <typename... Args>
+    Index create(Args&&... args) {
+        if (!freed.empty()) {
+            Index index = freed.back();
+            nodes[index] = Node(std::forward<Args>(args)...);
+            freed.pop_back();
+            return index;
+        }
+        if (nodes.size() > PackedLink::kMaxIndex)
+            throw std::length_error("IndexPool: не больше 2^31 - 1 узлов");
+        nodes.emplace_back(std::forward<Args>(args)...);
+        return static_cast<Index>(nodes.size() - 1);
+    }
+    void destroy(Index index) {
+        nodes[index] = Node();  // Ключ с динамической памятью (строка) отдает ее сразу
+        freed.push_back(index);
+    }
+    // Освобождение всей памяти разом
+    void release() {
+        std::vector<Node>(1).swap(nodes);
+        std::vector<Index>().swap(freed);
+    }
+
+private:
+    std::vector<Node> nodes;
+    std::vector<Index> freed;  // Номера удаленных узлов
+};
+
+// Поворот поддерева node в сторону dir (0 — влево, 1 — вправо): вверх поднимается потомок
+// с другой стороны. Признаки ссылок остаются при своих узлах. Возвращает новый корень поддерева
+template <typename Node>
+uint32_t rotateIndex(IndexPool<Node>& pool, uint32_t node, int dir) {
+    uint32_t up = pool[node].child[1 - dir].index();
+    pool[node].child[1 - dir].setIndex(pool[up].child[dir].index());
+    pool[up].child[dir].setIndex(node);
+    return up;
+}
+
+// Итератор симметричного обхода дерева из пула. Ссылок на родителя нет, путь от корня хранится
+// в массиве на MaxHeight уровней — это предел высоты сбалансированного дерева
+template <typename Node, int MaxHeight>
+class IndexTreeIterator {
+public:
+    using Index = uint32_t;
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = typename std::remove_const<decltype(Node::key)>::type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const value_type*;
+    using reference = const value_type&;
+
+    IndexTreeIterator() : pool(nullptr), depth(0) {}
+    IndexTreeIterator(const IndexPool<Node>* pool, Index root) : pool(pool), depth(0) { pushLeft(root); }
+
+    reference operator*() const { return (*pool)[path[depth - 1]].key; }
+    pointer operator->() const { return &(*pool)[path[depth - 1]].key; }
+    IndexTreeIterator& operator++() {
+        Index node = path[--depth];
+        pushLeft((*pool)[node].child[1].index());
+        return *this;
+    }
+    IndexTreeIterator operator++(int) {
+        IndexTreeIterator copy = *this;
+        ++*this;
+        return copy;
+    }
+    bool operator==(const IndexTreeIterator& other) const {
+        return depth == 0 ? other.depth == 0 : other.depth != 0 && path[depth - 1] == other.path[other.depth - 1];
+    }
+    bool operator!=(const IndexTreeIterator& other) const { return !(*this == other); }
+
+private:
+    const IndexPool<Node>* pool;
+    Index path[MaxHeight];  // Узлы, ключи которых еще не выданы; текущий — последний
+    int depth;
+
+    void pushLeft(Index node) {
+        for (; node != IndexPool<Node>::kNull; node = (*pool)[node].child[0].index())
+            path[depth++] = node;
+    }
+};
@@ -0,0 +1,263 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// Политики выделения памяти под узлы деревьев.
+// Дерево владеет экземпляром политики и создает/удаляет узлы только через него:
+//   create<Node>(args...) — выделить память и сконструировать узел
+//   destroy(node)         — разрушить узел и вернуть память (если политика это умеет)
+//   release()             — освободить разом всю память политики
+//   adopt(other)          — забрать всю память другого экземпляра той же политики: узлы,
+//                           созданные через other, дальше разрушаются через этот экземпляр
+// kBulkRelease == true означает, что release() освобождает все узлы за O(числа страниц),
+// и деревьям с тривиально разрушаемыми узлами не нужно обходить их по одному.
+// kSharedHeap == true означает, что узлы берутся из общей кучи и экземпляру не принадлежат:
+// дерево может отдать часть узлов другому дереву как есть (split), не забирая памяти целиком.
+
+// Обычное выделение через std::allocator: по одному вызову на каждый узел.
+// Используется для сравнения с остальными политиками.
+class StdNodeAllocator {
+public:
+    static constexpr bool kBulkRelease = false;
+    static constexpr bool kSharedHeap = true;
+
+    template <typename Node, typename... Args>
+    Node* create(Args&&... args) {
+        std::allocator<Node> alloc;
+        Node* node = std::allocator_traits<std::allocator<Node>>::allocate(alloc, 1);
+        try {
+            std::allocator_traits<std::allocator<Node>>::construct(alloc, node, std::forward<Args>(args)...);
+        }
+        catch (...) {
+            std::allocator_traits<std::allocator<Node>>::deallocate(alloc, node, 1);
+            throw;
+        }
+        return node;
+    }
+
+    template <typename Node>
+    void destroy(Node* node) {
+        std::allocator<Node> alloc;
+        std::allocator_traits<std::allocator<Node>>::destroy(alloc, node);
+        std::allocator_traits<std::allocator<Node>>::deallocate(alloc, node, 1);
+    }
+
+    void release() {}
+
+    // Узлы выделены в общей куче, забирать нечего
+    void adopt(StdNodeAllocator&) {}
+};
+
+// Общая часть арены и слаба: крупные блоки памяти, выровненные по строке кэша
+class ChunkList {
+public:
+    static constexpr size_t kAlignment = 64;
+
+    ChunkList() = default;
+    ChunkList(const ChunkList&) = delete;
+    ChunkList& operator=(const ChunkList&) = delete;
+    ~ChunkList() { release(); }
+
+    char* allocate(size_t bytes) {
+        chunks.reserve(chunks.size() + 1);  // Чтобы push_back ниже не бросил исключение
+        char* chunk = static_cast<char*>(::operator new(bytes, std::align_val_t(kAlignment)));
+        chunks.push_back(chunk);
+        return chunk;
+    }
+
+    void release() {
+        for (char* chunk : chunks)
+            ::operator delete(chunk, std::align_val_t(kAlignment));
+        chunks.clear();
+    }
+
+    // Перенос блоков другого списка в этот
+    void adopt(ChunkList& other) {
+        chunks.insert(chunks.end(), other.chunks.begin(), other.chunks.end());
+        other.chunks.clear();
+    }
+
+    size_t count() const { return chunks.size(); }
+
+private:
+    std::vector<char*> chunks;
+};
+
+// Арена: узлы нарезаются подряд из больших блоков (bump pointer).
+// destroy() только вызывает деструктор — память отдельных узлов не переиспользуется,
+// вся арена освобождается целиком в release().
+class ArenaNodeAllocator {
+public:
+    static constexpr bool kBulkRelease = true;
+    static constexpr bool kSharedHeap = false;
+    static constexpr size_t kChunkBytes = 256 * 1024;
+
+    ArenaNodeAllocator() : cursor(nullptr), end(nullptr) {}
+
+    template <typename Node, typename... Args>
+    Node* create(Args&&... args) {
+        void* memory = allocate(sizeof(Node), alignof(Node));
+        return new (memory) Node(std::forward<Args>(args)...);
+    }
+
+    template <typename Node>
+    void destroy(Node* node) {
+        node->~Node();
+    }
+
+    void release() {
+        chunks.release();
+        cursor = end = nullptr;
+    }
+
+    // Остаток текущего блока other пропадает до общего release()
+    void adopt(ArenaNodeAllocator& other) {
+        chunks.adopt(other.chunks);
+        other.cursor = other.end = nullptr;
+    }
+
+private:
+    ChunkList chunks;
+    char* cursor;
+    char* end;
+
+    void* allocate(size_t size, size_t align) {
+        if (align > ChunkList::kAlignment)
+            throw std::invalid_argument("ArenaNodeAllocator: слишком строгое выравнивание");
+        size_t padding = (align - reinterpret_cast<uintptr_t>(cursor) % align) % align;
+        if (cursor == nullptr || static_cast<size_t>(end - cursor) < padding + size) {
+            size_t bytes = size > kChunkBytes ? size : kChunkBytes;
+            cursor = chunks.allocate(bytes);
+            end = cursor + bytes;
+            padding = 0;
+        }
+        void* result = cursor + padding;
+        cursor += padding + size;
+        return result;
+    }
+};
+
+// Слаб с классами размеров: для каждого размера (с шагом 16 байт) свой список свободных
+// ячеек и свой блок, из которого нарезаются новые. Освобожденные узлы сразу идут
+// в повторное использование, поэтому при постоянной вставке/удалении память не растет.
+// Это политика по умолчанию, и маленькие деревья не должны стоить дорого: таблица классов
+// растет только до самого крупного встреченного размера, а блоки класса — вдвое от 1 КБ до 64 КБ.
+class SlabNodeAllocator {
+public:
+    static constexpr bool kBulkRelease = true;
+    static constexpr bool kSharedHeap = false;
+    static constexpr size_t kGranularity = 16;
+    static constexpr size_t kMaxSlot = 4096;
+    static constexpr size_t kFirstSlabBytes = 1024;
+    static constexpr size_t kSlabBytes = 64 * 1024;
+
+    SlabNodeAllocator() = default;
+
+    template <typename Node, typename... Args>
+    Node* create(Args&&... args) {
+        void* memory = allocate(slotSize(sizeof(Node), alignof(Node)));
+        try {
+            return new (memory) Node(std::forward<Args>(args)...);
+        }
+        catch (...) {
+            deallocate(memory, slotSize(sizeof(Node), alignof(Node)));
+            throw;
+        }
+    }
+
+    template <typename Node>
+    void destroy(Node* node) {
+        node->~Node();
+        deallocate(node, slotSize(sizeof(Node), alignof(Node)));
+    }
+
+    void release() {
+        chunks.release();
+        classes.clear();
+    }
+
+    // Свободные ячейки other добавляются к своим; из недорезанных блоков
+    // в каждом классе остается больший
+    void adopt(SlabNodeAllocator& other) {
+        if (classes.size() < other.classes.size())
+            classes.resize(other.classes.size());
+        chunks.adopt(other.chunks);
+        for (size_t i = 0; i < other.classes.size(); ++i) {
+            SizeClass& mine = classes[i];
+            SizeClass& theirs = other.classes[i];
+            if (theirs.freeList != nullptr) {
+                FreeSlot* last = theirs.freeList;
+                while (last->next != nullptr)
+                    last = last->next;
+                last->next = mine.freeList;
+                mine.freeList = theirs.freeList;
+            }
+            if (theirs.end - theirs.cursor > mine.end - mine.cursor) {
+                mine.cursor = theirs.cursor;
+                mine.end = theirs.end;
+            }
+            if (theirs.slabBytes > mine.slabBytes)
+                mine.slabBytes = theirs.slabBytes;
+        }
+        other.classes.clear();
+    }
+
+private:
+    struct FreeSlot {
+        FreeSlot* next;
+    };
+    struct SizeClass {
+        FreeSlot* freeList = nullptr;
+        char* cursor = nullptr;
+        char* end = nullptr;
+        size_t slabBytes = kFirstSlabBytes;  // Размер следующего блока
+    };
+
+    ChunkList chunks;
+    std::vector<SizeClass> classes;  // Классы до самого крупного из встреченных
+
+    // Размер ячейки: кратен шагу и выравниванию узла. Блоки выровнены по 64 байтам,
+    // а ячейки одного класса идут подряд, поэтому выравнивание узла сохраняется
+    static constexpr size_t slotSize(size_t size, size_t align) {
+        size_t step = align > kGranularity ? align : kGranularity;
+        return (size + step - 1) / step * step;
+    }
+
+    void* allocate(size_t slot) {
+        if (slot > kMaxSlot)
+            throw std::invalid_argument("SlabNodeAllocator: узел больше максимальной ячейки");
+        if (classes.size() < slot / kGranularity)
+            classes.resize(slot / kGranularity);
+        SizeClass& c = classes[slot / kGranularity - 1];
+        if (c.freeList != nullptr) {
+            FreeSlot* result = c.freeList;
+            c.freeList = result->next;
+            return result;
+        }
+        if (static_cast<size_t>(c.end - c.cursor) < slot) {
+            size_t bytes = c.slabBytes > slot ? c.slabBytes / slot * slot : slot;
+            c.cursor = chunks.allocate(bytes);
+            c.end = c.cursor + bytes;
+            if (c.slabBytes < kSlabBytes)
+                c.slabBytes *= 2;
+        }
+        void* result = c.cursor;
+        c.cursor += slot;
+        return result;
+    }
+
+    void deallocate(void* memory, size_t slot) {
+        SizeClass& c = classes[slot / kGranularity - 1];
+        FreeSlot* freed = static_cast<FreeSlot*>(memory);
+        freed->next = c.freeList;
+        c.freeList = freed;
+    }
+};
+
+// Политика по умолчанию для всех деревьев
+using DefaultNodeAllocator = SlabNodeAllocator;
@@ -0,0 +1,498 @@
+﻿#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "Snapshot.h"
+
+// Упорядоченные контейнеры с интерфейсом std::set / std::map поверх деревьев проекта.
+// Дерево параметризуется ключом, компаратором, политикой памяти и видом элемента (Entry):
+//   SetEntry<Key>         — дерево хранит сами ключи
+//   MapEntry<Key, T>      — дерево хранит пары ключ-значение
+//   CountedEntry<Key>     — мультимножество: ключ и число его вхождений
+//   MultiMapEntry<Key, T> — мультисловарь: ключ и список значений
+// В дереве не больше одного элемента на ключ. Что делает insert с ключом, который уже есть,
+// решает Entry::merge: у множества и словаря — ничего (как std::set::insert), у мультимножества
+// счетчик растет, у мультисловаря значения дописываются в список. Так поток событий с частыми
+// повторами занимает по узлу на различный ключ, а не на каждое событие.
+// От дерева контейнеру нужны:
+//   begin/end, size, clear, keyComp    — двунаправленный итератор Iterator по хранимым значениям
+//   search(key)                        — узел с ключом или nullptr
+//   find/lowerBound/upperBound(key)    — итераторы; key может быть любого типа, сравнимого компаратором
+//   emplaceUnique(args...)             — вставка, если такого ключа еще нет
+//   tryEmplace(key, args...)           — то же, но значение конструируется только при отсутствии ключа
+//   erase(iterator), erase(key)        — удаление одного элемента
+//   count(key)                         — число вхождений ключа (Entry::count его элемента или 0)
+//   buildFromSorted(first, last)       — замена содержимого отсортированной последовательностью за O(n)
+//   rank(key), countRange(lo, hi)      — порядковые статистики за O(log n): сколько элементов меньше key
+//   select(k)                            и в отрезке [lo, hi]; итератор на k-й по порядку элемент (с нуля)
+//   save(out, encoding), load(in)      — снимок в двоичный поток и восстановление из него (Snapshot.h)
+
+// Кроме key и view, Entry задает работу с повторами ключа:
+//   merge(into, from) — вставка from, ключ которого уже есть в элементе into
+//   count(value)      — сколько вхождений ключа представляет элемент
+//   release(value)    — убрать одно вхождение (eraseOne дерева); true — элемент опустел и удаляется
+
+// Множество: хранимое значение и есть ключ; снаружи оно доступно только для чтения
+template <typename Key>
+struct SetEntry {
+    using value_type = Key;       // Что хранится в дереве
+    using view_type = const Key;  // Что видит пользователь контейнера
+
+    static const Key& key(const value_type& value) { return value; }
+    static view_type& view(value_type& value) { return value; }
+    static void merge(value_type&, const value_type&) {}
+    static std::size_t count(const value_type&) { return 1; }
+    static bool release(value_type&) { return true; }
+};
+
+// Словарь: дерево хранит std::pair<Key, T>, а наружу отдает std::pair<const Key, T>.
+// Представление у этих пар одинаковое (так же устроены реализации стандартной библиотеки);
+// ключ в хранилище неконстантный, чтобы B-дерево могло перемещать элементы внутри узлов
+template <typename Key, typename T>
+struct MapEntry {
+    using value_type = std::pair<Key, T>;
+    using view_type = std::pair<const Key, T>;
+    using mapped_type = T;
+
+    static const Key& key(const value_type& value) { return value.first; }
+    static view_type& view(value_type& value) { return reinterpret_cast<view_type&>(value); }
+    // Повторная вставка не меняет значение, как std::map::insert
+    static void merge(value_type&, const value_type&) {}
+    static std::size_t count(const value_type&) { return 1; }
+    static bool release(value_type&) { return true; }
+};
+
+// Элемент мультимножества: ключ и число его вхождений. Из ключа строится неявно,
+// поэтому insert(key) дерева добавляет одно вхождение
+template <typename Key>
+struct CountedKey {
+    Key key;
+    std::size_t count;
+
+    CountedKey() : key(), count(0) {}
+    CountedKey(const Key& key, std::size_t count = 1) : key(key), count(count) {}
+
+    friend bool operator==(const CountedKey& a, const CountedKey& b) { return a.key == b.key && a.count == b.count; }
+    friend bool operator!=(const CountedKey& a, const CountedKey& b) { return !(a == b); }
+};
+
+// Мультимножество: повторы ключа не создают узлов, а увеличивают счетчик элемента.
+// Размер дерева, ранги и select считают различные ключи
+template <typename Key>
+struct CountedEntry {
+    using value_type = CountedKey<Key>;
+    using view_type = const CountedKey<Key>;
+
+    static const Key& key(const value_type& value) { return value.key; }
+    static view_type& view(value_type& value) { return value; }
+    static void merge(value_type& into, const value_type& from) { into.count += from.count; }
+    static std::size_t count(const value_type& value) { return value.count; }
+    static bool release(value_type& value) { return --value.count == 0; }
+};
+
+// Мультисловарь: дерево хранит std::pair<Key, std::vector<T>>, значения одного ключа — в порядке вставки.
+// insert({key, {value}}) дописывает значение к списку ключа; без лишнего вектора на каждую вставку
+// то же делает tryEmplace(key).first->second.push_back(value)
+template <typename Key, typename T>
+struct MultiMapEntry {
+    using value_type = std::pair<Key, std::vector<T>>;
+    using view_type = std::pair<const Key, std::vector<T>>;
+    using mapped_type = std::vector<T>;
+
+    static const Key& key(const value_type& value) { return value.first; }
+    static view_type& view(value_type& value) { return reinterpret_cast<view_type&>(value); }
+    static void merge(value_type& into, const value_type& from) {
+        into.second.insert(into.second.end(), from.second.begin(), from.second.end());
+    }
+    static void merge(value_type& into, value_type&& from) {
+        into.second.insert(into.second.end(), std::make_move_iterator(from.second.begin()),
+                           std::make_move_iterator(from.second.end()));
+    }
+    static std::size_t count(const value_type& value) { return value.second.size(); }
+    // Убирается последнее добавленное значение
+    static bool release(value_type& value) {
+        if (!value.second.empty())
+            value.second.pop_back();
+        return value.second.empty();
+    }
+};
+
+// Номер элемента, на который приходится квантиль q из [0, 1] среди count элементов (count > 0):
+// ближайший ранг, ceil(q * count) - 1. Медиана четного числа элементов — нижняя из двух средних,
+// 99-й перцентиль ста элементов — 99-й по возрастанию. q вне [0, 1] (и NaN) прижимается к краю
+inline std::size_t quantileIndex(double q, std::size_t count) {
+    if (!(q > 0.0))
+        return 0;
+    double position = std::ceil(q * static_cast<double>(count));
+    if (position >= static_cast<double>(count))
+        return count - 1;
+    return static_cast<std::size_t>(position) - 1;
+}
+
+// Разнородный поиск доступен, если компаратор объявляет is_transparent (как std::less<>).
+// Тип ключа K участвует в шаблоне, чтобы отсутствие is_transparent только убирало перегрузку
+template <typename Compare, typename K, typename = void>
+struct TransparentLookup {};
+
+template <typename Compare, typename K>
+struct TransparentLookup<Compare, K, std::void_t<typename Compare::is_transparent>> {
+    using type = void;
+};
+
+// Двунаправленный итератор контейнера поверх итератора дерева
+template <typename Tree, bool Const>
+class OrderedIterator {
+    using Entry = typename Tree::entry_type;
+    using View = typename Entry::view_type;
+
+public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = typename std::remove_const<View>::type;
+    using difference_type = std::ptrdiff_t;
+    using reference = typename std::conditional<Const, const View&, View&>::type;
+    using pointer = typename std::remove_reference<reference>::type*;
+
+    OrderedIterator() = default;
+    explicit OrderedIterator(const typename Tree::Iterator& it) : it(it) {}
+    // Неконстантный итератор приводится к константному
+    template <bool OtherConst, typename = typename std::enable_if<Const && !OtherConst>::type>
+    OrderedIterator(const OrderedIterator<Tree, OtherConst>& other) : it(other.base()) {}
+
+    reference operator*() const { return Entry::view(*it); }
+    pointer operator->() const { return &Entry::view(*it); }
+    OrderedIterator& operator++() {
+        ++it;
+        return *this;
+    }
+    OrderedIterator operator++(int) {
+        OrderedIterator copy = *this;
+        ++it;
+        return copy;
+    }
+    OrderedIterator& operator--() {
+        --it;
+        return *this;
+    }
+    OrderedIterator operator--(int) {
+        OrderedIterator copy = *this;
+        --it;
+        return copy;
+    }
+    friend bool operator==(const OrderedIterator& a, const OrderedIterator& b) { return a.it == b.it; }
+    friend bool operator!=(const OrderedIterator& a, const OrderedIterator& b) { return !(a.it == b.it); }
+
+    const typename Tree::Iterator& base() const { return it; }
+
+private:
+    typename Tree::Iterator it;
+};
+
+// Общая часть множества и словаря.
+// Дерево хранится по указателю, поэтому перемещение контейнера не копирует узлы.
+// Исходный контейнер после перемещения, как у std::map, пуст и пригоден для любых операций:
+// конструктор перемещения отдает ему новое пустое дерево с тем же компаратором.
+// Итераторы контейнеров на AVL и красно-черном деревьях переживают вставки и удаление
+// других элементов, как у std::map; у B-дерева элементы переезжают между узлами,
+// поэтому любая вставка или удаление делает итераторы недействительными.
+template <typename Tree>
+class OrderedContainer {
+protected:
+    using Entry = typename Tree::entry_type;
+    using TreeIterator = typename Tree::Iterator;
+
+    // Разнородный поиск (find("abc") у множества строк) разрешен только прозрачным компараторам
+    template <typename K>
+    using Transparent = typename TransparentLookup<typename Tree::key_compare, K>::type;
+
+public:
+    using key_type = typename Tree::key_type;
+    using value_type = typename std::remove_const<typename Entry::view_type>::type;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using key_compare = typename Tree::key_compare;
+    using reference = value_type&;
+    using const_reference = const value_type&;
+    using pointer = value_type*;
+    using const_pointer = const value_type*;
+    using iterator = OrderedIterator<Tree, std::is_const<typename Entry::view_type>::value>;
+    using const_iterator = OrderedIterator<Tree, true>;
+    using reverse_iterator = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    OrderedContainer() : tree(new Tree()) {}
+    explicit OrderedContainer(const key_compare& comp) : tree(new Tree(comp)) {}
+    template <typename InputIt>
+    OrderedContainer(InputIt first, InputIt last, const key_compare& comp = key_compare()) : OrderedContainer(comp) {
+        insert(first, last);
+    }
+    OrderedContainer(std::initializer_list<value_type> init, const key_compare& comp = key_compare()) : OrderedContainer(comp) {
+        insert(init);
+    }
+    // Элементы другого контейнера уже упорядочены, поэтому копия строится за O(n)
+    OrderedContainer(const OrderedContainer& other) : OrderedContainer(other.key_comp()) {
+        tree->buildFromSorted(other.begin(), other.end());
+    }
+    OrderedContainer(OrderedContainer&& other) : tree(new Tree(other.key_comp())) { tree.swap(other.tree); }
+
+    OrderedContainer& operator=(const OrderedContainer& other) {
+        if (this != &other) {
+            OrderedContainer copy(other);
+            swap(copy);
+        }
+        return *this;
+    }
+    OrderedContainer& operator=(OrderedContainer&& other) noexcept {
+        tree.swap(other.tree);
+        return *this;
+    }
+    OrderedContainer& operator=(std::initializer_list<value_type> init) {
+        clear();
+        insert(init);
+        return *this;
+    }
+
+    // Итераторы
+    iterator begin() { return iterator(tree->begin()); }
+    const_iterator begin() const { return const_iterator(tree->begin()); }
+    const_iterator cbegin() const { return begin(); }
+    iterator end() { return iterator(tree->end()); }
+    const_iterator end() const { return const_iterator(tree->end()); }
+    const_iterator cend() const { return end(); }
+    reverse_iterator rbegin() { return reverse_iterator(end()); }
+    const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+    const_reverse_iterator crbegin() const { return rbegin(); }
+    reverse_iterator rend() { return reverse_iterator(begin()); }
+    const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+    const_reverse_iterator crend() const { return rend(); }
+
+    // Размер
+    bool empty() const { return size() == 0; }
+    size_type size() const { return tree->size(); }
+    size_type max_size() const { return static_cast<size_type>(std::numeric_limits<difference_type>::max()); }
+
+    // Изменение
+    void clear() { tree->clear(); }
+    std::pair<iterator, bool> insert(const value_type& value) { return wrap(tree->emplaceUnique(value)); }
+    std::pair<iterator, bool> insert(value_type&& value) { return wrap(tree->emplaceUnique(std::move(value))); }
+    // Подсказка позиции не используется: дерево все равно спускается от корня
+    iterator insert(const_iterator, const value_type& value) { return insert(value).first; }
+    iterator insert(const_iterator, value_type&& value) { return insert(std::move(value)).first; }
+    template <typename InputIt>
+    void insert(InputIt first, InputIt last) {
+        for (; first != last; ++first)
+            tree->emplaceUnique(*first);
+    }
+    void insert(std::initializer_list<value_type> init) { insert(init.begin(), init.end()); }
+    // Замена содержимого элементами [first, last), упорядоченными компаратором и без повторов ключей,
+    // за O(n) вместо O(n log n) при вставке по одному
+    template <typename ForwardIt>
+    void build_from_sorted(ForwardIt first, ForwardIt last) { tree->buildFromSorted(first, last); }
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args) { return wrap(tree->emplaceUnique(std::forward<Args>(args)...)); }
+    template <typename... Args>
+    iterator emplace_hint(const_iterator, Args&&... args) { return emplace(std::forward<Args>(args)...).first; }
+
+    iterator erase(const_iterator pos) { return iterator(tree->erase(pos.base())); }
+    // Удаление по одному элементу: erase(iterator) возвращает действительный итератор и для B-дерева
+    iterator erase(const_iterator first, const_iterator last) {
+        difference_type count = std::distance(first, last);
+        iterator it(first.base());
+        while (count-- > 0)
+            it = erase(it);
+        return it;
+    }
+    size_type erase(const key_type& key) { return tree->erase(key) ? 1 : 0; }
+    void swap(OrderedContainer& other) noexcept { tree.swap(other.tree); }
+
+    // Поиск
+    size_type count(const key_type& key) const { return tree->count(key); }
+    template <typename K, typename = Transparent<K>>
+    size_type count(const K& key) const { return tree->count(key); }
+    bool contains(const key_type& key) const { return tree->search(key) != nullptr; }
+    template <typename K, typename = Transparent<K>>
+    bool contains(const K& key) const { return tree->search(key) != nullptr; }
+
+    iterator find(const key_type& key) { return iterator(tree->find(key)); }
+    const_iterator find(const key_type& key) const { return const_iterator(tree->find(key)); }
+    template <typename K, typename = Transparent<K>>
+    iterator find(const K& key) { return iterator(tree->find(key)); }
+    template <typename K, typename = Transparent<K>>
+    const_iterator find(const K& key) const { return const_iterator(tree->find(key)); }
+
+    iterator lower_bound(const key_type& key) { return iterator(tree->lowerBound(key)); }
+    const_iterator lower_bound(const key_type& key) const { return const_iterator(tree->lowerBound(key)); }
+    template <typename K, typename = Transparent<K>>
+    iterator lower_bound(const K& key) { return iterator(tree->lowerBound(key)); }
+    template <typename K, typename = Transparent<K>>
+    const_iterator lower_bound(const K& key) const { return const_iterator(tree->lowerBound(key)); }
+
+    iterator upper_bound(const key_type& key) { return iterator(tree->upperBound(key)); }
+    const_iterator upper_bound(const key_type& key) const { return const_iterator(tree->upperBound(key)); }
+    template <typename K, typename = Transparent<K>>
+    iterator upper_bound(const K& key) { return iterator(tree->upperBound(key)); }
+    template <typename K, typename = Transparent<K>>
+    const_iterator upper_bound(const K& key) const { return const_iterator(tree->upperBound(key)); }
+
+    std::pair<iterator, iterator> equal_range(const key_type& key) { return { lower_bound(key), upper_bound(key) }; }
+    std::pair<const_iterator, const_iterator> equal_range(const key_type& key) const { return { lower_bound(key), upper_bound(key) }; }
+    template <typename K, typename = Transparent<K>>
+    std::pair<iterator, iterator> equal_range(const K& key) { return { lower_bound(key), upper_bound(key) }; }
+    template <typename K, typename = Transparent<K>>
+    std::pair<const_iterator, const_iterator> equal_range(const K& key) const { return { lower_bound(key), upper_bound(key) }; }
+
+    // Порядковые статистики за O(log n): деревья хранят в узлах размеры поддеревьев
+    // Сколько элементов меньше key (позиция lower_bound(key) от начала)
+    size_type rank(const key_type& key) const { return tree->rank(key); }
+    template <typename K, typename = Transparent<K>>
+    size_type rank(const K& key) const { return tree->rank(key); }
+    // Сколько элементов с ключами в отрезке [lo, hi]
+    size_type count_range(const key_type& lo, const key_type& hi) const { return tree->countRange(lo, hi); }
+    template <typename K, typename = Transparent<K>>
+    size_type count_range(const K& lo, const K& hi) const { return tree->countRange(lo, hi); }
+    // k-й по порядку элемент (с нуля); end(), если k >= size()
+    iterator select(size_type k) { return iterator(tree->select(k)); }
+    const_iterator select(size_type k) const { return const_iterator(tree->select(k)); }
+    // Элемент квантиля q из [0, 1] (см. quantileIndex); end() у пустого контейнера
+    iterator quantile(double q) { return empty() ? end() : select(quantileIndex(q, size())); }
+    const_iterator quantile(double q) const { return empty() ? end() : select(quantileIndex(q, size())); }
+    iterator median() { return quantile(0.5); }
+    const_iterator median() const { return quantile(0.5); }
+
+    // Снимок в двоичный поток (формат — в Snapshot.h)
+    void save(std::ostream& out, SnapshotEncoding encoding = SnapshotEncoding::Compact) const { tree->save(out, encoding); }
+    // Замена содержимого снимком за O(n), без вставок по одному. Снимок с повторами ключей
+    // отвергает само дерево; при любой ошибке контейнер остается пустым
+    void load(std::istream& in) { tree->load(in); }
+
+    key_compare key_comp() const { return tree->keyComp(); }
+
+    friend bool operator==(const OrderedContainer& a, const OrderedContainer& b) {
+        return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+    }
+    friend bool operator!=(const OrderedContainer& a, const OrderedContainer& b) { return !(a == b); }
+    friend bool operator<(const OrderedContainer& a, const OrderedContainer& b) {
+        return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end());
+    }
+    friend bool operator>(const OrderedContainer& a, const OrderedContainer& b) { return b < a; }
+    friend bool operator<=(const OrderedContainer& a, const OrderedContainer& b) { return !(b < a); }
+    friend bool operator>=(const OrderedContainer& a, const OrderedContainer& b) { return !(a < b); }
+
+protected:
+    std::unique_ptr<Tree> tree;
+
+    static std::pair<iterator, bool> wrap(const std::pair<TreeIterator, bool>& result) {
+        return { iterator(result.first), result.second };
+    }
+};
+
+// Аналог std::set. Tree — дерево с SetEntry (см. псевдонимы AVLSet, RedBlackSet, BTreeSet)
+template <typename Tree>
+class OrderedSet : public OrderedContainer<Tree> {
+    using Base = OrderedContainer<Tree>;
+
+public:
+    using value_compare = typename Base::key_compare;
+
+    using Base::Base;
+    using Base::operator=;
+
+    value_compare value_comp() const { return this->key_comp(); }
+
+    friend void swap(OrderedSet& a, OrderedSet& b) noexcept { a.swap(b); }
+};
+
+// Аналог std::map. Tree — дерево с MapEntry (см. псевдонимы AVLMap, RedBlackMap, BTreeMap)
+template <typename Tree>
+class OrderedMap : public OrderedContainer<Tree> {
+    using Base = OrderedContainer<Tree>;
+    using Base::tree;
+
+public:
+    using typename Base::key_type;
+    using typename Base::value_type;
+    using typename Base::key_compare;
+    using typename Base::iterator;
+    using typename Base::const_iterator;
+    using mapped_type = typename Base::Entry::mapped_type;
+
+    // Сравнение элементов словаря по ключам
+    class value_compare {
+    public:
+        bool operator()(const value_type& a, const value_type& b) const { return comp(a.first, b.first); }
+
+    protected:
+        friend class OrderedMap;
+        explicit value_compare(key_compare comp) : comp(comp) {}
+        key_compare comp;
+    };
+
+    using Base::Base;
+    using Base::operator=;
+
+    value_compare value_comp() const { return value_compare(this->key_comp()); }
+
+    // Доступ к значению; отсутствующий ключ вставляется со значением по умолчанию
+    mapped_type& operator[](const key_type& key) { return try_emplace(key).first->second; }
+    mapped_type& operator[](key_type&& key) { return try_emplace(std::move(key)).first->second; }
+
+    mapped_type& at(const key_type& key) {
+        iterator it = this->find(key);
+        if (it == this->end())
+            throw std::out_of_range("OrderedMap::at: ключ не найден");
+        return it->second;
+    }
+    const mapped_type& at(const key_type& key) const {
+        const_iterator it = this->find(key);
+        if (it == this->end())
+            throw std::out_of_range("OrderedMap::at: ключ не найден");
+        return it->second;
+    }
+
+    // Значение конструируется из args только если ключа еще нет; иначе аргументы не трогаются
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(const key_type& key, Args&&... args) {
+        return this->wrap(tree->tryEmplace(key, std::piecewise_construct, std::forward_as_tuple(key),
+            std::forward_as_tuple(std::forward<Args>(args)...)));
+    }
+    // Ключ перемещается в узел уже после поиска, поэтому ссылка key остается действительной на время спуска
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(key_type&& key, Args&&... args) {
+        return this->wrap(tree->tryEmplace(key, std::piecewise_construct, std::forward_as_tuple(std::move(key)),
+            std::forward_as_tuple(std::forward<Args>(args)...)));
+    }
+    template <typename... Args>
+    iterator try_emplace(const_iterator, const key_type& key, Args&&... args) {
+        return try_emplace(key, std::forward<Args>(args)...).first;
+    }
+    template <typename... Args>
+    iterator try_emplace(const_iterator, key_type&& key, Args&&... args) {
+        return try_emplace(std::move(key), std::forward<Args>(args)...).first;
+    }
+
+    template <typename M>
+    std::pair<iterator, bool> insert_or_assign(const key_type& key, M&& obj) {
+        auto result = tree->tryEmplace(key, key, std::forward<M>(obj));
+        if (!result.second)
+            result.first->second = std::forward<M>(obj);
+        return this->wrap(result);
+    }
+    template <typename M>
+    std::pair<iterator, bool> insert_or_assign(key_type&& key, M&& obj) {
+        auto result = tree->tryEmplace(key, std::move(key), std::forward<M>(obj));
+        if (!result.second)
+            result.first->second = std::forward<M>(obj);
+        return this->wrap(result);
+    }
+
+    friend void swap(OrderedMap& a, OrderedMap& b) noexcept { a.swap(b); }
+};
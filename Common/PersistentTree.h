@@ -0,0 +1,498 @@
+﻿#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "NodeAllocator.h"
+#include "Snapshot.h"
+
+// Персистентные деревья с копированием пути (path copying).
+// Опубликованный узел больше не меняется: вставка и удаление копируют узлы на пути от корня
+// (и те соседние, которые задевает балансировка), остальное новая версия делит со старой.
+// Версия — корень и размер — публикуется атомарно. Читатель берет текущую версию без блокировок
+// и обходит ее сколько угодно долго: писатели ее не трогают и не освобождают.
+//
+// Память возвращается подсчетом ссылок. У узла считаются ссылки от родителей и корней версий,
+// у версии — от дерева и читателей. Версия, которую никто не держит, освобождается сразу
+// (вместе с узлами, которые были только в ней), поэтому долгий обход держит лишь свою версию,
+// а не весь мусор, накопленный за время обхода (как было бы при эпохах).
+// Узлы освобождают те потоки, которые отпустили последнюю ссылку, поэтому они выделяются
+// StdNodeAllocator: однопоточные арены и slab-аллокаторы сюда не подходят.
+//
+// Единственная гонка — между читателем, который прочел указатель на текущую версию, но еще
+// не увеличил ее счетчик, и писателем, который в этот момент заменяет версию. На время этих
+// двух шагов читатель объявляет указатель в ячейке hazards и перепроверяет current (hazard pointer).
+// Писатель после публикации отпускает каждую замененную версию, которой нет ни в одной ячейке:
+// захватить ее больше нельзя. Остальные ждут в списке retired до следующей публикации, и список
+// не длиннее числа ячеек — сколько бы читателей ни шло подряд и как бы их ни вытесняла ОС.
+//
+// Писатели выстраиваются в очередь на мьютексе. Транзакция (update) может сделать много вставок
+// и удалений и публикуется одной версией; узлы, созданные в ней, помечены ее номером (stamp)
+// и меняются на месте, без повторного копирования.
+//
+// Балансировка — в политике Balance (PersistentAVL.h, PersistentRedBlack.h):
+//   Node                                   — тип узла, наследник PersistentNodeBase
+//   insert(copier, root, key, comp)        — вставка ключа, которого в дереве нет
+//   erase(copier, root, key, comp)         — удаление ключа, который в дереве есть
+//   BuildShape(count), shape(node, height, depth) — разметка узла при сборке из отсортированного
+// Политика меняет только узлы, полученные через copier (PathCopier)
+
+// Общая часть узла персистентного дерева
+template <typename Node, typename Key>
+struct PersistentNodeBase {
+    Key key;
+    Node* child[2];              // Левый и правый потомки
+    std::atomic<size_t> refs;    // Ссылок от родителей и корней версий
+    uint64_t stamp;              // Транзакция, создавшая узел; только ей он доступен для записи
+
+    PersistentNodeBase(const Key& key, uint64_t stamp) : key(key), child{ nullptr, nullptr }, refs(1), stamp(stamp) {}
+    // Копия узла для транзакции stamp; ссылки на потомков копия добавляет сама
+    PersistentNodeBase(const PersistentNodeBase& other, uint64_t stamp)
+        : key(other.key), child{ other.child[0], other.child[1] }, refs(1), stamp(stamp) {
+        for (Node* next : child)
+            if (next != nullptr)
+                next->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+// Отпустить ссылку на поддерево; узлы, на которые ссылок не осталось, освобождаются.
+// Рекурсия только влево, вправо — цикл: глубина не больше высоты дерева
+template <typename Node>
+void releaseNode(Node* node) {
+    while (node != nullptr && node->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        releaseNode(node->child[0]);
+        Node* right = node->child[1];
+        StdNodeAllocator().destroy(node);
+        node = right;
+    }
+}
+
+// Копирование пути в одной транзакции записи
+template <typename Node>
+class PathCopier {
+public:
+    explicit PathCopier(uint64_t stamp) : stamp(stamp) {}
+
+    // Узел по ссылке slot (slot лежит в узле этой транзакции или это корень), доступный для записи:
+    // созданный этой транзакцией возвращается как есть, чужой заменяется в slot своей копией.
+    // Если копирование бросит исключение, дерево не изменится
+    Node* own(Node*& slot) {
+        Node* node = slot;
+        if (node->stamp == stamp)
+            return node;
+        Node* copy = StdNodeAllocator().create<Node>(*node, stamp);
+        slot = copy;
+        releaseNode(node);  // Ссылка slot перешла к копии; старую версию узел держит сам
+        return copy;
+    }
+    template <typename... Args>
+    Node* create(Args&&... args) {
+        return StdNodeAllocator().create<Node>(std::forward<Args>(args)..., stamp);
+    }
+    // Узел slot (своей транзакции) удаляется, его место занимает потомок side
+    void unlink(Node*& slot, int side) {
+        Node* node = slot;
+        slot = node->child[side];
+        node->child[side] = nullptr;
+        releaseNode(node);
+    }
+    // Поворот поддерева slot (узел своей транзакции) в сторону dir (0 — влево, 1 — вправо):
+    // вверх поднимается потомок с другой стороны. Число ссылок на узлы поворот не меняет
+    Node* rotate(Node*& slot, int dir) {
+        Node* node = slot;
+        Node* up = own(node->child[1 - dir]);
+        node->child[1 - dir] = up->child[dir];
+        up->child[dir] = node;
+        slot = up;
+        return up;
+    }
+
+private:
+    uint64_t stamp;
+};
+
+// Узел с ключом key или nullptr
+template <typename Node, typename K, typename Compare>
+const Node* findPersistentNode(const Node* node, const K& key, const Compare& comp) {
+    while (node != nullptr) {
+        if (comp(key, node->key))
+            node = node->child[0];
+        else if (comp(node->key, key))
+            node = node->child[1];
+        else
+            return node;
+    }
+    return nullptr;
+}
+
+template <typename Balance, typename Compare>
+class PersistentTree;
+
+// Неизменяемая версия дерева. Копирование дешевое (счетчик ссылок), версию можно читать
+// из любого числа потоков и держать сколько угодно, в том числе дольше самого дерева.
+// Итераторы действительны, пока жив хоть один объект этой версии
+template <typename Node, typename Compare>
+class PersistentVersion {
+public:
+    using Key = typename std::remove_const<decltype(Node::key)>::type;
+    using key_type = Key;
+
+    // Итератор симметричного обхода; путь от корня хранится в векторе
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Key;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Key*;
+        using reference = const Key&;
+
+        Iterator() {}
+
+        reference operator*() const { return path.back()->key; }
+        pointer operator->() const { return &path.back()->key; }
+        Iterator& operator++() {
+            const Node* node = path.back();
+            path.pop_back();
+            pushLeft(node->child[1]);
+            return *this;
+        }
+        Iterator operator++(int) {
+            Iterator copy = *this;
+            ++*this;
+            return copy;
+        }
+        bool operator==(const Iterator& other) const {
+            return path.empty() ? other.path.empty() : !other.path.empty() && path.back() == other.path.back();
+        }
+        bool operator!=(const Iterator& other) const { return !(*this == other); }
+
+    private:
+        friend class PersistentVersion;
+
+        std::vector<const Node*> path;  // Узлы, ключи которых еще не выданы; текущий — последний
+
+        void pushLeft(const Node* node) {
+            for (; node != nullptr; node = node->child[0])
+                path.push_back(node);
+        }
+    };
+
+    PersistentVersion(const PersistentVersion& other) : data(other.data) { data->refs.fetch_add(1, std::memory_order_relaxed); }
+    PersistentVersion& operator=(PersistentVersion other) {
+        std::swap(data, other.data);
+        return *this;
+    }
+    ~PersistentVersion() { releaseData(data); }
+
+    size_t size() const { return data->size; }
+    bool empty() const { return data->size == 0; }
+    // Номер версии: растет на единицу с каждой опубликованной транзакцией
+    uint64_t number() const { return data->number; }
+
+    template <typename K>
+    bool contains(const K& key) const { return find(key) != nullptr; }
+    // Ключ, равный key, или nullptr
+    template <typename K>
+    const Key* find(const K& key) const {
+        const Node* node = findPersistentNode(data->root, key, data->comp);
+        return node != nullptr ? &node->key : nullptr;
+    }
+
+    Iterator begin() const {
+        Iterator it;
+        it.pushLeft(data->root);
+        return it;
+    }
+    Iterator end() const { return Iterator(); }
+    // Первый ключ, не меньший key
+    template <typename K>
+    Iterator lowerBound(const K& key) const {
+        Iterator it;
+        for (const Node* node = data->root; node != nullptr;) {
+            if (data->comp(node->key, key)) {
+                node = node->child[1];
+            }
+            else {
+                it.path.push_back(node);
+                node = node->child[0];
+            }
+        }
+        return it;
+    }
+
+    // Снимок версии в поток (формат — в Snapshot.h); писатели тем временем не ждут
+    void save(std::ostream& out, SnapshotEncoding encoding = SnapshotEncoding::Compact) const {
+        saveSnapshot<SetEntry<Key>>(out, begin(), end(), data->size, encoding);
+    }
+
+private:
+    template <typename, typename>
+    friend class PersistentTree;
+
+    struct Data {
+        std::atomic<size_t> refs;  // Ссылок от дерева и от PersistentVersion
+        Node* root;
+        size_t size;
+        uint64_t number;
+        Compare comp;
+
+        Data(Node* root, size_t size, uint64_t number, const Compare& comp)
+            : refs(1), root(root), size(size), number(number), comp(comp) {}
+        ~Data() { releaseNode(root); }
+    };
+
+    Data* data;
+
+    // Владение ссылкой на data переходит к версии
+    explicit PersistentVersion(Data* data) : data(data) {}
+
+    static void releaseData(Data* data) {
+        if (data->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete data;
+    }
+};
+
+// Персистентное дерево (множество уникальных ключей): читатели работают с версиями
+// (version() — без блокировок), писатели публикуют новые версии
+template <typename Balance, typename Compare>
+class PersistentTree {
+public:
+    using Node = typename Balance::Node;
+    using Version = PersistentVersion<Node, Compare>;
+    using Key = typename Version::Key;
+    using key_type = Key;
+
+    // Транзакция записи: изменения видны только ей, пока update не опубликует ее целиком
+    class Transaction {
+    public:
+        Transaction(const Transaction&) = delete;
+        Transaction& operator=(const Transaction&) = delete;
+        ~Transaction() { releaseNode(root); }
+
+        size_t size() const { return size_; }
+        template <typename K>
+        bool contains(const K& key) const { return findPersistentNode<Node>(root, key, comp) != nullptr; }
+
+        // Вставка ключа; возвращает false, если он уже есть.
+        // Ключ сначала ищется: при повторе путь не копируется зря
+        bool insert(const Key& key) {
+            if (contains(key))
+                return false;
+            guard([&] { Balance::insert(copier, root, key, comp); });
+            ++size_;
+            return true;
+        }
+        // Удаление ключа; возвращает false, если его нет
+        template <typename K>
+        bool erase(const K& key) {
+            if (!contains(key))
+                return false;
+            guard([&] { Balance::erase(copier, root, key, comp); });
+            --size_;
+            return true;
+        }
+        void clear() {
+            releaseNode(root);
+            root = nullptr;
+            size_ = 0;
+            changed = true;
+        }
+
+    private:
+        friend class PersistentTree;
+
+        PathCopier<Node> copier;
+        const Compare& comp;
+        Node* root;
+        size_t size_;
+        bool changed;  // Было что публиковать
+        bool broken;   // Операция бросила исключение посреди балансировки: транзакция не публикуется
+
+        Transaction(const typename Version::Data& base, uint64_t stamp)
+            : copier(stamp), comp(base.comp), root(base.root), size_(base.size), changed(false), broken(false) {
+            if (root != nullptr)
+                root->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        template <typename Operation>
+        void guard(Operation operation) {
+            try {
+                operation();
+            }
+            catch (...) {
+                broken = true;
+                throw;
+            }
+            changed = true;
+        }
+    };
+
+    explicit PersistentTree(const Compare& comp = Compare())
+        : current(new typename Version::Data(nullptr, 0, 0, comp)), lastStamp(0) {}
+    PersistentTree(const PersistentTree&) = delete;
+    PersistentTree& operator=(const PersistentTree&) = delete;
+    ~PersistentTree() {
+        for (typename Version::Data* data : retired)
+            Version::releaseData(data);
+        Version::releaseData(current.load());
+    }
+
+    // Текущая версия, без блокировок
+    Version version() const {
+        static thread_local const size_t hint = std::hash<std::thread::id>()(std::this_thread::get_id()) % kHazardSlots;
+        typename Version::Data* data = current.load();
+        // Свободная ячейка; все заняты только при kHazardSlots читателях внутри окна сразу
+        size_t slot = hint;
+        for (typename Version::Data* expected = nullptr; !hazards[slot].data.compare_exchange_strong(expected, data);
+             expected = nullptr)
+            slot = (slot + 1) % kHazardSlots;
+        // Версия, объявленная до того, как писатель ее заменил, им не освобождается
+        for (typename Version::Data* now; (now = current.load()) != data; data = now)
+            hazards[slot].data.store(now);
+        data->refs.fetch_add(1, std::memory_order_relaxed);
+        hazards[slot].data.store(nullptr, std::memory_order_release);
+        return Version(data);
+    }
+    size_t size() const { return version().size(); }
+
+    // Транзакция: edit(Transaction&) вставляет и удаляет ключи, результат публикуется одной версией.
+    // Если edit бросит исключение, ничего не публикуется
+    template <typename Edit>
+    void update(Edit edit) {
+        std::lock_guard<std::mutex> lock(writeLock);
+        const typename Version::Data& base = *current.load();
+        Transaction transaction(base, ++lastStamp);
+        edit(transaction);
+        if (transaction.changed && !transaction.broken)
+            publish(transaction);
+    }
+
+    bool insert(const Key& key) {
+        bool inserted = false;
+        update([&](Transaction& transaction) { inserted = transaction.insert(key); });
+        return inserted;
+    }
+    template <typename K>
+    bool erase(const K& key) {
+        bool erased = false;
+        update([&](Transaction& transaction) { erased = transaction.erase(key); });
+        return erased;
+    }
+    template <typename K>
+    bool contains(const K& key) const { return version().contains(key); }
+    void clear() {
+        update([](Transaction& transaction) { transaction.clear(); });
+    }
+
+    // Замена содержимого ключами из [first, last), отсортированными по возрастанию без повторов.
+    // Новая версия строится идеально сбалансированной за O(n) и публикуется целиком
+    template <typename ForwardIt>
+    void buildFromSorted(ForwardIt first, ForwardIt last) {
+        buildCounted(first, std::distance(first, last));
+    }
+
+    // Снимок текущей версии в поток (формат — в Snapshot.h)
+    void save(std::ostream& out, SnapshotEncoding encoding = SnapshotEncoding::Compact) const {
+        version().save(out, encoding);
+    }
+    // Замена содержимого снимком из потока; при ошибке исключение, опубликованная версия остается прежней
+    void load(std::istream& in) {
+        SnapshotReader<SetEntry<Key>, Compare> reader(in, current.load()->comp, true);
+        buildCounted(reader.begin(), reader.size(), [&] { reader.finish(); });
+    }
+
+    // Замененные версии, которые дерево еще держит из-за читателей (не больше kHazardSlots)
+    size_t retiredCount() {
+        std::lock_guard<std::mutex> lock(writeLock);
+        return retired.size();
+    }
+
+private:
+    using Data = typename Version::Data;
+
+    // Ячейки читателей разнесены по строкам кэша, чтобы потоки не делили одну строку
+    static constexpr size_t kHazardSlots = 16;
+    struct alignas(ChunkList::kAlignment) Hazard {
+        std::atomic<Data*> data{ nullptr };  // Версия, которую читатель захватывает; nullptr — ячейка свободна
+    };
+
+    std::atomic<Data*> current;
+    mutable Hazard hazards[kHazardSlots];
+    std::mutex writeLock;
+    uint64_t lastStamp;                     // Номер последней транзакции
+    std::vector<Data*> retired;             // Замененные версии, которые еще может захватывать читатель
+
+    // Публикация результата транзакции; вызывается под writeLock
+    void publish(Transaction& transaction) {
+        Data* old = current.load();
+        retired.reserve(retired.size() + 1);
+        Data* data = new Data(transaction.root, transaction.size_, old->number + 1, old->comp);
+        transaction.root = nullptr;  // Ссылка перешла к версии
+        current.store(data);
+        retired.push_back(old);
+        // Читатель, объявивший версию после store, при перепроверке увидит новую;
+        // необъявленные замененные версии захватить уже нельзя
+        size_t kept = 0;
+        for (Data* version : retired) {
+            if (isHazard(version))
+                retired[kept++] = version;
+            else
+                Version::releaseData(version);
+        }
+        retired.resize(kept);
+    }
+    bool isHazard(const Data* version) const {
+        for (const Hazard& hazard : hazards)
+            if (hazard.data.load() == version)
+                return true;
+        return false;
+    }
+
+    // Замена содержимого count ключами, читаемыми по порядку с it; check() вызывается после чтения
+    template <typename InputIt, typename Check = void (*)()>
+    void buildCounted(InputIt it, size_t count, Check check = [] {}) {
+        std::lock_guard<std::mutex> lock(writeLock);
+        Transaction transaction(*current.load(), ++lastStamp);
+        transaction.clear();
+        typename Balance::BuildShape shape(count);
+        transaction.root = buildBalanced(transaction.copier, it, count, 0, shape).first;
+        transaction.size_ = count;
+        check();
+        publish(transaction);
+    }
+    // Сбалансированное поддерево из count ключей с корнем на глубине depth; возвращает его корень и высоту
+    template <typename It>
+    static std::pair<Node*, int> buildBalanced(PathCopier<Node>& copier, It& it, size_t count, int depth,
+                                               const typename Balance::BuildShape& shape) {
+        if (count == 0)
+            return { nullptr, 0 };
+        size_t leftCount = count / 2;
+        std::pair<Node*, int> left = buildBalanced(copier, it, leftCount, depth + 1, shape);
+        Node* node;
+        try {
+            node = copier.create(*it);
+        }
+        catch (...) {
+            releaseNode(left.first);
+            throw;
+        }
+        node->child[0] = left.first;
+        try {
+            ++it;
+            node->child[1] = buildBalanced(copier, it, count - leftCount - 1, depth + 1, shape).first;
+        }
+        catch (...) {
+            releaseNode(node);
+            throw;
+        }
+        int height = left.second + 1;  // Левая половина не меньше правой
+        shape(node, height, depth);
+        return { node, height };
+    }
+};
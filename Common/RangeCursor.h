@@ -0,0 +1,177 @@
+﻿#pragma once
+#include <cstddef>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+// Курсоры по диапазону ключей: range(lo, hi) и scan(keys, direction) у BST, AVLTree, RedBlackTree и BTree.
+// Начало диапазона находится спуском за O(log n), дальше элементы выдаются лениво — по одному
+// (operator*, next) или пачками в буфер вызывающего (fetch), и обход можно бросить в любой момент.
+// Обход идет по возрастанию (Forward) или по убыванию ключей (Backward).
+// Курсор держит итераторы дерева и действителен, пока действительны они: в BST, AVL и красно-черном
+// дереве — пока не удалены элементы под курсором и последний элемент диапазона, в B-дереве — до любого
+// изменения. Продолжить после изменения дерева или в следующем запросе («следующие 100 ключей после X»)
+// позволяет rest(): диапазон еще не выданных ключей, в котором сторона, откуда шел обход, заменена
+// строгой границей по последнему выданному ключу
+//
+// От дерева курсору нужны key_type, entry_type, value_type, двунаправленный Iterator,
+// begin/end, lowerBound/upperBound и keyComp. Если у дерева есть copyRun (как у BTree),
+// fetch копирует подряд лежащие в узле элементы одним куском, а не по одному
+
+enum class ScanDirection { Forward, Backward };
+
+// Диапазон ключей. Граница без ключа — до края дерева
+template <typename Key>
+struct KeyRange {
+    std::optional<Key> lower;
+    std::optional<Key> upper;
+    bool lowerInclusive = true;
+    bool upperInclusive = true;
+
+    // Все ключи
+    static KeyRange all() { return KeyRange(); }
+    // Отрезок [lo, hi]
+    static KeyRange closed(const Key& lo, const Key& hi) {
+        KeyRange keys;
+        keys.lower = lo;
+        keys.upper = hi;
+        return keys;
+    }
+    // Полуинтервал [lo, hi)
+    static KeyRange halfOpen(const Key& lo, const Key& hi) {
+        KeyRange keys = closed(lo, hi);
+        keys.upperInclusive = false;
+        return keys;
+    }
+    // Ключи не меньше key
+    static KeyRange atLeast(const Key& key) {
+        KeyRange keys;
+        keys.lower = key;
+        return keys;
+    }
+    // Ключи больше key: продолжение после последнего выданного
+    static KeyRange greaterThan(const Key& key) {
+        KeyRange keys = atLeast(key);
+        keys.lowerInclusive = false;
+        return keys;
+    }
+    // Ключи не больше key
+    static KeyRange atMost(const Key& key) {
+        KeyRange keys;
+        keys.upper = key;
+        return keys;
+    }
+    // Ключи меньше key
+    static KeyRange lessThan(const Key& key) {
+        KeyRange keys = atMost(key);
+        keys.upperInclusive = false;
+        return keys;
+    }
+};
+
+template <typename Tree, typename = void>
+struct HasCopyRun : std::false_type {};
+
+template <typename Tree>
+struct HasCopyRun<Tree, std::void_t<decltype(std::declval<const Tree&>().copyRun(
+    std::declval<typename Tree::Iterator&>(), std::declval<const typename Tree::Iterator&>(), true,
+    std::declval<typename Tree::value_type*>(), std::size_t()))>> : std::true_type {};
+
+template <typename Tree>
+class RangeCursor {
+public:
+    using key_type = typename Tree::key_type;
+    using value_type = typename Tree::value_type;
+    using Iterator = typename Tree::Iterator;
+    using reference = typename Iterator::reference;
+    using pointer = typename Iterator::pointer;
+
+    // Два спуска: к первому элементу диапазона и к первому за его концом
+    RangeCursor(const Tree& tree, const KeyRange<key_type>& range, ScanDirection direction)
+        : keys(range), forward(direction == ScanDirection::Forward), started(false), finished(true) {
+        Iterator first = !keys.lower ? tree.begin()
+                         : keys.lowerInclusive ? tree.lowerBound(*keys.lower) : tree.upperBound(*keys.lower);
+        Iterator stop = !keys.upper ? tree.end()
+                        : keys.upperInclusive ? tree.upperBound(*keys.upper) : tree.lowerBound(*keys.upper);
+        // Нижняя граница выше верхней: первый элемент уже за верхней границей или за концом дерева
+        if (first == stop || first == tree.end() || (keys.upper && aboveUpper(tree, Tree::entry_type::key(*first))))
+            return;
+        --stop;
+        pos = forward ? first : stop;
+        last = forward ? stop : first;
+        finished = false;
+    }
+
+    ScanDirection direction() const { return forward ? ScanDirection::Forward : ScanDirection::Backward; }
+    // Выданы ли все элементы диапазона
+    bool done() const { return finished; }
+    // Текущий элемент (пока !done())
+    reference operator*() const { return *pos; }
+    pointer operator->() const { return &*pos; }
+    // Переход к следующему элементу в направлении обхода
+    void next() {
+        started = true;
+        if (pos == last)
+            finished = true;
+        else if (forward)
+            ++pos;
+        else
+            --pos;
+    }
+    // Следующие элементы, не больше capacity, копируются в out; возвращает их число (0 — диапазон исчерпан)
+    size_t fetch(value_type* out, size_t capacity) {
+        size_t count = 0;
+        while (count < capacity && !finished) {
+            count += copyRun(out + count, capacity - count);
+            next();
+        }
+        return count;
+    }
+    // Диапазон еще не выданных элементов: для продолжения через scan() после изменения дерева.
+    // Вызывать до изменения: последний выданный ключ читается из дерева
+    KeyRange<key_type> rest() const {
+        KeyRange<key_type> result = keys;
+        if (!started)
+            return result;
+        Iterator previous = last;
+        if (!finished) {
+            previous = pos;
+            if (forward)
+                --previous;
+            else
+                ++previous;
+        }
+        const key_type& key = Tree::entry_type::key(*previous);
+        if (forward) {
+            result.lower = key;
+            result.lowerInclusive = false;
+        }
+        else {
+            result.upper = key;
+            result.upperInclusive = false;
+        }
+        return result;
+    }
+
+private:
+    KeyRange<key_type> keys;
+    Iterator pos;    // Текущий элемент
+    Iterator last;   // Последний элемент диапазона в направлении обхода
+    bool forward;
+    bool started;    // Выдан ли хоть один элемент
+    bool finished;
+
+    bool aboveUpper(const Tree& tree, const key_type& key) const {
+        return keys.upperInclusive ? tree.keyComp()(*keys.upper, key) : !tree.keyComp()(key, *keys.upper);
+    }
+    // Элементы от текущего в out; курсор остается на последнем скопированном
+    size_t copyRun(value_type* out, size_t capacity) {
+        if constexpr (HasCopyRun<Tree>::value) {
+            return Tree::copyRun(pos, last, forward, out, capacity);
+        }
+        else {
+            *out = *pos;
+            return 1;
+        }
+    }
+};
@@ -0,0 +1,163 @@
+﻿#pragma once
+#include <cstddef>
+#include <system_error>
+#include <thread>
+#include "BulkBuild.h"
+
+// Операции над множествами двоичных деревьев через split и join
+// (Blelloch, Ferizovic, Sun, «Just Join for Parallel Ordered Sets»).
+// Вся балансировка спрятана в join: алгоритмы ниже одинаковы для AVL и красно-черного дерева.
+// Дерево-владелец дает (приватно, через дружбу с SetAlgebra) поддеревья типа Sub — корень
+// и то, что нужно join без обхода (красно-черному — черная высота), и операции над ними:
+//   isEmpty(t), subtreeSize(t)
+//   expose(t, left, node, right)              — отцепить корень t от его поддеревьев
+//   splitNodes(t, pivot, less, equal, greater) — разрезать t по ключу узла pivot на три части
+//   joinNodes(left, node, right)              — склеить через узел (ключи left <= node <= right)
+//   concatNodes(left, right)                  — склеить без среднего узла
+//   discard(t, garbage)                       — отправить поддерево в мусор
+//   absorb(node, equal)                       — слить в node элемент из equal с тем же ключом (Entry::merge)
+// Рекурсия идет по корням одного дерева, второе режется их ключами; половины независимы,
+// и на верхних уровнях считаются в разных потоках. Работа O(m log(n/m + 1)) при m <= n,
+// глубина (длина критического пути) O(log n log m).
+// Элементы сравниваются только по ключам: объединение добавляет элементы другого дерева, ключей
+// которых здесь нет, пересечение оставляет элементы, ключ которых есть в другом дереве, разность —
+// элементы, ключа которых там нет. При совпадении ключей в объединении элемент другого дерева
+// сливается с элементом этого через Entry::merge (OrderedContainers.h): у словаря остается здешнее
+// значение, у мультимножества счетчики складываются, у мультисловаря списки значений склеиваются.
+
+// Список поддеревьев на удаление. Аллокатор дерева однопоточный, поэтому потоки узлы не освобождают,
+// а копят и разрушают их после слияния. Список связан через ссылку корня на родителя
+// и не выделяет памяти, так что сами операции не бросают исключений
+template <typename Node>
+struct NodeGarbage {
+    Node* head = nullptr;
+    Node* tail = nullptr;
+
+    void push(Node* subtree) {
+        subtree->parent = head;
+        head = subtree;
+        if (tail == nullptr)
+            tail = subtree;
+    }
+    void append(NodeGarbage& other) {
+        if (other.head == nullptr)
+            return;
+        other.tail->parent = head;
+        head = other.head;
+        if (tail == nullptr)
+            tail = other.tail;
+        other.head = other.tail = nullptr;
+    }
+};
+
+// Выполнение left() и right(); при parallel left уходит в отдельный поток.
+// Если поток запустить не удалось, обе части выполняются здесь же
+template <typename Left, typename Right>
+void forkJoin(bool parallel, Left&& left, Right&& right) {
+    std::thread worker;
+    if (parallel) {
+        try {
+            worker = std::thread([&left] { left(); });
+        }
+        catch (const std::system_error&) {
+        }
+    }
+    if (!worker.joinable())
+        left();
+    right();
+    if (worker.joinable())
+        worker.join();
+}
+
+// Глубина рекурсии, до которой половины отдаются разным потокам: по два поддерева на поток
+inline int forkDepth(unsigned threads) {
+    int depth = 0;
+    while (threads > 1 && (1u << depth) < threads * 2)
+        ++depth;
+    return depth;
+}
+
+template <typename Tree>
+class SetAlgebra {
+public:
+    using Node = typename Tree::Node;
+    using Sub = typename Tree::Sub;
+    using Garbage = NodeGarbage<Node>;
+
+    SetAlgebra(Tree& tree, unsigned threads) : tree(tree), maxForkDepth(forkDepth(threads)) {}
+
+    // Все элементы a и элементы b с ключами, которых нет в a
+    Sub unite(Sub a, Sub b, Garbage& garbage, int depth = 0) {
+        if (tree.isEmpty(a))
+            return b;
+        if (tree.isEmpty(b))
+            return a;
+        bool fork = parallel(a, b, depth);
+        Sub aLeft, aRight, bLess, bEqual, bGreater;
+        Node* pivot;
+        tree.expose(a, aLeft, pivot, aRight);
+        tree.splitNodes(b, pivot, bLess, bEqual, bGreater);
+        tree.absorb(pivot, bEqual);
+        tree.discard(bEqual, garbage);
+        Sub left, right;
+        Garbage leftGarbage;
+        forkJoin(fork,
+            [&] { left = unite(aLeft, bLess, leftGarbage, depth + 1); },
+            [&] { right = unite(aRight, bGreater, garbage, depth + 1); });
+        garbage.append(leftGarbage);
+        return tree.joinNodes(left, pivot, right);
+    }
+
+    // Элементы a, ключи которых есть в b
+    Sub intersect(Sub a, Sub b, Garbage& garbage, int depth = 0) {
+        if (tree.isEmpty(a) || tree.isEmpty(b)) {
+            tree.discard(a, garbage);
+            tree.discard(b, garbage);
+            return tree.isEmpty(a) ? a : b;
+        }
+        bool fork = parallel(a, b, depth);
+        Sub bLeft, bRight, aLess, aEqual, aGreater;
+        Node* pivot;
+        tree.expose(b, bLeft, pivot, bRight);
+        tree.splitNodes(a, pivot, aLess, aEqual, aGreater);
+        garbage.push(pivot);
+        Sub left, right;
+        Garbage leftGarbage;
+        forkJoin(fork,
+            [&] { left = intersect(aLess, bLeft, leftGarbage, depth + 1); },
+            [&] { right = intersect(aGreater, bRight, garbage, depth + 1); });
+        garbage.append(leftGarbage);
+        return tree.concatNodes(tree.concatNodes(left, aEqual), right);
+    }
+
+    // Элементы a, ключей которых нет в b
+    Sub subtract(Sub a, Sub b, Garbage& garbage, int depth = 0) {
+        if (tree.isEmpty(a) || tree.isEmpty(b)) {
+            tree.discard(b, garbage);
+            return a;
+        }
+        bool fork = parallel(a, b, depth);
+        Sub bLeft, bRight, aLess, aEqual, aGreater;
+        Node* pivot;
+        tree.expose(b, bLeft, pivot, bRight);
+        tree.splitNodes(a, pivot, aLess, aEqual, aGreater);
+        garbage.push(pivot);
+        tree.discard(aEqual, garbage);
+        Sub left, right;
+        Garbage leftGarbage;
+        forkJoin(fork,
+            [&] { left = subtract(aLess, bLeft, leftGarbage, depth + 1); },
+            [&] { right = subtract(aGreater, bRight, garbage, depth + 1); });
+        garbage.append(leftGarbage);
+        return tree.concatNodes(left, right);
+    }
+
+private:
+    Tree& tree;
+    int maxForkDepth;
+
+    // Делить ли работу между потоками: мелкие задачи дешевле посчитать на месте
+    bool parallel(const Sub& a, const Sub& b, int depth) const {
+        return depth < maxForkDepth && tree.subtreeSize(a) + tree.subtreeSize(b) >= kParallelBuildMin;
+    }
+};
@@ -0,0 +1,593 @@
+﻿#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <iterator>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Снимок дерева: компактный двоичный формат, в котором элементы идут по возрастанию.
+// Сохранение — один проход по дереву, загрузка — сразу сбалансированная сборка (buildFromSorted)
+// без вставок по одной. Все числа записаны в little-endian, от порядка байт машины формат не зависит.
+//
+//   Заголовок (28 байт)
+//     magic              4 байта "TSNP"
+//     version            u16      kSnapshotVersion
+//     flags              u16      kSnapshotVarint: целые — varint, ключи — разностями с предыдущим
+//     keyTag, valueTag   u32, u32 типы ключа и значения (SnapshotCodec::kTag; у множества valueTag = 0,
+//                                 у мультимножества 0x2000, у мультисловаря 0x4000 | kTag значения)
+//     count              u64      число элементов
+//     crc                u32      CRC-32 предыдущих 24 байт
+//   Блоки данных (элемент целиком лежит в одном блоке)
+//     length, items      u32, u32 байт данных и элементов в блоке
+//     data               length байт
+//     crc                u32      CRC-32 данных
+//   Конец снимка — блок с length = 0 и items = 0 (без данных и crc)
+//
+// Ошибки ввода-вывода, повреждение и несовпадение типов — исключения std::runtime_error.
+// count из заголовка сверяется с остатком потока: элемент занимает хотя бы байт, так что поддельное
+// число элементов отвергается до сборки, а не уходит в резервирование памяти под узлы. У потока без
+// позиционирования (канал, сокет) остаток неизвестен, и проверяется только, что count помещается в size_t
+
+constexpr uint16_t kSnapshotVersion = 1;
+constexpr uint16_t kSnapshotVarint = 1;
+constexpr size_t kSnapshotHeaderSize = 28;
+constexpr size_t kSnapshotBlockSize = 64 * 1024;        // После стольких байт блок уходит в поток
+constexpr size_t kSnapshotMaxBlock = size_t(1) << 30;   // Больше не бывает: length поврежден
+
+// Кодирование снимка. Compact сжимает только целые: ключи становятся varint-разностями
+// с предыдущим (плотные ключи — 1-2 байта вместо 4-8), целые значения — varint.
+// Для остальных типов Compact и Raw совпадают
+enum class SnapshotEncoding { Raw, Compact };
+
+// CRC-32 (многочлен 0xEDB88320, как в zip и Ethernet), табличный, по байту за шаг
+inline uint32_t snapshotCrc(const unsigned char* data, size_t length, uint32_t crc = 0) {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> result{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; ++bit)
+                value = (value >> 1) ^ (value & 1 ? 0xEDB88320u : 0u);
+            result[i] = value;
+        }
+        return result;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < length; ++i)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+// Буфер, в котором собирается блок снимка
+class SnapshotBuffer {
+public:
+    size_t size() const { return bytes.size(); }
+    const unsigned char* data() const { return bytes.data(); }
+    void clear() { bytes.clear(); }
+    void reserve(size_t capacity) { bytes.reserve(capacity); }
+
+    void put(const void* data, size_t length) {
+        const unsigned char* from = static_cast<const unsigned char*>(data);
+        bytes.insert(bytes.end(), from, from + length);
+    }
+    // Младшие size байт value, начиная с младшего
+    void putFixed(uint64_t value, size_t size) {
+        for (size_t i = 0; i < size; ++i)
+            bytes.push_back(static_cast<unsigned char>(value >> (8 * i)));
+    }
+    // LEB128: по 7 бит в байте, старший бит — «дальше есть еще»
+    void putVarint(uint64_t value) {
+        while (value >= 0x80) {
+            bytes.push_back(static_cast<unsigned char>(value | 0x80));
+            value >>= 7;
+        }
+        bytes.push_back(static_cast<unsigned char>(value));
+    }
+
+private:
+    std::vector<unsigned char> bytes;
+};
+
+// Чтение блока снимка; выход за конец блока — повреждение
+class SnapshotCursor {
+public:
+    SnapshotCursor() : pos(nullptr), end(nullptr) {}
+    SnapshotCursor(const unsigned char* data, size_t length) : pos(data), end(data + length) {}
+
+    bool atEnd() const { return pos == end; }
+    size_t remaining() const { return static_cast<size_t>(end - pos); }
+
+    void get(void* data, size_t length) {
+        need(length);
+        std::memcpy(data, pos, length);
+        pos += length;
+    }
+    uint64_t getFixed(size_t size) {
+        need(size);
+        uint64_t value = 0;
+        for (size_t i = 0; i < size; ++i)
+            value |= static_cast<uint64_t>(pos[i]) << (8 * i);
+        pos += size;
+        return value;
+    }
+    // Не больше 10 байт; в десятом помещается только старший бит числа, поэтому там допустимы 0 и 1,
+    // а лишние биты или продолжение после него — повреждение, а не молча обрезанное значение
+    uint64_t getVarint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            need(1);
+            unsigned char byte = *pos++;
+            if (shift == 63 && byte > 1)
+                corrupt();
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+                return value;
+        }
+        corrupt();
+    }
+
+    [[noreturn]] static void corrupt() { throw std::runtime_error("Snapshot: блок данных поврежден"); }
+
+private:
+    const unsigned char* pos;
+    const unsigned char* end;
+
+    void need(size_t length) const {
+        if (remaining() < length)
+            corrupt();
+    }
+};
+
+// Знаковое число -> беззнаковое так, что малые по модулю дают малые (0, -1, 1, -2 -> 0, 1, 2, 3)
+inline uint64_t zigzagEncode(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ (value < 0 ? ~uint64_t(0) : 0);
+}
+inline int64_t zigzagDecode(uint64_t value) {
+    return static_cast<int64_t>((value >> 1) ^ (~(value & 1) + 1));
+}
+
+// Как элемент типа T записывается в снимок. Есть для арифметических типов и std::string;
+// для своего типа достаточно специализации с kTag (отличным от встроенных), write и read
+template <typename T, typename = void>
+struct SnapshotCodec;
+
+template <typename T>
+struct SnapshotCodec<T, std::enable_if_t<std::is_arithmetic<T>::value>> {
+    static_assert(sizeof(T) <= 8, "SnapshotCodec: числа длиннее 8 байт не поддерживаются");
+
+    // Размер в байтах и вид числа: беззнаковое, знаковое или с плавающей точкой
+    static constexpr uint32_t kTag = sizeof(T) | (std::is_floating_point<T>::value ? 0x200u
+                                                  : std::is_signed<T>::value ? 0x100u : 0u);
+
+    static void write(SnapshotBuffer& out, const T& value, bool varint) {
+        if (varint && std::is_integral<T>::value)
+            out.putVarint(std::is_signed<T>::value ? zigzagEncode(static_cast<int64_t>(value)) : toBits(value));
+        else
+            out.putFixed(toBits(value), sizeof(T));
+    }
+    static void read(SnapshotCursor& in, T& value, bool varint) {
+        if (varint && std::is_integral<T>::value) {
+            uint64_t code = in.getVarint();
+            uint64_t bits = std::is_signed<T>::value ? static_cast<uint64_t>(zigzagDecode(code)) : code;
+            value = fromBits(bits);
+            if (toBits(value) != bits)
+                SnapshotCursor::corrupt();  // Число не помещается в T
+        }
+        else {
+            value = fromBits(in.getFixed(sizeof(T)));
+        }
+    }
+
+    // Целое — со знаковым расширением до 64 бит, число с плавающей точкой — его биты
+    static uint64_t toBits(const T& value) {
+        if constexpr (std::is_integral<T>::value) {
+            return static_cast<uint64_t>(value);
+        }
+        else {
+            typename std::conditional<sizeof(T) == 4, uint32_t, uint64_t>::type bits;
+            std::memcpy(&bits, &value, sizeof(T));
+            return bits;
+        }
+    }
+    static T fromBits(uint64_t bits) {
+        if constexpr (std::is_integral<T>::value) {
+            if constexpr (std::is_signed<T>::value && sizeof(T) < 8) {
+                // Раскрываем знак записанных sizeof(T) байт
+                int64_t shift = 64 - 8 * sizeof(T);
+                return static_cast<T>(static_cast<int64_t>(bits << shift) >> shift);
+            }
+            return static_cast<T>(bits);
+        }
+        else {
+            typename std::conditional<sizeof(T) == 4, uint32_t, uint64_t>::type narrow =
+                static_cast<typename std::conditional<sizeof(T) == 4, uint32_t, uint64_t>::type>(bits);
+            T value;
+            std::memcpy(&value, &narrow, sizeof(T));
+            return value;
+        }
+    }
+};
+
+// Строка: длина varint, затем байты
+template <>
+struct SnapshotCodec<std::string> {
+    static constexpr uint32_t kTag = 0x1000;
+
+    static void write(SnapshotBuffer& out, const std::string& value, bool) {
+        out.putVarint(value.size());
+        out.put(value.data(), value.size());
+    }
+    static void read(SnapshotCursor& in, std::string& value, bool) {
+        uint64_t length = in.getVarint();
+        if (length > in.remaining())
+            SnapshotCursor::corrupt();
+        value.resize(static_cast<size_t>(length));
+        in.get(&value[0], value.size());
+    }
+};
+
+// Виды элементов деревьев (OrderedContainers.h)
+template <typename Key>
+struct SetEntry;
+template <typename Key, typename T>
+struct MapEntry;
+template <typename Key>
+struct CountedKey;
+template <typename Key>
+struct CountedEntry;
+template <typename Key, typename T>
+struct MultiMapEntry;
+
+// Ключ и значение элемента дерева; ключи-целые в режиме varint пишутся разностью с предыдущим ключом
+template <typename Entry>
+struct SnapshotEntry;
+
+template <typename Key>
+struct SnapshotEntry<SetEntry<Key>> {
+    using value_type = Key;
+    static constexpr uint32_t kValueTag = 0;
+
+    static Key& key(value_type& value) { return value; }
+    static const Key& key(const value_type& value) { return value; }
+    static void writeValue(SnapshotBuffer&, const value_type&, bool) {}
+    static void readValue(SnapshotCursor&, value_type&, bool) {}
+};
+
+template <typename Key, typename T>
+struct SnapshotEntry<MapEntry<Key, T>> {
+    using value_type = std::pair<Key, T>;
+    static constexpr uint32_t kValueTag = SnapshotCodec<T>::kTag;
+
+    static Key& key(value_type& value) { return value.first; }
+    static const Key& key(const value_type& value) { return value.first; }
+    static void writeValue(SnapshotBuffer& out, const value_type& value, bool varint) {
+        SnapshotCodec<T>::write(out, value.second, varint);
+    }
+    static void readValue(SnapshotCursor& in, value_type& value, bool varint) {
+        SnapshotCodec<T>::read(in, value.second, varint);
+    }
+};
+
+// Мультимножество: после ключа — число вхождений (varint, не меньше 1)
+template <typename Key>
+struct SnapshotEntry<CountedEntry<Key>> {
+    using value_type = CountedKey<Key>;
+    static constexpr uint32_t kValueTag = 0x2000;
+
+    static Key& key(value_type& value) { return value.key; }
+    static const Key& key(const value_type& value) { return value.key; }
+    static void writeValue(SnapshotBuffer& out, const value_type& value, bool) { out.putVarint(value.count); }
+    static void readValue(SnapshotCursor& in, value_type& value, bool) {
+        uint64_t count = in.getVarint();
+        if (count == 0 || static_cast<size_t>(count) != count)
+            SnapshotCursor::corrupt();
+        value.count = static_cast<size_t>(count);
+    }
+};
+
+// Мультисловарь: после ключа — длина списка (varint, не меньше 1) и значения по порядку
+template <typename Key, typename T>
+struct SnapshotEntry<MultiMapEntry<Key, T>> {
+    using value_type = std::pair<Key, std::vector<T>>;
+    static constexpr uint32_t kValueTag = 0x4000 | SnapshotCodec<T>::kTag;
+
+    static Key& key(value_type& value) { return value.first; }
+    static const Key& key(const value_type& value) { return value.first; }
+    static void writeValue(SnapshotBuffer& out, const value_type& value, bool varint) {
+        out.putVarint(value.second.size());
+        for (const T& item : value.second)
+            SnapshotCodec<T>::write(out, item, varint);
+    }
+    static void readValue(SnapshotCursor& in, value_type& value, bool varint) {
+        uint64_t length = in.getVarint();
+        // Значение занимает хотя бы байт: длина больше остатка блока — повреждение
+        if (length == 0 || length > in.remaining())
+            SnapshotCursor::corrupt();
+        value.second.resize(static_cast<size_t>(length));
+        for (T& item : value.second)
+            SnapshotCodec<T>::read(in, item, varint);
+    }
+};
+
+// Потоковая запись снимка: заголовок сразу, элементы — блоками по kSnapshotBlockSize.
+// Число элементов известно заранее: по нему загрузка строит дерево, не собирая элементы в память
+template <typename Entry>
+class SnapshotWriter {
+public:
+    using Element = SnapshotEntry<Entry>;
+    using value_type = typename Element::value_type;
+    using key_type = typename std::decay<decltype(Element::key(std::declval<const value_type&>()))>::type;
+
+    SnapshotWriter(std::ostream& out, uint64_t count, SnapshotEncoding encoding)
+        : out(out), count(count), written(0), blockItems(0), previous(0),
+          varint(encoding == SnapshotEncoding::Compact) {
+        SnapshotBuffer header;
+        header.put("TSNP", 4);
+        header.putFixed(kSnapshotVersion, 2);
+        header.putFixed(varint ? kSnapshotVarint : 0, 2);
+        header.putFixed(SnapshotCodec<key_type>::kTag, 4);
+        header.putFixed(Element::kValueTag, 4);
+        header.putFixed(count, 8);
+        header.putFixed(snapshotCrc(header.data(), header.size()), 4);
+        emit(header.data(), header.size());
+        block.reserve(kSnapshotBlockSize + 64);
+    }
+
+    void write(const value_type& value) {
+        if (written == count)
+            throw std::logic_error("SnapshotWriter: элементов больше, чем объявлено");
+        const key_type& key = Element::key(value);
+        if constexpr (std::is_integral<key_type>::value) {
+            if (varint) {
+                uint64_t bits = SnapshotCodec<key_type>::toBits(key);
+                block.putVarint(zigzagEncode(static_cast<int64_t>(bits - previous)));
+                previous = bits;
+            }
+            else {
+                SnapshotCodec<key_type>::write(block, key, false);
+            }
+        }
+        else {
+            SnapshotCodec<key_type>::write(block, key, varint);
+        }
+        Element::writeValue(block, value, varint);
+        ++written;
+        ++blockItems;
+        if (block.size() >= kSnapshotBlockSize)
+            flushBlock();
+    }
+
+    // Последний блок и признак конца; после finish снимок полон
+    void finish() {
+        if (written != count)
+            throw std::logic_error("SnapshotWriter: элементов меньше, чем объявлено");
+        flushBlock();
+        SnapshotBuffer end;
+        end.putFixed(0, 4);
+        end.putFixed(0, 4);
+        emit(end.data(), end.size());
+        out.flush();
+        if (!out)
+            throw std::runtime_error("Snapshot: ошибка записи");
+    }
+
+private:
+    std::ostream& out;
+    uint64_t count;
+    uint64_t written;
+    uint32_t blockItems;
+    uint64_t previous;  // Биты предыдущего ключа для разностей
+    bool varint;
+    SnapshotBuffer block;
+
+    void flushBlock() {
+        if (blockItems == 0)
+            return;
+        SnapshotBuffer frame;
+        frame.putFixed(block.size(), 4);
+        frame.putFixed(blockItems, 4);
+        emit(frame.data(), frame.size());
+        emit(block.data(), block.size());
+        frame.clear();
+        frame.putFixed(snapshotCrc(block.data(), block.size()), 4);
+        emit(frame.data(), frame.size());
+        block.clear();
+        blockItems = 0;
+    }
+    void emit(const unsigned char* data, size_t length) {
+        out.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(length));
+        if (!out)
+            throw std::runtime_error("Snapshot: ошибка записи");
+    }
+};
+
+// Потоковое чтение снимка. Заголовок проверяется в конструкторе; элементы выдает однопроходный
+// итератор begin(), ровно size() штук, — этого достаточно buildFromSorted. Порядок проверяется
+// компаратором дерева (unique — строго по возрастанию), иначе поврежденный, но с верной суммой
+// снимок дал бы неверное дерево. После сборки finish() проверяет признак конца
+template <typename Entry, typename Compare>
+class SnapshotReader {
+public:
+    using Element = SnapshotEntry<Entry>;
+    using value_type = typename Element::value_type;
+    using key_type = typename std::decay<decltype(Element::key(std::declval<const value_type&>()))>::type;
+
+    class Iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = typename Element::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const value_type*;
+        using reference = const value_type&;
+
+        explicit Iterator(SnapshotReader* reader) : reader(reader) {}
+
+        reference operator*() const { return reader->current(); }
+        pointer operator->() const { return &reader->current(); }
+        Iterator& operator++() {
+            reader->advance();
+            return *this;
+        }
+
+    private:
+        SnapshotReader* reader;
+    };
+
+    SnapshotReader(std::istream& in, const Compare& comp, bool unique)
+        : in(in), comp(comp), unique(unique), decoded(0), blockItems(0), previous(0), slot(0) {
+        unsigned char header[kSnapshotHeaderSize];
+        take(header, sizeof(header));
+        SnapshotCursor cursor(header, sizeof(header));
+        char magic[4];
+        cursor.get(magic, 4);
+        if (std::memcmp(magic, "TSNP", 4) != 0)
+            throw std::runtime_error("Snapshot: это не снимок дерева");
+        uint64_t version = cursor.getFixed(2);
+        uint64_t flags = cursor.getFixed(2);
+        uint64_t keyTag = cursor.getFixed(4);
+        uint64_t valueTag = cursor.getFixed(4);
+        count = cursor.getFixed(8);
+        if (cursor.getFixed(4) != snapshotCrc(header, kSnapshotHeaderSize - 4))
+            throw std::runtime_error("Snapshot: заголовок поврежден");
+        if (version != kSnapshotVersion || (flags & ~uint64_t(kSnapshotVarint)) != 0)
+            throw std::runtime_error("Snapshot: неподдерживаемая версия формата");
+        if (keyTag != SnapshotCodec<key_type>::kTag || valueTag != Element::kValueTag)
+            throw std::runtime_error("Snapshot: типы элементов снимка и дерева не совпадают");
+        varint = (flags & kSnapshotVarint) != 0;
+        if (count > std::numeric_limits<size_t>::max() / 2 || count > remainingBytes())
+            throw std::runtime_error("Snapshot: неверное число элементов в заголовке");
+    }
+
+    size_t size() const { return static_cast<size_t>(count); }
+
+    // Итератор на первый элемент; вызывается один раз
+    Iterator begin() {
+        if (count != 0)
+            decodeNext();
+        return Iterator(this);
+    }
+
+    // Все элементы прочитаны, дальше — признак конца снимка
+    void finish() {
+        if (decoded != count || blockItems != 0 || !cursor.atEnd())
+            throw std::runtime_error("Snapshot: прочитаны не все элементы");
+        if (readBlock())
+            throw std::runtime_error("Snapshot: лишние данные после элементов");
+    }
+
+private:
+    std::istream& in;
+    Compare comp;
+    bool unique;
+    bool varint;
+    uint64_t count;
+    uint64_t decoded;
+    uint32_t blockItems;  // Элементов, еще не прочитанных из текущего блока
+    uint64_t previous;    // Биты предыдущего ключа для разностей
+    std::vector<unsigned char> block;
+    SnapshotCursor cursor;
+    // Текущий и предыдущий элементы по очереди: предыдущий нужен для проверки порядка,
+    // а повторное использование слотов не перевыделяет память строк
+    value_type slots[2];
+    int slot;
+
+    const value_type& current() const { return slots[slot]; }
+
+    void advance() {
+        if (decoded < count)
+            decodeNext();
+    }
+
+    void decodeNext() {
+        if (blockItems == 0) {
+            if (!cursor.atEnd())
+                SnapshotCursor::corrupt();
+            if (!readBlock())
+                throw std::runtime_error("Snapshot: снимок оборван");
+        }
+        int next = decoded == 0 ? slot : 1 - slot;
+        value_type& value = slots[next];
+        key_type& key = Element::key(value);
+        if constexpr (std::is_integral<key_type>::value) {
+            if (varint) {
+                uint64_t bits = previous + static_cast<uint64_t>(zigzagDecode(cursor.getVarint()));
+                key = SnapshotCodec<key_type>::fromBits(bits);
+                if (SnapshotCodec<key_type>::toBits(key) != bits)
+                    SnapshotCursor::corrupt();
+                previous = bits;
+            }
+            else {
+                SnapshotCodec<key_type>::read(cursor, key, false);
+            }
+        }
+        else {
+            SnapshotCodec<key_type>::read(cursor, key, varint);
+        }
+        Element::readValue(cursor, value, varint);
+        if (decoded != 0) {
+            const key_type& before = Element::key(slots[slot]);
+            if (unique ? !comp(before, key) : comp(key, before))
+                throw std::runtime_error("Snapshot: элементы снимка не упорядочены");
+        }
+        slot = next;
+        ++decoded;
+        --blockItems;
+    }
+
+    // Следующий блок в block; false — признак конца снимка
+    bool readBlock() {
+        unsigned char frame[8];
+        take(frame, sizeof(frame));
+        SnapshotCursor sizes(frame, sizeof(frame));
+        size_t length = static_cast<size_t>(sizes.getFixed(4));
+        uint32_t items = static_cast<uint32_t>(sizes.getFixed(4));
+        if (length == 0 && items == 0)
+            return false;
+        if (length == 0 || items == 0 || length > kSnapshotMaxBlock)
+            SnapshotCursor::corrupt();
+        block.resize(length);
+        take(block.data(), length);
+        unsigned char crc[4];
+        take(crc, sizeof(crc));
+        if (SnapshotCursor(crc, sizeof(crc)).getFixed(4) != snapshotCrc(block.data(), length))
+            throw std::runtime_error("Snapshot: контрольная сумма блока не совпадает");
+        cursor = SnapshotCursor(block.data(), length);
+        blockItems = items;
+        return true;
+    }
+    void take(unsigned char* data, size_t length) {
+        in.read(reinterpret_cast<char*>(data), static_cast<std::streamsize>(length));
+        if (static_cast<size_t>(in.gcount()) != length)
+            throw std::runtime_error("Snapshot: неожиданный конец снимка");
+    }
+    // Байт от текущей позиции до конца потока; без позиционирования — наибольшее значение
+    uint64_t remainingBytes() {
+        const uint64_t unknown = std::numeric_limits<uint64_t>::max();
+        std::istream::pos_type here = in.tellg();
+        if (here == std::istream::pos_type(-1))
+            return unknown;
+        in.seekg(0, std::ios::end);
+        std::istream::pos_type end = in.tellg();
+        in.clear();
+        in.seekg(here);
+        if (end == std::istream::pos_type(-1) || !in)
+            return unknown;
+        return static_cast<uint64_t>(end - here);
+    }
+};
+
+// Снимок элементов [first, last) — их ровно count, по возрастанию
+template <typename Entry, typename It>
+void saveSnapshot(std::ostream& out, It first, It last, uint64_t count, SnapshotEncoding encoding) {
+    SnapshotWriter<Entry> writer(out, count, encoding);
+    for (; first != last; ++first)
+        writer.write(*first);
+    writer.finish();
+}
@@ -0,0 +1,182 @@
+﻿#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+// Счетчики горячего пути деревьев: сравнения, пройденные узлы, повороты по случаям, перекраски,
+// деления и слияния узлов, гистограмма глубины спусков. Включаются макросом TREE_STATS,
+// который задается для всей программы (например, /DTREE_STATS или -DTREE_STATS); без него
+// все вызовы счетчиков — пустые встроенные функции и исчезают при компиляции.
+// Счетчики живут в дереве. Поиск константный и может идти из нескольких потоков сразу,
+// поэтому значения — атомарные, но увеличиваются не атомарной операцией, а чтением и записью
+// (без блокировки шины): при одновременных поисках часть приращений теряется, зато включенные
+// счетчики почти не замедляют дерево
+
+// Случай поворота при балансировке: с какой стороны перевес у узла и у его потомка.
+// LL и RR — одиночный поворот, LR и RL — двойной
+enum class RotationCase { LL, LR, RL, RR };
+
+// Гистограмма глубины: спусков, прошедших d узлов; последняя ячейка — d и больше
+constexpr int kStatsMaxDepth = 64;
+
+// Снимок счетчиков дерева
+struct TreeStats {
+    bool enabled = false;          // Собрана ли программа с TREE_STATS; иначе все нули
+    uint64_t comparisons = 0;      // Вызовов компаратора на спусках
+    uint64_t nodesVisited = 0;     // Узлов, пройденных спусками
+    uint64_t rotations[4] = {};    // Балансировок по случаям RotationCase
+    uint64_t recolorings = 0;      // Перекрашенных узлов (красно-черное дерево)
+    uint64_t splits = 0;           // Делений узлов (B-дерево)
+    uint64_t merges = 0;           // Слияний узлов (B-дерево)
+    uint64_t borrows = 0;          // Заемов ключа у соседа (B-дерево)
+    int height = 0;                // Высота дерева в момент снимка
+    uint64_t depthHistogram[kStatsMaxDepth] = {};
+
+    uint64_t descents() const {
+        uint64_t total = 0;
+        for (uint64_t count : depthHistogram)
+            total += count;
+        return total;
+    }
+    uint64_t totalRotations() const { return rotations[0] + rotations[1] + rotations[2] + rotations[3]; }
+    double meanDepth() const {
+        uint64_t total = descents();
+        return total != 0 ? static_cast<double>(nodesVisited) / total : 0.0;
+    }
+};
+
+inline void writeJson(std::ostream& out, const TreeStats& stats) {
+    static const char* const kCaseNames[4] = { "ll", "lr", "rl", "rr" };
+    out << "{\"enabled\": " << (stats.enabled ? "true" : "false") << ", \"comparisons\": " << stats.comparisons
+        << ", \"nodes_visited\": " << stats.nodesVisited << ", \"descents\": " << stats.descents()
+        << ", \"mean_depth\": " << stats.meanDepth() << ", \"rotations\": {";
+    for (int i = 0; i < 4; ++i)
+        out << (i > 0 ? ", " : "") << '"' << kCaseNames[i] << "\": " << stats.rotations[i];
+    out << "}, \"recolorings\": " << stats.recolorings << ", \"splits\": " << stats.splits
+        << ", \"merges\": " << stats.merges << ", \"borrows\": " << stats.borrows << ", \"height\": " << stats.height
+        << ", \"depth_histogram\": [";
+    // Хвост из нулей не пишется
+    int used = kStatsMaxDepth;
+    while (used > 0 && stats.depthHistogram[used - 1] == 0)
+        --used;
+    for (int i = 0; i < used; ++i)
+        out << (i > 0 ? ", " : "") << stats.depthHistogram[i];
+    out << "]}";
+}
+
+#ifdef TREE_STATS
+
+// Счетчики одного дерева
+class TreeCounters {
+public:
+    static constexpr bool kEnabled = true;
+
+    void compare(uint64_t count = 1) { bump(comparisons, count); }
+    void rotation(RotationCase kind) { bump(rotations[static_cast<int>(kind)], 1); }
+    void recolor(uint64_t count = 1) { bump(recolorings, count); }
+    void split() { bump(splits, 1); }
+    void merge() { bump(merges, 1); }
+    void borrow() { bump(borrows, 1); }
+    // Спуск закончился, пройдя depth узлов
+    void descent(int depth) {
+        bump(nodesVisited, depth);
+        bump(depthHistogram[depth < kStatsMaxDepth ? depth : kStatsMaxDepth - 1], 1);
+    }
+
+    TreeStats snapshot(int height) const {
+        TreeStats stats;
+        stats.enabled = true;
+        stats.comparisons = comparisons.load(std::memory_order_relaxed);
+        stats.nodesVisited = nodesVisited.load(std::memory_order_relaxed);
+        for (int i = 0; i < 4; ++i)
+            stats.rotations[i] = rotations[i].load(std::memory_order_relaxed);
+        stats.recolorings = recolorings.load(std::memory_order_relaxed);
+        stats.splits = splits.load(std::memory_order_relaxed);
+        stats.merges = merges.load(std::memory_order_relaxed);
+        stats.borrows = borrows.load(std::memory_order_relaxed);
+        stats.height = height;
+        for (int i = 0; i < kStatsMaxDepth; ++i)
+            stats.depthHistogram[i] = depthHistogram[i].load(std::memory_order_relaxed);
+        return stats;
+    }
+    void reset() {
+        for (std::atomic<uint64_t>* counter : { &comparisons, &nodesVisited, &recolorings, &splits, &merges, &borrows })
+            counter->store(0, std::memory_order_relaxed);
+        for (std::atomic<uint64_t>& counter : rotations)
+            counter.store(0, std::memory_order_relaxed);
+        for (std::atomic<uint64_t>& counter : depthHistogram)
+            counter.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> comparisons{ 0 };
+    std::atomic<uint64_t> nodesVisited{ 0 };
+    std::atomic<uint64_t> rotations[4] = {};
+    std::atomic<uint64_t> recolorings{ 0 };
+    std::atomic<uint64_t> splits{ 0 };
+    std::atomic<uint64_t> merges{ 0 };
+    std::atomic<uint64_t> borrows{ 0 };
+    std::atomic<uint64_t> depthHistogram[kStatsMaxDepth] = {};
+
+    static void bump(std::atomic<uint64_t>& counter, uint64_t count) {
+        counter.store(counter.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+    }
+};
+
+// Один спуск от корня: узлы и сравнения копятся в локальных переменных
+// и попадают в счетчики дерева одним разом, при выходе из спуска
+class TreeDescent {
+public:
+    explicit TreeDescent(TreeCounters& counters) : counters(counters), depth(0), comparisons(0) {}
+    ~TreeDescent() {
+        counters.compare(comparisons);
+        counters.descent(depth);
+    }
+    TreeDescent(const TreeDescent&) = delete;
+    TreeDescent& operator=(const TreeDescent&) = delete;
+
+    void visit() { ++depth; }
+    template <typename Compare, typename A, typename B>
+    bool less(const Compare& comp, const A& a, const B& b) {
+        ++comparisons;
+        return comp(a, b);
+    }
+
+private:
+    TreeCounters& counters;
+    int depth;
+    uint64_t comparisons;
+};
+
+#else
+
+class TreeCounters {
+public:
+    static constexpr bool kEnabled = false;
+
+    void compare(uint64_t = 1) {}
+    void rotation(RotationCase) {}
+    void recolor(uint64_t = 1) {}
+    void split() {}
+    void merge() {}
+    void borrow() {}
+    void descent(int) {}
+    TreeStats snapshot(int) const { return TreeStats(); }
+    void reset() {}
+};
+
+class TreeDescent {
+public:
+    explicit TreeDescent(TreeCounters&) {}
+    TreeDescent(const TreeDescent&) = delete;
+    TreeDescent& operator=(const TreeDescent&) = delete;
+
+    void visit() {}
+    template <typename Compare, typename A, typename B>
+    bool less(const Compare& comp, const A& a, const B& b) {
+        return comp(a, b);
+    }
+};
+
+#endif
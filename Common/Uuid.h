@@ -0,0 +1,47 @@
+﻿#pragma once
+#include <cstdint>
+#include <ostream>
+
+// 16-байтный UUID как ключ дерева. Хранится двумя 64-битными половинами: high — первые 8 байт
+// в порядке RFC 4122 (big-endian), low — последние, поэтому сравнение половин как чисел совпадает
+// с побайтным сравнением UUID. Поиск в узле B-дерева сравнивает такие ключи без ветвлений
+// (BTreeNodeSearch в Btree.h)
+struct Uuid {
+    uint64_t high = 0;
+    uint64_t low = 0;
+
+    Uuid() = default;
+    Uuid(uint64_t high, uint64_t low) : high(high), low(low) {}
+
+    static Uuid fromBytes(const unsigned char (&bytes)[16]) {
+        Uuid id;
+        for (int i = 0; i < 8; ++i) {
+            id.high = id.high << 8 | bytes[i];
+            id.low = id.low << 8 | bytes[8 + i];
+        }
+        return id;
+    }
+    void toBytes(unsigned char (&bytes)[16]) const {
+        for (int i = 0; i < 8; ++i) {
+            bytes[i] = static_cast<unsigned char>(high >> (56 - 8 * i));
+            bytes[8 + i] = static_cast<unsigned char>(low >> (56 - 8 * i));
+        }
+    }
+
+    friend bool operator<(const Uuid& a, const Uuid& b) { return a.high < b.high || (a.high == b.high && a.low < b.low); }
+    friend bool operator==(const Uuid& a, const Uuid& b) { return a.high == b.high && a.low == b.low; }
+    friend bool operator!=(const Uuid& a, const Uuid& b) { return !(a == b); }
+
+    // Каноническая запись 8-4-4-4-12 шестнадцатеричными цифрами
+    friend std::ostream& operator<<(std::ostream& out, const Uuid& id) {
+        static const char digits[] = "0123456789abcdef";
+        unsigned char bytes[16];
+        id.toBytes(bytes);
+        for (int i = 0; i < 16; ++i) {
+            if (i == 4 || i == 6 || i == 8 || i == 10)
+                out << '-';
+            out << digits[bytes[i] >> 4] << digits[bytes[i] & 0xF];
+        }
+        return out;
+    }
+};
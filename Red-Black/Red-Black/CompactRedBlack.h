@@ -0,0 +1,312 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include "../../Common/BulkBuild.h"
+#include "../../Common/IndexPool.h"
+#include "../../Common/Snapshot.h"
+
+// Узел компактного красно-черного дерева: ключ и две 32-битные ссылки.
+// Цвет — признак левой ссылки (установлен — красный); пустая ссылка ведет на черную заглушку пула
+template <typename Key>
+struct CompactRBNode {
+    Key key;
+    PackedLink child[2];  // Левый и правый потомки
+
+    CompactRBNode() : key() {}
+    explicit CompactRBNode(const Key& key) : key(key) {}
+    explicit CompactRBNode(Key&& key) : key(std::move(key)) {}
+
+    bool red() const { return child[0].flag(); }
+    void setRed(bool red) { child[0].setFlag(red); }
+};
+
+// Красно-черное дерево (множество уникальных ключей) в компактном виде: узлы лежат в одном векторе
+// (IndexPool.h) и связаны 32-битными номерами, цвет упакован в ссылку, ссылки на родителя нет —
+// балансировка после вставки и удаления идет снизу вверх по пути, запомненному при спуске.
+// Узел с ключом int занимает 12 байт против 48 у RedBlackTree. Итератор однонаправленный,
+// порядковых статистик нет. Не больше 2^31 - 1 элементов
+template <typename Key = int, typename Compare = std::less<Key>>
+class CompactRedBlackTree {
+public:
+    using key_type = Key;
+    using Node = CompactRBNode<Key>;
+    using Index = typename IndexPool<Node>::Index;
+
+    // Высота красно-черного дерева из n узлов не больше 2 * log2(n + 1): для 2^31 узлов это 62;
+    // еще уровень нужен удалению, которое поворотом опускает родителя
+    static constexpr int kMaxHeight = 64;
+
+    using Iterator = IndexTreeIterator<Node, kMaxHeight>;
+
+    explicit CompactRedBlackTree(const Compare& comp = Compare()) : root(kNull), size_(0), comp(comp) {}
+    CompactRedBlackTree(const CompactRedBlackTree&) = delete;
+    CompactRedBlackTree& operator=(const CompactRedBlackTree&) = delete;
+
+    Iterator begin() const { return Iterator(&pool, root); }
+    Iterator end() const { return Iterator(); }
+    size_t size() const { return size_; }
+    const Compare& keyComp() const { return comp; }
+
+    // Память под count узлов заранее
+    void reserve(size_t count) { pool.reserve(count); }
+    // Байт, занятых узлами
+    size_t memoryUsage() const { return pool.memoryUsage(); }
+
+    // Поиск ключа
+    template <typename K>
+    bool contains(const K& key) const {
+        Index node = root;
+        while (node != kNull) {
+            const Node& current = pool[node];
+            if (comp(key, current.key))
+                node = current.child[0].index();
+            else if (comp(current.key, key))
+                node = current.child[1].index();
+            else
+                return true;
+        }
+        return false;
+    }
+
+    // Вставка ключа; возвращает false, если он уже есть
+    bool insert(const Key& key) {
+        Index path[kMaxHeight];
+        unsigned char dirs[kMaxHeight];  // Сторона, в которую шли из path[i]
+        int depth = 0;
+        for (Index node = root; node != kNull; ++depth) {
+            const Node& current = pool[node];
+            int dir;
+            if (comp(key, current.key))
+                dir = 0;
+            else if (comp(current.key, key))
+                dir = 1;
+            else
+                return false;
+            path[depth] = node;
+            dirs[depth] = static_cast<unsigned char>(dir);
+            node = current.child[dir].index();
+        }
+        Index fresh = pool.create(key);
+        ++size_;
+        pool[fresh].setRed(true);
+        relink(path, dirs, depth, fresh);
+
+        // Красный под красным: поднимаемся, пока родитель x красный (красный родитель — не корень,
+        // поэтому дед есть). i — уровень x, path[i - 1] — родитель, path[i - 2] — дед
+        for (int i = depth; i >= 2 && pool[path[i - 1]].red();) {
+            Index parent = path[i - 1];
+            Index grand = path[i - 2];
+            int side = dirs[i - 2];  // С какой стороны деда родитель
+            Index uncle = pool[grand].child[1 - side].index();
+            if (pool[uncle].red()) {
+                // Красный дядя: перекраска, нарушение поднимается к деду
+                pool[parent].setRed(false);
+                pool[uncle].setRed(false);
+                pool[grand].setRed(true);
+                i -= 2;
+                continue;
+            }
+            // Черный дядя: x с внутренней стороны сначала поворотом выводится наружу,
+            // затем поворот вокруг деда поднимает середину тройки
+            if (dirs[i - 1] != side)
+                pool[grand].child[side].setIndex(rotateIndex(pool, parent, side));
+            Index top = rotateIndex(pool, grand, 1 - side);
+            pool[top].setRed(false);
+            pool[grand].setRed(true);
+            relink(path, dirs, i - 2, top);
+            break;
+        }
+        pool[root].setRed(false);
+        return true;
+    }
+
+    // Удаление ключа; возвращает false, если его нет
+    template <typename K>
+    bool erase(const K& key) {
+        Index path[kMaxHeight];
+        unsigned char dirs[kMaxHeight];
+        int depth = 0;
+        Index node = root;
+        while (node != kNull) {
+            const Node& current = pool[node];
+            int dir;
+            if (comp(key, current.key))
+                dir = 0;
+            else if (comp(current.key, key))
+                dir = 1;
+            else
+                break;
+            path[depth] = node;
+            dirs[depth++] = static_cast<unsigned char>(dir);
+            node = current.child[dir].index();
+        }
+        if (node == kNull)
+            return false;
+
+        if (pool[node].child[0].index() != kNull && pool[node].child[1].index() != kNull) {
+            // Два потомка: сюда переносится следующий по порядку ключ, удаляется его узел
+            Index target = node;
+            path[depth] = node;
+            dirs[depth++] = 1;
+            node = pool[node].child[1].index();
+            while (pool[node].child[0].index() != kNull) {
+                path[depth] = node;
+                dirs[depth++] = 0;
+                node = pool[node].child[0].index();
+            }
+            pool[target].key = std::move(pool[node].key);
+        }
+        // У удаляемого узла не больше одного потомка: он и занимает место узла
+        Index left = pool[node].child[0].index();
+        Index child = left != kNull ? left : pool[node].child[1].index();
+        bool removedRed = pool[node].red();
+        relink(path, dirs, depth, child);
+        pool.destroy(node);
+        --size_;
+
+        // Ушел черный узел: его путь стал короче на черный. Красный потомок просто чернеет,
+        // иначе «двойная чернота» поднимается вверх
+        if (!removedRed) {
+            if (pool[child].red())
+                pool[child].setRed(false);
+            else
+                eraseFix(path, dirs, depth, child);
+        }
+        return true;
+    }
+
+    // Удаление всех узлов: память пула отдается целиком, без обхода
+    void clear() {
+        pool.release();
+        root = kNull;
+        size_ = 0;
+    }
+
+    // Замена содержимого ключами из [first, last), отсортированными по возрастанию без повторов.
+    // Дерево строится идеально сбалансированным за O(n): все уровни, кроме последнего, черные,
+    // узлы неполного последнего уровня красные
+    template <typename ForwardIt>
+    void buildFromSorted(ForwardIt first, ForwardIt last) {
+        buildCounted(first, std::distance(first, last));
+    }
+
+    // Снимок дерева в поток (формат — в Snapshot.h)
+    void save(std::ostream& out, SnapshotEncoding encoding = SnapshotEncoding::Compact) const {
+        saveSnapshot<SetEntry<Key>>(out, begin(), end(), size_, encoding);
+    }
+    // Замена содержимого снимком из потока; при ошибке исключение, дерево остается пустым
+    void load(std::istream& in) {
+        try {
+            SnapshotReader<SetEntry<Key>, Compare> reader(in, comp, true);
+            buildCounted(reader.begin(), reader.size());
+            reader.finish();
+        }
+        catch (...) {
+            clear();
+            throw;
+        }
+    }
+
+private:
+    static constexpr Index kNull = IndexPool<Node>::kNull;
+
+    IndexPool<Node> pool;
+    Index root;
+    size_t size_;
+    Compare comp;
+
+    // Поддерево, висевшее под path[level - 1] (или корень при level == 0), заменяется на node
+    void relink(const Index* path, const unsigned char* dirs, int level, Index node) {
+        if (level == 0)
+            root = node;
+        else
+            pool[path[level - 1]].child[dirs[level - 1]].setIndex(node);
+    }
+
+    // Исправление «двойной черноты» x на уровне level (x может быть пустой ссылкой).
+    // Путь меняется на месте: поворот с красным братом опускает родителя на уровень
+    void eraseFix(Index* path, unsigned char* dirs, int level, Index x) {
+        while (level > 0 && !pool[x].red()) {
+            Index parent = path[level - 1];
+            int side = dirs[level - 1];  // С какой стороны родителя x
+            Index sibling = pool[parent].child[1 - side].index();
+            if (pool[sibling].red()) {
+                // Красный брат поднимается над родителем; новый брат x черный
+                pool[sibling].setRed(false);
+                pool[parent].setRed(true);
+                relink(path, dirs, level - 1, rotateIndex(pool, parent, side));
+                path[level - 1] = sibling;
+                path[level] = parent;
+                dirs[level] = static_cast<unsigned char>(side);
+                ++level;
+                sibling = pool[parent].child[1 - side].index();
+            }
+            Index nearChild = pool[sibling].child[side].index();
+            Index farChild = pool[sibling].child[1 - side].index();
+            if (!pool[nearChild].red() && !pool[farChild].red()) {
+                // Оба племянника черные: брат краснеет, недостача переходит к родителю
+                pool[sibling].setRed(true);
+                x = parent;
+                --level;
+                continue;
+            }
+            if (!pool[farChild].red()) {
+                // Красный только ближний племянник: поворот брата делает красным дальнего
+                pool[nearChild].setRed(false);
+                pool[sibling].setRed(true);
+                sibling = rotateIndex(pool, sibling, 1 - side);
+                pool[parent].child[1 - side].setIndex(sibling);
+                farChild = pool[sibling].child[1 - side].index();
+            }
+            // Красный дальний племянник: поворот вокруг родителя возвращает черную высоту
+            pool[sibling].setRed(pool[parent].red());
+            pool[parent].setRed(false);
+            pool[farChild].setRed(false);
+            relink(path, dirs, level - 1, rotateIndex(pool, parent, side));
+            x = root;
+            break;
+        }
+        if (x != kNull)
+            pool[x].setRed(false);
+    }
+
+    // Глубина, узлы которой красятся в красный при построении из count ключей (как в RedBlackTree)
+    static int redDepth(size_t count) {
+        int depth = balancedHeight(count) - 1;
+        return depth > 0 ? depth : -1;
+    }
+
+    // Замена содержимого count ключами, читаемыми по порядку с it: хватает однопроходного итератора
+    template <typename InputIt>
+    void buildCounted(InputIt it, size_t count) {
+        clear();
+        try {
+            pool.reserve(count);
+            root = buildBalanced(it, count, 0, redDepth(count));
+        }
+        catch (...) {
+            clear();
+            throw;
+        }
+        size_ = count;
+    }
+    // Сбалансированное поддерево из count ключей с корнем на глубине depth
+    template <typename It>
+    Index buildBalanced(It& it, size_t count, int depth, int red) {
+        if (count == 0)
+            return kNull;
+        size_t leftCount = count / 2;
+        Index left = buildBalanced(it, leftCount, depth + 1, red);
+        Index node = pool.create(*it);
+        ++it;
+        Index right = buildBalanced(it, count - leftCount - 1, depth + 1, red);
+        Node& current = pool[node];
+        current.child[0].setIndex(left);
+        current.child[1].setIndex(right);
+        current.setRed(depth == red);
+        return node;
+    }
+};
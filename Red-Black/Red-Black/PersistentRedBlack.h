@@ -0,0 +1,181 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include "../../Common/BulkBuild.h"
+#include "../../Common/PersistentTree.h"
+
+// Узел персистентного красно-черного дерева: общая часть (PersistentTree.h) и цвет.
+// Пустой потомок (nullptr) считается черным
+template <typename Key>
+struct PersistentRBNode : PersistentNodeBase<PersistentRBNode<Key>, Key> {
+    using Base = PersistentNodeBase<PersistentRBNode<Key>, Key>;
+
+    bool red;
+
+    PersistentRBNode(const Key& key, uint64_t stamp) : Base(key, stamp), red(true) {}
+    PersistentRBNode(const PersistentRBNode& other, uint64_t stamp) : Base(other, stamp), red(other.red) {}
+};
+
+// Балансировка красно-черного дерева для PersistentTree. Ссылок на родителя нет (узел
+// делят несколько версий), поэтому, как в CompactRedBlackTree, исправление идет снизу вверх
+// по пути, запомненному при спуске. Путь — ссылки на узлы в их родителях: все узлы пути
+// скопированы, и ссылки остаются на месте, даже когда повороты меняют, какой узел под ними висит.
+// Перекрашиваемые и поворачиваемые соседи пути копируются перед изменением
+template <typename Key, typename Compare>
+struct PersistentRedBlackBalance {
+    using Node = PersistentRBNode<Key>;
+    using Copier = PathCopier<Node>;
+
+    // Высота красно-черного дерева из n узлов не больше 2 * log2(n + 1), то есть 128 для 64-битного n;
+    // еще уровень нужен удалению, которое поворотом опускает родителя
+    static constexpr int kMaxHeight = 130;
+
+    // Вставка ключа, которого в дереве нет
+    static void insert(Copier& copier, Node*& root, const Key& key, const Compare& comp) {
+        Node** slots[kMaxHeight];  // slots[i] — ссылка на узел уровня i
+        int depth = 0;
+        Node** slot = &root;
+        while (*slot != nullptr) {
+            Node* node = copier.own(*slot);
+            slots[depth++] = slot;
+            slot = &node->child[comp(node->key, key) ? 1 : 0];
+        }
+        *slot = copier.create(key);
+        slots[depth] = slot;
+
+        // Красный под красным: поднимаемся, пока родитель x (уровень i) красный;
+        // красный родитель — не корень, поэтому дед есть
+        for (int i = depth; i >= 2 && (*slots[i - 1])->red;) {
+            Node* parent = *slots[i - 1];
+            Node* grand = *slots[i - 2];
+            int side = slots[i - 1] == &grand->child[1] ? 1 : 0;  // С какой стороны деда родитель
+            if (isRed(grand->child[1 - side])) {
+                // Красный дядя: перекраска, нарушение поднимается к деду
+                parent->red = false;
+                copier.own(grand->child[1 - side])->red = false;
+                grand->red = true;
+                i -= 2;
+                continue;
+            }
+            // Черный дядя: x с внутренней стороны сначала поворотом выводится наружу,
+            // затем поворот вокруг деда поднимает середину тройки
+            if (slots[i] != &parent->child[side])
+                copier.rotate(grand->child[side], side);
+            Node* top = copier.rotate(*slots[i - 2], 1 - side);
+            top->red = false;
+            grand->red = true;
+            break;
+        }
+        root->red = false;
+    }
+
+    // Удаление ключа, который в дереве есть
+    template <typename K>
+    static void erase(Copier& copier, Node*& root, const K& key, const Compare& comp) {
+        Node** slots[kMaxHeight];
+        int depth = 0;
+        Node** slot = &root;
+        Node* node;
+        for (;;) {
+            node = copier.own(*slot);
+            slots[depth] = slot;
+            if (comp(key, node->key))
+                slot = &node->child[0];
+            else if (comp(node->key, key))
+                slot = &node->child[1];
+            else
+                break;
+            ++depth;
+        }
+        if (node->child[0] != nullptr && node->child[1] != nullptr) {
+            // Два потомка: сюда переносится следующий по порядку ключ, удаляется его узел
+            Node* target = node;
+            slot = &node->child[1];
+            for (;;) {
+                node = copier.own(*slot);
+                slots[++depth] = slot;
+                if (node->child[0] == nullptr)
+                    break;
+                slot = &node->child[0];
+            }
+            target->key = std::move(node->key);  // Узел — копия этой транзакции
+        }
+        // У удаляемого узла не больше одного потомка: он и занимает место узла
+        bool removedRed = node->red;
+        copier.unlink(*slots[depth], node->child[0] != nullptr ? 0 : 1);
+
+        // Ушел черный узел: его путь стал короче на черный. Красный потомок просто чернеет,
+        // иначе «двойная чернота» поднимается вверх
+        if (!removedRed) {
+            if (isRed(*slots[depth]))
+                copier.own(*slots[depth])->red = false;
+            else
+                eraseFix(copier, slots, depth);
+        }
+        if (root != nullptr && root->red)
+            copier.own(root)->red = false;
+    }
+
+    // Разметка при сборке из отсортированного (как в RedBlackTree): все уровни, кроме последнего,
+    // черные, узлы неполного последнего уровня красные
+    struct BuildShape {
+        int red;
+
+        explicit BuildShape(size_t count) {
+            int depth = balancedHeight(count) - 1;
+            red = depth > 0 ? depth : -1;
+        }
+        void operator()(Node* node, int, int depth) const { node->red = depth == red; }
+    };
+
+private:
+    static bool isRed(const Node* node) { return node != nullptr && node->red; }
+
+    // Исправление «двойной черноты» узла уровня level (пустая ссылка тоже может быть x).
+    // Путь меняется на месте: поворот с красным братом опускает родителя на уровень
+    static void eraseFix(Copier& copier, Node** slots[], int level) {
+        while (level > 0 && !isRed(*slots[level])) {
+            Node* parent = *slots[level - 1];
+            int side = slots[level] == &parent->child[1] ? 1 : 0;  // С какой стороны родителя x
+            // У x двойная чернота, поэтому брат не пуст
+            Node* sibling = copier.own(parent->child[1 - side]);
+            if (sibling->red) {
+                // Красный брат поднимается над родителем; новый брат x черный
+                sibling->red = false;
+                parent->red = true;
+                copier.rotate(*slots[level - 1], side);
+                slots[level] = &sibling->child[side];
+                slots[level + 1] = &parent->child[side];
+                ++level;
+                sibling = copier.own(parent->child[1 - side]);
+            }
+            if (!isRed(sibling->child[side]) && !isRed(sibling->child[1 - side])) {
+                // Оба племянника черные: брат краснеет, недостача переходит к родителю
+                sibling->red = true;
+                --level;
+                continue;
+            }
+            if (!isRed(sibling->child[1 - side])) {
+                // Красный только ближний племянник: поворот брата делает красным дальнего
+                copier.own(sibling->child[side])->red = false;
+                sibling->red = true;
+                sibling = copier.rotate(parent->child[1 - side], 1 - side);
+            }
+            // Красный дальний племянник: поворот вокруг родителя возвращает черную высоту
+            sibling->red = parent->red;
+            parent->red = false;
+            copier.own(sibling->child[1 - side])->red = false;
+            copier.rotate(*slots[level - 1], side);
+            return;
+        }
+        if (*slots[level] != nullptr)
+            copier.own(*slots[level])->red = false;
+    }
+};
+
+// Персистентное красно-черное дерево (множество уникальных ключей):
+// читатели берут неизменяемую версию (version()) без блокировок, вставка и удаление копируют
+// путь и публикуют новую версию. Подробности — в PersistentTree.h
+template <typename Key = int, typename Compare = std::less<Key>>
+using PersistentRedBlackTree = PersistentTree<PersistentRedBlackBalance<Key, Compare>, Compare>;
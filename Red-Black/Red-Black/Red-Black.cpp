@@ -1,187 +1,16 @@
 ﻿#include <iostream>
 #include <cstdlib>   // Для генерации случайных чисел
-#include <chrono>    // Для замера времени
+#include <ctime>
+#include <stdexcept>
+#include "Red-Black.h"
 
 using namespace std;
-using namespace std::chrono;
-
-// Структура узла для красно-черного дерева
-struct Node {
-    int value;         // Значение узла
-    Node* left;        // Левый потомок
-    Node* right;       // Правый потомок
-    Node* parent;      // Родитель
-    bool isRed;        // Цвет узла: красный (true) или черный (false)
-
-    // Конструктор для создания узла
-    Node(int val) : value(val), left(nullptr), right(nullptr), parent(nullptr), isRed(true) {}
-};
-
-// Класс для красно-черного дерева
-class RedBlackTree {
-public:
-    RedBlackTree() : root(nullptr), TNULL(nullptr) {
-        TNULL = new Node(0);  // Лист пустой узел
-        TNULL->isRed = false;  // Лист всегда черный
-    }
-
-    // Вставка нового элемента в дерево
-    void insert(int key) {
-        Node* newNode = new Node(key);
-        newNode->left = TNULL;
-        newNode->right = TNULL;
-
-        // Стандартная вставка узла
-        Node* y = nullptr;
-        Node* x = root;
-
-        while (x != nullptr && x != TNULL) {
-            y = x;
-            if (newNode->value < x->value)
-                x = x->left;
-            else
-                x = x->right;
-        }
-
-        newNode->parent = y;
-        if (y == nullptr)
-            root = newNode;
-        else if (newNode->value < y->value)
-            y->left = newNode;
-        else
-            y->right = newNode;
-
-        // Балансировка дерева после вставки
-        insertFix(newNode);
-    }
-
-    // Поиск элемента в дереве
-    Node* search(Node* node, int key) {
-        if (node == nullptr || node == TNULL || node->value == key)
-            return node;
-
-        if (key < node->value)
-            return search(node->left, key);
-
-        return search(node->right, key);
-    }
-
-    // Функция для замера времени поиска
-    double measureSearchTime(Node* root, int key) {
-        auto start = high_resolution_clock::now();
-        search(root, key);  // Поиск элемента
-        auto end = high_resolution_clock::now();
-        auto duration = duration_cast<microseconds>(end - start);
-        return duration.count() / 1000000.0;  // Переводим в секунды
-    }
-
-    // Функция для вывода дерева в порядке возрастания
-    void printInOrder(Node* node) {
-        if (node != TNULL && node != nullptr) {
-            printInOrder(node->left);
-            cout << node->value << " ";
-            printInOrder(node->right);
-        }
-    }
-
-    // Публичный метод для получения корня дерева
-    Node* getRoot() {
-        return root;
-    }
-
-private:
-    Node* root;
-    Node* TNULL;  // Лист пустой узел
-
-    // Функция для балансировки дерева после вставки
-    void insertFix(Node* k) {
-        Node* u;
-        while (k->parent != nullptr && k->parent->isRed) {
-            if (k->parent == k->parent->parent->right) {
-                u = k->parent->parent->left;
-                if (u->isRed) {
-                    u->isRed = false;
-                    k->parent->isRed = false;
-                    k->parent->parent->isRed = true;
-                    k = k->parent->parent;
-                }
-                else {
-                    if (k == k->parent->left) {
-                        k = k->parent;
-                        rightRotate(k);
-                    }
-                    k->parent->isRed = false;
-                    k->parent->parent->isRed = true;
-                    leftRotate(k->parent->parent);
-                }
-            }
-            else {
-                u = k->parent->parent->right;
-                if (u->isRed) {
-                    u->isRed = false;
-                    k->parent->isRed = false;
-                    k->parent->parent->isRed = true;
-                    k = k->parent->parent;
-                }
-                else {
-                    if (k == k->parent->right) {
-                        k = k->parent;
-                        leftRotate(k);
-                    }
-                    k->parent->isRed = false;
-                    k->parent->parent->isRed = true;
-                    rightRotate(k->parent->parent);
-                }
-            }
-            if (k == root)
-                break;
-        }
-        root->isRed = false;  // Корень всегда черный
-    }
-
-    // Левый поворот
-    void leftRotate(Node* x) {
-        Node* y = x->right;
-        x->right = y->left;
-        if (y->left != TNULL)
-            y->left->parent = x;
-
-        y->parent = x->parent;
-        if (x->parent == nullptr)
-            root = y;
-        else if (x == x->parent->left)
-            x->parent->left = y;
-        else
-            x->parent->right = y;
-
-        y->left = x;
-        x->parent = y;
-    }
-
-    // Правый поворот
-    void rightRotate(Node* x) {
-        Node* y = x->left;
-        x->left = y->right;
-        if (y->right != TNULL)
-            y->right->parent = x;
-
-        y->parent = x->parent;
-        if (x->parent == nullptr)
-            root = y;
-        else if (x == x->parent->right)
-            x->parent->right = y;
-        else
-            x->parent->left = y;
-
-        y->right = x;
-        x->parent = y;
-    }
-};
 
 int main() {
     setlocale(LC_ALL, "Russian");
     srand(time(NULL));
-    RedBlackTree tree;
+    // Мультимножество: повторное число не добавляет узел, а увеличивает счетчик своего узла
+    RedBlackTree<int, std::less<int>, DefaultNodeAllocator, CountedEntry<int>> tree;
     int n = 1000;  // Количество случайных чисел
 
     // Заполнение дерева случайными числами
@@ -190,41 +19,95 @@ int main() {
         tree.insert(num);  // Вставка числа в дерево
     }
 
-    // Выводим все элементы дерева
-    cout << "Все числа, добавленные в дерево:" << endl;
-    tree.printInOrder(tree.getRoot());  // Используем метод getRoot() для получения корня
+    // Выводим все элементы дерева; у повторявшихся чисел в скобках — сколько раз они встретились
+    cout << "Все числа, добавленные в дерево (различных: " << tree.size() << "):" << endl;
+    for (const CountedKey<int>& entry : tree) {
+        cout << entry.key;
+        if (entry.count > 1)
+            cout << "(" << entry.count << ")";
+        cout << " ";
+    }
     cout << endl;
 
     // Выбираем случайное число для поиска
     int searchKey = rand() % 10000 + 1;
     cout << "Ищем число: " << searchKey << endl;
 
-    // Замер времени поиска
-    double rb_time = tree.measureSearchTime(tree.getRoot(), searchKey);
-
-    // Выводим время поиска с точностью до миллионных долей секунды
-    cout.precision(6);
-    cout << "Время поиска в красно-черном дереве: " << fixed << rb_time << " секунд" << endl;
+    size_t occurrences = tree.count(searchKey);
+    if (occurrences != 0)
+        cout << "Число найдено, вставлено раз: " << occurrences << endl;
+    else
+        cout << "Число не найдено" << endl;
+
+    // Склейка требует, чтобы все ключи right были больше здешних: общий ключ на стыке
+    // дал бы два узла с одним ключом, поэтому {1, 2, 3} и {3, 4} не склеиваются
+    RedBlackTree<> low, high;
+    for (int key : { 1, 2, 3 })
+        low.insert(key);
+    for (int key : { 3, 4 })
+        high.insert(key);
+    try {
+        low.join(high);
+        cout << "Ошибка: склеены деревья с общим ключом 3" << endl;
+    }
+    catch (const invalid_argument&) {
+        cout << "Склейка {1, 2, 3} и {3, 4} отклонена, размеры: " << low.size() << " и " << high.size() << endl;
+    }
+    try {
+        high.erase(3);
+        low.join(3, high);
+        cout << "Ошибка: средний ключ 3 совпал с наибольшим ключом дерева" << endl;
+    }
+    catch (const invalid_argument&) {
+        cout << "Склейка со средним ключом 3 после {1, 2, 3} отклонена" << endl;
+    }
+    high.insert(3);
+    low.erase(3);
+    low.join(high);
+    cout << "Склейка {1, 2} и {3, 4}: " << low.size() << " ключа" << endl;
 
     return 0;
 }
 /*
-1. Структура узла `Node`:
+1. Структура узла `RBNode<T>` (Red-Black.h):
    - Узел содержит:
-     - `value`: Значение, хранимое в узле.
+     - `value`: Значение, хранимое в узле (у общего листа `TNULL` не конструируется).
      - `left`, `right`, `parent`: Указатели на левого, правого потомков и родителя.
      - `isRed`: Флаг, показывающий, является ли узел красным (если `true`) или черным (если `false`).
+     - `subtreeSize`: Число узлов в поддереве (у `TNULL` — 0); поддерживается вставкой, удалением и поворотами.
+   - Узлы создаются через политику аллокатора (шаблонный параметр `NodeAllocator`, см. Common/NodeAllocator.h).
 
-2. Класс `RedBlackTree`:
+2. Класс `RedBlackTree<Key, Compare, NodeAllocator, Entry>` (Red-Black.h):
+   - Порядок задает компаратор `Compare`; `Entry` выбирает, хранит ли узел ключ или пару ключ-значение (Common/OrderedContainers.h).
    - Метод `insert`: Вставляет новый элемент в дерево и вызывает метод `insertFix` для балансировки.
+     Ключи уникальны: если ключ уже есть, элемент сливается с имеющимся (`Entry::merge`) — у `CountedEntry`
+     растет счетчик, у `MultiMapEntry` дописывается список значений.
+   - Методы `count`, `equalRange`, `eraseOne`: число вхождений ключа, его элементы и удаление одного вхождения.
    - Методы `leftRotate` и `rightRotate`: Повороты, которые используются для балансировки дерева.
    - Метод `insertFix`: Выполняет балансировку дерева после вставки нового узла. Основные операции — это изменение цветов и выполнение поворотов.
-   - Метод `search`: Стандартный поиск элемента в бинарном дереве.
-   - Метод `measureSearchTime`: Замеряет время поиска с использованием `std::chrono`.
-   - Метод `printInOrder`: Выполняет обход дерева в порядке возрастания (in-order).
-
-3. Основная функция:
-   - Генерирует 1000 случайных чисел и вставляет их в красно-черное дерево.
-   - Выводит все числа в порядке возрастания с помощью метода `printInOrder`.
-   - После этого выбирается случайное число для поиска, и замеряется время поиска с использованием `measureSearchTime`.
+   - Метод `erase`: Удаляет ключ; при удалении черного узла вызывает `deleteFix`, который снимает «двойную черноту» перекрашиванием и поворотами.
+   - Метод `search`: Стандартный поиск элемента в бинарном дереве (при отсутствии ключа возвращает `nullptr`); цикл без рекурсии.
+   - Метод `printInOrder`: Выполняет обход поддерева в порядке возрастания (in-order) по ссылкам на родителя, без рекурсии.
+   - Методы `begin`/`end`: Двунаправленный итератор для обхода в порядке возрастания (`for (int v : tree)`).
+   - Методы `emplaceUnique`, `tryEmplace`, `find`, `lowerBound`, `upperBound`, `erase(iterator)`: основа контейнеров.
+   - Метод `buildFromSorted`: Строит дерево из отсортированной последовательности за O(n) без поворотов:
+     средний элемент — корень, все уровни черные, кроме неполного нижнего, который красится в красный.
+     `buildFromSortedParallel` строит поддеревья под верхними уровнями в нескольких потоках (Common/BulkBuild.h).
+   - Методы `rank`, `select`, `countRange`: Порядковые статистики за O(log n) по размерам поддеревьев:
+     число ключей меньше заданного, k-й элемент и число ключей в отрезке [lo, hi].
+
+3. Контейнеры `RedBlackSet` и `RedBlackMap` (Red-Black.h):
+   - Интерфейс `std::set` и `std::map`: итераторы, `lower_bound`/`upper_bound`/`equal_range`, `emplace`, `try_emplace`,
+     `insert_or_assign`, `operator[]`, поиск по разнородному ключу при прозрачном компараторе (`std::less<>`).
+   - Копирование контейнера и `build_from_sorted` строят дерево за O(n) через `buildFromSorted`.
+   - `rank`, `select`, `count_range`, `quantile`, `median`: порядковые статистики за O(log n).
+   - Метод `clear` и деструктор: Освобождают все узлы (при слабе или арене — разом, без обхода).
+
+4. Основная функция:
+   - Генерирует 1000 случайных чисел и вставляет их в красно-черное дерево-мультимножество (`CountedEntry`):
+     повторы не создают узлов, а увеличивают счетчики.
+   - Выводит все числа в порядке возрастания со счетчиками повторов.
+   - После этого выбирается случайное число для поиска и выводится, сколько раз оно встретилось (`count`).
+   - Показывает, что `join` отклоняет деревья с общим ключом на стыке (`std::invalid_argument`).
+   - Замеры производительности вынесены в общий стенд Benchmark (см. Benchmark/Benchmark.sln).
    */
\ No newline at end of file
@@ -0,0 +1,1228 @@
+﻿#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "../../Common/BatchSearch.h"
+#include "../../Common/BulkBuild.h"
+#include "../../Common/NodeAllocator.h"
+#include "../../Common/OrderedContainers.h"
+#include "../../Common/RangeCursor.h"
+#include "../../Common/SetOperations.h"
+#include "../../Common/Snapshot.h"
+#include "../../Common/TreeStats.h"
+
+// Метка для конструктора общего черного листа TNULL
+struct RBSentinel {};
+
+// Структура узла для красно-черного дерева
+template <typename T>
+struct RBNode {
+    union {
+        T value;       // Значение узла; у листа TNULL не конструируется
+    };
+    RBNode* left;      // Левый потомок
+    RBNode* right;     // Правый потомок
+    RBNode* parent;    // Родитель
+    bool isRed;        // Цвет узла: красный (true) или черный (false)
+    size_t subtreeSize; // Число узлов в поддереве вместе с этим; у TNULL всегда 0
+
+    // Конструктор для создания узла: значение строится на месте из аргументов
+    template <typename... Args>
+    explicit RBNode(Args&&... args)
+        : value(std::forward<Args>(args)...), left(nullptr), right(nullptr), parent(nullptr), isRed(true), subtreeSize(1) {}
+    // Конструктор листа TNULL: значения у него нет
+    explicit RBNode(RBSentinel) : left(nullptr), right(nullptr), parent(nullptr), isRed(false), subtreeSize(0) {}
+    // Значение разрушает дерево (у TNULL его нет), поэтому деструктор узла пустой
+    ~RBNode() {}
+};
+
+// Класс для красно-черного дерева.
+// Дерево владеет своими узлами; память под них выделяет политика NodeAllocator (см. NodeAllocator.h).
+// Ключи уникальны и упорядочены компаратором Compare; Entry задает, что хранит узел: ключ (SetEntry),
+// пару ключ-значение (MapEntry), ключ со счетчиком (CountedEntry) или ключ со списком значений
+// (MultiMapEntry), и что делает вставка уже имеющегося ключа, см. OrderedContainers.h.
+// Поиск, обход и разрушение итеративные: для обхода достаточно ссылок на родителя.
+// Узел хранит размер своего поддерева (повороты его пересчитывают), поэтому ранг ключа,
+// k-й элемент и число ключей в отрезке находятся за один спуск, O(log n).
+// По черной высоте работают split и join, а на них — параллельные объединение,
+// пересечение и разность деревьев (SetOperations.h)
+template <typename Key = int, typename Compare = std::less<Key>, typename NodeAllocator = DefaultNodeAllocator,
+          typename Entry = SetEntry<Key>>
+class RedBlackTree {
+public:
+    using key_type = Key;
+    using key_compare = Compare;
+    using entry_type = Entry;
+    using value_type = typename Entry::value_type;
+    using Node = RBNode<value_type>;
+
+    // Двунаправленный итератор симметричного обхода: переход к соседнему узлу по ссылкам на родителя, без стека
+    class Iterator {
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = typename Entry::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = value_type*;
+        using reference = value_type&;
+
+        Iterator() : node(nullptr), tree(nullptr) {}
+
+        reference operator*() const { return node->value; }
+        pointer operator->() const { return &node->value; }
+        Iterator& operator++() {
+            if (node->right != tree->TNULL) {
+                node = tree->minimum(node->right);
+            }
+            else {
+                // Поднимаемся, пока приходим из правого поддерева; у корня parent == nullptr (конец)
+                while (node->parent != nullptr && node == node->parent->right)
+                    node = node->parent;
+                node = node->parent;
+            }
+            return *this;
+        }
+        Iterator operator++(int) {
+            Iterator copy = *this;
+            ++*this;
+            return copy;
+        }
+        Iterator& operator--() {
+            if (node == nullptr) {
+                node = tree->maximum(tree->root);  // Шаг назад от конца — наибольший элемент
+            }
+            else if (node->left != tree->TNULL) {
+                node = tree->maximum(node->left);
+            }
+            else {
+                while (node->parent != nullptr && node == node->parent->left)
+                    node = node->parent;
+                node = node->parent;
+            }
+            return *this;
+        }
+        Iterator operator--(int) {
+            Iterator copy = *this;
+            --*this;
+            return copy;
+        }
+        bool operator==(const Iterator& other) const { return node == other.node; }
+        bool operator!=(const Iterator& other) const { return node != other.node; }
+
+    private:
+        friend class RedBlackTree;
+        Iterator(Node* node, const RedBlackTree* tree) : node(node), tree(tree) {}
+
+        Node* node;                 // nullptr — позиция за последним элементом
+        const RedBlackTree* tree;   // Дает TNULL и корень для шага назад от конца
+    };
+
+    explicit RedBlackTree(const Compare& comp = Compare())
+        : root(nullptr), nil(RBSentinel()), TNULL(&nil), size_(0), comp(comp) {}
+    ~RedBlackTree() { clear(); }
+    RedBlackTree(const RedBlackTree&) = delete;
+    RedBlackTree& operator=(const RedBlackTree&) = delete;
+
+    Iterator begin() const { return Iterator(root != nullptr ? minimum(root) : nullptr, this); }
+    Iterator end() const { return Iterator(nullptr, this); }
+    size_t size() const { return size_; }
+    const Compare& keyComp() const { return comp; }
+    // Счетчики горячего пути (TreeStats.h); без TREE_STATS — нули. Высота считается обходом, O(n)
+    TreeStats stats() const { return counters.snapshot(TreeCounters::kEnabled ? height(root) : 0); }
+    void resetStats() { counters.reset(); }
+
+    // Вставка элемента в дерево; если ключ уже существует, элемент сливается с имеющимся
+    // (Entry::merge: множество и словарь не меняются, у мультимножества растет счетчик)
+    void insert(const value_type& value) {
+        Node* existing;
+        Node* parent = findParent(Entry::key(value), existing);
+        if (existing != nullptr) {
+            Entry::merge(existing->value, value);
+            return;
+        }
+        attach(allocator.template create<Node>(value), parent);
+    }
+
+    // Вставка значения, построенного из аргументов, если такого ключа еще нет
+    template <typename... Args>
+    std::pair<Iterator, bool> emplaceUnique(Args&&... args) {
+        Node* newNode = allocator.template create<Node>(std::forward<Args>(args)...);
+        Node* existing;
+        Node* parent = findParent(Entry::key(newNode->value), existing);
+        if (existing != nullptr) {
+            destroyNode(newNode);
+            return { Iterator(existing, this), false };
+        }
+        attach(newNode, parent);
+        return { Iterator(newNode, this), true };
+    }
+
+    // Вставка по ключу: значение строится из аргументов, только если ключа еще нет
+    template <typename K, typename... Args>
+    std::pair<Iterator, bool> tryEmplace(const K& key, Args&&... args) {
+        Node* existing;
+        Node* parent = findParent(key, existing);
+        if (existing != nullptr)
+            return { Iterator(existing, this), false };
+        Node* newNode = allocator.template create<Node>(std::forward<Args>(args)...);
+        attach(newNode, parent);
+        return { Iterator(newNode, this), true };
+    }
+
+    // Удаление элемента; возвращает false, если ключа нет
+    template <typename K>
+    bool erase(const K& key) {
+        Node* z = search(root, key);
+        if (z == nullptr)
+            return false;
+        eraseNode(z);
+        return true;
+    }
+
+    // Удаление одного вхождения ключа (Entry::release): у мультимножества уменьшается счетчик,
+    // узел удаляется, когда вхождений не осталось. false, если ключа нет
+    template <typename K>
+    bool eraseOne(const K& key) {
+        Node* z = search(root, key);
+        if (z == nullptr)
+            return false;
+        if (Entry::release(z->value))
+            eraseNode(z);
+        return true;
+    }
+
+    // Удаление элемента по итератору; возвращает итератор на следующий элемент
+    Iterator erase(Iterator pos) {
+        Iterator next = pos;
+        ++next;
+        eraseNode(pos.node);
+        return next;
+    }
+
+    // Поиск элемента в дереве
+    template <typename K>
+    Node* search(const K& key) const {
+        return search(root, key);
+    }
+
+    template <typename K>
+    Node* search(Node* node, const K& key) const {
+        TreeDescent descent(counters);
+        while (node != nullptr && node != TNULL) {
+            descent.visit();
+            if (descent.less(comp, key, Entry::key(node->value)))
+                node = node->left;
+            else if (descent.less(comp, Entry::key(node->value), key))
+                node = node->right;
+            else
+                return node;
+        }
+        return nullptr;  // Ключ не найден (TNULL наружу не отдаем)
+    }
+
+    // Поиск сразу count ключей: results[i] = search(keys[i]). Спуски разных ключей чередуются
+    // с упреждающей загрузкой узлов (BatchSearch.h), и промахи кэша перекрываются
+    template <typename K>
+    void searchBatch(const K* keys, size_t count, Node** results) const {
+        struct State {
+            Node* node;
+            size_t index;
+        };
+        interleavedSearch<State>(count,
+            [&](State& state, size_t index) {
+                state.node = root;
+                state.index = index;
+                if (root != nullptr && root != TNULL)
+                    return false;
+                results[index] = nullptr;
+                return true;
+            },
+            [&](State& state) {
+                Node* node = state.node;
+                const K& key = keys[state.index];
+                if (comp(key, Entry::key(node->value)))
+                    node = node->left;
+                else if (comp(Entry::key(node->value), key))
+                    node = node->right;
+                else {
+                    results[state.index] = node;
+                    return true;
+                }
+                if (node == TNULL) {
+                    results[state.index] = nullptr;
+                    return true;
+                }
+                prefetchLine(node);
+                state.node = node;
+                return false;
+            });
+    }
+
+    template <typename K>
+    Iterator find(const K& key) const {
+        return Iterator(search(root, key), this);
+    }
+
+    // Число вхождений ключа: 0 или 1, у мультимножества и мультисловаря — Entry::count элемента
+    template <typename K>
+    size_t count(const K& key) const {
+        Node* node = search(root, key);
+        return node != nullptr ? Entry::count(node->value) : 0;
+    }
+
+    // Первый элемент, не меньший key
+    template <typename K>
+    Iterator lowerBound(const K& key) const {
+        Node* node = root;
+        Node* result = nullptr;
+        while (node != nullptr && node != TNULL) {
+            if (comp(Entry::key(node->value), key)) {
+                node = node->right;
+            }
+            else {
+                result = node;
+                node = node->left;
+            }
+        }
+        return Iterator(result, this);
+    }
+
+    // Первый элемент, больший key
+    template <typename K>
+    Iterator upperBound(const K& key) const {
+        Node* node = root;
+        Node* result = nullptr;
+        while (node != nullptr && node != TNULL) {
+            if (comp(key, Entry::key(node->value))) {
+                result = node;
+                node = node->left;
+            }
+            else {
+                node = node->right;
+            }
+        }
+        return Iterator(result, this);
+    }
+    // Элементы с ключом key, [first, last). Элемент на ключ один, поэтому хватает спуска lowerBound
+    template <typename K>
+    std::pair<Iterator, Iterator> equalRange(const K& key) const {
+        Iterator first = lowerBound(key);
+        Iterator last = first;
+        if (first != end() && !comp(key, Entry::key(*first)))
+            ++last;
+        return { first, last };
+    }
+    // Курсор по элементам с ключами из отрезка [lo, hi] (RangeCursor.h): начало ищется за O(log n),
+    // дальше элементы выдаются лениво, по одному или пачками
+    RangeCursor<RedBlackTree> range(const Key& lo, const Key& hi, ScanDirection direction = ScanDirection::Forward) const {
+        return RangeCursor<RedBlackTree>(*this, KeyRange<Key>::closed(lo, hi), direction);
+    }
+    // То же для любого диапазона: с открытыми границами, после ключа X и т. д.
+    RangeCursor<RedBlackTree> scan(const KeyRange<Key>& keys, ScanDirection direction = ScanDirection::Forward) const {
+        return RangeCursor<RedBlackTree>(*this, keys, direction);
+    }
+
+    // Снимок дерева в поток (формат — в Snapshot.h): элементы по порядку, блоками с контрольными суммами
+    void save(std::ostream& out, SnapshotEncoding encoding = SnapshotEncoding::Compact) const {
+        saveSnapshot<Entry>(out, begin(), end(), size_, encoding);
+    }
+
+    // Замена содержимого снимком из потока. Дерево сразу собирается сбалансированным, как в buildFromSorted;
+    // при ошибке (снимок поврежден или с другими типами элементов) исключение, дерево остается пустым
+    void load(std::istream& in) {
+        try {
+            SnapshotReader<Entry, Compare> reader(in, comp, true);
+            buildCounted(reader.begin(), reader.size());
+            reader.finish();
+        }
+        catch (...) {
+            clear();
+            throw;
+        }
+    }
+
+    // Сколько элементов меньше key
+    template <typename K>
+    size_t rank(const K& key) const {
+        size_t result = 0;
+        for (Node* node = root; node != nullptr && node != TNULL;) {
+            if (comp(Entry::key(node->value), key)) {
+                result += node->left->subtreeSize + 1;  // Левое поддерево и сам узел меньше key
+                node = node->right;
+            }
+            else {
+                node = node->left;
+            }
+        }
+        return result;
+    }
+
+    // Сколько элементов с ключами в отрезке [lo, hi]
+    template <typename K>
+    size_t countRange(const K& lo, const K& hi) const {
+        if (comp(hi, lo))
+            return 0;
+        return countNotGreater(hi) - rank(lo);
+    }
+
+    // k-й по порядку элемент (с нуля); end(), если k >= size()
+    Iterator select(size_t k) const {
+        if (k >= size_)
+            return end();
+        Node* node = root;
+        while (k != node->left->subtreeSize) {
+            if (k < node->left->subtreeSize) {
+                node = node->left;
+            }
+            else {
+                k -= node->left->subtreeSize + 1;
+                node = node->right;
+            }
+        }
+        return Iterator(node, this);
+    }
+
+    // Функция для вывода поддерева node в порядке возрастания
+    void printInOrder(Node* node) {
+        if (node == nullptr || node == TNULL)
+            return;
+        Node* current = minimum(node);
+        while (true) {
+            std::cout << current->value << " ";
+            if (current->right != TNULL) {
+                current = minimum(current->right);
+                continue;
+            }
+            // Поднимаемся к первому предку, в чьем левом поддереве мы были; выше node не выходим
+            while (current != node && current == current->parent->right)
+                current = current->parent;
+            if (current == node)
+                break;
+            current = current->parent;
+        }
+    }
+
+    // Публичный метод для получения корня дерева
+    Node* getRoot() {
+        return root;
+    }
+
+    // Замена содержимого элементами из [first, last), отсортированными по возрастанию без повторов.
+    // Дерево строится идеально сбалансированным за O(n): все уровни, кроме последнего, полные,
+    // их узлы черные, а узлы неполного последнего уровня красные — черная высота всех путей одинакова
+    template <typename ForwardIt>
+    void buildFromSorted(ForwardIt first, ForwardIt last) {
+        buildCounted(first, std::distance(first, last));
+    }
+
+    // То же в threads потоков: верхние уровни строит текущий поток, поддеревья под ними — рабочие
+    template <typename RandomIt>
+    void buildFromSortedParallel(RandomIt first, RandomIt last, unsigned threads = defaultBuildThreads()) {
+        size_t count = last - first;
+        int splitDepth = parallelSplitDepth(count, threads);
+        if (splitDepth == 0) {
+            buildFromSorted(first, last);
+            return;
+        }
+        clear();
+        int red = redDepth(count);
+        std::vector<SubtreeTask<RandomIt, Node>> tasks;
+        std::vector<NodeAllocator> allocators(threads);
+        try {
+            buildTop(first, count, 0, splitDepth, red, &root, nullptr, tasks);
+            runParallel(tasks.size(), threads, [&](unsigned worker, size_t i) {
+                const SubtreeTask<RandomIt, Node>& task = tasks[i];
+                RandomIt it = task.first;
+                buildBalanced(it, task.count, task.link, task.parent, task.depth, red, allocators[worker]);
+            });
+        }
+        catch (...) {
+            for (NodeAllocator& other : allocators)
+                allocator.adopt(other);
+            clear();
+            throw;
+        }
+        for (NodeAllocator& other : allocators)
+            allocator.adopt(other);
+        size_ = count;
+    }
+
+    // Разрезание по ключу: элементы с ключами не меньше key переходят в right (его прежнее содержимое
+    // удаляется), здесь остаются меньшие. Сам разрез — O(log n). У каждого дерева свой лист TNULL,
+    // поэтому узлы правой части перевешиваются на лист right за O(размера части); при политике
+    // без общей кучи (kSharedHeap) они вместо этого копируются в память right
+    template <typename K>
+    void split(const K& key, RedBlackTree& right) {
+        if (&right == this)
+            return;
+        right.clear();
+        Sub less, notLess;
+        auto isLess = [&](const Node* node) { return comp(Entry::key(node->value), key); };
+        splitWhere(whole(), isLess, less, notLess);
+        assign(less);
+        if (notLess.root == TNULL)
+            return;
+        notLess.root->parent = nullptr;
+        if (NodeAllocator::kSharedHeap) {
+            right.relinkLeaves(notLess.root, TNULL, 1);
+            right.assign(Sub{ notLess.root, notLess.blackHeight });
+            return;
+        }
+        try {
+            right.buildCounted(Iterator(minimum(notLess.root), this), notLess.root->subtreeSize);
+        }
+        catch (...) {
+            assign(concatNodes(whole(), notLess));
+            throw;
+        }
+        destroy(notLess.root);
+    }
+
+    // Склейка: элементы right, ключи которых больше всех здешних, дописываются справа за O(log n)
+    // и перевешивание листьев right, O(|right|); right пустеет, его память переходит к этому дереву
+    void join(RedBlackTree& right, unsigned threads = defaultBuildThreads()) {
+        if (right.root == nullptr)
+            return;
+        if (&right == this)
+            throw std::invalid_argument("RedBlackTree::join: дерево нельзя приклеить к самому себе");
+        // Равные ключи на стыке дали бы два узла с одним ключом: строгое сравнение, как в AVLTree::join
+        if (root != nullptr && !comp(Entry::key(maximum(root)->value), Entry::key(right.minimum(right.root)->value)))
+            throw std::invalid_argument("RedBlackTree::join: ключи right должны быть больше ключей дерева");
+        Sub other = adoptTree(right, threads);
+        assign(concatNodes(whole(), other));
+    }
+
+    // То же со средним элементом: middle встает между здешними ключами и ключами right
+    void join(const value_type& middle, RedBlackTree& right, unsigned threads = defaultBuildThreads()) {
+        const Key& key = Entry::key(middle);
+        if ((root != nullptr && !comp(Entry::key(maximum(root)->value), key)) ||
+            (right.root != nullptr && !comp(key, Entry::key(right.minimum(right.root)->value))))
+            throw std::invalid_argument("RedBlackTree::join: нужно ключи дерева < middle < ключи right");
+        Node* node = allocator.template create<Node>(middle);
+        node->left = node->right = TNULL;
+        Sub other = &right != this ? adoptTree(right, threads) : Sub{ TNULL, 0 };
+        assign(joinNodes(whole(), node, other));
+    }
+
+    // Объединение: добавляются элементы other с ключами, которых здесь нет. other пустеет,
+    // его память переходит к этому дереву. Работа O(m log(n/m + 1)) для размеров m <= n
+    // и перевешивание листьев other, O(m); все это делится между threads потоками (SetOperations.h)
+    void unionWith(RedBlackTree& other, unsigned threads = defaultBuildThreads()) {
+        if (&other != this)
+            combine(other, threads, &SetAlgebra<RedBlackTree>::unite);
+    }
+
+    // Пересечение: остаются элементы, ключи которых есть в other; other пустеет
+    void intersectWith(RedBlackTree& other, unsigned threads = defaultBuildThreads()) {
+        if (&other != this)
+            combine(other, threads, &SetAlgebra<RedBlackTree>::intersect);
+    }
+
+    // Разность: остаются элементы, ключей которых нет в other; other пустеет
+    void differenceWith(RedBlackTree& other, unsigned threads = defaultBuildThreads()) {
+        if (&other != this)
+            combine(other, threads, &SetAlgebra<RedBlackTree>::subtract);
+        else
+            clear();
+    }
+
+    // Удаление всех узлов
+    void clear() {
+        // Значения без деструкторов можно не обходить: аллокатор отдает всю память разом
+        if (!NodeAllocator::kBulkRelease || !std::is_trivially_destructible<value_type>::value)
+            destroy(root);
+        allocator.release();
+        root = nullptr;
+        size_ = 0;
+    }
+
+private:
+    Node* root;
+    Node nil;       // Общий черный лист; хранится в самом дереве, а не в аллокаторе
+    Node* TNULL;    // Лист пустой узел
+    size_t size_;
+    Compare comp;
+    NodeAllocator allocator;
+    mutable TreeCounters counters;
+
+    // Поддерево для split/join (SetOperations.h): корень (TNULL — пустое) и черная высота —
+    // число черных узлов на пути от корня до листа, включая корень. Корень поддерева может быть красным,
+    // а его ссылка на родителя — устаревшей: ее задает тот, кто поддерево подвешивает
+    struct Sub {
+        Node* root;
+        int blackHeight;
+    };
+    template <typename> friend class SetAlgebra;
+
+    // Все дерево как поддерево; черная высота считается по левому краю
+    Sub whole() const {
+        Sub t{ root != nullptr ? root : TNULL, 0 };
+        for (Node* node = t.root; node != TNULL; node = node->left)
+            t.blackHeight += node->isRed ? 0 : 1;
+        return t;
+    }
+    // Дерево становится поддеревом t
+    void assign(Sub t) {
+        if (t.root == TNULL) {
+            root = nullptr;
+            size_ = 0;
+            return;
+        }
+        root = t.root;
+        root->parent = nullptr;
+        root->isRed = false;
+        size_ = root->subtreeSize;
+    }
+    // Забирает узлы other вместе с памятью; их листья перевешиваются на свой TNULL
+    Sub adoptTree(RedBlackTree& other, unsigned threads) {
+        Sub t = other.whole();
+        if (t.root != other.TNULL)
+            relinkLeaves(t.root, other.TNULL, threads);
+        else
+            t.root = TNULL;
+        allocator.adopt(other.allocator);
+        other.root = nullptr;
+        other.size_ = 0;
+        return t;
+    }
+    // Ссылки на чужой лист old в поддереве top заменяются ссылками на TNULL.
+    // Верхние уровни обходит текущий поток, поддеревья под ними — threads потоков
+    void relinkLeaves(Node* top, Node* old, unsigned threads) {
+        int splitDepth = parallelSplitDepth(top->subtreeSize, threads);
+        std::vector<Node*> tasks;
+        if (splitDepth == 0) {
+            relinkTop(top, old, 0, -1, tasks);
+            return;
+        }
+        tasks.reserve(size_t(1) << splitDepth);  // Дальше память не выделяется: перевешивание не прервется
+        relinkTop(top, old, 0, splitDepth, tasks);
+        runParallel(tasks.size(), threads, [&](unsigned, size_t i) { relinkTop(tasks[i], old, 0, -1, tasks); });
+    }
+    // Поддерево на глубине splitDepth не обходится, а откладывается в tasks (-1 — обойти все)
+    void relinkTop(Node* node, Node* old, int depth, int splitDepth, std::vector<Node*>& tasks) const {
+        if (depth == splitDepth) {
+            tasks.push_back(node);
+            return;
+        }
+        if (node->left == old)
+            node->left = TNULL;
+        else
+            relinkTop(node->left, old, depth + 1, splitDepth, tasks);
+        if (node->right == old)
+            node->right = TNULL;
+        else
+            relinkTop(node->right, old, depth + 1, splitDepth, tasks);
+    }
+    // Общая часть объединения, пересечения и разности: узлы other переходят сюда, лишние разрушаются
+    // после слияния потоков
+    template <typename Operation>
+    void combine(RedBlackTree& other, unsigned threads, Operation operation) {
+        Sub b = adoptTree(other, threads);
+        SetAlgebra<RedBlackTree> algebra(*this, threads);
+        NodeGarbage<Node> garbage;
+        assign((algebra.*operation)(whole(), b, garbage, 0));
+        while (garbage.head != nullptr) {
+            Node* next = garbage.head->parent;
+            destroy(garbage.head);
+            garbage.head = next;
+        }
+    }
+
+    bool isEmpty(const Sub& t) const { return t.root == TNULL; }
+    static size_t subtreeSize(const Sub& t) { return t.root->subtreeSize; }
+    void discard(const Sub& t, NodeGarbage<Node>& garbage) const {
+        if (t.root != TNULL)
+            garbage.push(t.root);
+    }
+    void absorb(Node* node, const Sub& equal) const {
+        if (equal.root != TNULL)
+            Entry::merge(node->value, std::move(equal.root->value));
+    }
+    // Ссылка на родителя; у TNULL она не меняется, чтобы потоки не писали в общий лист
+    void setParent(Node* child, Node* parent) const {
+        if (child != TNULL)
+            child->parent = parent;
+    }
+    // Корень t отцепляется от своих поддеревьев; их черная высота на единицу меньше, если корень черный
+    void expose(const Sub& t, Sub& left, Node*& node, Sub& right) const {
+        node = t.root;
+        int childHeight = t.blackHeight - (node->isRed ? 0 : 1);
+        left = Sub{ node->left, childHeight };
+        right = Sub{ node->right, childHeight };
+        node->left = node->right = TNULL;
+    }
+    // Узел node с поддеревьями left и right (цвет задает вызывающий)
+    Node* link(Node* left, Node* node, Node* right) const {
+        node->left = left;
+        node->right = right;
+        setParent(left, node);
+        setParent(right, node);
+        updateSize(node);
+        return node;
+    }
+    // Повороты отцепленного поддерева: ссылку на новый корень переставляет вызывающий
+    Node* rotateLeftLocal(Node* x) const {
+        Node* y = x->right;
+        x->right = y->left;
+        setParent(y->left, x);
+        y->left = x;
+        x->parent = y;
+        y->subtreeSize = x->subtreeSize;
+        updateSize(x);
+        return y;
+    }
+    Node* rotateRightLocal(Node* x) const {
+        Node* y = x->left;
+        x->left = y->right;
+        setParent(y->right, x);
+        y->right = x;
+        x->parent = y;
+        y->subtreeSize = x->subtreeSize;
+        updateSize(x);
+        return y;
+    }
+    // Склейка через узел: ключи left не больше ключа node, а он не больше ключей right.
+    // При равной черной высоте node просто встает над ними; иначе спуск по краю более высокого дерева
+    // до черного узла той же черной высоты, что у низкого, и одна перекраска или поворот на обратном пути
+    Sub joinNodes(const Sub& left, Node* node, const Sub& right) const {
+        Sub t;
+        if (left.blackHeight > right.blackHeight) {
+            t = Sub{ joinRight(left.root, left.blackHeight, node, right.root, right.blackHeight), left.blackHeight };
+            if (t.root->isRed && t.root->right->isRed) {
+                t.root->isRed = false;
+                ++t.blackHeight;
+            }
+        }
+        else if (right.blackHeight > left.blackHeight) {
+            t = Sub{ joinLeft(left.root, left.blackHeight, node, right.root, right.blackHeight), right.blackHeight };
+            if (t.root->isRed && t.root->left->isRed) {
+                t.root->isRed = false;
+                ++t.blackHeight;
+            }
+        }
+        else {
+            node->isRed = !left.root->isRed && !right.root->isRed;
+            t = Sub{ link(left.root, node, right.root), left.blackHeight + (node->isRed ? 0 : 1) };
+        }
+        t.root->parent = nullptr;
+        return t;
+    }
+    // Спуск по правому краю left (черная высота leftHeight) до черного узла с черной высотой right
+    Node* joinRight(Node* left, int leftHeight, Node* node, Node* right, int rightHeight) const {
+        if (!left->isRed && leftHeight == rightHeight) {
+            node->isRed = true;
+            return link(left, node, right);
+        }
+        Node* sub = joinRight(left->right, leftHeight - (left->isRed ? 0 : 1), node, right, rightHeight);
+        left->right = sub;
+        sub->parent = left;
+        updateSize(left);
+        if (!left->isRed && sub->isRed && sub->right->isRed) {
+            // Два красных подряд под черным узлом: поворот поднимает середину, нижний чернеет
+            sub->right->isRed = false;
+            return rotateLeftLocal(left);
+        }
+        return left;
+    }
+    // Спуск по левому краю right до черного узла с черной высотой left
+    Node* joinLeft(Node* left, int leftHeight, Node* node, Node* right, int rightHeight) const {
+        if (!right->isRed && rightHeight == leftHeight) {
+            node->isRed = true;
+            return link(left, node, right);
+        }
+        Node* sub = joinLeft(left, leftHeight, node, right->left, rightHeight - (right->isRed ? 0 : 1));
+        right->left = sub;
+        sub->parent = right;
+        updateSize(right);
+        if (!right->isRed && sub->isRed && sub->left->isRed) {
+            sub->left->isRed = false;
+            return rotateRightLocal(right);
+        }
+        return right;
+    }
+    // Склейка без среднего узла: им становится наибольший узел left
+    Sub concatNodes(const Sub& left, const Sub& right) const {
+        if (left.root == TNULL)
+            return right;
+        if (right.root == TNULL)
+            return left;
+        Node* last;
+        Sub rest = splitLast(left, last);
+        return joinNodes(rest, last, right);
+    }
+    // Отцепление наибольшего узла t в last; возвращает остальное
+    Sub splitLast(const Sub& t, Node*& last) const {
+        Sub left, right;
+        Node* node;
+        expose(t, left, node, right);
+        if (right.root == TNULL) {
+            last = node;
+            return left;
+        }
+        Sub rest = splitLast(right, last);
+        return joinNodes(left, node, rest);
+    }
+    // Разрезание t на две части: в left — узлы, для которых goesLeft (это должен быть префикс порядка), в right — остальные.
+    // На каждом уровне отрезанная часть приклеивается join, в сумме O(log n)
+    template <typename GoesLeft>
+    void splitWhere(const Sub& t, const GoesLeft& goesLeft, Sub& left, Sub& right) const {
+        if (t.root == TNULL) {
+            left = right = t;
+            return;
+        }
+        Sub below, above, rest;
+        Node* node;
+        expose(t, below, node, above);
+        if (goesLeft(node)) {
+            splitWhere(above, goesLeft, rest, right);
+            left = joinNodes(below, node, rest);
+        }
+        else {
+            splitWhere(below, goesLeft, left, rest);
+            right = joinNodes(rest, node, above);
+        }
+    }
+    // Разрезание на три части: ключи меньше ключа pivot, равный ему (не больше одного узла) и большие
+    void splitNodes(const Sub& t, const Node* pivot, Sub& less, Sub& equal, Sub& greater) const {
+        const Key& key = Entry::key(pivot->value);
+        Sub notLess;
+        splitWhere(t, [&](const Node* node) { return comp(Entry::key(node->value), key); }, less, notLess);
+        splitWhere(notLess, [&](const Node* node) { return !comp(key, Entry::key(node->value)); }, equal, greater);
+    }
+
+    // Поиск родителя для нового ключа; если ключ уже есть, его узел возвращается в existing
+    template <typename K>
+    Node* findParent(const K& key, Node*& existing) const {
+        TreeDescent descent(counters);
+        Node* parent = nullptr;
+        Node* x = root;
+        existing = nullptr;
+        while (x != nullptr && x != TNULL) {
+            parent = x;
+            descent.visit();
+            if (descent.less(comp, key, Entry::key(x->value))) {
+                x = x->left;
+            }
+            else if (descent.less(comp, Entry::key(x->value), key)) {
+                x = x->right;
+            }
+            else {
+                existing = x;
+                break;
+            }
+        }
+        return parent;
+    }
+
+    // Сколько элементов не больше key
+    template <typename K>
+    size_t countNotGreater(const K& key) const {
+        size_t result = 0;
+        for (Node* node = root; node != nullptr && node != TNULL;) {
+            if (!comp(key, Entry::key(node->value))) {
+                result += node->left->subtreeSize + 1;
+                node = node->right;
+            }
+            else {
+                node = node->left;
+            }
+        }
+        return result;
+    }
+
+    // Размер узла по потомкам (TNULL дает 0)
+    static void updateSize(Node* node) {
+        node->subtreeSize = 1 + node->left->subtreeSize + node->right->subtreeSize;
+    }
+
+    // Подвешивание нового красного узла к родителю y и балансировка
+    void attach(Node* newNode, Node* y) {
+        newNode->left = TNULL;
+        newNode->right = TNULL;
+        newNode->parent = y;
+        if (y == nullptr)
+            root = newNode;
+        else if (comp(Entry::key(newNode->value), Entry::key(y->value)))
+            y->left = newNode;
+        else
+            y->right = newNode;
+        ++size_;
+        for (Node* ancestor = y; ancestor != nullptr; ancestor = ancestor->parent)
+            ++ancestor->subtreeSize;
+
+        // Балансировка дерева после вставки
+        insertFix(newNode);
+    }
+
+    // Удаление узла z: узлы не копируются, а переподвешиваются, поэтому итераторы
+    // на остальные элементы остаются действительными
+    void eraseNode(Node* z) {
+        Node* y = z;
+        bool yWasRed = y->isRed;
+        Node* x;
+
+        if (z->left == TNULL) {
+            x = z->right;
+            transplant(z, z->right);
+        }
+        else if (z->right == TNULL) {
+            x = z->left;
+            transplant(z, z->left);
+        }
+        else {
+            // Два потомка: на место z встает минимальный узел правого поддерева
+            y = minimum(z->right);
+            yWasRed = y->isRed;
+            x = y->right;
+            if (y->parent == z) {
+                x->parent = y;  // x может быть TNULL: родитель нужен для deleteFix
+            }
+            else {
+                transplant(y, y->right);
+                y->right = z->right;
+                y->right->parent = y;
+            }
+            transplant(z, y);
+            y->left = z->left;
+            y->left->parent = y;
+            y->isRed = z->isRed;
+        }
+
+        destroyNode(z);  // Узел возвращается аллокатору для повторного использования
+        --size_;
+
+        // Ниже всех изменился родитель x (он задан и для TNULL); размеры пересчитываются
+        // от него до корня, до поворотов deleteFix, которые считают размеры по потомкам
+        for (Node* ancestor = x->parent; ancestor != nullptr; ancestor = ancestor->parent)
+            updateSize(ancestor);
+
+        // Удаление черного узла нарушает черную высоту: исправляем «двойную черноту»
+        if (!yWasRed)
+            deleteFix(x);
+
+        if (root == TNULL)
+            root = nullptr;  // Дерево опустело
+    }
+
+    // Глубина, узлы которой красятся в красный при построении из count элементов:
+    // самый нижний уровень сбалансированного дерева (floor(log2(count))). Корень всегда черный
+    static int redDepth(size_t count) {
+        int depth = balancedHeight(count) - 1;
+        return depth > 0 ? depth : -1;
+    }
+
+    // Замена содержимого count элементами, читаемыми по порядку с it: хватает однопроходного итератора
+    template <typename InputIt>
+    void buildCounted(InputIt it, size_t count) {
+        clear();
+        try {
+            buildBalanced(it, count, &root, nullptr, 0, redDepth(count), allocator);
+        }
+        catch (...) {
+            clear();  // Недостроенное дерево связно, его можно разобрать обычным способом
+            throw;
+        }
+        size_ = count;
+    }
+
+    // Сбалансированное поддерево из count элементов, читаемых по порядку начиная с it; корень на глубине depth.
+    // Левое поддерево строится прямо в link и, пока нет его корня, висит там само,
+    // поэтому при исключении все созданные узлы достижимы от корня дерева.
+    // Глубина рекурсии — высота результата, то есть log2(count)
+    template <typename It>
+    void buildBalanced(It& it, size_t count, Node** link, Node* parent, int depth, int red, NodeAllocator& alloc) {
+        if (count == 0)
+            return;
+        size_t leftCount = count / 2;
+        buildBalanced(it, leftCount, link, nullptr, depth + 1, red, alloc);
+        Node* node = alloc.template create<Node>(*it);
+        ++it;
+        if (leftCount != 0) {
+            node->left = *link;
+            node->left->parent = node;
+        }
+        else {
+            node->left = TNULL;
+        }
+        node->right = TNULL;
+        node->parent = parent;
+        node->isRed = depth == red;
+        node->subtreeSize = count;
+        *link = node;
+        buildBalanced(it, count - leftCount - 1, &node->right, node, depth + 1, red, alloc);
+    }
+
+    // Верхние уровни для параллельного построения: деление то же, что в buildBalanced,
+    // а поддеревья на глубине splitDepth откладываются в tasks
+    template <typename RandomIt>
+    void buildTop(RandomIt first, size_t count, int depth, int splitDepth, int red, Node** link, Node* parent,
+                  std::vector<SubtreeTask<RandomIt, Node>>& tasks) {
+        if (depth == splitDepth) {
+            tasks.push_back({ first, count, link, parent, depth });
+            return;
+        }
+        if (count == 0)
+            return;
+        size_t leftCount = count / 2;
+        Node* node = allocator.template create<Node>(first[leftCount]);
+        node->left = node->right = TNULL;
+        node->parent = parent;
+        node->isRed = depth == red;
+        node->subtreeSize = count;
+        *link = node;
+        buildTop(first, leftCount, depth + 1, splitDepth, red, &node->left, node, tasks);
+        buildTop(first + leftCount + 1, count - leftCount - 1, depth + 1, splitDepth, red, &node->right, node, tasks);
+    }
+
+    void destroyNode(Node* node) {
+        node->value.~value_type();
+        allocator.destroy(node);
+    }
+
+    // Разбор без стека: правыми поворотами вытягиваем дерево в список по правым ссылкам
+    // (ссылки на родителя и цвета при этом уже не поддерживаются)
+    void destroy(Node* node) {
+        while (node != nullptr && node != TNULL) {
+            if (node->left != TNULL) {
+                Node* left = node->left;
+                node->left = left->right;
+                left->right = node;
+                node = left;
+            }
+            else {
+                Node* next = node->right;
+                destroyNode(node);
+                node = next;
+            }
+        }
+    }
+
+    // Функция для балансировки дерева после вставки
+    void insertFix(Node* k) {
+        Node* u;
+        while (k->parent != nullptr && k->parent->isRed) {
+            if (k->parent == k->parent->parent->right) {
+                u = k->parent->parent->left;
+                if (u->isRed) {
+                    u->isRed = false;
+                    k->parent->isRed = false;
+                    k->parent->parent->isRed = true;
+                    k = k->parent->parent;
+                    counters.recolor(3);
+                }
+                else {
+                    if (k == k->parent->left) {
+                        k = k->parent;
+                        rightRotate(k);
+                        counters.rotation(RotationCase::RL);
+                    }
+                    else {
+                        counters.rotation(RotationCase::RR);
+                    }
+                    counters.recolor(2);
+                    k->parent->isRed = false;
+                    k->parent->parent->isRed = true;
+                    leftRotate(k->parent->parent);
+                }
+            }
+            else {
+                u = k->parent->parent->right;
+                if (u->isRed) {
+                    u->isRed = false;
+                    k->parent->isRed = false;
+                    k->parent->parent->isRed = true;
+                    k = k->parent->parent;
+                    counters.recolor(3);
+                }
+                else {
+                    if (k == k->parent->right) {
+                        k = k->parent;
+                        leftRotate(k);
+                        counters.rotation(RotationCase::LR);
+                    }
+                    else {
+                        counters.rotation(RotationCase::LL);
+                    }
+                    counters.recolor(2);
+                    k->parent->isRed = false;
+                    k->parent->parent->isRed = true;
+                    rightRotate(k->parent->parent);
+                }
+            }
+            if (k == root)
+                break;
+        }
+        root->isRed = false;  // Корень всегда черный
+    }
+
+    // Замена поддерева u поддеревом v в родителе u
+    void transplant(Node* u, Node* v) {
+        if (u->parent == nullptr)
+            root = v;
+        else if (u == u->parent->left)
+            u->parent->left = v;
+        else
+            u->parent->right = v;
+        v->parent = u->parent;
+    }
+
+    // Высота поддерева (TNULL дает 0); глубина рекурсии — сама высота, O(log n)
+    int height(const Node* node) const {
+        if (node == nullptr || node == TNULL)
+            return 0;
+        return 1 + std::max(height(node->left), height(node->right));
+    }
+
+    Node* minimum(Node* node) const {
+        while (node->left != TNULL)
+            node = node->left;
+        return node;
+    }
+
+    Node* maximum(Node* node) const {
+        while (node->right != TNULL)
+            node = node->right;
+        return node;
+    }
+
+    // Функция для балансировки дерева после удаления: x несет лишний черный цвет.
+    // В счетчиках повороты случаев 1 и 4 идут как одиночные (RR, если брат справа, иначе LL),
+    // случай 3 вместе с 4 — как двойной (RL или LR)
+    void deleteFix(Node* x) {
+        Node* w;
+        while (x != root && !x->isRed) {
+            if (x == x->parent->left) {
+                w = x->parent->right;
+                if (w->isRed) {
+                    // Случай 1: красный брат — поворотом сводим к черному брату
+                    w->isRed = false;
+                    x->parent->isRed = true;
+                    leftRotate(x->parent);
+                    w = x->parent->right;
+                    counters.rotation(RotationCase::RR);
+                    counters.recolor(2);
+                }
+                if (!w->left->isRed && !w->right->isRed) {
+                    // Случай 2: у брата оба потомка черные — перекрашиваем и поднимаемся
+                    w->isRed = true;
+                    x = x->parent;
+                    counters.recolor();
+                }
+                else {
+                    if (!w->right->isRed) {
+                        // Случай 3: ближний потомок брата красный — сводим к случаю 4
+                        w->left->isRed = false;
+                        w->isRed = true;
+                        rightRotate(w);
+                        w = x->parent->right;
+                        counters.rotation(RotationCase::RL);
+                        counters.recolor(2);
+                    }
+                    else {
+                        counters.rotation(RotationCase::RR);
+                    }
+                    // Случай 4: дальний потомок брата красный — поворот завершает исправление
+                    counters.recolor(3);
+                    w->isRed = x->parent->isRed;
+                    x->parent->isRed = false;
+                    w->right->isRed = false;
+                    leftRotate(x->parent);
+                    x = root;
+                }
+            }
+            else {
+                w = x->parent->left;
+                if (w->isRed) {
+                    w->isRed = false;
+                    x->parent->isRed = true;
+                    rightRotate(x->parent);
+                    w = x->parent->left;
+                    counters.rotation(RotationCase::LL);
+                    counters.recolor(2);
+                }
+                if (!w->right->isRed && !w->left->isRed) {
+                    w->isRed = true;
+                    x = x->parent;
+                    counters.recolor();
+                }
+                else {
+                    if (!w->left->isRed) {
+                        w->right->isRed = false;
+                        w->isRed = true;
+                        leftRotate(w);
+                        w = x->parent->left;
+                        counters.rotation(RotationCase::LR);
+                        counters.recolor(2);
+                    }
+                    else {
+                        counters.rotation(RotationCase::LL);
+                    }
+                    counters.recolor(3);
+                    w->isRed = x->parent->isRed;
+                    x->parent->isRed = false;
+                    w->left->isRed = false;
+                    rightRotate(x->parent);
+                    x = root;
+                }
+            }
+        }
+        x->isRed = false;
+    }
+
+    // Левый поворот
+    void leftRotate(Node* x) {
+        Node* y = x->right;
+        x->right = y->left;
+        if (y->left != TNULL)
+            y->left->parent = x;
+
+        y->parent = x->parent;
+        if (x->parent == nullptr)
+            root = y;
+        else if (x == x->parent->left)
+            x->parent->left = y;
+        else
+            x->parent->right = y;
+
+        y->left = x;
+        x->parent = y;
+
+        // Поддерево y теперь то же, что было у x
+        y->subtreeSize = x->subtreeSize;
+        updateSize(x);
+    }
+
+    // Правый поворот
+    void rightRotate(Node* x) {
+        Node* y = x->left;
+        x->left = y->right;
+        if (y->right != TNULL)
+            y->right->parent = x;
+
+        y->parent = x->parent;
+        if (x->parent == nullptr)
+            root = y;
+        else if (x == x->parent->right)
+            x->parent->right = y;
+        else
+            x->parent->left = y;
+
+        y->right = x;
+        x->parent = y;
+
+        y->subtreeSize = x->subtreeSize;
+        updateSize(x);
+    }
+};
+
+
+// Контейнеры с интерфейсом std::set и std::map на красно-черном дереве
+template <typename Key, typename Compare = std::less<Key>, typename NodeAllocator = DefaultNodeAllocator>
+using RedBlackSet = OrderedSet<RedBlackTree<Key, Compare, NodeAllocator>>;
+template <typename Key, typename T, typename Compare = std::less<Key>, typename NodeAllocator = DefaultNodeAllocator>
+using RedBlackMap = OrderedMap<RedBlackTree<Key, Compare, NodeAllocator, MapEntry<Key, T>>>;
@@ -0,0 +1,31 @@
+﻿#include <iostream>
+#include <ctime>
+#include <cstdlib>
+#include "Splay.h"
+using namespace std;
+// Замеры времени вынесены в общий стенд Benchmark (см. Benchmark/Benchmark.sln);
+// на перекошенной нагрузке (zipf) там видно, что дает подъем горячих ключей к корню
+int main() {
+    setlocale(LC_ALL, "Russian");
+    srand(time(NULL));
+    SplayTree<> tree;
+    int n = 1000;  // 1000 случайных чисел
+    // Заполнение дерева случайными числами
+    for (int i = 0; i < n; i++) {
+        int num = rand() % 10000 + 1;  // генерируем случайное число от 1 до 10000
+        tree.insert(num);  // вставляем число в дерево
+    }
+    // Выбираем случайное число для поиска
+    int searchKey = rand() % 10000 + 1;  // генерируем случайное число для поиска
+    tree.insert(searchKey);
+    tree.insert(rand() % 10000 + 1);  // Последняя вставка поднимает в корень другой ключ
+    cout << "Ищем число: " << searchKey << ", глубина до поиска: " << tree.depth(searchKey) << endl;
+    cout << (tree.search(searchKey) != nullptr ? "Число найдено" : "Число не найдено") << endl;
+    // Найденный узел поднят в корень: повторные запросы горячего ключа проходят один узел
+    cout << "Глубина после поиска: " << tree.depth(searchKey) << endl;
+    cout << "Высота дерева: " << tree.height() << endl;
+    // Опционально: вывести элементы дерева в порядке Inorder
+    cout << "Элементы дерева в порядке Inorder: ";
+    tree.inorder();
+    cout << endl;
+}
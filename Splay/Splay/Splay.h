@@ -0,0 +1,518 @@
+﻿#pragma once
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include "../../Common/BulkBuild.h"
+#include "../../Common/NodeAllocator.h"
+#include "../../Common/OrderedContainers.h"
+#include "../../Common/RangeCursor.h"
+#include "../../Common/Snapshot.h"
+#include "../../Common/TreeStats.h"
+
+// Структура узла для косого (splay) дерева
+template <typename T>
+struct SplayNode {
+    T value;             // Значение, которое хранится в узле
+    SplayNode* left;     // Указатель на левое поддерево
+    SplayNode* right;    // Указатель на правое поддерево
+    SplayNode* parent;   // Родитель: по нему идут подъем к корню и итераторы
+
+    // Конструктор для создания узла: значение строится на месте из аргументов
+    template <typename... Args>
+    explicit SplayNode(Args&&... args)
+        : value(std::forward<Args>(args)...), left(nullptr), right(nullptr), parent(nullptr) {}
+};
+// Класс для косого (splay) дерева (Sleator, Tarjan, «Self-Adjusting Binary Search Trees»).
+// Дерево не хранит показателей баланса: каждый найденный или вставленный узел поворотами
+// поднимается в корень (splay). Часто запрашиваемые ключи поэтому держатся в нескольких уровнях
+// от корня, и на перекошенной нагрузке (закон Ципфа) средний спуск короче, чем у AVL и
+// красно-черного дерева, которые балансируют только по высоте. Амортизированная стоимость
+// операции — O(log n), а для ключа, запрашиваемого с частотой p, — O(log(1/p)).
+// Платой служат записи в узлы при каждом поиске: search и find меняют дерево, поэтому
+// дерево нельзя читать из нескольких потоков без блокировки. Константные lowerBound,
+// upperBound, обход и курсоры дерево не перестраивают.
+// Дерево владеет своими узлами; память под них выделяет политика NodeAllocator (см. NodeAllocator.h).
+// Ключи уникальны и упорядочены компаратором Compare; Entry задает, что хранит узел и что делает
+// вставка уже имеющегося ключа (SetEntry, MapEntry, CountedEntry, MultiMapEntry, см. OrderedContainers.h).
+// Отдельные ветви могут быть глубиной до n, поэтому все операции итеративные.
+template <typename Key = int, typename Compare = std::less<Key>, typename NodeAllocator = DefaultNodeAllocator,
+          typename Entry = SetEntry<Key>>
+class SplayTree {
+public:
+    using key_type = Key;
+    using key_compare = Compare;
+    using entry_type = Entry;
+    using value_type = typename Entry::value_type;
+    using Node = SplayNode<value_type>;
+
+    // Двунаправленный итератор симметричного обхода по ссылкам на родителя.
+    // Повороты не перемещают значения, поэтому итератор переживает поиски и вставки
+    class Iterator {
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = typename Entry::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = value_type*;
+        using reference = value_type&;
+
+        Iterator() : node(nullptr), tree(nullptr) {}
+
+        reference operator*() const { return node->value; }
+        pointer operator->() const { return &node->value; }
+        Iterator& operator++() {
+            if (node->right != nullptr) {
+                node = minimum(node->right);
+            }
+            else {
+                // Поднимаемся, пока приходим из правого поддерева; выше корня — конец
+                while (node->parent != nullptr && node == node->parent->right)
+                    node = node->parent;
+                node = node->parent;
+            }
+            return *this;
+        }
+        Iterator operator++(int) {
+            Iterator copy = *this;
+            ++*this;
+            return copy;
+        }
+        Iterator& operator--() {
+            if (node == nullptr) {
+                node = maximum(tree->root);  // Шаг назад от конца — наибольший элемент
+            }
+            else if (node->left != nullptr) {
+                node = maximum(node->left);
+            }
+            else {
+                while (node->parent != nullptr && node == node->parent->left)
+                    node = node->parent;
+                node = node->parent;
+            }
+            return *this;
+        }
+        Iterator operator--(int) {
+            Iterator copy = *this;
+            --*this;
+            return copy;
+        }
+        bool operator==(const Iterator& other) const { return node == other.node; }
+        bool operator!=(const Iterator& other) const { return node != other.node; }
+
+    private:
+        friend class SplayTree;
+        Iterator(Node* node, const SplayTree* tree) : node(node), tree(tree) {}
+
+        Node* node;              // nullptr — позиция за последним элементом
+        const SplayTree* tree;   // Нужен, чтобы шагнуть назад от конца
+    };
+
+    explicit SplayTree(const Compare& comp = Compare()) : root(nullptr), size_(0), comp(comp) {}
+    ~SplayTree() { clear(); }
+    SplayTree(const SplayTree&) = delete;
+    SplayTree& operator=(const SplayTree&) = delete;
+
+    Iterator begin() const { return Iterator(root != nullptr ? minimum(root) : nullptr, this); }
+    Iterator end() const { return Iterator(nullptr, this); }
+    size_t size() const { return size_; }
+    const Compare& keyComp() const { return comp; }
+    // Счетчики горячего пути (TreeStats.h); без TREE_STATS — нули. Высота считается обходом, O(n).
+    // Повороты: LL и RR — zig и zig-zig, LR и RL — zig-zag
+    TreeStats stats() const { return counters.snapshot(TreeCounters::kEnabled ? height() : 0); }
+    void resetStats() { counters.reset(); }
+
+    // Вставка элемента; если ключ уже существует, элемент сливается с имеющимся
+    // (Entry::merge). В обоих случаях узел ключа поднимается в корень
+    void insert(const value_type& value) {
+        Node* parent;
+        Node** link = findLink(Entry::key(value), parent);
+        if (*link != nullptr) {
+            Entry::merge((*link)->value, value);
+            splay(*link);
+            return;
+        }
+        attach(allocator.template create<Node>(value), parent, link);
+    }
+    // Вставка значения, построенного из аргументов; при повторном ключе узел сразу освобождается
+    template <typename... Args>
+    std::pair<Iterator, bool> emplaceUnique(Args&&... args) {
+        Node* node = allocator.template create<Node>(std::forward<Args>(args)...);
+        Node* parent;
+        Node** link = findLink(Entry::key(node->value), parent);
+        if (*link != nullptr) {
+            allocator.destroy(node);
+            Node* existing = *link;
+            splay(existing);
+            return { Iterator(existing, this), false };
+        }
+        attach(node, parent, link);
+        return { Iterator(node, this), true };
+    }
+    // Вставка по ключу: значение строится из аргументов, только если ключа еще нет
+    template <typename K, typename... Args>
+    std::pair<Iterator, bool> tryEmplace(const K& key, Args&&... args) {
+        Node* parent;
+        Node** link = findLink(key, parent);
+        if (*link != nullptr) {
+            Node* existing = *link;
+            splay(existing);
+            return { Iterator(existing, this), false };
+        }
+        Node* node = allocator.template create<Node>(std::forward<Args>(args)...);
+        attach(node, parent, link);
+        return { Iterator(node, this), true };
+    }
+    // Удаление элемента; возвращает false, если ключа нет
+    template <typename K>
+    bool erase(const K& key) {
+        Node* node = search(key);
+        if (node == nullptr)
+            return false;
+        eraseNode(node);
+        return true;
+    }
+    // Удаление одного вхождения ключа (Entry::release): у мультимножества уменьшается счетчик,
+    // узел удаляется, когда вхождений не осталось. false, если ключа нет
+    template <typename K>
+    bool eraseOne(const K& key) {
+        Node* node = search(key);
+        if (node == nullptr)
+            return false;
+        if (Entry::release(node->value))
+            eraseNode(node);
+        return true;
+    }
+    // Удаление элемента по итератору; возвращает итератор на следующий элемент
+    Iterator erase(Iterator pos) {
+        Iterator next = pos;
+        ++next;
+        eraseNode(pos.node);
+        return next;
+    }
+    // Поиск элемента; найденный узел поднимается в корень. При промахе в корень поднимается
+    // последний пройденный узел: без этого повторные промахи по глубокой ветви не окупались бы
+    template <typename K>
+    Node* search(const K& key) {
+        Node* parent;
+        Node** link = findLink(key, parent);
+        Node* node = *link;
+        if (node != nullptr)
+            splay(node);
+        else if (parent != nullptr)
+            splay(parent);
+        return node;
+    }
+    template <typename K>
+    Iterator find(const K& key) {
+        return Iterator(search(key), this);
+    }
+    // Число вхождений ключа (Entry::count); как и search, поднимает ключ в корень
+    template <typename K>
+    size_t count(const K& key) {
+        Node* node = search(key);
+        return node != nullptr ? Entry::count(node->value) : 0;
+    }
+    // Глубина узла ключа (корень — 0) или -1, если ключа нет; дерево не меняется
+    template <typename K>
+    int depth(const K& key) const {
+        int level = 0;
+        for (Node* node = root; node != nullptr; ++level) {
+            if (comp(key, Entry::key(node->value)))
+                node = node->left;
+            else if (comp(Entry::key(node->value), key))
+                node = node->right;
+            else
+                return level;
+        }
+        return -1;
+    }
+    // Первый элемент, не меньший key
+    template <typename K>
+    Iterator lowerBound(const K& key) const {
+        Node* node = root;
+        Node* result = nullptr;
+        while (node != nullptr) {
+            if (comp(Entry::key(node->value), key)) {
+                node = node->right;
+            }
+            else {
+                result = node;
+                node = node->left;
+            }
+        }
+        return Iterator(result, this);
+    }
+    // Первый элемент, больший key
+    template <typename K>
+    Iterator upperBound(const K& key) const {
+        Node* node = root;
+        Node* result = nullptr;
+        while (node != nullptr) {
+            if (comp(key, Entry::key(node->value))) {
+                result = node;
+                node = node->left;
+            }
+            else {
+                node = node->right;
+            }
+        }
+        return Iterator(result, this);
+    }
+    // Элементы с ключом key, [first, last). Элемент на ключ один, поэтому хватает спуска lowerBound
+    template <typename K>
+    std::pair<Iterator, Iterator> equalRange(const K& key) const {
+        Iterator first = lowerBound(key);
+        Iterator last = first;
+        if (first != end() && !comp(key, Entry::key(*first)))
+            ++last;
+        return { first, last };
+    }
+    // Курсор по элементам с ключами из отрезка [lo, hi] (RangeCursor.h); дерево не перестраивается,
+    // поэтому курсор действителен, пока не удалены элементы под ним и последний элемент диапазона
+    RangeCursor<SplayTree> range(const Key& lo, const Key& hi, ScanDirection direction = ScanDirection::Forward) const {
+        return RangeCursor<SplayTree>(*this, KeyRange<Key>::closed(lo, hi), direction);
+    }
+    // То же для любого диапазона: с открытыми границами, после ключа X и т. д.
+    RangeCursor<SplayTree> scan(const KeyRange<Key>& keys, ScanDirection direction = ScanDirection::Forward) const {
+        return RangeCursor<SplayTree>(*this, keys, direction);
+    }
+    // Функция для обхода дерева в порядке Inorder (симметричный обход)
+    void inorder() const {
+        for (const value_type& value : *this)
+            std::cout << value << " ";
+    }
+    // Высота дерева (пустое — 0). Обход по ссылкам на родителя, без рекурсии: O(n)
+    int height() const {
+        int best = 0;
+        int level = 0;
+        const Node* previous = nullptr;
+        for (const Node* node = root; node != nullptr;) {
+            const Node* next;
+            if (previous == node->parent) {
+                ++level;  // Пришли сверху
+                if (level > best)
+                    best = level;
+                next = node->left != nullptr ? node->left : node->right != nullptr ? node->right : node->parent;
+            }
+            else if (previous == node->left && node->right != nullptr) {
+                next = node->right;
+            }
+            else {
+                next = node->parent;
+            }
+            if (next == node->parent)
+                --level;
+            previous = node;
+            node = next;
+        }
+        return best;
+    }
+    // Удаление всех узлов
+    void clear() {
+        // Узлы без деструкторов можно не обходить: аллокатор отдает всю память разом
+        if (!NodeAllocator::kBulkRelease || !std::is_trivially_destructible<Node>::value)
+            destroy(root);
+        allocator.release();
+        root = nullptr;
+        size_ = 0;
+    }
+    // Замена содержимого элементами из [first, last), отсортированными по возрастанию без повторов.
+    // Дерево строится сбалансированным за O(n); дальше его форму меняют обращения
+    template <typename ForwardIt>
+    void buildFromSorted(ForwardIt first, ForwardIt last) {
+        buildCounted(first, std::distance(first, last));
+    }
+    // Снимок дерева в поток (формат — в Snapshot.h): элементы по порядку, блоками с контрольными суммами
+    void save(std::ostream& out, SnapshotEncoding encoding = SnapshotEncoding::Compact) const {
+        saveSnapshot<Entry>(out, begin(), end(), size_, encoding);
+    }
+    // Замена содержимого снимком из потока. Дерево собирается сбалансированным, как в buildFromSorted;
+    // при ошибке (снимок поврежден или с другими типами элементов) исключение, дерево остается пустым
+    void load(std::istream& in) {
+        try {
+            SnapshotReader<Entry, Compare> reader(in, comp, true);
+            buildCounted(reader.begin(), reader.size());
+            reader.finish();
+        }
+        catch (...) {
+            clear();
+            throw;
+        }
+    }
+    // Публичный метод для получения корня дерева
+    Node* getRoot() {
+        return root;
+    }
+private:
+    Node* root;
+    size_t size_;
+    Compare comp;
+    NodeAllocator allocator;
+    mutable TreeCounters counters;
+
+    // Поиск ссылки, на которой должен висеть ключ; parent — ее владелец (nullptr для корня).
+    // Если ключ уже есть, ссылка указывает на его узел
+    template <typename K>
+    Node** findLink(const K& key, Node*& parent) {
+        TreeDescent descent(counters);
+        parent = nullptr;
+        Node** link = &root;
+        while (*link != nullptr) {
+            Node* node = *link;
+            descent.visit();
+            if (descent.less(comp, key, Entry::key(node->value)))
+                link = &node->left;
+            else if (descent.less(comp, Entry::key(node->value), key))
+                link = &node->right;
+            else
+                break;
+            parent = node;
+        }
+        return link;
+    }
+    // Подвешивание нового листа и подъем его в корень
+    void attach(Node* node, Node* parent, Node** link) {
+        node->parent = parent;
+        *link = node;
+        ++size_;
+        splay(node);
+    }
+    // Удаление: узел поднимается в корень, его поддеревья склеиваются. Наибольший узел левого
+    // поддерева поднимается в его корень, правого потомка у него нет, туда и вешается правое поддерево.
+    // Узлы не копируются, поэтому итераторы на остальные элементы остаются действительными
+    void eraseNode(Node* node) {
+        splay(node);
+        Node* left = node->left;
+        Node* right = node->right;
+        if (left == nullptr) {
+            root = right;
+            if (right != nullptr)
+                right->parent = nullptr;
+        }
+        else {
+            left->parent = nullptr;
+            root = left;
+            splay(maximum(left));
+            root->right = right;
+            if (right != nullptr)
+                right->parent = root;
+        }
+        allocator.destroy(node);  // Узел возвращается аллокатору для повторного использования
+        --size_;
+    }
+    // Подъем x в корень. Шаги по два уровня: если x и его родитель — потомки с одной стороны (zig-zig),
+    // сначала поворачивается родитель, потом x; это и отличает splay от простого подъема
+    // поворотами и вдвое укорачивает пройденный путь. С разных сторон (zig-zag) — два поворота x.
+    // Последний одиночный шаг (zig) — когда родитель x уже корень
+    void splay(Node* x) {
+        while (x->parent != nullptr) {
+            Node* parent = x->parent;
+            Node* grand = parent->parent;
+            bool leftChild = x == parent->left;
+            if (grand == nullptr) {
+                counters.rotation(leftChild ? RotationCase::LL : RotationCase::RR);
+                rotateUp(x);
+            }
+            else if (leftChild == (parent == grand->left)) {
+                counters.rotation(leftChild ? RotationCase::LL : RotationCase::RR);
+                rotateUp(parent);
+                rotateUp(x);
+            }
+            else {
+                counters.rotation(leftChild ? RotationCase::RL : RotationCase::LR);
+                rotateUp(x);
+                rotateUp(x);
+            }
+        }
+        root = x;
+    }
+    // Поворот, поднимающий x на место его родителя; ссылку на поддерево у деда (или корень) переставляет сам
+    void rotateUp(Node* x) {
+        Node* parent = x->parent;
+        Node* grand = parent->parent;
+        if (x == parent->left) {
+            parent->left = x->right;
+            if (x->right != nullptr)
+                x->right->parent = parent;
+            x->right = parent;
+        }
+        else {
+            parent->right = x->left;
+            if (x->left != nullptr)
+                x->left->parent = parent;
+            x->left = parent;
+        }
+        parent->parent = x;
+        x->parent = grand;
+        if (grand == nullptr)
+            root = x;
+        else if (grand->left == parent)
+            grand->left = x;
+        else
+            grand->right = x;
+    }
+    static Node* minimum(Node* node) {
+        while (node->left != nullptr)
+            node = node->left;
+        return node;
+    }
+    static Node* maximum(Node* node) {
+        while (node->right != nullptr)
+            node = node->right;
+        return node;
+    }
+    // Замена содержимого count элементами, читаемыми по порядку с it: хватает однопроходного итератора
+    template <typename InputIt>
+    void buildCounted(InputIt it, size_t count) {
+        clear();
+        try {
+            buildBalanced(it, count, &root, nullptr);
+        }
+        catch (...) {
+            clear();  // Недостроенное дерево связно, его можно разобрать обычным способом
+            throw;
+        }
+        size_ = count;
+    }
+    // Сбалансированное поддерево из count элементов, читаемых по порядку начиная с it.
+    // Левое поддерево строится прямо в link и, пока нет его корня, висит там само,
+    // поэтому при исключении все созданные узлы достижимы от корня дерева.
+    // Глубина рекурсии — высота результата, то есть log2(count)
+    template <typename It>
+    void buildBalanced(It& it, size_t count, Node** link, Node* parent) {
+        if (count == 0)
+            return;
+        size_t leftCount = count / 2;
+        buildBalanced(it, leftCount, link, nullptr);
+        Node* node = allocator.template create<Node>(*it);
+        ++it;
+        if (leftCount != 0) {
+            node->left = *link;
+            node->left->parent = node;
+        }
+        node->parent = parent;
+        *link = node;
+        buildBalanced(it, count - leftCount - 1, &node->right, node);
+    }
+    // Разбор без стека: правыми поворотами вытягиваем дерево в список по правым ссылкам
+    void destroy(Node* node) {
+        while (node != nullptr) {
+            if (node->left != nullptr) {
+                Node* left = node->left;
+                node->left = left->right;
+                left->right = node;
+                node = left;
+            }
+            else {
+                Node* next = node->right;
+                allocator.destroy(node);
+                node = next;
+            }
+        }
+    }
+};
+
+// Контейнеры с интерфейсом std::set и std::map на косом дереве не делаются: константный
+// поиск контейнера (find, count, contains) у косого дерева меняет его форму